@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "batchdecode"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include "include/SoftAudioBatchDecoder.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/NuMediaExtractor.h>
+#include <utils/Vector.h>
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-b access units per batch]\n"
+                    "\t\t[-o pcm buffer size in KB]\n"
+                    "\t\t[-n number of passes]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const struct {
+    const char *mMime;
+    const char *mComponentName;
+} kBatchDecoders[] = {
+    { MEDIA_MIMETYPE_AUDIO_MPEG, "OMX.google.mp3.decoder" },
+    { MEDIA_MIMETYPE_AUDIO_AAC, "OMX.google.aac.decoder" },
+    { MEDIA_MIMETYPE_AUDIO_VORBIS, "OMX.google.vorbis.decoder" },
+    { MEDIA_MIMETYPE_AUDIO_OPUS, "OMX.google.opus.decoder" },
+};
+
+static const size_t kNumBatchDecoders =
+    sizeof(kBatchDecoders) / sizeof(kBatchDecoders[0]);
+
+static const char *FindComponentForMime(const char *mime) {
+    for (size_t i = 0; i < kNumBatchDecoders; ++i) {
+        if (!strcasecmp(mime, kBatchDecoders[i].mMime)) {
+            return kBatchDecoders[i].mComponentName;
+        }
+    }
+
+    return NULL;
+}
+
+}  // namespace android
+
+static int decode(
+        const char *path, size_t unitsPerBatch, size_t pcmSize, int numPasses) {
+    using namespace android;
+
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor;
+    if (extractor->setDataSource(NULL /* httpService */, path) != OK) {
+        fprintf(stderr, "unable to instantiate extractor.\n");
+        return 1;
+    }
+
+    ssize_t trackIndex = -1;
+    sp<AMessage> format;
+    const char *componentName = NULL;
+    AString mime;
+    for (size_t i = 0; i < extractor->countTracks(); ++i) {
+        CHECK_EQ(extractor->getTrackFormat(i, &format), (status_t)OK);
+        CHECK(format->findString("mime", &mime));
+
+        componentName = FindComponentForMime(mime.c_str());
+        if (componentName != NULL) {
+            trackIndex = i;
+            break;
+        }
+    }
+
+    if (trackIndex < 0) {
+        fprintf(stderr, "no track with a batch decodable audio format.\n");
+        return 1;
+    }
+
+    CHECK_EQ(extractor->selectTrack(trackIndex), (status_t)OK);
+
+    // Pull the entire track into memory up front so that only decoding is
+    // measured below.
+    Vector<sp<ABuffer> > samples;
+    size_t totalInputBytes = 0;
+    size_t capacity = 8192;
+    for (;;) {
+        size_t index;
+        if (extractor->getSampleTrackIndex(&index) != OK) {
+            break;
+        }
+
+        sp<ABuffer> buffer = new ABuffer(capacity);
+        status_t err = extractor->readSampleData(buffer);
+        if (err == -ENOMEM) {
+            capacity *= 2;
+            continue;
+        }
+        CHECK_EQ(err, (status_t)OK);
+
+        totalInputBytes += buffer->size();
+        samples.push(buffer);
+
+        extractor->advance();
+    }
+
+    Vector<SoftAudioBatchDecoder::AccessUnit> units;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        SoftAudioBatchDecoder::AccessUnit unit;
+        unit.mData = samples[i]->data();
+        unit.mSize = samples[i]->size();
+        units.push(unit);
+    }
+
+    printf("%s: %zu access units, %zu bytes, using %s\n",
+           mime.c_str(), units.size(), totalInputBytes, componentName);
+
+    int16_t *pcm = (int16_t *)malloc(pcmSize);
+    CHECK(pcm != NULL);
+
+    for (int pass = 0; pass < numPasses; ++pass) {
+        SoftAudioBatchDecoder *decoder =
+            SoftAudioBatchDecoder::Create(componentName);
+
+        if (decoder == NULL) {
+            fprintf(stderr, "unable to instantiate batch decoder.\n");
+            free(pcm);
+            return 1;
+        }
+
+        for (size_t i = 0;; ++i) {
+            AString tag = StringPrintf("csd-%zu", i);
+            sp<ABuffer> csd;
+            if (!format->findBuffer(tag.c_str(), &csd)) {
+                break;
+            }
+
+            CHECK_EQ(decoder->addCodecSpecificData(csd->data(), csd->size()),
+                     (status_t)OK);
+        }
+
+        if (pcmSize < decoder->maxOutputSizePerUnit()) {
+            fprintf(stderr, "pcm buffer must be at least %zu bytes.\n",
+                    decoder->maxOutputSizePerUnit());
+            SoftAudioBatchDecoder::Destroy(decoder);
+            free(pcm);
+            return 1;
+        }
+
+        int64_t numPcmBytes = 0;
+        int64_t numCalls = 0;
+        int64_t startTimeUs = ALooper::GetNowUs();
+
+        size_t offset = 0;
+        while (offset < units.size()) {
+            size_t numUnits = units.size() - offset;
+            if (unitsPerBatch > 0 && numUnits > unitsPerBatch) {
+                numUnits = unitsPerBatch;
+            }
+
+            size_t numConsumed, numBytes;
+            status_t err = decoder->decode(
+                    units.array() + offset, numUnits, pcm, pcmSize,
+                    &numConsumed, &numBytes);
+
+            ++numCalls;
+
+            if (err != OK) {
+                fprintf(stderr, "decode failed at access unit %zu (%d).\n",
+                        offset, err);
+                break;
+            }
+
+            if (numConsumed == 0 && numBytes == 0) {
+                fprintf(stderr, "decoder made no progress at access unit %zu.\n",
+                        offset);
+                break;
+            }
+
+            offset += numConsumed;
+            numPcmBytes += numBytes;
+        }
+
+        int64_t elapsedTimeUs = ALooper::GetNowUs() - startTimeUs;
+
+        int32_t numChannels, sampleRate;
+        decoder->getOutputFormat(&numChannels, &sampleRate);
+
+        double durationSecs = 0.0;
+        if (numChannels > 0 && sampleRate > 0) {
+            durationSecs =
+                (double)numPcmBytes / sizeof(int16_t) / numChannels / sampleRate;
+        }
+
+        printf("pass %d: %" PRId64 " bytes of pcm (%d ch, %d Hz) in %" PRId64
+               " calls, %.2f secs of audio in %.2f ms, %.1fx realtime, "
+               "%.2f MB/sec\n",
+               pass,
+               numPcmBytes,
+               numChannels,
+               sampleRate,
+               numCalls,
+               durationSecs,
+               elapsedTimeUs / 1E3,
+               elapsedTimeUs > 0 ? durationSecs * 1E6 / elapsedTimeUs : 0.0,
+               elapsedTimeUs > 0 ? numPcmBytes / 1024.0 / 1024.0 * 1E6 / elapsedTimeUs : 0.0);
+
+        SoftAudioBatchDecoder::Destroy(decoder);
+        decoder = NULL;
+    }
+
+    free(pcm);
+    pcm = NULL;
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t unitsPerBatch = 0;  // as many as fit
+    size_t pcmSize = 1024 * 1024;
+    int numPasses = 1;
+
+    int res;
+    while ((res = getopt(argc, argv, "hb:o:n:")) >= 0) {
+        switch (res) {
+            case 'b':
+            {
+                unitsPerBatch = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'o':
+            {
+                pcmSize = strtoul(optarg, NULL, 10) * 1024;
+                break;
+            }
+
+            case 'n':
+            {
+                numPasses = atoi(optarg);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || pcmSize == 0 || numPasses <= 0) {
+        usage(me);
+    }
+
+    DataSource::RegisterDefaultSniffers();
+
+    return decode(argv[0], unitsPerBatch, pcmSize, numPasses);
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "hlsdecrypt"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AES128Decryptor.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+
+#include <openssl/aes.h>
+
+// Throughput benchmark for HLS segment decryption: decrypts an AES-128
+// encrypted segment (or random data) in download sized blocks, once the way
+// PlaylistFetcher used to (AES_cbc_encrypt, key schedule set up per block)
+// and once through AES128Decryptor, and checks that both agree.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-k key in hex]\n"
+                    "\t\t[-i iv in hex]\n"
+                    "\t\t[-b block size in KB]\n"
+                    "\t\t[-s synthetic segment size in MB]\n"
+                    "\t\t[-n number of passes]\n"
+                    "\t\t[file]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static bool ParseHex(const char *s, uint8_t *out) {
+    if (!strncasecmp(s, "0x", 2)) {
+        s += 2;
+    }
+
+    if (strlen(s) != 32) {
+        return false;
+    }
+
+    for (size_t i = 0; i < 16; ++i) {
+        char c1 = tolower(s[2 * i]);
+        char c2 = tolower(s[2 * i + 1]);
+        if (!isxdigit(c1) || !isxdigit(c2)) {
+            return false;
+        }
+        uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
+        uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
+        out[i] = nibble1 << 4 | nibble2;
+    }
+
+    return true;
+}
+
+static int64_t DecryptLegacy(
+        uint8_t *data, size_t size, size_t blockSize,
+        const uint8_t *key, const uint8_t *iv) {
+    int64_t startUs = ALooper::GetNowUs();
+
+    uint8_t initVec[16];
+    memcpy(initVec, iv, sizeof(initVec));
+
+    for (size_t offset = 0; offset < size; offset += blockSize) {
+        size_t n = size - offset < blockSize ? size - offset : blockSize;
+
+        AES_KEY aesKey;
+        CHECK_EQ(AES_set_decrypt_key(key, 128, &aesKey), 0);
+
+        AES_cbc_encrypt(
+                data + offset, data + offset, n, &aesKey, initVec, AES_DECRYPT);
+    }
+
+    return ALooper::GetNowUs() - startUs;
+}
+
+static int64_t DecryptStreaming(
+        uint8_t *data, size_t size, size_t blockSize,
+        const uint8_t *key, const uint8_t *iv) {
+    int64_t startUs = ALooper::GetNowUs();
+
+    AES128Decryptor decryptor;
+    CHECK_EQ(decryptor.init(key, iv), (status_t)OK);
+
+    for (size_t offset = 0; offset < size; offset += blockSize) {
+        size_t n = size - offset < blockSize ? size - offset : blockSize;
+        CHECK_EQ(decryptor.decrypt(data + offset, n), (status_t)OK);
+    }
+
+    return ALooper::GetNowUs() - startUs;
+}
+
+static int run(
+        const char *path, const uint8_t *key, const uint8_t *iv,
+        size_t blockSize, size_t syntheticSize, int numPasses) {
+    uint8_t *segment;
+    size_t size;
+
+    if (path != NULL) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "unable to open '%s'.\n", path);
+            return 1;
+        }
+
+        struct stat st;
+        CHECK_EQ(fstat(fd, &st), 0);
+        size = st.st_size;
+
+        segment = (uint8_t *)malloc(size);
+        CHECK(segment != NULL);
+
+        size_t filled = 0;
+        while (filled < size) {
+            ssize_t n = read(fd, segment + filled, size - filled);
+            if (n <= 0) {
+                break;
+            }
+            filled += n;
+        }
+        size = filled;
+
+        close(fd);
+        fd = -1;
+    } else {
+        size = syntheticSize;
+        segment = (uint8_t *)malloc(size);
+        CHECK(segment != NULL);
+
+        srand(1);
+        for (size_t i = 0; i < size; ++i) {
+            segment[i] = rand();
+        }
+    }
+
+    // Anything beyond the last full cipher block is not a valid segment.
+    size -= size % 16;
+
+    uint8_t *legacy = (uint8_t *)malloc(size);
+    uint8_t *streaming = (uint8_t *)malloc(size);
+    CHECK(legacy != NULL && streaming != NULL);
+
+    printf("%zu bytes in blocks of %zu bytes\n", size, blockSize);
+
+    for (int pass = 0; pass < numPasses; ++pass) {
+        memcpy(legacy, segment, size);
+        memcpy(streaming, segment, size);
+
+        int64_t legacyUs = DecryptLegacy(legacy, size, blockSize, key, iv);
+        int64_t streamingUs =
+            DecryptStreaming(streaming, size, blockSize, key, iv);
+
+        CHECK(!memcmp(legacy, streaming, size));
+
+        printf("pass %d: AES_cbc_encrypt %.2f ms (%.2f MB/sec), "
+               "AES128Decryptor %.2f ms (%.2f MB/sec), %.2fx\n",
+               pass,
+               legacyUs / 1E3,
+               legacyUs > 0 ? size / 1024.0 / 1024.0 * 1E6 / legacyUs : 0.0,
+               streamingUs / 1E3,
+               streamingUs > 0 ? size / 1024.0 / 1024.0 * 1E6 / streamingUs : 0.0,
+               streamingUs > 0 ? (double)legacyUs / streamingUs : 0.0);
+    }
+
+    free(streaming);
+    streaming = NULL;
+
+    free(legacy);
+    legacy = NULL;
+
+    free(segment);
+    segment = NULL;
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    uint8_t key[16], iv[16];
+    memset(key, 0x5a, sizeof(key));
+    memset(iv, 0, sizeof(iv));
+
+    // Same block size as PlaylistFetcher downloads in.
+    size_t blockSize = 47 * 1024;
+    size_t syntheticSize = 64 * 1024 * 1024;
+    int numPasses = 3;
+
+    int res;
+    while ((res = getopt(argc, argv, "hk:i:b:s:n:")) >= 0) {
+        switch (res) {
+            case 'k':
+            {
+                if (!ParseHex(optarg, key)) {
+                    usage(me);
+                }
+                break;
+            }
+
+            case 'i':
+            {
+                if (!ParseHex(optarg, iv)) {
+                    usage(me);
+                }
+                break;
+            }
+
+            case 'b':
+            {
+                blockSize = strtoul(optarg, NULL, 10) * 1024;
+                break;
+            }
+
+            case 's':
+            {
+                syntheticSize = strtoul(optarg, NULL, 10) * 1024 * 1024;
+                break;
+            }
+
+            case 'n':
+            {
+                numPasses = atoi(optarg);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 1 || blockSize == 0 || syntheticSize == 0 || numPasses <= 0) {
+        usage(me);
+    }
+
+    return run(argc == 1 ? argv[0] : NULL, key, iv, blockSize, syntheticSize,
+               numPasses);
+}
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "id3scan"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/ID3.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/String8.h>
+
+// Benchmark for ID3: generates a directory of MP3 files tagged with a few
+// text frames and a large picture, and reads their tags the way the media
+// scanner does, once loading every tag the way it used to be done, once
+// indexing the tags in place and leaving the pictures where they are and
+// once more reading the pictures too, checking all three agree.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n number of files]\n"
+                    "\t\t[-a album art size in KB]\n"
+                    "\t\t[-r (reuse existing files)]\n"
+                    "\t\tdirectory\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+struct CountingDataSource : public DataSource {
+    CountingDataSource(const sp<DataSource> &source)
+        : mSource(source),
+          mNumReads(0),
+          mNumBytesRead(0) {
+    }
+
+    virtual status_t initCheck() const {
+        return mSource->initCheck();
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        ssize_t n = mSource->readAt(offset, data, size);
+
+        ++mNumReads;
+        if (n > 0) {
+            mNumBytesRead += n;
+        }
+
+        return n;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        return mSource->getSize(size);
+    }
+
+    size_t numReads() const {
+        return mNumReads;
+    }
+
+    off64_t numBytesRead() const {
+        return mNumBytesRead;
+    }
+
+protected:
+    virtual ~CountingDataSource() {}
+
+private:
+    sp<DataSource> mSource;
+    size_t mNumReads;
+    off64_t mNumBytesRead;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CountingDataSource);
+};
+
+// Frames the scanner asks for, in ID3v2.3 terms.
+static const char *kTextFrames[] = {
+    "TIT2", "TPE1", "TPE2", "TALB", "TCON", "TYER", "TRCK", "TCOM",
+};
+static const size_t kNumTextFrames = sizeof(kTextFrames) / sizeof(kTextFrames[0]);
+
+static void WriteBE(uint8_t *ptr, uint32_t x, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        ptr[size - 1 - i] = x >> (8 * i);
+    }
+}
+
+static void AppendFrame(AString *tag, const char *id, const AString &data) {
+    uint8_t header[10];
+    memcpy(header, id, 4);
+    WriteBE(&header[4], data.size(), 4);
+    header[8] = header[9] = 0;
+
+    tag->append((const char *)header, sizeof(header));
+    tag->append(data);
+}
+
+// An ID3v2.3 tag followed by a few silent MPEG-1 layer III frames. Every
+// 16th tag is unsynchronized, it has to be loaded either way.
+static bool WriteMP3(const char *path, size_t index, size_t albumArtSize) {
+    AString body;
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        AString text;
+        text.append('\0');  // ISO 8859-1
+        text.append(StringPrintf("%s of file %zu", kTextFrames[i], index));
+        AppendFrame(&body, kTextFrames[i], text);
+    }
+
+    AString picture;
+    picture.append('\0');
+    picture.append("image/jpeg");
+    picture.append('\0');
+    picture.append('\x03');  // front cover
+    picture.append("cover");
+    picture.append('\0');
+
+    uint8_t *albumArt = new uint8_t[albumArtSize];
+    for (size_t i = 0; i < albumArtSize; ++i) {
+        albumArt[i] = (index + i * 31) >> 3;
+    }
+    picture.append((const char *)albumArt, albumArtSize);
+    delete[] albumArt;
+    albumArt = NULL;
+
+    AppendFrame(&body, "APIC", picture);
+
+    bool unsynchronized = (index % 16) == 15;
+    if (unsynchronized) {
+        const uint8_t *in = (const uint8_t *)body.c_str();
+        uint8_t *out = new uint8_t[2 * body.size()];
+        size_t n = 0;
+        for (size_t i = 0; i < body.size(); ++i) {
+            out[n++] = in[i];
+            if (in[i] == 0xff) {
+                out[n++] = 0x00;
+            }
+        }
+        body.setTo((const char *)out, n);
+        delete[] out;
+        out = NULL;
+    }
+
+    uint8_t header[10];
+    memcpy(header, "ID3", 3);
+    header[3] = 3;
+    header[4] = 0;
+    header[5] = unsynchronized ? 0x80 : 0x00;
+    for (size_t i = 0; i < 4; ++i) {
+        header[9 - i] = (body.size() >> (7 * i)) & 0x7f;
+    }
+
+    AString data((const char *)header, sizeof(header));
+    data.append(body);
+
+    // 128kbps 44.1kHz stereo, 417 bytes per frame.
+    uint8_t frame[417];
+    memset(frame, 0, sizeof(frame));
+    frame[0] = 0xff;
+    frame[1] = 0xfb;
+    frame[2] = 0x90;
+    for (size_t i = 0; i < 10; ++i) {
+        data.append((const char *)frame, sizeof(frame));
+    }
+
+    bool success = false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        success = write(fd, data.c_str(), data.size()) == (ssize_t)data.size();
+        close(fd);
+    }
+
+    return success;
+}
+
+static uint64_t Hash(
+        const uint8_t *data, size_t size,
+        uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t HashTextFrames(const ID3 &id3) {
+    uint64_t hash = Hash(NULL, 0);
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        ID3::Iterator it(id3, kTextFrames[i]);
+        if (it.done()) {
+            continue;
+        }
+
+        String8 s;
+        it.getString(&s);
+        hash = Hash((const uint8_t *)s.string(), s.size(), hash);
+    }
+    return hash;
+}
+
+struct Pass {
+    Pass()
+        : mNumReads(0),
+          mNumBytesRead(0),
+          mNumBytesAllocated(0),
+          mDurationUs(0),
+          mTextHash(0),
+          mAlbumArtHash(0) {
+    }
+
+    size_t mNumReads;
+    off64_t mNumBytesRead;
+    off64_t mNumBytesAllocated;
+    int64_t mDurationUs;
+    uint64_t mTextHash;
+    uint64_t mAlbumArtHash;
+};
+
+enum Mode {
+    LOAD,
+    INDEX,
+    INDEX_AND_READ_ALBUM_ART,
+};
+
+static void ScanFile(const char *path, Mode mode, Pass *pass) {
+    sp<CountingDataSource> source = new CountingDataSource(new FileSource(path));
+    CHECK_EQ(source->initCheck(), (status_t)OK);
+
+    if (mode == LOAD) {
+        // What parsing a tag used to come down to: reading all of it.
+        uint8_t header[10];
+        CHECK_EQ(source->readAt(0, header, sizeof(header)), (ssize_t)sizeof(header));
+
+        size_t size = sizeof(header);
+        for (size_t i = 0; i < 4; ++i) {
+            size += header[6 + i] << (7 * (3 - i));
+        }
+
+        uint8_t *data = (uint8_t *)malloc(size);
+        CHECK(data != NULL);
+        CHECK_EQ(source->readAt(0, data, size), (ssize_t)size);
+
+        ID3 id3(data, size, true /* ignoreV1 */);
+        CHECK(id3.isValid());
+
+        pass->mTextHash += HashTextFrames(id3);
+
+        size_t length;
+        String8 mime;
+        const uint8_t *albumArt = (const uint8_t *)id3.getAlbumArt(&length, &mime);
+        CHECK(albumArt != NULL);
+        pass->mAlbumArtHash += Hash(albumArt, length);
+
+        pass->mNumBytesAllocated += size;
+
+        free(data);
+        data = NULL;
+    } else {
+        ID3 id3(source, true /* ignoreV1 */);
+        CHECK(id3.isValid());
+
+        pass->mTextHash += HashTextFrames(id3);
+
+        off64_t offset;
+        size_t length;
+        String8 mime;
+        if (!id3.getAlbumArtRange(&offset, &length, &mime)) {
+            // Unsynchronized, loaded after all.
+            pass->mNumBytesAllocated += id3.rawSize();
+        }
+
+        if (mode == INDEX_AND_READ_ALBUM_ART) {
+            const uint8_t *albumArt =
+                (const uint8_t *)id3.getAlbumArt(&length, &mime);
+            CHECK(albumArt != NULL);
+            pass->mAlbumArtHash += Hash(albumArt, length);
+
+            pass->mNumBytesAllocated += length;
+        }
+    }
+
+    pass->mNumReads += source->numReads();
+    pass->mNumBytesRead += source->numBytesRead();
+}
+
+static void Scan(const char *root, size_t numFiles, Mode mode, Pass *pass) {
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < numFiles; ++i) {
+        AString path = StringPrintf("%s/%05zu.mp3", root, i);
+        ScanFile(path.c_str(), mode, pass);
+    }
+    pass->mDurationUs = ALooper::GetNowUs() - startUs;
+}
+
+static void PrintPass(const char *name, size_t numFiles, const Pass &pass) {
+    printf("%-22s %8.2f ms, %6.1f reads/file, %9.1f KB read/file, "
+           "%9.1f KB allocated/file\n",
+           name,
+           pass.mDurationUs / 1E3,
+           (double)pass.mNumReads / numFiles,
+           pass.mNumBytesRead / 1024.0 / numFiles,
+           pass.mNumBytesAllocated / 1024.0 / numFiles);
+}
+
+static int run(const char *root, size_t numFiles) {
+    // Warm up the page cache, all passes read from memory.
+    Pass warmup;
+    Scan(root, numFiles, LOAD, &warmup);
+
+    Pass load;
+    Scan(root, numFiles, LOAD, &load);
+
+    Pass index;
+    Scan(root, numFiles, INDEX, &index);
+
+    Pass indexAndRead;
+    Scan(root, numFiles, INDEX_AND_READ_ALBUM_ART, &indexAndRead);
+
+    CHECK_EQ(index.mTextHash, load.mTextHash);
+    CHECK_EQ(indexAndRead.mTextHash, load.mTextHash);
+    CHECK_EQ(indexAndRead.mAlbumArtHash, load.mAlbumArtHash);
+
+    printf("%zu files:\n", numFiles);
+    PrintPass("loaded", numFiles, load);
+    PrintPass("indexed", numFiles, index);
+    PrintPass("indexed, album art", numFiles, indexAndRead);
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t numFiles = 2000;
+    size_t albumArtSize = 256 * 1024;
+    bool reuse = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:a:r")) >= 0) {
+        switch (res) {
+            case 'n':
+            {
+                numFiles = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'a':
+            {
+                albumArtSize = strtoul(optarg, NULL, 10) * 1024;
+                break;
+            }
+
+            case 'r':
+            {
+                reuse = true;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    // Loaded the old way tags are limited to 3 MB.
+    if (argc != 1 || numFiles == 0 || albumArtSize > 3000 * 1024) {
+        usage(me);
+    }
+
+    if (!reuse) {
+        if (mkdir(argv[0], 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "unable to create '%s'.\n", argv[0]);
+            return 1;
+        }
+
+        for (size_t i = 0; i < numFiles; ++i) {
+            AString path = StringPrintf("%s/%05zu.mp3", argv[0], i);
+            if (!WriteMP3(path.c_str(), i, albumArtSize)) {
+                fprintf(stderr, "unable to create '%s'.\n", path.c_str());
+                return 1;
+            }
+        }
+    }
+
+    return run(argv[0], numFiles);
+}
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "m3uparse"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include "M3UParser.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
+
+// Benchmark for M3UParser on generated event playlists with many entries:
+// time and cipher lookups through the playlist index against walking the
+// items the way PlaylistFetcher used to, and parsing only what was
+// appended to a reloaded playlist against parsing it from scratch.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n number of segments]\n"
+                    "\t\t[-a number of segments appended per reload]\n"
+                    "\t\t[-k segments per key]\n"
+                    "\t\t[-l number of lookups]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const char *kBaseURI = "http://example.com/event/playlist.m3u8";
+
+static void AppendSegments(
+        AString *playlist, size_t first, size_t count, size_t segmentsPerKey) {
+    for (size_t i = first; i < first + count; ++i) {
+        if (segmentsPerKey > 0 && (i % segmentsPerKey) == 0) {
+            playlist->append(
+                    StringPrintf("#EXT-X-KEY:METHOD=AES-128,"
+                                 "URI=\"keys/%zu.key\"\n",
+                                 i / segmentsPerKey).c_str());
+        }
+
+        // Vary the durations a bit, as encoders do.
+        playlist->append(
+                StringPrintf("#EXTINF:%zu.%03zu,\nsegment%zu.ts\n",
+                             (size_t)5 + (i % 3), (i * 37) % 1000, i).c_str());
+    }
+}
+
+static int64_t LinearStartTimeUs(const sp<M3UParser> &playlist, size_t index) {
+    int64_t segmentStartUs = 0ll;
+    for (size_t i = 0; i < index; ++i) {
+        sp<AMessage> itemMeta;
+        CHECK(playlist->itemAt(i, NULL /* uri */, &itemMeta));
+
+        int64_t itemDurationUs;
+        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
+
+        segmentStartUs += itemDurationUs;
+    }
+
+    return segmentStartUs;
+}
+
+static size_t LinearIndexForTime(const sp<M3UParser> &playlist, int64_t timeUs) {
+    size_t index = 0;
+    int64_t segmentStartUs = 0ll;
+    while (index < playlist->size()) {
+        sp<AMessage> itemMeta;
+        CHECK(playlist->itemAt(index, NULL /* uri */, &itemMeta));
+
+        int64_t itemDurationUs;
+        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
+
+        if (timeUs < segmentStartUs + itemDurationUs) {
+            break;
+        }
+
+        segmentStartUs += itemDurationUs;
+        ++index;
+    }
+
+    return index;
+}
+
+static ssize_t LinearCipherItemIndex(
+        const sp<M3UParser> &playlist, size_t index) {
+    for (ssize_t i = index; i >= 0; --i) {
+        sp<AMessage> itemMeta;
+        CHECK(playlist->itemAt(i, NULL /* uri */, &itemMeta));
+
+        AString method;
+        if (itemMeta->findString("cipher-method", &method)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void CheckSamePlaylist(
+        const sp<M3UParser> &a, const sp<M3UParser> &b) {
+    CHECK_EQ(a->size(), b->size());
+    CHECK_EQ(a->isComplete(), b->isComplete());
+    CHECK_EQ(a->getTotalDurationUs(), b->getTotalDurationUs());
+
+    for (size_t i = 0; i < a->size(); ++i) {
+        AString uriA, uriB;
+        CHECK(a->itemAt(i, &uriA));
+        CHECK(b->itemAt(i, &uriB));
+        CHECK(uriA == uriB);
+
+        CHECK_EQ(a->getSegmentStartTimeUs(i), b->getSegmentStartTimeUs(i));
+        CHECK_EQ(a->getCipherItemIndex(i), b->getCipherItemIndex(i));
+    }
+}
+
+static void benchmarkLookups(const sp<M3UParser> &playlist, size_t numLookups) {
+    size_t n = playlist->size();
+    int64_t durationUs = playlist->getTotalDurationUs();
+
+    int64_t linearUs = 0ll;
+    int64_t indexedUs = 0ll;
+
+    srand(1);
+    for (size_t i = 0; i < numLookups; ++i) {
+        size_t index = rand() % n;
+        int64_t timeUs = (int64_t)(((double)rand() / RAND_MAX) * durationUs);
+
+        int64_t startUs = ALooper::GetNowUs();
+        int64_t linearStartUs = LinearStartTimeUs(playlist, index);
+        size_t linearIndex = LinearIndexForTime(playlist, timeUs);
+        ssize_t linearCipherIndex = LinearCipherItemIndex(playlist, index);
+        int64_t midUs = ALooper::GetNowUs();
+        int64_t indexedStartUs = playlist->getSegmentStartTimeUs(index);
+        size_t indexedIndex = playlist->getItemIndexForTime(timeUs);
+        ssize_t indexedCipherIndex = playlist->getCipherItemIndex(index);
+        int64_t endUs = ALooper::GetNowUs();
+
+        CHECK_EQ(linearStartUs, indexedStartUs);
+        CHECK_EQ(linearIndex, indexedIndex);
+        CHECK_EQ(linearCipherIndex, indexedCipherIndex);
+
+        linearUs += midUs - startUs;
+        indexedUs += endUs - midUs;
+    }
+
+    printf("%zu lookups: linear %.2f ms, indexed %.2f ms\n",
+           numLookups, linearUs / 1E3, indexedUs / 1E3);
+}
+
+static int run(
+        size_t numSegments, size_t numAppended, size_t segmentsPerKey,
+        size_t numLookups) {
+    AString text("#EXTM3U\n"
+                 "#EXT-X-VERSION:3\n"
+                 "#EXT-X-PLAYLIST-TYPE:EVENT\n"
+                 "#EXT-X-TARGETDURATION:8\n"
+                 "#EXT-X-MEDIA-SEQUENCE:0\n");
+
+    AppendSegments(&text, 0, numSegments, segmentsPerKey);
+
+    int64_t startUs = ALooper::GetNowUs();
+    sp<M3UParser> playlist = new M3UParser(kBaseURI, text.c_str(), text.size());
+    int64_t parseUs = ALooper::GetNowUs() - startUs;
+
+    CHECK_EQ(playlist->initCheck(), (status_t)OK);
+    CHECK_EQ(playlist->size(), numSegments);
+
+    printf("%zu segments, %zu bytes: parsed in %.2f ms\n",
+           numSegments, text.size(), parseUs / 1E3);
+
+    benchmarkLookups(playlist, numLookups);
+
+    // Reload the growing playlist a couple of times, the last time around
+    // it ends.
+    static const size_t kNumReloads = 10;
+
+    int64_t fullUs = 0ll;
+    int64_t appendUs = 0ll;
+    for (size_t i = 0; i < kNumReloads; ++i) {
+        AppendSegments(&text, playlist->size(), numAppended, segmentsPerKey);
+        if (i + 1 == kNumReloads) {
+            text.append("#EXT-X-ENDLIST\n");
+        }
+
+        startUs = ALooper::GetNowUs();
+        sp<M3UParser> reparsed =
+            new M3UParser(kBaseURI, text.c_str(), text.size());
+        int64_t midUs = ALooper::GetNowUs();
+        CHECK_EQ(playlist->append(kBaseURI, text.c_str(), text.size()),
+                 (status_t)OK);
+        int64_t endUs = ALooper::GetNowUs();
+
+        CHECK_EQ(reparsed->initCheck(), (status_t)OK);
+        CheckSamePlaylist(playlist, reparsed);
+
+        fullUs += midUs - startUs;
+        appendUs += endUs - midUs;
+    }
+
+    CHECK(playlist->isComplete());
+
+    printf("%zu reloads adding %zu segments each: "
+           "full parse %.2f ms, append %.2f ms\n",
+           kNumReloads, numAppended, fullUs / 1E3, appendUs / 1E3);
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    // A 24 hour event in 6 second segments, reloaded every few segments.
+    size_t numSegments = 14400;
+    size_t numAppended = 3;
+    size_t segmentsPerKey = 100;
+    size_t numLookups = 1000;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:a:k:l:")) >= 0) {
+        switch (res) {
+            case 'n':
+            {
+                numSegments = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'a':
+            {
+                numAppended = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'k':
+            {
+                segmentsPerKey = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'l':
+            {
+                numLookups = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 0 || numSegments == 0 || numLookups == 0) {
+        usage(me);
+    }
+
+    return run(numSegments, numAppended, segmentsPerKey, numLookups);
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "mediascan"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <binder/ProcessState.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/StagefrightMediaScanner.h>
+
+// Benchmark for MediaScanner: generates a tree of short WAV files and scans
+// it the way the Java scanner client does, once on the calling thread and
+// once in parallel, checking both report the same, and then rescans it in
+// parallel with nothing changed.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d number of directories]\n"
+                    "\t\t[-f files per directory]\n"
+                    "\t\t[-t number of threads]\n"
+                    "\t\t[-r (reuse existing tree)]\n"
+                    "\t\tdirectory\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static uint64_t Hash(const char *s, uint64_t hash = 14695981039346656037ull) {
+    while (*s) {
+        hash = (hash ^ (uint8_t)*s++) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Reports what it is told as an order independent digest, asks for the
+// metadata of every file it hasn't seen before, like the Java client does
+// for files missing from or changed in the media database.
+struct BenchmarkClient : public MediaScannerClient {
+    BenchmarkClient(MediaScanner *scanner, bool processFiles)
+        : mNumDirectories(0),
+          mNumFiles(0),
+          mNumProcessed(0),
+          mDigest(0),
+          mScanner(scanner),
+          mProcessFiles(processFiles),
+          mFileHash(0) {
+    }
+
+    virtual status_t scanFile(
+            const char *path, long long /* lastModified */,
+            long long /* fileSize */, bool isDirectory, bool noMedia) {
+        if (isDirectory) {
+            ++mNumDirectories;
+            mDigest += Hash(path);
+            return OK;
+        }
+
+        ++mNumFiles;
+
+        if (!mProcessFiles || noMedia) {
+            mDigest += Hash(path);
+            return OK;
+        }
+
+        mFileHash = Hash(path);
+        if (mScanner->processFile(path, NULL /* mimeType */, *this)
+                == MEDIA_SCAN_RESULT_ERROR) {
+            return UNKNOWN_ERROR;
+        }
+        mDigest += mFileHash;
+        ++mNumProcessed;
+
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char *name, const char *value) {
+        mFileHash = Hash(value, Hash(name, mFileHash));
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char *mimeType) {
+        mFileHash = Hash(mimeType, mFileHash);
+        return OK;
+    }
+
+    size_t mNumDirectories;
+    size_t mNumFiles;
+    size_t mNumProcessed;
+    uint64_t mDigest;
+
+private:
+    MediaScanner *mScanner;
+    bool mProcessFiles;
+    uint64_t mFileHash;
+
+    DISALLOW_EVIL_CONSTRUCTORS(BenchmarkClient);
+};
+
+static void WriteLE(uint8_t *ptr, uint32_t x, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        ptr[i] = x >> (8 * i);
+    }
+}
+
+// 100ms of 8kHz mono 16-bit PCM, of varying length so the files' durations
+// differ.
+static bool WriteWAV(const char *path, size_t index) {
+    size_t numSamples = 800 + (index % 100) * 8;
+    size_t size = 44 + numSamples * 2;
+
+    uint8_t *data = new uint8_t[size];
+    memset(data, 0, size);
+
+    memcpy(data, "RIFF", 4);
+    WriteLE(&data[4], size - 8, 4);
+    memcpy(&data[8], "WAVEfmt ", 8);
+    WriteLE(&data[16], 16, 4);
+    WriteLE(&data[20], 1, 2);   // PCM
+    WriteLE(&data[22], 1, 2);   // channels
+    WriteLE(&data[24], 8000, 4);
+    WriteLE(&data[28], 16000, 4);
+    WriteLE(&data[32], 2, 2);
+    WriteLE(&data[34], 16, 2);
+    memcpy(&data[36], "data", 4);
+    WriteLE(&data[40], numSamples * 2, 4);
+
+    bool success = false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        success = write(fd, data, size) == (ssize_t)size;
+        close(fd);
+    }
+
+    delete[] data;
+
+    return success;
+}
+
+static status_t GenerateTree(
+        const char *root, size_t numDirectories, size_t filesPerDirectory) {
+    mkdir(root, 0755);
+
+    for (size_t i = 0; i < numDirectories; ++i) {
+        // Two levels deep, 16 directories per parent.
+        AString path = StringPrintf("%s/%03zu", root, i / 16);
+        mkdir(path.c_str(), 0755);
+
+        path.append(StringPrintf("/%05zu", i));
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "unable to create '%s'.\n", path.c_str());
+            return -errno;
+        }
+
+        for (size_t j = 0; j < filesPerDirectory; ++j) {
+            AString filePath = StringPrintf("%s/%05zu.wav", path.c_str(), j);
+            if (!WriteWAV(filePath.c_str(), i * filesPerDirectory + j)) {
+                fprintf(stderr, "unable to create '%s'.\n", filePath.c_str());
+                return ERROR_IO;
+            }
+        }
+    }
+
+    return OK;
+}
+
+static int64_t Scan(
+        MediaScanner *scanner, const char *root, bool processFiles,
+        BenchmarkClient **client) {
+    *client = new BenchmarkClient(scanner, processFiles);
+
+    int64_t startUs = ALooper::GetNowUs();
+    CHECK_EQ(scanner->processDirectory(root, **client), MEDIA_SCAN_RESULT_OK);
+
+    return ALooper::GetNowUs() - startUs;
+}
+
+static int run(const char *root, size_t numThreads) {
+    StagefrightMediaScanner serialScanner;
+    serialScanner.setNumThreads(1);
+
+    BenchmarkClient *serial;
+    int64_t serialUs = Scan(&serialScanner, root, true, &serial);
+
+    printf("serial: %zu directories, %zu files in %.2f secs\n",
+           serial->mNumDirectories, serial->mNumFiles, serialUs / 1E6);
+
+    StagefrightMediaScanner parallelScanner;
+    parallelScanner.setNumThreads(numThreads);
+
+    BenchmarkClient *parallel;
+    int64_t parallelUs = Scan(&parallelScanner, root, true, &parallel);
+
+    CHECK_EQ(parallel->mNumDirectories, serial->mNumDirectories);
+    CHECK_EQ(parallel->mNumFiles, serial->mNumFiles);
+    CHECK_EQ(parallel->mNumProcessed, serial->mNumProcessed);
+    CHECK_EQ(parallel->mDigest, serial->mDigest);
+
+    printf("%zu threads: %.2f secs, %.2fx\n",
+           numThreads, parallelUs / 1E6,
+           parallelUs > 0 ? (double)serialUs / parallelUs : 0.0);
+
+    // Nothing changed, the client asks for no metadata and the scanner has
+    // no business extracting any.
+    BenchmarkClient *rescan;
+    int64_t rescanUs = Scan(&parallelScanner, root, false, &rescan);
+
+    CHECK_EQ(rescan->mNumFiles, serial->mNumFiles);
+
+    printf("%zu threads, unchanged: %.2f secs\n", numThreads, rescanUs / 1E6);
+
+    delete rescan;
+    rescan = NULL;
+
+    delete parallel;
+    parallel = NULL;
+
+    delete serial;
+    serial = NULL;
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t numDirectories = 200;
+    size_t filesPerDirectory = 50;
+    size_t numThreads = 4;
+    bool reuse = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "hd:f:t:r")) >= 0) {
+        switch (res) {
+            case 'd':
+            {
+                numDirectories = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'f':
+            {
+                filesPerDirectory = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 't':
+            {
+                numThreads = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'r':
+            {
+                reuse = true;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || numDirectories == 0 || numThreads == 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    if (!reuse && GenerateTree(argv[0], numDirectories, filesPerDirectory) != OK) {
+        return 1;
+    }
+
+    return run(argv[0], numThreads);
+}
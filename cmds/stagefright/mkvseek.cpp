@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "mkvseek"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <utils/Vector.h>
+
+// Seek benchmark for MatroskaExtractor: generates a large single track
+// matroska file, with or without Cues, then seeks to random positions in
+// it, reporting the latency of each seek and the reads it took, followed by
+// the reads it takes to play through a couple of clusters.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-s file size in MB]\n"
+                    "\t\t[-f frame size in KB]\n"
+                    "\t\t[-c (no cues)]\n"
+                    "\t\t[-r (reuse existing file)]\n"
+                    "\t\t[-n number of seeks]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const int64_t kFrameDurationMs = 40;    // 25 fps
+static const size_t kFramesPerCluster = 25;     // 1 sec
+static const size_t kFramesPerKeyFrame = 50;    // 2 secs
+
+struct EBMLWriter {
+    Vector<uint8_t> mData;
+
+    void writeID(uint32_t id) {
+        bool started = false;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            uint8_t x = id >> shift;
+            if (x || started) {
+                mData.push(x);
+                started = true;
+            }
+        }
+    }
+
+    // Sizes are always written in 8 bytes, so they can be patched later.
+    size_t writeSize(uint64_t size) {
+        size_t offset = mData.size();
+        mData.push(0x01);
+        for (int shift = 48; shift >= 0; shift -= 8) {
+            mData.push(size >> shift);
+        }
+        return offset;
+    }
+
+    void patchSize(size_t offset, uint64_t size) {
+        for (size_t i = 0; i < 7; ++i) {
+            mData.editItemAt(offset + 1 + i) = size >> (48 - 8 * i);
+        }
+    }
+
+    void writeUInt(uint32_t id, uint64_t x) {
+        writeID(id);
+        mData.push(0x88);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            mData.push(x >> shift);
+        }
+    }
+
+    void writeFloat(uint32_t id, double x) {
+        uint64_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        writeUInt(id, bits);
+    }
+
+    void writeString(uint32_t id, const char *s) {
+        writeID(id);
+        mData.push(0x80 | strlen(s));
+        mData.appendArray((const uint8_t *)s, strlen(s));
+    }
+
+    // Starts a master element, returns what endMaster() needs to fill in
+    // its size.
+    size_t beginMaster(uint32_t id) {
+        writeID(id);
+        return writeSize(0);
+    }
+
+    void endMaster(size_t sizeOffset) {
+        patchSize(sizeOffset, mData.size() - sizeOffset - 8);
+    }
+};
+
+static bool WriteFully(int fd, const void *data, size_t size) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+static status_t GenerateFile(
+        const char *path, off64_t fileSize, size_t frameSize, bool withCues) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "unable to create '%s'.\n", path);
+        return -errno;
+    }
+
+    size_t numFrames = fileSize / (frameSize + 16);
+    numFrames -= numFrames % kFramesPerCluster;
+    if (numFrames == 0) {
+        numFrames = kFramesPerCluster;
+    }
+
+    EBMLWriter header;
+
+    size_t offset = header.beginMaster(0x1A45DFA3);  // EBML
+    header.writeUInt(0x4286, 1);  // EBMLVersion
+    header.writeUInt(0x42F7, 1);  // EBMLReadVersion
+    header.writeUInt(0x42F2, 4);  // EBMLMaxIDLength
+    header.writeUInt(0x42F3, 8);  // EBMLMaxSizeLength
+    header.writeString(0x4282, "webm");  // DocType
+    header.writeUInt(0x4287, 2);  // DocTypeVersion
+    header.writeUInt(0x4285, 2);  // DocTypeReadVersion
+    header.endMaster(offset);
+
+    header.writeID(0x18538067);  // Segment
+    size_t segmentSizeOffset = header.writeSize(0);
+    size_t segmentStart = header.mData.size();
+
+    // Seek entries for Info, Tracks and Cues, positions filled in below.
+    static const uint32_t kSeekIDs[] = { 0x1549A966, 0x1654AE6B, 0x1C53BB6B };
+    size_t numSeekEntries = withCues ? 3 : 2;
+    size_t seekPositionOffsets[3];
+
+    offset = header.beginMaster(0x114D9B74);  // SeekHead
+    for (size_t i = 0; i < numSeekEntries; ++i) {
+        size_t seekOffset = header.beginMaster(0x4DBB);  // Seek
+        header.writeID(0x53AB);  // SeekID
+        header.mData.push(0x84);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            header.mData.push(kSeekIDs[i] >> shift);
+        }
+        seekPositionOffsets[i] = header.mData.size() + 3;
+        header.writeUInt(0x53AC, 0);  // SeekPosition
+        header.endMaster(seekOffset);
+    }
+    header.endMaster(offset);
+
+    uint64_t infoPosition = header.mData.size() - segmentStart;
+    offset = header.beginMaster(0x1549A966);  // Info
+    header.writeUInt(0x2AD7B1, 1000000);  // TimecodeScale, ms
+    header.writeFloat(0x4489, (double)numFrames * kFrameDurationMs);  // Duration
+    header.writeString(0x4D80, "mkvseek");  // MuxingApp
+    header.writeString(0x5741, "mkvseek");  // WritingApp
+    header.endMaster(offset);
+
+    uint64_t tracksPosition = header.mData.size() - segmentStart;
+    offset = header.beginMaster(0x1654AE6B);  // Tracks
+    size_t trackOffset = header.beginMaster(0xAE);  // TrackEntry
+    header.writeUInt(0xD7, 1);  // TrackNumber
+    header.writeUInt(0x73C5, 1);  // TrackUID
+    header.writeUInt(0x83, 1);  // TrackType, video
+    header.writeString(0x86, "V_VP8");  // CodecID
+    size_t videoOffset = header.beginMaster(0xE0);  // Video
+    header.writeUInt(0xB0, 1280);  // PixelWidth
+    header.writeUInt(0xBA, 720);  // PixelHeight
+    header.endMaster(videoOffset);
+    header.endMaster(trackOffset);
+    header.endMaster(offset);
+
+    uint64_t positions[3] = { infoPosition, tracksPosition, 0 };
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            header.mData.editItemAt(seekPositionOffsets[i] + j) =
+                positions[i] >> (56 - 8 * j);
+        }
+    }
+
+    if (!WriteFully(fd, header.mData.array(), header.mData.size())) {
+        close(fd);
+        return ERROR_IO;
+    }
+
+    off64_t filePos = header.mData.size();
+
+    uint8_t *payload = new uint8_t[frameSize];
+    memset(payload, 0, frameSize);
+
+    EBMLWriter cues;
+    size_t cuesOffset = cues.beginMaster(0x1C53BB6B);  // Cues
+
+    for (size_t frame = 0; frame < numFrames; frame += kFramesPerCluster) {
+        uint64_t clusterPosition = filePos - segmentStart;
+        int64_t clusterTimeMs = frame * kFrameDurationMs;
+
+        EBMLWriter cluster;
+        cluster.writeID(0x1F43B675);  // Cluster
+        cluster.writeSize(
+                10 + kFramesPerCluster * (frameSize + 4 + 9));
+        cluster.writeUInt(0xE7, clusterTimeMs);  // Timecode
+
+        for (size_t i = 0; i < kFramesPerCluster; ++i) {
+            bool isKey = ((frame + i) % kFramesPerKeyFrame) == 0;
+
+            if (isKey) {
+                size_t cuePointOffset = cues.beginMaster(0xBB);  // CuePoint
+                cues.writeUInt(0xB3, clusterTimeMs + i * kFrameDurationMs);
+                size_t positionsOffset = cues.beginMaster(0xB7);
+                cues.writeUInt(0xF7, 1);  // CueTrack
+                cues.writeUInt(0xF1, clusterPosition);  // CueClusterPosition
+                cues.writeUInt(0x5378, i + 1);  // CueBlockNumber
+                cues.endMaster(positionsOffset);
+                cues.endMaster(cuePointOffset);
+            }
+
+            cluster.writeID(0xA3);  // SimpleBlock
+            cluster.writeSize(frameSize + 4);
+            cluster.mData.push(0x81);  // track number
+            int16_t relativeTimeMs = i * kFrameDurationMs;
+            cluster.mData.push(relativeTimeMs >> 8);
+            cluster.mData.push(relativeTimeMs & 0xff);
+            cluster.mData.push(isKey ? 0x80 : 0x00);
+
+            // Payload is written straight from the shared buffer.
+            if (!WriteFully(fd, cluster.mData.array(), cluster.mData.size())
+                    || !WriteFully(fd, payload, frameSize)) {
+                delete[] payload;
+                close(fd);
+                return ERROR_IO;
+            }
+
+            filePos += cluster.mData.size() + frameSize;
+            cluster.mData.clear();
+        }
+    }
+
+    delete[] payload;
+    payload = NULL;
+
+    cues.endMaster(cuesOffset);
+
+    if (withCues) {
+        positions[2] = filePos - segmentStart;
+        if (!WriteFully(fd, cues.mData.array(), cues.mData.size())) {
+            close(fd);
+            return ERROR_IO;
+        }
+        filePos += cues.mData.size();
+
+        header.mData.clear();
+        header.writeUInt(0x53AC, positions[2]);
+        off64_t seekPositionOffset = seekPositionOffsets[2] - 3;
+        CHECK_EQ(lseek64(fd, seekPositionOffset, SEEK_SET), seekPositionOffset);
+        CHECK(WriteFully(fd, header.mData.array(), header.mData.size()));
+    }
+
+    header.mData.clear();
+    header.writeSize(filePos - segmentStart);
+    CHECK_EQ(lseek64(fd, segmentSizeOffset, SEEK_SET),
+             (off64_t)segmentSizeOffset);
+    CHECK(WriteFully(fd, header.mData.array(), header.mData.size()));
+
+    close(fd);
+    fd = -1;
+
+    printf("wrote %zu frames (%" PRId64 " secs), %" PRId64 " bytes, %s\n",
+           numFrames, (int64_t)numFrames * kFrameDurationMs / 1000,
+           (int64_t)filePos, withCues ? "with cues" : "without cues");
+
+    return OK;
+}
+
+// Counts the reads the extractor issues.
+struct CountingDataSource : public DataSource {
+    CountingDataSource(const sp<DataSource> &source)
+        : mSource(source),
+          mNumReads(0),
+          mNumBytesRead(0) {
+    }
+
+    virtual status_t initCheck() const {
+        return mSource->initCheck();
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        ssize_t n = mSource->readAt(offset, data, size);
+
+        ++mNumReads;
+        if (n > 0) {
+            mNumBytesRead += n;
+        }
+
+        return n;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        return mSource->getSize(size);
+    }
+
+    virtual uint32_t flags() {
+        return mSource->flags();
+    }
+
+    void reset() {
+        mNumReads = 0;
+        mNumBytesRead = 0;
+    }
+
+    size_t numReads() const {
+        return mNumReads;
+    }
+
+    off64_t numBytesRead() const {
+        return mNumBytesRead;
+    }
+
+protected:
+    virtual ~CountingDataSource() {}
+
+private:
+    sp<DataSource> mSource;
+    size_t mNumReads;
+    off64_t mNumBytesRead;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CountingDataSource);
+};
+
+static int run(const char *path, size_t numSeeks) {
+    sp<CountingDataSource> source =
+        new CountingDataSource(new FileSource(path));
+
+    if (source->initCheck() != OK) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    int64_t startUs = ALooper::GetNowUs();
+    sp<MediaExtractor> extractor =
+        MediaExtractor::Create(source, MEDIA_MIMETYPE_CONTAINER_MATROSKA);
+
+    if (extractor == NULL || extractor->countTracks() == 0) {
+        fprintf(stderr, "unable to extract '%s'.\n", path);
+        return 1;
+    }
+
+    sp<MediaSource> track = extractor->getTrack(0);
+    CHECK_EQ(track->start(), (status_t)OK);
+
+    printf("opened in %.2f ms, %zu reads\n",
+           (ALooper::GetNowUs() - startUs) / 1E3, source->numReads());
+
+    int64_t durationUs;
+    CHECK(track->getFormat()->findInt64(kKeyDuration, &durationUs));
+
+    int64_t totalUs = 0ll;
+    int64_t maxUs = 0ll;
+    size_t totalReads = 0;
+    off64_t totalBytes = 0;
+
+    srand(1);
+    for (size_t i = 0; i < numSeeks; ++i) {
+        int64_t seekTimeUs =
+            (int64_t)(((double)rand() / RAND_MAX) * (durationUs - 1000000ll));
+
+        MediaSource::ReadOptions options;
+        options.setSeekTo(seekTimeUs, MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+
+        source->reset();
+        startUs = ALooper::GetNowUs();
+
+        MediaBuffer *buffer;
+        status_t err = track->read(&buffer, &options);
+
+        int64_t seekUs = ALooper::GetNowUs() - startUs;
+
+        if (err != OK) {
+            fprintf(stderr, "seek to %" PRId64 " us failed (%d).\n",
+                    seekTimeUs, err);
+            return 1;
+        }
+
+        int64_t timeUs;
+        CHECK(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+        buffer->release();
+        buffer = NULL;
+
+        ALOGV("seek to %" PRId64 " us landed at %" PRId64 " us in %" PRId64
+              " us, %zu reads", seekTimeUs, timeUs, seekUs, source->numReads());
+
+        CHECK_LE(llabs(timeUs - seekTimeUs),
+                 kFramesPerKeyFrame * kFrameDurationMs * 1000ll);
+
+        totalUs += seekUs;
+        if (seekUs > maxUs) {
+            maxUs = seekUs;
+        }
+        totalReads += source->numReads();
+        totalBytes += source->numBytesRead();
+    }
+
+    printf("%zu seeks: avg %.2f ms, max %.2f ms, "
+           "%.1f reads (%.1f KB) per seek\n",
+           numSeeks, totalUs / 1E3 / numSeeks, maxUs / 1E3,
+           (double)totalReads / numSeeks,
+           totalBytes / 1024.0 / numSeeks);
+
+    // Play through a couple of clusters from where the last seek left off.
+    static const size_t kNumFrames = 10 * kFramesPerCluster;
+
+    source->reset();
+    startUs = ALooper::GetNowUs();
+
+    size_t n = 0;
+    for (; n < kNumFrames; ++n) {
+        MediaBuffer *buffer;
+        if (track->read(&buffer) != OK) {
+            break;
+        }
+        buffer->release();
+    }
+
+    printf("%zu frames read in %.2f ms, %.2f reads per frame\n",
+           n, (ALooper::GetNowUs() - startUs) / 1E3,
+           n > 0 ? (double)source->numReads() / n : 0.0);
+
+    track->stop();
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    off64_t fileSize = 2048ll * 1024 * 1024;
+    size_t frameSize = 50 * 1024;
+    bool withCues = true;
+    bool reuse = false;
+    size_t numSeeks = 100;
+
+    int res;
+    while ((res = getopt(argc, argv, "hs:f:crn:")) >= 0) {
+        switch (res) {
+            case 's':
+            {
+                fileSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+                break;
+            }
+
+            case 'f':
+            {
+                frameSize = strtoul(optarg, NULL, 10) * 1024;
+                break;
+            }
+
+            case 'c':
+            {
+                withCues = false;
+                break;
+            }
+
+            case 'r':
+            {
+                reuse = true;
+                break;
+            }
+
+            case 'n':
+            {
+                numSeeks = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || fileSize == 0 || frameSize == 0 || numSeeks == 0) {
+        usage(me);
+    }
+
+    if (!reuse && GenerateFile(argv[0], fileSize, frameSize, withCues) != OK) {
+        return 1;
+    }
+
+    return run(argv[0], numSeeks);
+}
@@ -0,0 +1,534 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "mp4writerbench"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/MPEG4Writer.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+// Muxes hours worth of synthetic AVC, and optionally AMR, samples as fast
+// as the writer takes them and prints how long that took, how long stop()
+// took to finish the file, and the peak RSS of the process. The sample
+// tables of a plain mp4 file grow with the recording, those of a
+// fragmented one only with a fragment. Like an encoder, the sources have
+// only so many buffers, so that samples the writer has yet to write do
+// not count towards the peak.
+//
+// With -p, the samples come in real time, the way a camera recording
+// gets them, and the writer's dump tells how long writing out chunks and
+// the file writes themselves took, e.g. for 100 Mbps 4K recording:
+//   mp4writerbench -p -d 60 -b 100000000 -a -o /data/local/tmp/out.mp4
+// Samples the sources could not hand over in time, for the writer was
+// still holding on to all their buffers, would have been dropped by an
+// encoder.
+//
+// With B frames, every video sample needs an entry of its own in the ctts
+// box. Millions of samples, e.g. a few hours at 240 fps, show what the
+// sample tables cost in memory and in stop(), and with -t how much of
+// that the writer can spill to a temporary file:
+//   mp4writerbench -r 240 -B -d 14400 -t /data/local/tmp -o /data/local/tmp/out.mp4
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d duration in secs (default: 3600)]\n"
+                    "\t\t[-b video bit rate (default: 4000000)]\n"
+                    "\t\t[-r video frame rate (default: 30)]\n"
+                    "\t\t[-i I frame interval in secs (default: 1)]\n"
+                    "\t\t[-a (add an audio track)]\n"
+                    "\t\t[-f fragment duration in ms (default: 0, not fragmented)]\n"
+                    "\t\t[-p (pace the sources in real time)]\n"
+                    "\t\t[-w write-back size in KB (default: the writer's, 0: none)]\n"
+                    "\t\t[-D (direct I/O)]\n"
+                    "\t\t[-B (B frames)]\n"
+                    "\t\t[-t directory for the writer's temporary files]\n"
+                    "\t\t[-o output file (default: /sdcard/mp4writerbench.mp4)]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+// An AVC stream, with a B frame between every two P frames if asked to,
+// or 12.2 kbps AMR-NB, with samples of the sizes an encoder would output
+// but nothing meaningful in them. Video samples are up to a quarter
+// larger or smaller than the average, at random.
+struct SyntheticSource : public MediaSource, public MediaBufferObserver {
+    static sp<SyntheticSource> CreateVideo(
+            int64_t durationUs, int32_t bitRate, int32_t frameRate,
+            int32_t iFramesIntervalSec, bool bFrames, int64_t maxBufferedUs);
+
+    static sp<SyntheticSource> CreateAudio(
+            int64_t durationUs, int64_t maxBufferedUs);
+
+    virtual status_t start(MetaData *params);
+    virtual status_t stop();
+    virtual sp<MetaData> getFormat();
+    virtual status_t read(
+            MediaBuffer **buffer, const ReadOptions *options);
+
+    virtual void signalBufferReturned(MediaBuffer *buffer);
+
+    // Hands out every sample no earlier than its time past start().
+    void setRealTime(bool realTime) { mRealTime = realTime; }
+
+    size_t numSamples() const { return mNumSamples; }
+
+    // Real time samples handed out more than a sample duration late.
+    size_t numLateSamples() const { return mNumLateSamples; }
+
+protected:
+    virtual ~SyntheticSource() {}
+
+private:
+    sp<MetaData> mFormat;
+    int64_t mDurationUs;
+    int64_t mSampleDurationUs;
+    size_t mSampleSize;
+    size_t mSyncSampleSize;
+    size_t mSyncInterval;  // In samples, 0 if every sample is a sync sample
+    bool mBFrames;
+    size_t mNumSamples;
+    bool mRealTime;
+    int64_t mStartTimeUs;
+    size_t mNumLateSamples;
+    unsigned mSeed;
+
+    Mutex mLock;
+    Condition mBufferReturned;
+    size_t mMaxBuffersOutstanding;
+    size_t mNumBuffersOutstanding;
+
+    SyntheticSource(
+            const sp<MetaData> &format, int64_t durationUs, int64_t sampleDurationUs,
+            size_t sampleSize, size_t syncSampleSize, size_t syncInterval,
+            bool bFrames, int64_t maxBufferedUs);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SyntheticSource);
+};
+
+SyntheticSource::SyntheticSource(
+        const sp<MetaData> &format, int64_t durationUs, int64_t sampleDurationUs,
+        size_t sampleSize, size_t syncSampleSize, size_t syncInterval,
+        bool bFrames, int64_t maxBufferedUs)
+    : mFormat(format),
+      mDurationUs(durationUs),
+      mSampleDurationUs(sampleDurationUs),
+      mSampleSize(sampleSize),
+      mSyncSampleSize(syncSampleSize),
+      mSyncInterval(syncInterval),
+      mBFrames(bFrames),
+      mNumSamples(0),
+      mRealTime(false),
+      mStartTimeUs(0),
+      mNumLateSamples(0),
+      mSeed(1),
+      mMaxBuffersOutstanding(maxBufferedUs / sampleDurationUs + 1),
+      mNumBuffersOutstanding(0) {
+}
+
+// static
+sp<SyntheticSource> SyntheticSource::CreateVideo(
+        int64_t durationUs, int32_t bitRate, int32_t frameRate,
+        int32_t iFramesIntervalSec, bool bFrames, int64_t maxBufferedUs) {
+    // Baseline profile, level 3.1, a made-up SPS and PPS.
+    static const uint8_t kAVCC[] = {
+        0x01, 0x42, 0x80, 0x1f, 0xff, 0xe1, 0x00, 0x09,
+        0x67, 0x42, 0x80, 0x1f, 0xda, 0x01, 0x40, 0x16,
+        0xe8, 0x01, 0x00, 0x04, 0x68, 0xce, 0x06, 0xe2,
+    };
+
+    sp<MetaData> format = new MetaData;
+    format->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+    format->setInt32(kKeyWidth, 1280);
+    format->setInt32(kKeyHeight, 720);
+    format->setInt32(kKeyBitRate, bitRate);
+    format->setInt32(kKeyFrameRate, frameRate);
+    format->setData(kKeyAVCC, kTypeAVCC, kAVCC, sizeof(kAVCC));
+
+    // I frames four times the size of P frames, for the average
+    // to come out at the bit rate.
+    size_t syncInterval = iFramesIntervalSec * frameRate;
+    if (syncInterval < 1) {
+        syncInterval = 1;
+    }
+    size_t averageSize = bitRate / 8 / frameRate;
+    size_t sampleSize = averageSize * syncInterval / (syncInterval + 3);
+
+    return new SyntheticSource(
+            format, durationUs, 1000000ll / frameRate,
+            sampleSize, 4 * sampleSize, syncInterval, bFrames, maxBufferedUs);
+}
+
+// static
+sp<SyntheticSource> SyntheticSource::CreateAudio(
+        int64_t durationUs, int64_t maxBufferedUs) {
+    sp<MetaData> format = new MetaData;
+    format->setCString(kKeyMIMEType, MEDIA_MIMETYPE_AUDIO_AMR_NB);
+    format->setInt32(kKeySampleRate, 8000);
+    format->setInt32(kKeyChannelCount, 1);
+
+    // 20 ms frames of 12.2 kbps
+    return new SyntheticSource(
+            format, durationUs, 20000ll, 32, 32, 0, false, maxBufferedUs);
+}
+
+status_t SyntheticSource::start(MetaData * /* params */) {
+    mNumSamples = 0;
+    mNumLateSamples = 0;
+    mSeed = 1;
+    mStartTimeUs = ALooper::GetNowUs();
+    return OK;
+}
+
+status_t SyntheticSource::stop() {
+    return OK;
+}
+
+sp<MetaData> SyntheticSource::getFormat() {
+    return mFormat;
+}
+
+status_t SyntheticSource::read(
+        MediaBuffer **out, const ReadOptions * /* options */) {
+    *out = NULL;
+
+    int64_t timeUs = mNumSamples * mSampleDurationUs;
+    if (timeUs >= mDurationUs) {
+        return ERROR_END_OF_STREAM;
+    }
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumBuffersOutstanding >= mMaxBuffersOutstanding) {
+            mBufferReturned.wait(mLock);
+        }
+        ++mNumBuffersOutstanding;
+    }
+
+    if (mRealTime) {
+        int64_t delayUs = mStartTimeUs + timeUs - ALooper::GetNowUs();
+        if (delayUs > 0) {
+            usleep(delayUs);
+        } else if (delayUs < -mSampleDurationUs) {
+            ++mNumLateSamples;
+        }
+    }
+
+    bool isSync = (mSyncInterval == 0 || (mNumSamples % mSyncInterval) == 0);
+    size_t size = isSync ? mSyncSampleSize : mSampleSize;
+    if (mSyncInterval > 0 && size >= 4) {
+        size = size - size / 4 + rand_r(&mSeed) % (size / 2 + 1);
+    }
+
+    // Handed over to the writer instead of being copied, and freed
+    // once it is written.
+    MediaBuffer *buffer = new MediaBuffer(size);
+    memset(buffer->data(), (uint8_t)mNumSamples, size);
+    buffer->set_range(0, size);
+    buffer->setObserver(this);
+    buffer->add_ref();
+
+    // Decoding order I P B P B ... P I, presented as I B P B P ... P I:
+    // P frames but the last one a sample duration after being decoded,
+    // B frames one before.
+    int64_t presentationTimeUs = timeUs;
+    if (mBFrames && mSyncInterval > 0) {
+        size_t i = mNumSamples % mSyncInterval;
+        if (i % 2 == 1 && i + 1 < mSyncInterval) {
+            presentationTimeUs += mSampleDurationUs;
+        } else if (i > 0 && i % 2 == 0) {
+            presentationTimeUs -= mSampleDurationUs;
+        }
+    }
+
+    sp<MetaData> meta = buffer->meta_data();
+    meta->setInt64(kKeyTime, presentationTimeUs);
+    meta->setInt64(kKeyDecodingTime, timeUs);
+    meta->setInt32(kKeyIsSyncFrame, isSync);
+    meta->setInt32(kKeyCanDeferRelease, true);
+
+    ++mNumSamples;
+
+    *out = buffer;
+    return OK;
+}
+
+void SyntheticSource::signalBufferReturned(MediaBuffer *buffer) {
+    buffer->setObserver(NULL);
+    buffer->release();
+    buffer = NULL;
+
+    Mutex::Autolock autoLock(mLock);
+    --mNumBuffersOutstanding;
+    mBufferReturned.signal();
+}
+
+static long getPeakRSSKBytes() {
+    struct rusage usage;
+    CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+    return usage.ru_maxrss;
+}
+
+static double getCPUSecs() {
+    struct rusage usage;
+    CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+}
+
+static int run(
+        const char *path, int64_t durationUs, int32_t bitRate, int32_t frameRate,
+        int32_t iFramesIntervalSec, bool addAudio, int64_t fragmentDurationUs,
+        bool realTime, int32_t writeBackSize, bool directIO, bool bFrames,
+        const char *tempDir) {
+    // Rather than truncated, for ext4 flushes a truncated file on close(),
+    // which would count towards stop().
+    unlink(path);
+    int fd = open(path, O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "unable to create '%s'.\n", path);
+        return 1;
+    }
+
+    sp<MPEG4Writer> writer = new MPEG4Writer(fd);
+    close(fd);
+    fd = -1;
+
+    // Enough for the writer to hold on to the samples of a couple of
+    // chunks, which end at the first I frame past the interleave, or
+    // fragment, duration.
+    int64_t maxChunkDurationUs =
+        (fragmentDurationUs > 0 ? fragmentDurationUs : writer->interleaveDuration())
+            + iFramesIntervalSec * 1000000ll;
+    int64_t maxBufferedUs = 2 * maxChunkDurationUs + 1000000ll;
+
+    sp<SyntheticSource> video = SyntheticSource::CreateVideo(
+            durationUs, bitRate, frameRate, iFramesIntervalSec, bFrames, maxBufferedUs);
+    video->setRealTime(realTime);
+    CHECK_EQ(writer->addSource(video), (status_t)OK);
+
+    sp<SyntheticSource> audio;
+    if (addAudio) {
+        audio = SyntheticSource::CreateAudio(durationUs, maxBufferedUs);
+        audio->setRealTime(realTime);
+        CHECK_EQ(writer->addSource(audio), (status_t)OK);
+    }
+
+    sp<MetaData> params = new MetaData;
+    params->setInt64(kKeyTime, 0ll);
+    params->setInt32(kKeyRealTimeRecording, realTime);
+    params->setInt32(kKey64BitFileOffset, true);
+    params->setInt32(kKeyBitRate, bitRate);
+    if (fragmentDurationUs > 0) {
+        params->setInt64(kKeyFragmentDuration, fragmentDurationUs);
+    }
+    if (writeBackSize >= 0) {
+        params->setInt32(kKeyWriteBackSize, writeBackSize);
+    }
+    params->setInt32(kKeyDirectIO, directIO);
+    if (tempDir != NULL) {
+        params->setCString(kKeyTempFileDirectory, tempDir);
+    }
+
+    long startRSSKBytes = getPeakRSSKBytes();
+    double startCPUSecs = getCPUSecs();
+    int64_t startUs = ALooper::GetNowUs();
+
+    status_t err = writer->start(params.get());
+    if (err != OK) {
+        fprintf(stderr, "unable to start the writer (%d).\n", err);
+        return 1;
+    }
+
+    while (!writer->reachedEOS()) {
+        usleep(100000);
+    }
+
+    int64_t stopUs = ALooper::GetNowUs();
+    err = writer->stop();
+    int64_t endUs = ALooper::GetNowUs();
+
+    if (err != OK) {
+        fprintf(stderr, "the writer failed (%d).\n", err);
+        return 1;
+    }
+
+    struct stat st;
+    CHECK_EQ(stat(path, &st), 0);
+
+    printf("%s: %.2f hours, %zu video and %zu audio samples, %s\n",
+           path,
+           durationUs / 3600E6,
+           video->numSamples(),
+           audio != NULL ? audio->numSamples() : 0,
+           fragmentDurationUs > 0 ? "fragmented" : "not fragmented");
+
+    printf("%.2f MB in %.2f secs, stop() took %.2f ms, "
+           "peak RSS %ld KB (%ld KB before starting), CPU %.2f secs\n",
+           st.st_size / 1E6,
+           (endUs - startUs) / 1E6,
+           (endUs - stopUs) / 1E3,
+           getPeakRSSKBytes(),
+           startRSSKBytes,
+           getCPUSecs() - startCPUSecs);
+
+    if (realTime) {
+        printf("late samples: %zu video, %zu audio\n",
+               video->numLateSamples(),
+               audio != NULL ? audio->numLateSamples() : 0);
+    }
+
+    fflush(stdout);
+    writer->dump(STDOUT_FILENO, Vector<String16>());
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    int64_t durationUs = 3600000000ll;
+    int32_t bitRate = 4000000;
+    int32_t frameRate = 30;
+    int32_t iFramesIntervalSec = 1;
+    bool addAudio = false;
+    int64_t fragmentDurationUs = 0;
+    const char *path = "/sdcard/mp4writerbench.mp4";
+    bool realTime = false;
+    int32_t writeBackSize = -1;
+    bool directIO = false;
+    bool bFrames = false;
+    const char *tempDir = NULL;
+
+    int res;
+    while ((res = getopt(argc, argv, "hd:b:r:i:af:o:pw:DBt:")) >= 0) {
+        switch (res) {
+            case 'd':
+            {
+                durationUs = strtoll(optarg, NULL, 10) * 1000000ll;
+                break;
+            }
+
+            case 'b':
+            {
+                bitRate = atoi(optarg);
+                break;
+            }
+
+            case 'r':
+            {
+                frameRate = atoi(optarg);
+                break;
+            }
+
+            case 'i':
+            {
+                iFramesIntervalSec = atoi(optarg);
+                break;
+            }
+
+            case 'a':
+            {
+                addAudio = true;
+                break;
+            }
+
+            case 'f':
+            {
+                fragmentDurationUs = strtoll(optarg, NULL, 10) * 1000ll;
+                break;
+            }
+
+            case 'o':
+            {
+                path = optarg;
+                break;
+            }
+
+            case 'p':
+            {
+                realTime = true;
+                break;
+            }
+
+            case 'w':
+            {
+                writeBackSize = atoi(optarg) * 1024;
+                break;
+            }
+
+            case 'D':
+            {
+                directIO = true;
+                break;
+            }
+
+            case 'B':
+            {
+                bFrames = true;
+                break;
+            }
+
+            case 't':
+            {
+                tempDir = optarg;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 0 || durationUs <= 0 || bitRate <= 0 || frameRate <= 0) {
+        usage(me);
+    }
+
+    return run(path, durationUs, bitRate, frameRate, iFramesIntervalSec,
+               addAudio, fragmentDurationUs, realTime, writeBackSize, directIO,
+               bFrames, tempDir);
+}
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "netsession"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <arpa/inet.h>
+#include <sys/resource.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/ANetworkSession.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+// Loopback benchmark for ANetworkSession: pushes timestamped datagrams
+// through a number of UDP or TCP sessions and reports the throughput as
+// well as the latency from sendRequest() until the network thread has read
+// the datagram off the receiving socket.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-t(cp)]\n"
+                    "\t\t[-s number of sessions]\n"
+                    "\t\t[-n datagrams per session]\n"
+                    "\t\t[-b bytes per datagram]\n"
+                    "\t\t[-p base port]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const size_t kMaxDatagramSize = 1472;
+static const int64_t kTimeoutUs = 2000000ll;
+
+static int CompareIncreasing(const int64_t *a, const int64_t *b) {
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+struct BenchHandler : public AHandler {
+    BenchHandler();
+
+    void resetStats();
+
+    // Waits until at least "numConnected" sessions have connected.
+    bool waitForConnections(size_t numConnected);
+
+    // Waits until at most "numOutstanding" of "numSent" datagrams have not
+    // been received yet.
+    bool waitForDatagrams(size_t numSent, size_t numOutstanding);
+
+    void dumpStats(size_t numSent, int64_t elapsedUs);
+
+protected:
+    virtual ~BenchHandler();
+
+    virtual void onMessageReceived(const sp<AMessage> &msg);
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+
+    size_t mNumConnected;
+    size_t mNumReceived;
+    int64_t mNumBytesReceived;
+    Vector<int64_t> mLatenciesUs;
+
+    DISALLOW_EVIL_CONSTRUCTORS(BenchHandler);
+};
+
+BenchHandler::BenchHandler()
+    : mNumConnected(0),
+      mNumReceived(0),
+      mNumBytesReceived(0) {
+}
+
+BenchHandler::~BenchHandler() {
+}
+
+void BenchHandler::resetStats() {
+    Mutex::Autolock autoLock(mLock);
+    mNumReceived = 0;
+    mNumBytesReceived = 0;
+    mLatenciesUs.clear();
+}
+
+bool BenchHandler::waitForConnections(size_t numConnected) {
+    Mutex::Autolock autoLock(mLock);
+    while (mNumConnected < numConnected) {
+        if (mCondition.waitRelative(mLock, kTimeoutUs * 1000ll) != OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BenchHandler::waitForDatagrams(size_t numSent, size_t numOutstanding) {
+    Mutex::Autolock autoLock(mLock);
+    while (mNumReceived + numOutstanding < numSent) {
+        if (mCondition.waitRelative(mLock, kTimeoutUs * 1000ll) != OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BenchHandler::dumpStats(size_t numSent, int64_t elapsedUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    printf("%zu/%zu datagrams (%" PRId64 " bytes) in %.2f ms, "
+           "%.0f datagrams/sec, %.2f MB/sec\n",
+           mNumReceived, numSent, mNumBytesReceived, elapsedUs / 1E3,
+           elapsedUs > 0 ? mNumReceived * 1E6 / elapsedUs : 0.0,
+           elapsedUs > 0 ? mNumBytesReceived / 1024.0 / 1024.0 * 1E6 / elapsedUs : 0.0);
+
+    size_t n = mLatenciesUs.size();
+    if (n == 0) {
+        return;
+    }
+
+    mLatenciesUs.sort(CompareIncreasing);
+
+    int64_t sumUs = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sumUs += mLatenciesUs.itemAt(i);
+    }
+
+    printf("latency: min %" PRId64 " us, avg %" PRId64 " us, "
+           "50%% %" PRId64 " us, 99%% %" PRId64 " us, max %" PRId64 " us\n",
+           mLatenciesUs.itemAt(0),
+           sumUs / (int64_t)n,
+           mLatenciesUs.itemAt(n / 2),
+           mLatenciesUs.itemAt((n * 99) / 100),
+           mLatenciesUs.itemAt(n - 1));
+}
+
+void BenchHandler::onMessageReceived(const sp<AMessage> &msg) {
+    int32_t reason;
+    CHECK(msg->findInt32("reason", &reason));
+
+    switch (reason) {
+        case ANetworkSession::kWhatConnected:
+        {
+            Mutex::Autolock autoLock(mLock);
+            ++mNumConnected;
+            mCondition.signal();
+            break;
+        }
+
+        case ANetworkSession::kWhatDatagram:
+        {
+            sp<ABuffer> data;
+            CHECK(msg->findBuffer("data", &data));
+
+            int64_t arrivalTimeUs;
+            CHECK(data->meta()->findInt64("arrivalTimeUs", &arrivalTimeUs));
+
+            Mutex::Autolock autoLock(mLock);
+            if (data->size() >= sizeof(int64_t)) {
+                int64_t sendTimeUs;
+                memcpy(&sendTimeUs, data->data(), sizeof(sendTimeUs));
+                mLatenciesUs.push(arrivalTimeUs - sendTimeUs);
+            }
+
+            ++mNumReceived;
+            mNumBytesReceived += data->size();
+            mCondition.signal();
+            break;
+        }
+
+        case ANetworkSession::kWhatError:
+        {
+            int32_t sessionID, err;
+            CHECK(msg->findInt32("sessionID", &sessionID));
+            CHECK(msg->findInt32("err", &err));
+
+            AString detail;
+            CHECK(msg->findString("detail", &detail));
+
+            fprintf(stderr, "session %d: %s (%d)\n",
+                    sessionID, detail.c_str(), err);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static int run(
+        bool useTCP, size_t numSessions, size_t numDatagrams,
+        size_t datagramSize, unsigned basePort) {
+    // Each session needs a socket, 1000 UDP pairs exceed the default limit.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+            && limit.rlim_cur < 2 * numSessions + 64) {
+        limit.rlim_cur = 2 * numSessions + 64;
+        if (limit.rlim_max < limit.rlim_cur) {
+            limit.rlim_max = limit.rlim_cur;
+        }
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            fprintf(stderr, "unable to raise the file descriptor limit.\n");
+        }
+    }
+
+    sp<ANetworkSession> netSession = new ANetworkSession;
+    CHECK_EQ(netSession->start(), (status_t)OK);
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("netsession");
+    looper->start();
+
+    sp<BenchHandler> handler = new BenchHandler;
+    looper->registerHandler(handler);
+
+    sp<AMessage> notify = new AMessage(0, handler->id());
+
+    Vector<int32_t> senders;
+    int32_t sessionID;
+
+    if (useTCP) {
+        struct in_addr addr;
+        addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        CHECK_EQ(netSession->createTCPDatagramSession(
+                    addr, basePort, notify, &sessionID), (status_t)OK);
+
+        for (size_t i = 0; i < numSessions; ++i) {
+            CHECK_EQ(netSession->createTCPDatagramSession(
+                        basePort + 1 + i, "127.0.0.1", basePort,
+                        notify, &sessionID), (status_t)OK);
+            senders.push(sessionID);
+        }
+
+        if (!handler->waitForConnections(numSessions)) {
+            fprintf(stderr, "not all sessions connected.\n");
+            return 1;
+        }
+    } else {
+        for (size_t i = 0; i < numSessions; ++i) {
+            CHECK_EQ(netSession->createUDPSession(
+                        basePort + i, notify, &sessionID), (status_t)OK);
+
+            CHECK_EQ(netSession->createUDPSession(
+                        basePort + numSessions + i, "127.0.0.1", basePort + i,
+                        notify, &sessionID), (status_t)OK);
+            senders.push(sessionID);
+        }
+    }
+
+    printf("%zu %s sessions, %zu datagrams of %zu bytes each\n",
+           numSessions, useTCP ? "TCP" : "UDP", numDatagrams, datagramSize);
+
+    uint8_t datagram[kMaxDatagramSize];
+    memset(datagram, 0, sizeof(datagram));
+
+    // Keep a few rounds in flight so that throughput is not limited by the
+    // round trip, but not so many that UDP starts dropping.
+    const size_t maxOutstanding = numSessions * 4;
+
+    handler->resetStats();
+
+    size_t numSent = 0;
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t round = 0; round < numDatagrams; ++round) {
+        for (size_t i = 0; i < senders.size(); ++i) {
+            int64_t nowUs = ALooper::GetNowUs();
+            memcpy(datagram, &nowUs, sizeof(nowUs));
+
+            CHECK_EQ(netSession->sendRequest(
+                        senders[i], datagram, datagramSize), (status_t)OK);
+            ++numSent;
+        }
+
+        if (!handler->waitForDatagrams(numSent, maxOutstanding)) {
+            break;
+        }
+    }
+
+    handler->waitForDatagrams(numSent, 0);
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    handler->dumpStats(numSent, elapsedUs);
+
+    looper->unregisterHandler(handler->id());
+    looper->stop();
+    netSession->stop();
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    bool useTCP = false;
+    size_t numSessions = 1;
+    size_t numDatagrams = 1000;
+    size_t datagramSize = 1024;
+    unsigned basePort = 20000;
+
+    int res;
+    while ((res = getopt(argc, argv, "hts:n:b:p:")) >= 0) {
+        switch (res) {
+            case 't':
+            {
+                useTCP = true;
+                break;
+            }
+
+            case 's':
+            {
+                numSessions = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'n':
+            {
+                numDatagrams = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'b':
+            {
+                datagramSize = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'p':
+            {
+                basePort = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 0
+            || numSessions == 0
+            || numDatagrams == 0
+            || datagramSize < sizeof(int64_t)
+            || datagramSize > kMaxDatagramSize
+            || basePort + 2 * numSessions > 65535) {
+        usage(me);
+    }
+
+    return run(useTCP, numSessions, numDatagrams, datagramSize, basePort);
+}
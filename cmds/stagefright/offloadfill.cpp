@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "offloadfill"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "NuPlayer.h"
+#include "NuPlayerRenderer.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaDefs.h>
+#include <utils/Condition.h>
+#include <utils/Vector.h>
+
+// Stress test for the renderer's offloaded audio path: an AudioSink whose
+// callback thread asks for small, random amounts of data as fast as it can,
+// while the test queues buffers and flushes the renderer at random. Checks
+// that the callback sees every buffer queued since the last flush exactly
+// once and in order, nothing queued before a flush after anything queued
+// after it, and reports how long the callback took.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n number of buffers]\n"
+                    "\t\t[-s min,max bytes per callback]\n"
+                    "\t\t[-f average buffers between flushes]\n"
+                    "\t\t[-q max buffers queued]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const size_t kMinBufferSize = 256;
+static const size_t kMaxBufferSize = 4096;
+
+// What the test queued, for the sink to check what it is given against.
+// Buffer i is filled with (i & 0xff), so that runs of bytes tell buffers
+// apart as long as fewer than 128 are in flight.
+struct Script {
+    Script(size_t numBuffers)
+        : mSizes(new size_t[numBuffers]),
+          mEpochs(new int32_t[numBuffers]),
+          mNumBuffers(numBuffers) {
+    }
+
+    ~Script() {
+        delete[] mEpochs;
+        delete[] mSizes;
+    }
+
+    size_t *mSizes;
+    int32_t *mEpochs;  // number of flushes before the buffer was queued
+    size_t mNumBuffers;
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(Script);
+};
+
+struct CallbackSink : public MediaPlayerBase::AudioSink {
+    CallbackSink(const Script *script, size_t minFillSize, size_t maxFillSize)
+        : mScript(script),
+          mMinFillSize(minFillSize),
+          mMaxFillSize(maxFillSize),
+          mCallback(NULL),
+          mCookie(NULL),
+          mThreadStarted(false),
+          mRunning(false),
+          mPlaying(false),
+          mStopped(false),
+          mNumCallbacks(0),
+          mNumBytes(0),
+          mNumErrors(0),
+          mTotalCallbackUs(0),
+          mMaxCallbackUs(0),
+          mNumSlowCallbacks(0),
+          mBuffer(-1),
+          mBufferOffset(0) {
+    }
+
+    virtual bool ready() const { return mCallback != NULL; }
+    virtual bool realtime() const { return true; }
+    virtual ssize_t bufferSize() const { return mMaxFillSize; }
+    virtual ssize_t frameCount() const { return mMaxFillSize; }
+    virtual ssize_t channelCount() const { return 2; }
+    virtual ssize_t frameSize() const { return 1; }
+    virtual uint32_t latency() const { return 0; }
+    virtual float msecsPerFrame() const { return 1000.0f / 44100; }
+    virtual status_t getPosition(uint32_t *position) const { *position = 0; return OK; }
+    virtual status_t getTimestamp(AudioTimestamp & /* ts */) const { return WOULD_BLOCK; }
+
+    virtual status_t getFramesWritten(uint32_t *framesWritten) const {
+        *framesWritten = 0;
+        return OK;
+    }
+
+    virtual int getSessionId() const { return 0; }
+    virtual audio_stream_type_t getAudioStreamType() const { return AUDIO_STREAM_MUSIC; }
+    virtual uint32_t getSampleRate() const { return 44100; }
+
+    virtual status_t open(
+            uint32_t /* sampleRate */, int /* channelCount */,
+            audio_channel_mask_t /* channelMask */, audio_format_t /* format */,
+            int /* bufferCount */, AudioCallback cb, void *cookie,
+            audio_output_flags_t /* flags */,
+            const audio_offload_info_t * /* offloadInfo */) {
+        if (cb == NULL) {
+            return INVALID_OPERATION;
+        }
+
+        close();
+
+        mCallback = cb;
+        mCookie = cookie;
+        mRunning = true;
+        mThreadStarted = pthread_create(&mThread, NULL, ThreadWrapper, this) == 0;
+        return mThreadStarted ? OK : UNKNOWN_ERROR;
+    }
+
+    virtual status_t start() {
+        Mutex::Autolock autoLock(mLock);
+        mPlaying = true;
+        mStopped = false;
+        return OK;
+    }
+
+    virtual ssize_t write(const void * /* buffer */, size_t /* size */) {
+        return INVALID_OPERATION;
+    }
+
+    virtual void stop() {
+        Mutex::Autolock autoLock(mLock);
+        mPlaying = false;
+        mStopped = true;
+        mCondition.broadcast();
+    }
+
+    virtual void flush() {}
+
+    virtual void pause() {
+        Mutex::Autolock autoLock(mLock);
+        mPlaying = false;
+    }
+
+    virtual void close() {
+        if (!mThreadStarted) {
+            return;
+        }
+
+        {
+            Mutex::Autolock autoLock(mLock);
+            mRunning = false;
+        }
+
+        // Like an AudioTrack, no callback runs once this returns.
+        pthread_join(mThread, NULL);
+        mThreadStarted = false;
+        mCallback = NULL;
+    }
+
+    // Waits for the renderer to stop the sink at EOS.
+    bool waitForStop(int64_t timeoutUs) {
+        Mutex::Autolock autoLock(mLock);
+        if (!mStopped) {
+            mCondition.waitRelative(mLock, timeoutUs * 1000ll);
+        }
+        return mStopped;
+    }
+
+    void report(size_t lastBuffer) {
+        // The last buffer queued must have been played out in full.
+        if (mBuffer != (ssize_t)lastBuffer
+                || mBufferOffset != mScript->mSizes[lastBuffer]) {
+            ALOGE("ended in buffer %zd at %zu, expected buffer %zu to end at %zu",
+                  mBuffer, mBufferOffset, lastBuffer, mScript->mSizes[lastBuffer]);
+            ++mNumErrors;
+        }
+
+        printf("%zu callbacks, %zu bytes, %zu errors\n",
+               mNumCallbacks, mNumBytes, mNumErrors);
+        printf("callback took %.2f us on average, %" PRId64 " us at most, "
+               "%zu took over 1 ms\n",
+               mNumCallbacks > 0 ? (double)mTotalCallbackUs / mNumCallbacks : 0.0,
+               mMaxCallbackUs, mNumSlowCallbacks);
+    }
+
+    size_t numErrors() const { return mNumErrors; }
+
+protected:
+    virtual ~CallbackSink() {
+        close();
+    }
+
+private:
+    const Script *mScript;
+    size_t mMinFillSize;
+    size_t mMaxFillSize;
+
+    AudioCallback mCallback;
+    void *mCookie;
+
+    pthread_t mThread;
+    bool mThreadStarted;
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mRunning;
+    bool mPlaying;
+    bool mStopped;
+
+    // owned by the callback thread
+    size_t mNumCallbacks;
+    size_t mNumBytes;
+    size_t mNumErrors;
+    int64_t mTotalCallbackUs;
+    int64_t mMaxCallbackUs;
+    size_t mNumSlowCallbacks;
+    ssize_t mBuffer;        // buffer being played, -1 if none yet
+    size_t mBufferOffset;   // how much of it was played
+
+    static void *ThreadWrapper(void *me) {
+        static_cast<CallbackSink *>(me)->threadEntry();
+        return NULL;
+    }
+
+    void threadEntry() {
+        uint8_t *data = new uint8_t[mMaxFillSize];
+        unsigned seed = 1;
+
+        for (;;) {
+            {
+                Mutex::Autolock autoLock(mLock);
+                if (!mRunning) {
+                    break;
+                }
+                if (!mPlaying) {
+                    mLock.unlock();
+                    usleep(1000);
+                    mLock.lock();
+                    continue;
+                }
+            }
+
+            size_t size = mMinFillSize + rand_r(&seed) % (mMaxFillSize - mMinFillSize + 1);
+
+            int64_t startUs = ALooper::GetNowUs();
+            size_t filled = (*mCallback)(
+                    this, data, size, mCookie, CB_EVENT_FILL_BUFFER);
+            int64_t callbackUs = ALooper::GetNowUs() - startUs;
+
+            ++mNumCallbacks;
+            mTotalCallbackUs += callbackUs;
+            if (callbackUs > mMaxCallbackUs) {
+                mMaxCallbackUs = callbackUs;
+            }
+            if (callbackUs > 1000) {
+                ++mNumSlowCallbacks;
+            }
+
+            CHECK_LE(filled, size);
+            check(data, filled);
+            mNumBytes += filled;
+
+            if (filled == 0) {
+                usleep(100);
+            }
+        }
+
+        delete[] data;
+    }
+
+    void check(const uint8_t *data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (mBuffer >= 0 && data[i] == (uint8_t)mBuffer
+                    && mBufferOffset < mScript->mSizes[mBuffer]) {
+                ++mBufferOffset;
+                continue;
+            }
+
+            // A new buffer starts, one that was queued after the last one.
+            size_t next = (mBuffer < 0)
+                ? data[i] : mBuffer + (uint8_t)(data[i] - (uint8_t)mBuffer);
+
+            bool ok = next < mScript->mNumBuffers
+                && (mBuffer < 0 || next - mBuffer < 128);
+            if (ok && mBuffer >= 0) {
+                int32_t epoch = mScript->mEpochs[mBuffer];
+                int32_t nextEpoch = mScript->mEpochs[next];
+                bool complete = mBufferOffset == mScript->mSizes[mBuffer];
+
+                // Within an epoch buffers follow each other in full, a flush
+                // may cut one short and drop any number.
+                ok = (nextEpoch == epoch && next == (size_t)mBuffer + 1 && complete)
+                    || nextEpoch > epoch;
+            }
+
+            if (!ok) {
+                if (mNumErrors++ < 10) {
+                    ALOGE("buffer %zu (epoch %d) after buffer %zd (epoch %d) at %zu of %zu",
+                          next, next < mScript->mNumBuffers ? mScript->mEpochs[next] : -1,
+                          mBuffer, mBuffer >= 0 ? mScript->mEpochs[mBuffer] : -1,
+                          mBufferOffset, mBuffer >= 0 ? mScript->mSizes[mBuffer] : 0);
+                }
+                if (next >= mScript->mNumBuffers) {
+                    continue;
+                }
+            }
+
+            mBuffer = next;
+            mBufferOffset = 1;
+        }
+    }
+
+    DISALLOW_EVIL_CONSTRUCTORS(CallbackSink);
+};
+
+// Counts the buffers the renderer is done with.
+struct Feeder : public AHandler {
+    Feeder() : mNumOutstanding(0) {}
+
+    enum {
+        kWhatConsumed = 'cons',
+        kWhatRendererNotify = 'renN',
+    };
+
+    void onQueued() {
+        Mutex::Autolock autoLock(mLock);
+        ++mNumOutstanding;
+    }
+
+    void waitForOutstanding(size_t maxOutstanding) {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumOutstanding > maxOutstanding) {
+            mCondition.wait(mLock);
+        }
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        if (msg->what() == kWhatConsumed) {
+            Mutex::Autolock autoLock(mLock);
+            CHECK_GT(mNumOutstanding, 0u);
+            --mNumOutstanding;
+            mCondition.broadcast();
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    size_t mNumOutstanding;
+
+    DISALLOW_EVIL_CONSTRUCTORS(Feeder);
+};
+
+static int run(
+        size_t numBuffers, size_t minFillSize, size_t maxFillSize,
+        size_t flushInterval, size_t maxQueued) {
+    Script script(numBuffers);
+    sp<CallbackSink> sink = new CallbackSink(&script, minFillSize, maxFillSize);
+
+    sp<ALooper> feederLooper = new ALooper;
+    feederLooper->setName("offloadfill");
+    feederLooper->start();
+
+    sp<Feeder> feeder = new Feeder;
+    feederLooper->registerHandler(feeder);
+
+    sp<ALooper> rendererLooper = new ALooper;
+    rendererLooper->setName("NuPlayerRenderer");
+    rendererLooper->start(false, false, ANDROID_PRIORITY_AUDIO);
+
+    sp<NuPlayer::Renderer> renderer = new NuPlayer::Renderer(
+            sink,
+            new AMessage(Feeder::kWhatRendererNotify, feeder->id()),
+            NuPlayer::Renderer::FLAG_OFFLOAD_AUDIO);
+    rendererLooper->registerHandler(renderer);
+
+    sp<AMessage> format = new AMessage;
+    format->setString("mime", MEDIA_MIMETYPE_AUDIO_MPEG);
+    format->setInt32("channel-count", 2);
+    format->setInt32("sample-rate", 44100);
+
+    bool isOffloaded;
+    CHECK_EQ(renderer->openAudioSink(
+                format, true /* offloadOnly */, false /* hasVideo */,
+                0 /* flags */, false /* isStreaming */, &isOffloaded),
+             (status_t)OK);
+    CHECK(isOffloaded);
+
+    unsigned seed = 2;
+    int32_t epoch = 0;
+    int64_t startUs = ALooper::GetNowUs();
+
+    for (size_t i = 0; i < numBuffers; ++i) {
+        if (i > 0 && rand_r(&seed) % flushInterval == 0) {
+            renderer->flush(true /* audio */, false /* notifyComplete */);
+            ++epoch;
+        }
+
+        size_t size = kMinBufferSize + rand_r(&seed) % (kMaxBufferSize - kMinBufferSize + 1);
+        script.mSizes[i] = size;
+        script.mEpochs[i] = epoch;
+
+        sp<ABuffer> buffer = new ABuffer(size);
+        memset(buffer->data(), (uint8_t)i, size);
+        buffer->meta()->setInt64("timeUs", i * 10000ll);
+
+        feeder->waitForOutstanding(maxQueued - 1);
+        feeder->onQueued();
+        renderer->queueBuffer(
+                true /* audio */, buffer, new AMessage(Feeder::kWhatConsumed, feeder->id()));
+    }
+
+    renderer->queueEOS(true /* audio */, ERROR_END_OF_STREAM);
+    feeder->waitForOutstanding(0);
+    CHECK(sink->waitForStop(5000000ll));
+
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    renderer->closeAudioSink();
+
+    printf("%zu buffers, %d flushes in %.2f secs\n",
+           numBuffers, epoch, elapsedUs / 1E6);
+    sink->report(numBuffers - 1);
+
+    rendererLooper->unregisterHandler(renderer->id());
+    rendererLooper->stop();
+    feederLooper->unregisterHandler(feeder->id());
+    feederLooper->stop();
+
+    return sink->numErrors() > 0 ? 1 : 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t numBuffers = 100000;
+    size_t minFillSize = 16;
+    size_t maxFillSize = 512;
+    size_t flushInterval = 500;
+    size_t maxQueued = 32;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:s:f:q:")) >= 0) {
+        switch (res) {
+            case 'n':
+            {
+                numBuffers = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 's':
+            {
+                if (sscanf(optarg, "%zu,%zu", &minFillSize, &maxFillSize) != 2) {
+                    usage(me);
+                }
+                break;
+            }
+
+            case 'f':
+            {
+                flushInterval = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'q':
+            {
+                maxQueued = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 0 || numBuffers == 0 || minFillSize == 0 || maxFillSize < minFillSize
+            || flushInterval == 0 || maxQueued == 0 || maxQueued >= 128) {
+        usage(me);
+    }
+
+    return run(numBuffers, minFillSize, maxFillSize, flushInterval, maxQueued);
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "packetqueue"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <pthread.h>
+
+#include "AnotherPacketSource.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/List.h>
+
+// Benchmark for AnotherPacketSource: asks a deep queue for its buffered
+// duration, checking the answer against walking the queue the way it used
+// to be computed, and pushes access units from one thread to another
+// through a source with and without single producer mode.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d queue depth]\n"
+                    "\t\t[-r access units between discontinuities]\n"
+                    "\t\t[-q number of queries]\n"
+                    "\t\t[-n number of access units to pass between threads]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const int64_t kFrameDurationUs = 33367ll;
+
+// Presentation order of a IBBP... stream in decode order.
+static int64_t TimeUsForFrame(size_t frame) {
+    size_t index = frame % 3 == 0 ? frame + 2 : frame - 1;
+    return (index + 1) * kFrameDurationUs;
+}
+
+static sp<ABuffer> MakeAccessUnit(int64_t timeUs) {
+    sp<ABuffer> accessUnit = new ABuffer(16);
+    accessUnit->meta()->setInt64("timeUs", timeUs);
+    return accessUnit;
+}
+
+// How getBufferedDurationUs used to compute the buffered duration, -1
+// entries stand for discontinuities.
+static int64_t WalkBufferedDurationUs(const List<int64_t> &queue) {
+    if (queue.empty()) {
+        return 0;
+    }
+
+    int64_t time1 = -1;
+    int64_t time2 = -1;
+    int64_t durationUs = 0;
+
+    for (List<int64_t>::const_iterator it = queue.begin();
+            it != queue.end(); ++it) {
+        int64_t timeUs = *it;
+        if (timeUs >= 0) {
+            if (time1 < 0 || timeUs < time1) {
+                time1 = timeUs;
+            }
+
+            if (time2 < 0 || timeUs > time2) {
+                time2 = timeUs;
+            }
+        } else {
+            durationUs += time2 - time1;
+            time1 = time2 = -1;
+        }
+    }
+
+    return durationUs + (time2 - time1);
+}
+
+static void benchmarkQueries(
+        size_t depth, size_t runLength, size_t numQueries) {
+    sp<AnotherPacketSource> source = new AnotherPacketSource(NULL);
+    List<int64_t> queue;
+
+    for (size_t i = 0; i < depth; ++i) {
+        if (runLength > 0 && i > 0 && (i % runLength) == 0) {
+            source->queueDiscontinuity(
+                    ATSParser::DISCONTINUITY_TIME, NULL /* extra */,
+                    false /* discard */);
+            queue.push_back(-1ll);
+        }
+
+        int64_t timeUs = TimeUsForFrame(i);
+        source->queueAccessUnit(MakeAccessUnit(timeUs));
+        queue.push_back(timeUs);
+    }
+
+    status_t finalResult;
+    int64_t expectedUs = WalkBufferedDurationUs(queue);
+    CHECK_EQ(source->getBufferedDurationUs(&finalResult), expectedUs);
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < numQueries; ++i) {
+        CHECK_EQ(WalkBufferedDurationUs(queue), expectedUs);
+    }
+    int64_t walkUs = ALooper::GetNowUs() - startUs;
+
+    startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < numQueries; ++i) {
+        CHECK_EQ(source->getBufferedDurationUs(&finalResult), expectedUs);
+    }
+    int64_t queryUs = ALooper::GetNowUs() - startUs;
+
+    printf("%zu entries deep, %zu queries: walking the queue %.2f ms, "
+           "getBufferedDurationUs %.2f ms\n",
+           queue.size(), numQueries, walkUs / 1E3, queryUs / 1E3);
+
+    // Drain the queue, checking the bookkeeping along the way.
+    size_t n = 0;
+    while (!queue.empty()) {
+        sp<ABuffer> accessUnit;
+        status_t err = source->dequeueAccessUnit(&accessUnit);
+
+        int64_t timeUs;
+        if (err == INFO_DISCONTINUITY) {
+            CHECK_EQ(*queue.begin(), -1ll);
+        } else {
+            CHECK_EQ(err, (status_t)OK);
+            CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
+            CHECK_EQ(*queue.begin(), timeUs);
+        }
+        queue.erase(queue.begin());
+
+        if ((++n % 97) == 0 || queue.empty()) {
+            CHECK_EQ(source->getBufferedDurationUs(&finalResult),
+                     WalkBufferedDurationUs(queue));
+        }
+    }
+}
+
+struct ProducerParams {
+    sp<AnotherPacketSource> mSource;
+    size_t mNumAccessUnits;
+};
+
+static void *ProducerThread(void *cookie) {
+    ProducerParams *params = static_cast<ProducerParams *>(cookie);
+
+    // As a fetcher does, for as long as it is started.
+    params->mSource->bindProducer();
+    for (size_t i = 0; i < params->mNumAccessUnits; ++i) {
+        params->mSource->queueAccessUnit(MakeAccessUnit(TimeUsForFrame(i)));
+    }
+    params->mSource->unbindProducer();
+
+    params->mSource->signalEOS(ERROR_END_OF_STREAM);
+
+    return NULL;
+}
+
+static int64_t passAccessUnits(
+        const sp<AnotherPacketSource> &source, size_t numAccessUnits) {
+    ProducerParams params;
+    params.mSource = source;
+    params.mNumAccessUnits = numAccessUnits;
+
+    int64_t startUs = ALooper::GetNowUs();
+
+    pthread_t producer;
+    CHECK_EQ(pthread_create(&producer, NULL, ProducerThread, &params), 0);
+
+    size_t n = 0;
+    for (;;) {
+        sp<ABuffer> accessUnit;
+        status_t err = source->dequeueAccessUnit(&accessUnit);
+        if (err != OK) {
+            CHECK_EQ(err, (status_t)ERROR_END_OF_STREAM);
+            break;
+        }
+
+        int64_t timeUs;
+        CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
+        CHECK_EQ(timeUs, TimeUsForFrame(n));
+        ++n;
+    }
+
+    int64_t durationUs = ALooper::GetNowUs() - startUs;
+
+    CHECK_EQ(pthread_join(producer, NULL), 0);
+    CHECK_EQ(n, numAccessUnits);
+
+    return durationUs;
+}
+
+static void benchmarkThroughput(size_t numAccessUnits) {
+    sp<AnotherPacketSource> locked = new AnotherPacketSource(NULL);
+    int64_t lockedUs = passAccessUnits(locked, numAccessUnits);
+
+    sp<AnotherPacketSource> singleProducer = new AnotherPacketSource(NULL);
+    singleProducer->enableSingleProducerMode();
+    int64_t singleProducerUs = passAccessUnits(singleProducer, numAccessUnits);
+
+    printf("%zu access units between threads: locked %.2f ms, "
+           "single producer %.2f ms\n",
+           numAccessUnits, lockedUs / 1E3, singleProducerUs / 1E3);
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    // About ten minutes of 30 fps video.
+    size_t depth = 18000;
+    size_t runLength = 3000;
+    size_t numQueries = 1000;
+    size_t numAccessUnits = 1000000;
+
+    int res;
+    while ((res = getopt(argc, argv, "hd:r:q:n:")) >= 0) {
+        switch (res) {
+            case 'd':
+            {
+                depth = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'r':
+            {
+                runLength = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'q':
+            {
+                numQueries = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'n':
+            {
+                numAccessUnits = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 0 || depth == 0) {
+        usage(me);
+    }
+
+    benchmarkQueries(depth, runLength, numQueries);
+    benchmarkThroughput(numAccessUnits);
+
+    return 0;
+}
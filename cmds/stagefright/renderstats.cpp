@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "renderstats"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NuPlayerDriver.h"
+
+#include <binder/ProcessState.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <media/mediaplayer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <ui/DisplayInfo.h>
+#include <utils/Condition.h>
+
+// Plays a clip through NuPlayer into an audio sink that plays out at an
+// exactly known rate, optionally drifting from nominal, and prints the
+// renderer's timing histograms, so playback smoothness can be compared
+// from build to build without audio hardware in the loop.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d audio clock drift (ppm)]\n"
+                    "\t\t[-b audio sink buffer (ms)]\n"
+                    "\t\t[-t max seconds to play]\n"
+                    "\t\t[-N (no video)]\n"
+                    "\t\t[-o file to append the histograms to]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+// Consumes whatever is written to it in real time, at the sample rate
+// scaled by the drift, and reports exact timestamps. Starves, rather
+// than plays silence, when it isn't fed.
+struct FakeAudioSink : public MediaPlayerBase::AudioSink {
+    FakeAudioSink(int32_t driftPpm, int32_t bufferMs)
+        : mDriftPpm(driftPpm),
+          mBufferMs(bufferMs),
+          mOpen(false),
+          mPlaying(false),
+          mSampleRate(0),
+          mChannelCount(0),
+          mFrameSize(0),
+          mFrameCount(0),
+          mFramesWritten(0),
+          mFramesPlayed(0),
+          mLastUpdateUs(0),
+          mFrameRemainder(0.0) {
+    }
+
+    virtual bool ready() const { return mOpen; }
+    virtual bool realtime() const { return true; }
+    virtual ssize_t bufferSize() const { return mFrameCount * mFrameSize; }
+    virtual ssize_t frameCount() const { return mFrameCount; }
+    virtual ssize_t channelCount() const { return mChannelCount; }
+    virtual ssize_t frameSize() const { return mFrameSize; }
+    virtual uint32_t latency() const { return mBufferMs; }
+
+    virtual float msecsPerFrame() const {
+        return mSampleRate > 0 ? 1000.0f / mSampleRate : 0.0f;
+    }
+
+    virtual status_t getPosition(uint32_t *position) const {
+        Mutex::Autolock autoLock(mLock);
+        update_l();
+        *position = mFramesPlayed;
+        return OK;
+    }
+
+    virtual status_t getTimestamp(AudioTimestamp &ts) const {
+        Mutex::Autolock autoLock(mLock);
+        update_l();
+        if (!mPlaying || mFramesPlayed == 0) {
+            return WOULD_BLOCK;
+        }
+        ts.mPosition = mFramesPlayed;
+        ts.mTime.tv_sec = mLastUpdateUs / 1000000ll;
+        ts.mTime.tv_nsec = (mLastUpdateUs % 1000000ll) * 1000ll;
+        return OK;
+    }
+
+    virtual status_t getFramesWritten(uint32_t *framesWritten) const {
+        Mutex::Autolock autoLock(mLock);
+        *framesWritten = mFramesWritten;
+        return OK;
+    }
+
+    virtual int getSessionId() const { return 0; }
+    virtual audio_stream_type_t getAudioStreamType() const { return AUDIO_STREAM_MUSIC; }
+    virtual uint32_t getSampleRate() const { return mSampleRate; }
+
+    virtual status_t open(
+            uint32_t sampleRate, int channelCount, audio_channel_mask_t /* channelMask */,
+            audio_format_t format, int /* bufferCount */,
+            AudioCallback cb, void * /* cookie */,
+            audio_output_flags_t /* flags */,
+            const audio_offload_info_t * /* offloadInfo */) {
+        if (cb != NULL || !audio_is_linear_pcm(format)) {
+            // No offload, NuPlayer falls back to decoding to PCM.
+            return INVALID_OPERATION;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mSampleRate = sampleRate;
+        mChannelCount = channelCount;
+        mFrameSize = channelCount * audio_bytes_per_sample(format);
+        mFrameCount = (int64_t)sampleRate * mBufferMs / 1000;
+        mFramesWritten = 0;
+        mFramesPlayed = 0;
+        mOpen = true;
+        return OK;
+    }
+
+    virtual status_t start() {
+        Mutex::Autolock autoLock(mLock);
+        mPlaying = true;
+        mLastUpdateUs = ALooper::GetNowUs();
+        return OK;
+    }
+
+    virtual ssize_t write(const void * /* buffer */, size_t size) {
+        size_t numFrames = size / mFrameSize;
+
+        Mutex::Autolock autoLock(mLock);
+        for (;;) {
+            update_l();
+            if (!mPlaying || mFramesWritten - mFramesPlayed + numFrames <= mFrameCount) {
+                break;
+            }
+            // Block like AudioTrack does until there is room.
+            mLock.unlock();
+            usleep(2000);
+            mLock.lock();
+        }
+        mFramesWritten += numFrames;
+        return numFrames * mFrameSize;
+    }
+
+    virtual void stop() { pause(); }
+
+    virtual void flush() {
+        Mutex::Autolock autoLock(mLock);
+        mFramesWritten = mFramesPlayed = 0;
+        mFrameRemainder = 0.0;
+    }
+
+    virtual void pause() {
+        Mutex::Autolock autoLock(mLock);
+        update_l();
+        mPlaying = false;
+    }
+
+    virtual void close() {
+        Mutex::Autolock autoLock(mLock);
+        mOpen = mPlaying = false;
+    }
+
+protected:
+    virtual ~FakeAudioSink() {}
+
+private:
+    int32_t mDriftPpm;
+    int32_t mBufferMs;
+
+    mutable Mutex mLock;
+    bool mOpen;
+    bool mPlaying;
+    uint32_t mSampleRate;
+    int mChannelCount;
+    size_t mFrameSize;
+    size_t mFrameCount;
+    uint32_t mFramesWritten;
+    mutable uint32_t mFramesPlayed;
+    mutable int64_t mLastUpdateUs;
+    mutable double mFrameRemainder;
+
+    // Plays out what the elapsed time allows of what was written.
+    void update_l() const {
+        int64_t nowUs = ALooper::GetNowUs();
+        if (mPlaying) {
+            double frames = mFrameRemainder
+                + (nowUs - mLastUpdateUs) * 1E-6 * mSampleRate * (1.0 + mDriftPpm * 1E-6);
+            uint32_t wholeFrames = (uint32_t)frames;
+            mFrameRemainder = frames - wholeFrames;
+
+            mFramesPlayed += wholeFrames;
+            if (mFramesPlayed > mFramesWritten) {
+                mFramesPlayed = mFramesWritten;
+                mFrameRemainder = 0.0;
+            }
+        }
+        mLastUpdateUs = nowUs;
+    }
+
+    DISALLOW_EVIL_CONSTRUCTORS(FakeAudioSink);
+};
+
+struct Completion {
+    Completion() : mDone(false), mResult(OK) {}
+
+    static void Notify(
+            void *cookie, int msg, int ext1, int /* ext2 */, const Parcel * /* obj */) {
+        Completion *me = (Completion *)cookie;
+
+        if (msg != MEDIA_PLAYBACK_COMPLETE && msg != MEDIA_ERROR) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(me->mLock);
+        me->mDone = true;
+        me->mResult = (msg == MEDIA_ERROR) ? ext1 : OK;
+        me->mCondition.signal();
+    }
+
+    bool waitFor(int64_t timeoutUs) {
+        Mutex::Autolock autoLock(mLock);
+        int64_t endUs = ALooper::GetNowUs() + timeoutUs;
+        while (!mDone) {
+            int64_t remainingUs = endUs - ALooper::GetNowUs();
+            if (remainingUs <= 0) {
+                break;
+            }
+            mCondition.waitRelative(mLock, remainingUs * 1000ll);
+        }
+        return mDone;
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mDone;
+    status_t mResult;
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(Completion);
+};
+
+static int run(
+        const char *path, int32_t driftPpm, int32_t bufferMs, int32_t maxSecs,
+        const sp<IGraphicBufferProducer> &bufferProducer, const char *outPath) {
+    int fd = open(path, O_RDONLY | O_LARGEFILE);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0);
+
+    Completion completion;
+
+    sp<NuPlayerDriver> player = new NuPlayerDriver;
+    player->setNotifyCallback(&completion, &Completion::Notify);
+    player->setAudioSink(new FakeAudioSink(driftPpm, bufferMs));
+
+    status_t err = player->setDataSource(fd, 0, st.st_size);
+    close(fd);
+    fd = -1;
+
+    if (err == OK && bufferProducer != NULL) {
+        err = player->setVideoSurfaceTexture(bufferProducer);
+    }
+    if (err == OK) {
+        err = player->prepare();
+    }
+    if (err != OK) {
+        fprintf(stderr, "unable to play '%s' (%d).\n", path, err);
+        return 1;
+    }
+
+    int64_t startUs = ALooper::GetNowUs();
+    CHECK_EQ(player->start(), (status_t)OK);
+
+    bool completed = completion.waitFor(maxSecs * 1000000ll);
+    int64_t playedUs = ALooper::GetNowUs() - startUs;
+
+    printf("played %.2f secs%s, audio clock drift %d ppm, %d ms sink buffer\n",
+           playedUs / 1E6, completed ? "" : " (stopped early)", driftPpm, bufferMs);
+
+    Vector<String16> args;
+    CHECK_EQ(player->dump(STDOUT_FILENO, args), (status_t)OK);
+    fflush(stdout);
+
+    if (outPath != NULL) {
+        int outFd = open(outPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (outFd < 0) {
+            fprintf(stderr, "unable to open '%s'.\n", outPath);
+        } else {
+            dprintf(outFd, "%s drift=%d bufferMs=%d\n", path, driftPpm, bufferMs);
+            player->dump(outFd, args);
+            close(outFd);
+        }
+    }
+
+    player->reset();
+
+    return (completed && completion.mResult != OK) ? 1 : 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    int32_t driftPpm = 0;
+    int32_t bufferMs = 80;
+    int32_t maxSecs = 60;
+    bool useVideo = true;
+    const char *outPath = NULL;
+
+    int res;
+    while ((res = getopt(argc, argv, "hd:b:t:No:")) >= 0) {
+        switch (res) {
+            case 'd':
+            {
+                driftPpm = atoi(optarg);
+                break;
+            }
+
+            case 'b':
+            {
+                bufferMs = atoi(optarg);
+                break;
+            }
+
+            case 't':
+            {
+                maxSecs = atoi(optarg);
+                break;
+            }
+
+            case 'N':
+            {
+                useVideo = false;
+                break;
+            }
+
+            case 'o':
+            {
+                outPath = optarg;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || bufferMs <= 0 || maxSecs <= 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> composerClient;
+    sp<SurfaceControl> control;
+    sp<IGraphicBufferProducer> bufferProducer;
+
+    if (useVideo) {
+        composerClient = new SurfaceComposerClient;
+        CHECK_EQ(composerClient->initCheck(), (status_t)OK);
+
+        sp<IBinder> display(SurfaceComposerClient::getBuiltInDisplay(
+                ISurfaceComposer::eDisplayIdMain));
+        DisplayInfo info;
+        SurfaceComposerClient::getDisplayInfo(display, &info);
+
+        control = composerClient->createSurface(
+                String8("renderstats"), info.w, info.h, PIXEL_FORMAT_RGB_565, 0);
+
+        CHECK(control != NULL);
+        CHECK(control->isValid());
+
+        SurfaceComposerClient::openGlobalTransaction();
+        CHECK_EQ(control->setLayer(INT_MAX), (status_t)OK);
+        CHECK_EQ(control->show(), (status_t)OK);
+        SurfaceComposerClient::closeGlobalTransaction();
+
+        bufferProducer = control->getSurface()->getIGraphicBufferProducer();
+    }
+
+    int result = run(argv[0], driftPpm, bufferMs, maxSecs, bufferProducer, outPath);
+
+    if (useVideo) {
+        composerClient->dispose();
+    }
+
+    return result;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rtploopback"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "ARTPConnection.h"
+#include "ASessionDescription.h"
+#include "rtp/RTPSender.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/ANetworkSession.h>
+#include <utils/Mutex.h>
+
+// Loopback benchmark for the RTP send and receive paths: an RTPSender pushes
+// transport stream packets at a fixed bitrate to an ARTPConnection listening
+// on localhost. Reports the packet rate that made it through as well as the
+// CPU time the process spent per Mbps.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-r bitrate in Mbps]\n"
+                    "\t\t[-d duration in secs]\n"
+                    "\t\t[-a transport stream packets per access unit]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const char kSDP[] =
+    "v=0\r\n"
+    "o=- 0 0 IN IP4 127.0.0.1\r\n"
+    "s=rtploopback\r\n"
+    "c=IN IP4 127.0.0.1\r\n"
+    "t=0 0\r\n"
+    "m=video 0 RTP/AVP 33\r\n"
+    "a=rtpmap:33 MP2T/90000\r\n";
+
+// RTPSender fills each RTP packet with as many TS packets as fit.
+static const size_t kTSPacketsPerRTPPacket =
+    (RTPBase::kMaxUDPPacketSize - 12) / 188;
+
+static int64_t GetCPUTimeUs() {
+    struct rusage usage;
+    CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ll
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+struct ReceiveHandler : public AHandler {
+    ReceiveHandler();
+
+    void getStats(int64_t *numPackets, int64_t *numBytes);
+
+protected:
+    virtual ~ReceiveHandler();
+
+    virtual void onMessageReceived(const sp<AMessage> &msg);
+
+private:
+    Mutex mLock;
+    int64_t mNumPackets;
+    int64_t mNumBytes;
+
+    DISALLOW_EVIL_CONSTRUCTORS(ReceiveHandler);
+};
+
+ReceiveHandler::ReceiveHandler()
+    : mNumPackets(0),
+      mNumBytes(0) {
+}
+
+ReceiveHandler::~ReceiveHandler() {
+}
+
+void ReceiveHandler::getStats(int64_t *numPackets, int64_t *numBytes) {
+    Mutex::Autolock autoLock(mLock);
+    *numPackets = mNumPackets;
+    *numBytes = mNumBytes;
+}
+
+void ReceiveHandler::onMessageReceived(const sp<AMessage> &msg) {
+    // The transport stream assembler emits every RTP payload as an access
+    // unit of its own.
+    sp<ABuffer> accessUnit;
+    if (!msg->findBuffer("access-unit", &accessUnit)) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    ++mNumPackets;
+    mNumBytes += accessUnit->size();
+}
+
+static int run(double bitrateMbps, int64_t durationUs, size_t tsPacketsPerUnit) {
+    sp<ANetworkSession> netSession = new ANetworkSession;
+    CHECK_EQ(netSession->start(), (status_t)OK);
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("rtploopback");
+    looper->start();
+
+    sp<ReceiveHandler> handler = new ReceiveHandler;
+    looper->registerHandler(handler);
+
+    sp<ASessionDescription> sessionDesc = new ASessionDescription;
+    CHECK(sessionDesc->setTo(kSDP, strlen(kSDP)));
+
+    sp<ARTPConnection> connection = new ARTPConnection;
+    looper->registerHandler(connection);
+
+    int rtpSocket, rtcpSocket;
+    unsigned rtpPort;
+    ARTPConnection::MakePortPair(&rtpSocket, &rtcpSocket, &rtpPort);
+
+    connection->addStream(
+            rtpSocket, rtcpSocket, sessionDesc, 1 /* index */,
+            new AMessage(0, handler->id()), false /* injected */);
+
+    sp<RTPSender> sender =
+        new RTPSender(netSession, new AMessage(0, handler->id()));
+    looper->registerHandler(sender);
+
+    int32_t localRTPPort;
+    CHECK_EQ(sender->initAsync(
+                "127.0.0.1", rtpPort, RTPBase::TRANSPORT_UDP,
+                -1 /* remoteRTCPPort */, RTPBase::TRANSPORT_NONE,
+                &localRTPPort),
+             (status_t)OK);
+
+    const size_t unitSize = tsPacketsPerUnit * 188;
+    const int64_t unitDurationUs = unitSize * 8 / bitrateMbps;
+
+    printf("%.1f Mbps for %.1f secs, %zu bytes every %" PRId64 " us\n",
+           bitrateMbps, durationUs / 1E6, unitSize, unitDurationUs);
+
+    int64_t numUnits = 0;
+    int64_t startUs = ALooper::GetNowUs();
+    int64_t startCPUUs = GetCPUTimeUs();
+
+    for (;;) {
+        int64_t nowUs = ALooper::GetNowUs();
+        if (nowUs >= startUs + durationUs) {
+            break;
+        }
+
+        int64_t nextUnitUs = startUs + numUnits * unitDurationUs;
+        if (nextUnitUs > nowUs) {
+            usleep(nextUnitUs - nowUs);
+            continue;
+        }
+
+        sp<ABuffer> unit = new ABuffer(unitSize);
+        for (size_t i = 0; i < tsPacketsPerUnit; ++i) {
+            uint8_t *ts = unit->data() + i * 188;
+            memset(ts, 0xff, 188);
+            ts[0] = 0x47;
+            ts[1] = 0x1f;  // null packets
+            ts[2] = 0xff;
+            ts[3] = 0x10;
+        }
+        unit->meta()->setInt64("timeUs", nowUs - startUs);
+
+        CHECK_EQ(sender->queueBuffer(
+                    unit, 33, RTPBase::PACKETIZATION_TRANSPORT_STREAM),
+                 (status_t)OK);
+
+        ++numUnits;
+    }
+
+    // Give the tail end a chance to arrive.
+    usleep(100000ll);
+
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+    int64_t cpuUs = GetCPUTimeUs() - startCPUUs;
+
+    int64_t numPackets, numBytes;
+    handler->getStats(&numPackets, &numBytes);
+
+    int64_t numPacketsSent = numUnits
+        * ((tsPacketsPerUnit + kTSPacketsPerRTPPacket - 1)
+                / kTSPacketsPerRTPPacket);
+    double mbps = numBytes * 8.0 / elapsedUs;
+
+    printf("%" PRId64 "/%" PRId64 " RTP packets, %.0f packets/sec, "
+           "%.2f Mbps received\n",
+           numPackets, numPacketsSent,
+           numPackets * 1E6 / elapsedUs,
+           mbps);
+
+    printf("cpu: %.2f ms/sec, %.3f%% per Mbps\n",
+           cpuUs / 1E3 / (elapsedUs / 1E6),
+           mbps > 0.0 ? cpuUs * 100.0 / elapsedUs / mbps : 0.0);
+
+    connection->removeStream(rtpSocket, rtcpSocket);
+
+    looper->unregisterHandler(sender->id());
+    looper->unregisterHandler(connection->id());
+    looper->unregisterHandler(handler->id());
+    looper->stop();
+    netSession->stop();
+
+    close(rtpSocket);
+    close(rtcpSocket);
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    double bitrateMbps = 20.0;
+    int64_t durationUs = 5000000ll;
+    size_t tsPacketsPerUnit = 70;
+
+    int res;
+    while ((res = getopt(argc, argv, "hr:d:a:")) >= 0) {
+        switch (res) {
+            case 'r':
+            {
+                bitrateMbps = strtod(optarg, NULL);
+                break;
+            }
+
+            case 'd':
+            {
+                durationUs = (int64_t)(strtod(optarg, NULL) * 1E6);
+                break;
+            }
+
+            case 'a':
+            {
+                tsPacketsPerUnit = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 0
+            || bitrateMbps <= 0.0
+            || durationUs <= 0
+            || tsPacketsPerUnit == 0) {
+        usage(me);
+    }
+
+    return run(bitrateMbps, durationUs, tsPacketsPerUnit);
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "samplebatch"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <utils/Vector.h>
+
+// Benchmark for the way NuPlayer::GenericSource pulls access units out of a
+// local file: reads the audio and video tracks interleaved by time, once an
+// access unit per read copied into an ABuffer the way it used to be done,
+// and once several access units per readMultiple handed on as they are,
+// checking both see the same data.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-a audio access units per read]\n"
+                    "\t\t[-v video access units per read]\n"
+                    "\t\t[-n number of runs]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+struct CountingDataSource : public DataSource {
+    CountingDataSource(const sp<DataSource> &source)
+        : mSource(source),
+          mNumReads(0),
+          mNumBytesRead(0) {
+    }
+
+    virtual status_t initCheck() const {
+        return mSource->initCheck();
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        ssize_t n = mSource->readAt(offset, data, size);
+
+        ++mNumReads;
+        if (n > 0) {
+            mNumBytesRead += n;
+        }
+
+        return n;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        return mSource->getSize(size);
+    }
+
+    virtual uint32_t flags() {
+        return mSource->flags();
+    }
+
+    void reset() {
+        mNumReads = 0;
+        mNumBytesRead = 0;
+    }
+
+    size_t numReads() const {
+        return mNumReads;
+    }
+
+    off64_t numBytesRead() const {
+        return mNumBytesRead;
+    }
+
+protected:
+    virtual ~CountingDataSource() {}
+
+private:
+    sp<DataSource> mSource;
+    size_t mNumReads;
+    off64_t mNumBytesRead;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CountingDataSource);
+};
+
+struct MediaBufferHolder : public RefBase {
+    MediaBufferHolder(MediaBuffer *buffer)
+        : mBuffer(buffer) {
+    }
+
+protected:
+    virtual ~MediaBufferHolder() {
+        mBuffer->release();
+        mBuffer = NULL;
+    }
+
+private:
+    MediaBuffer *mBuffer;
+
+    DISALLOW_EVIL_CONSTRUCTORS(MediaBufferHolder);
+};
+
+struct TrackState {
+    sp<MediaSource> mSource;
+    size_t mMaxBuffersPerRead;
+    int64_t mTimeUs;
+    bool mEOS;
+    size_t mNumAccessUnits;
+    uint64_t mHash;
+};
+
+static uint64_t Hash(const uint8_t *data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// What the decoder makes of an access unit, as far as the source is
+// concerned: it looks at all of it, once.
+static void Consume(TrackState *track, const sp<ABuffer> &accessUnit) {
+    int64_t timeUs;
+    CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
+
+    track->mTimeUs = timeUs;
+    track->mHash = Hash(accessUnit->data(), accessUnit->size(), track->mHash);
+    track->mHash = Hash((const uint8_t *)&timeUs, sizeof(timeUs), track->mHash);
+    ++track->mNumAccessUnits;
+}
+
+static void ReadOneAtATime(TrackState *track) {
+    for (size_t n = 0; n < track->mMaxBuffersPerRead; ++n) {
+        MediaBuffer *mbuf;
+        status_t err = track->mSource->read(&mbuf);
+        if (err != OK) {
+            track->mEOS = true;
+            return;
+        }
+
+        sp<ABuffer> accessUnit = new ABuffer(mbuf->range_length());
+        memcpy(accessUnit->data(),
+               (const uint8_t *)mbuf->data() + mbuf->range_offset(),
+               mbuf->range_length());
+
+        int64_t timeUs;
+        CHECK(mbuf->meta_data()->findInt64(kKeyTime, &timeUs));
+        accessUnit->meta()->setInt64("timeUs", timeUs);
+
+        mbuf->release();
+        mbuf = NULL;
+
+        Consume(track, accessUnit);
+    }
+}
+
+static void ReadMultiple(TrackState *track) {
+    Vector<MediaBuffer *> mediaBuffers;
+    size_t n = 0;
+    while (n < track->mMaxBuffersPerRead) {
+        status_t err = track->mSource->readMultiple(
+                &mediaBuffers, track->mMaxBuffersPerRead - n);
+        if (err != OK) {
+            track->mEOS = true;
+            return;
+        }
+
+        // Like the packet queue, hold on to all of them before consuming.
+        Vector<sp<ABuffer> > accessUnits;
+        for (size_t i = 0; i < mediaBuffers.size(); ++i) {
+            MediaBuffer *mbuf = mediaBuffers[i];
+
+            sp<ABuffer> accessUnit = new ABuffer(
+                    (uint8_t *)mbuf->data() + mbuf->range_offset(),
+                    mbuf->range_length());
+
+            int64_t timeUs;
+            CHECK(mbuf->meta_data()->findInt64(kKeyTime, &timeUs));
+            accessUnit->meta()->setInt64("timeUs", timeUs);
+            accessUnit->meta()->setObject(
+                    "mediaBufferHolder", new MediaBufferHolder(mbuf));
+
+            accessUnits.push(accessUnit);
+        }
+        n += mediaBuffers.size();
+        mediaBuffers.clear();
+
+        for (size_t i = 0; i < accessUnits.size(); ++i) {
+            Consume(track, accessUnits[i]);
+        }
+    }
+}
+
+struct Result {
+    int64_t mDurationUs;
+    size_t mNumReads;
+    off64_t mNumBytesRead;
+    Vector<TrackState> mTracks;
+};
+
+static status_t Play(
+        const char *path, bool readMultiple,
+        size_t audioBuffersPerRead, size_t videoBuffersPerRead,
+        Result *result) {
+    sp<CountingDataSource> source =
+        new CountingDataSource(new FileSource(path));
+
+    if (source->initCheck() != OK) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return ERROR_IO;
+    }
+
+    sp<MediaExtractor> extractor = MediaExtractor::Create(source);
+    if (extractor == NULL) {
+        fprintf(stderr, "unable to extract '%s'.\n", path);
+        return ERROR_UNSUPPORTED;
+    }
+
+    Vector<TrackState> tracks;
+    for (size_t i = 0; i < extractor->countTracks(); ++i) {
+        const char *mime;
+        CHECK(extractor->getTrackMetaData(i)->findCString(kKeyMIMEType, &mime));
+
+        TrackState track;
+        if (!strncasecmp(mime, "audio/", 6)) {
+            track.mMaxBuffersPerRead = audioBuffersPerRead;
+        } else if (!strncasecmp(mime, "video/", 6)) {
+            track.mMaxBuffersPerRead = videoBuffersPerRead;
+        } else {
+            continue;
+        }
+
+        track.mSource = extractor->getTrack(i);
+        track.mTimeUs = 0;
+        track.mEOS = false;
+        track.mNumAccessUnits = 0;
+        track.mHash = 14695981039346656037ull;
+
+        CHECK_EQ(track.mSource->start(), (status_t)OK);
+
+        if (readMultiple && !track.mSource->supportReadMultiple()) {
+            fprintf(stderr, "track %zu (%s) doesn't support readMultiple.\n",
+                    i, mime);
+            return ERROR_UNSUPPORTED;
+        }
+
+        tracks.push(track);
+    }
+
+    if (tracks.isEmpty()) {
+        fprintf(stderr, "'%s' has no audio or video.\n", path);
+        return ERROR_UNSUPPORTED;
+    }
+
+    source->reset();
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (;;) {
+        // Feed whichever track is furthest behind, like the renderer
+        // draining both keeps them.
+        ssize_t next = -1;
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            const TrackState &track = tracks[i];
+            if (!track.mEOS && (next < 0 || track.mTimeUs < tracks[next].mTimeUs)) {
+                next = i;
+            }
+        }
+
+        if (next < 0) {
+            break;
+        }
+
+        TrackState *track = &tracks.editItemAt(next);
+        if (readMultiple) {
+            ReadMultiple(track);
+        } else {
+            ReadOneAtATime(track);
+        }
+    }
+    result->mDurationUs = ALooper::GetNowUs() - startUs;
+    result->mNumReads = source->numReads();
+    result->mNumBytesRead = source->numBytesRead();
+
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        CHECK_EQ(tracks.editItemAt(i).mSource->stop(), (status_t)OK);
+        tracks.editItemAt(i).mSource.clear();
+    }
+    result->mTracks = tracks;
+
+    return OK;
+}
+
+static int run(
+        const char *path, size_t audioBuffersPerRead,
+        size_t videoBuffersPerRead, size_t numRuns) {
+    int64_t singleUs = 0;
+    int64_t multipleUs = 0;
+
+    Result single;
+    Result multiple;
+    for (size_t i = 0; i < numRuns; ++i) {
+        if (Play(path, false /* readMultiple */,
+                 audioBuffersPerRead, 1 /* videoBuffersPerRead */,
+                 &single) != OK
+                || Play(path, true /* readMultiple */,
+                        audioBuffersPerRead, videoBuffersPerRead,
+                        &multiple) != OK) {
+            return 1;
+        }
+
+        singleUs += single.mDurationUs;
+        multipleUs += multiple.mDurationUs;
+    }
+
+    CHECK_EQ(single.mTracks.size(), multiple.mTracks.size());
+    for (size_t i = 0; i < single.mTracks.size(); ++i) {
+        CHECK_EQ(single.mTracks[i].mNumAccessUnits,
+                 multiple.mTracks[i].mNumAccessUnits);
+        CHECK_EQ(single.mTracks[i].mHash, multiple.mTracks[i].mHash);
+
+        printf("track %zu: %zu access units\n",
+               i, single.mTracks[i].mNumAccessUnits);
+    }
+
+    printf("read: %.2f ms, %zu reads, %.2f MB\n",
+           singleUs / 1E3 / numRuns, single.mNumReads,
+           single.mNumBytesRead / 1E6);
+    printf("readMultiple: %.2f ms, %zu reads, %.2f MB (%.2fx)\n",
+           multipleUs / 1E3 / numRuns, multiple.mNumReads,
+           multiple.mNumBytesRead / 1E6,
+           multipleUs > 0 ? (double)singleUs / multipleUs : 0.0);
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    // What GenericSource asks for of local files.
+    size_t audioBuffersPerRead = 64;
+    size_t videoBuffersPerRead = 4;
+    size_t numRuns = 5;
+
+    int res;
+    while ((res = getopt(argc, argv, "ha:v:n:")) >= 0) {
+        switch (res) {
+            case 'a':
+            {
+                audioBuffersPerRead = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'v':
+            {
+                videoBuffersPerRead = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'n':
+            {
+                numRuns = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || audioBuffersPerRead == 0 || videoBuffersPerRead == 0
+            || numRuns == 0) {
+        usage(me);
+    }
+
+    DataSource::RegisterDefaultSniffers();
+
+    return run(argv[0], audioBuffersPerRead, videoBuffersPerRead, numRuns);
+}
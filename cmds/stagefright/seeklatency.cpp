@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "seeklatency"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MediaPlayerService.h"
+#include "NuPlayerDriver.h"
+
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <media/AudioSystem.h>
+#include <media/mediaplayer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <ui/DisplayInfo.h>
+#include <utils/Condition.h>
+#include <utils/Vector.h>
+
+// Seeks a paused NuPlayer to random positions of a local clip, the way a
+// scrubbing editor does, and prints how long each seek took until the
+// frame at the new position was up. Long-GOP clips show the cost of
+// precise seeks, which decode from the previous sync frame up to the
+// requested one.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n number of seeks]\n"
+                    "\t\t[-p (precise seeks)]\n"
+                    "\t\t[-c (compare plain and precise seeks)]\n"
+                    "\t\t[-s random seed]\n"
+                    "\t\t[-N (no video surface)]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+struct SeekListener {
+    SeekListener() : mNumSeeksCompleted(0), mError(OK) {}
+
+    static void Notify(
+            void *cookie, int msg, int ext1, int /* ext2 */, const Parcel * /* obj */) {
+        SeekListener *me = (SeekListener *)cookie;
+
+        if (msg != MEDIA_SEEK_COMPLETE && msg != MEDIA_ERROR) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(me->mLock);
+        if (msg == MEDIA_ERROR) {
+            me->mError = ext1;
+        } else {
+            ++me->mNumSeeksCompleted;
+        }
+        me->mCondition.signal();
+    }
+
+    // Waits for the seek complete notifications to number |numSeeks|,
+    // returns false on error or timeout.
+    bool waitFor(size_t numSeeks, int64_t timeoutUs) {
+        Mutex::Autolock autoLock(mLock);
+        int64_t endUs = ALooper::GetNowUs() + timeoutUs;
+        while (mNumSeeksCompleted < numSeeks && mError == OK) {
+            int64_t remainingUs = endUs - ALooper::GetNowUs();
+            if (remainingUs <= 0) {
+                break;
+            }
+            mCondition.waitRelative(mLock, remainingUs * 1000ll);
+        }
+        return mNumSeeksCompleted >= numSeeks && mError == OK;
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    size_t mNumSeeksCompleted;
+    status_t mError;
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(SeekListener);
+};
+
+static int compareInt64(const int64_t *a, const int64_t *b) {
+    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
+}
+
+// Seeks to each of |positionsMs| in turn and prints the latency stats.
+static status_t seekAll(
+        const sp<NuPlayerDriver> &player, SeekListener *listener,
+        const Vector<int> &positionsMs, bool precise) {
+    Parcel request;
+    request.writeInt32(precise);
+    request.setDataPosition(0);
+    CHECK_EQ(player->setParameter(KEY_PARAMETER_PRECISE_SEEK, request), (status_t)OK);
+
+    Vector<int64_t> latenciesUs;
+    int64_t totalUs = 0;
+
+    for (size_t i = 0; i < positionsMs.size(); ++i) {
+        size_t numSeeks;
+        {
+            Mutex::Autolock autoLock(listener->mLock);
+            numSeeks = listener->mNumSeeksCompleted + 1;
+        }
+
+        int64_t startUs = ALooper::GetNowUs();
+        status_t err = player->seekTo(positionsMs[i]);
+        if (err != OK || !listener->waitFor(numSeeks, 10000000ll)) {
+            fprintf(stderr, "seek to %d ms failed.\n", positionsMs[i]);
+            return err != OK ? err : UNKNOWN_ERROR;
+        }
+        int64_t latencyUs = ALooper::GetNowUs() - startUs;
+
+        ALOGV("seek to %d ms took %" PRId64 " us", positionsMs[i], latencyUs);
+
+        latenciesUs.push(latencyUs);
+        totalUs += latencyUs;
+    }
+
+    latenciesUs.sort(compareInt64);
+
+    size_t n = latenciesUs.size();
+    printf("%-7s %zu seeks: mean %.2f ms, median %.2f ms, 90%% %.2f ms, max %.2f ms\n",
+           precise ? "precise" : "plain",
+           n,
+           totalUs / 1E3 / n,
+           latenciesUs[n / 2] / 1E3,
+           latenciesUs[(n * 9) / 10] / 1E3,
+           latenciesUs[n - 1] / 1E3);
+
+    return OK;
+}
+
+static int run(
+        const char *path, size_t numSeeks, bool plain, bool precise, unsigned seed,
+        const sp<IGraphicBufferProducer> &bufferProducer) {
+    int fd = open(path, O_RDONLY | O_LARGEFILE);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0);
+
+    SeekListener listener;
+
+    sp<NuPlayerDriver> player = new NuPlayerDriver;
+    player->setNotifyCallback(&listener, &SeekListener::Notify);
+    player->setAudioSink(new MediaPlayerService::AudioOutput(
+                AudioSystem::newAudioUniqueId(), getuid(), getpid(), NULL));
+
+    status_t err = player->setDataSource(fd, 0, st.st_size);
+    close(fd);
+    fd = -1;
+
+    if (err == OK && bufferProducer != NULL) {
+        err = player->setVideoSurfaceTexture(bufferProducer);
+    }
+    if (err == OK) {
+        err = player->prepare();
+    }
+
+    int durationMs;
+    if (err == OK) {
+        err = player->getDuration(&durationMs);
+    }
+    if (err != OK || durationMs <= 0) {
+        fprintf(stderr, "unable to play '%s' (%d).\n", path, err);
+        return 1;
+    }
+
+    // Same positions for either kind of seek.
+    Vector<int> positionsMs;
+    for (size_t i = 0; i < numSeeks; ++i) {
+        positionsMs.push(rand_r(&seed) % durationMs);
+    }
+
+    CHECK_EQ(player->start(), (status_t)OK);
+    CHECK_EQ(player->pause(), (status_t)OK);
+
+    // Let the decoders get going before timing anything.
+    CHECK_EQ(player->seekTo(0), (status_t)OK);
+    CHECK(listener.waitFor(1, 10000000ll));
+
+    printf("%s: %.2f secs, seeking %zu times\n", path, durationMs / 1E3, numSeeks);
+
+    if (plain) {
+        err = seekAll(player, &listener, positionsMs, false /* precise */);
+    }
+    if (err == OK && precise) {
+        err = seekAll(player, &listener, positionsMs, true /* precise */);
+    }
+
+    player->reset();
+
+    return err == OK ? 0 : 1;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t numSeeks = 50;
+    bool plain = true;
+    bool precise = false;
+    unsigned seed = 1;
+    bool useVideo = true;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:pcs:N")) >= 0) {
+        switch (res) {
+            case 'n':
+            {
+                numSeeks = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'p':
+            {
+                plain = false;
+                precise = true;
+                break;
+            }
+
+            case 'c':
+            {
+                plain = true;
+                precise = true;
+                break;
+            }
+
+            case 's':
+            {
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 'N':
+            {
+                useVideo = false;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || numSeeks == 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> composerClient;
+    sp<SurfaceControl> control;
+    sp<IGraphicBufferProducer> bufferProducer;
+
+    if (useVideo) {
+        composerClient = new SurfaceComposerClient;
+        CHECK_EQ(composerClient->initCheck(), (status_t)OK);
+
+        sp<IBinder> display(SurfaceComposerClient::getBuiltInDisplay(
+                ISurfaceComposer::eDisplayIdMain));
+        DisplayInfo info;
+        SurfaceComposerClient::getDisplayInfo(display, &info);
+
+        control = composerClient->createSurface(
+                String8("seeklatency"), info.w, info.h, PIXEL_FORMAT_RGB_565, 0);
+
+        CHECK(control != NULL);
+        CHECK(control->isValid());
+
+        SurfaceComposerClient::openGlobalTransaction();
+        CHECK_EQ(control->setLayer(INT_MAX), (status_t)OK);
+        CHECK_EQ(control->show(), (status_t)OK);
+        SurfaceComposerClient::closeGlobalTransaction();
+
+        bufferProducer = control->getSurface()->getIGraphicBufferProducer();
+    }
+
+    int result = run(argv[0], numSeeks, plain, precise, seed, bufferProducer);
+
+    if (useVideo) {
+        composerClient->dispose();
+    }
+
+    return result;
+}
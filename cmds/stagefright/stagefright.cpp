@@ -47,6 +47,7 @@
 #include "SineSource.h"
 
 #include <binder/IServiceManager.h>
+#include <cutils/properties.h>
 #include <binder/ProcessState.h>
 #include <media/IMediaHTTPService.h>
 #include <media/IMediaPlayerService.h>
@@ -624,6 +625,8 @@ static void usage(const char *me) {
     fprintf(stderr, "       -k seek test\n");
     fprintf(stderr, "       -x display a histogram of decoding times/fps "
                     "(video only)\n");
+    fprintf(stderr, "       -j number of threads used by software video decoders "
+                    "(0 = one per core)\n");
     fprintf(stderr, "       -S allocate buffers from a surface\n");
     fprintf(stderr, "       -T allocate buffers from a surface texture\n");
     fprintf(stderr, "       -d(ump) output_filename (raw stream data to a file)\n");
@@ -704,7 +707,7 @@ int main(int argc, char **argv) {
     sp<ALooper> looper;
 
     int res;
-    while ((res = getopt(argc, argv, "han:lm:b:ptsrow:kxSTd:D:")) >= 0) {
+    while ((res = getopt(argc, argv, "han:lm:b:ptsrow:kxj:STd:D:")) >= 0) {
         switch (res) {
             case 'a':
             {
@@ -804,6 +807,16 @@ int main(int argc, char **argv) {
                 break;
             }
 
+            case 'j':
+            {
+                // Picked up by the software decoders when they are
+                // instantiated.
+                if (property_set("debug.stagefright.vdec-threads", optarg) != 0) {
+                    fprintf(stderr, "unable to set the decoder thread count.\n");
+                }
+                break;
+            }
+
             case 'S':
             {
                 useSurfaceAlloc = true;
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "startcodescan"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/StartCodeScanner.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+
+// Microbenchmark for the startcode and syncword scanner: walks a large
+// elementary stream from one startcode (or ADTS syncword) to the next, once
+// with the scalar scanner and once with the one selected for this target.
+// Without a file, a synthetic H.264 like stream with NAL units of random
+// size is used.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-a(dts syncwords)]\n"
+                    "\t\t[-s synthetic stream size in MB]\n"
+                    "\t\t[-n number of passes]\n"
+                    "\t\t[file]\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+typedef ssize_t (*ScanFunc)(const uint8_t *data, size_t size, bool adts);
+
+static ssize_t ScanScalar(const uint8_t *data, size_t size, bool adts) {
+    return adts
+        ? FindSyncWordScalar(data, size, 0xf6, 0xf0)
+        : FindStartCodeScalar(data, size);
+}
+
+static ssize_t ScanVector(const uint8_t *data, size_t size, bool adts) {
+    return adts
+        ? FindSyncWord(data, size, 0xf6, 0xf0)
+        : FindStartCode(data, size);
+}
+
+static uint8_t *MakeSyntheticStream(size_t size, bool adts) {
+    uint8_t *data = (uint8_t *)malloc(size);
+    CHECK(data != NULL);
+
+    srand(1);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = rand();
+    }
+
+    // Emulation prevention makes real payloads free of startcodes, do the
+    // same here. ADTS payloads have no such guarantee, leave them alone.
+    for (size_t i = 0; !adts && i + 2 < size; ++i) {
+        if (data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] <= 0x03) {
+            data[i + 2] = 0x03;
+        }
+    }
+
+    // Frames of 64 bytes to 32 KB.
+    size_t offset = 0;
+    while (offset + 8 < size) {
+        if (adts) {
+            data[offset] = 0xff;
+            data[offset + 1] = 0xf1;
+        } else {
+            memcpy(&data[offset], "\x00\x00\x00\x01", 4);
+        }
+
+        offset += 64 + rand() % (32 * 1024);
+    }
+
+    return data;
+}
+
+static int64_t Scan(
+        ScanFunc func, const uint8_t *data, size_t size, bool adts,
+        size_t *numFound) {
+    int64_t startUs = ALooper::GetNowUs();
+
+    *numFound = 0;
+    size_t offset = 0;
+    for (;;) {
+        ssize_t pos = func(&data[offset], size - offset, adts);
+        if (pos < 0) {
+            break;
+        }
+
+        ++*numFound;
+        offset += pos + 1;
+    }
+
+    return ALooper::GetNowUs() - startUs;
+}
+
+static int run(const char *path, size_t syntheticSize, bool adts, int numPasses) {
+    uint8_t *data;
+    size_t size;
+
+    if (path != NULL) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "unable to open '%s'.\n", path);
+            return 1;
+        }
+
+        struct stat st;
+        CHECK_EQ(fstat(fd, &st), 0);
+        size = st.st_size;
+
+        data = (uint8_t *)malloc(size);
+        CHECK(data != NULL);
+
+        size_t filled = 0;
+        while (filled < size) {
+            ssize_t n = read(fd, data + filled, size - filled);
+            if (n <= 0) {
+                break;
+            }
+            filled += n;
+        }
+        size = filled;
+
+        close(fd);
+        fd = -1;
+    } else {
+        size = syntheticSize;
+        data = MakeSyntheticStream(size, adts);
+    }
+
+    printf("%zu bytes, scanning for %s\n",
+           size, adts ? "ADTS syncwords" : "startcodes");
+
+    for (int pass = 0; pass < numPasses; ++pass) {
+        size_t numScalar, numVector;
+        int64_t scalarUs = Scan(ScanScalar, data, size, adts, &numScalar);
+        int64_t vectorUs = Scan(ScanVector, data, size, adts, &numVector);
+
+        CHECK_EQ(numScalar, numVector);
+
+        printf("pass %d: %zu found, scalar %.2f ms (%.2f MB/sec), "
+               "vector %.2f ms (%.2f MB/sec), %.2fx\n",
+               pass,
+               numVector,
+               scalarUs / 1E3,
+               scalarUs > 0 ? size / 1024.0 / 1024.0 * 1E6 / scalarUs : 0.0,
+               vectorUs / 1E3,
+               vectorUs > 0 ? size / 1024.0 / 1024.0 * 1E6 / vectorUs : 0.0,
+               vectorUs > 0 ? (double)scalarUs / vectorUs : 0.0);
+    }
+
+    free(data);
+    data = NULL;
+
+    return 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    bool adts = false;
+    size_t syntheticSize = 64 * 1024 * 1024;
+    int numPasses = 3;
+
+    int res;
+    while ((res = getopt(argc, argv, "has:n:")) >= 0) {
+        switch (res) {
+            case 'a':
+            {
+                adts = true;
+                break;
+            }
+
+            case 's':
+            {
+                syntheticSize = strtoul(optarg, NULL, 10) * 1024 * 1024;
+                break;
+            }
+
+            case 'n':
+            {
+                numPasses = atoi(optarg);
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 1 || syntheticSize == 0 || numPasses <= 0) {
+        usage(me);
+    }
+
+    return run(argc == 1 ? argv[0] : NULL, syntheticSize, adts, numPasses);
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "thumbstrip"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/StagefrightMetadataRetriever.h"
+
+#include <binder/ProcessState.h>
+#include <media/mediametadataretriever.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaSource.h>
+
+// Benchmark for timeline strip generation: extracts N frames spread evenly
+// over a (long) clip, once a frame at a time through getFrameAtTime the
+// way it used to be done, and once in a batch through getFramesAtTimes,
+// full size and scaled down, checking the full size frames agree.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n number of frames]\n"
+                    "\t\t[-s max width x max height of scaled frames]\n"
+                    "\t\t[-c (closest frames instead of sync frames)]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static void FreeFrames(Vector<VideoFrame *> *frames) {
+    for (size_t i = 0; i < frames->size(); ++i) {
+        delete frames->itemAt(i);
+    }
+    frames->clear();
+}
+
+static int run(
+        const char *path, size_t numFrames, int32_t maxWidth, int32_t maxHeight,
+        int option) {
+    int fd = open(path, O_RDONLY | O_LARGEFILE);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0);
+
+    sp<StagefrightMetadataRetriever> retriever = new StagefrightMetadataRetriever;
+    status_t err = retriever->setDataSource(fd, 0, st.st_size);
+
+    close(fd);
+    fd = -1;
+
+    if (err != OK) {
+        fprintf(stderr, "unable to extract '%s' (%d).\n", path, err);
+        return 1;
+    }
+
+    const char *value = retriever->extractMetadata(METADATA_KEY_DURATION);
+    if (value == NULL) {
+        fprintf(stderr, "'%s' has no duration.\n", path);
+        return 1;
+    }
+    int64_t durationUs = strtoll(value, NULL, 10) * 1000ll;
+
+    // Ask for the times out of order, the way a strip being filled in
+    // from the middle would.
+    Vector<int64_t> timesUs;
+    for (size_t i = 0; i < numFrames; ++i) {
+        size_t slot = (i * 7) % numFrames;
+        timesUs.push(durationUs * (2 * slot + 1) / (2 * numFrames));
+    }
+
+    Vector<VideoFrame *> single;
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < timesUs.size(); ++i) {
+        single.push(retriever->getFrameAtTime(timesUs[i], option));
+    }
+    int64_t singleUs = ALooper::GetNowUs() - startUs;
+
+    Vector<VideoFrame *> batch;
+    startUs = ALooper::GetNowUs();
+    CHECK_EQ(retriever->getFramesAtTimes(
+                timesUs, option, 0 /* maxWidth */, 0 /* maxHeight */, &batch),
+             (status_t)OK);
+    int64_t batchUs = ALooper::GetNowUs() - startUs;
+
+    Vector<VideoFrame *> scaled;
+    startUs = ALooper::GetNowUs();
+    CHECK_EQ(retriever->getFramesAtTimes(
+                timesUs, option, maxWidth, maxHeight, &scaled),
+             (status_t)OK);
+    int64_t scaledUs = ALooper::GetNowUs() - startUs;
+
+    CHECK_EQ(batch.size(), numFrames);
+    CHECK_EQ(scaled.size(), numFrames);
+
+    size_t numMissing = 0;
+    size_t numDifferent = 0;
+    for (size_t i = 0; i < numFrames; ++i) {
+        const VideoFrame *a = single[i];
+        const VideoFrame *b = batch[i];
+
+        if (a == NULL || b == NULL) {
+            numMissing += (a == NULL) + (b == NULL);
+            continue;
+        }
+
+        if (a->mWidth != b->mWidth || a->mHeight != b->mHeight
+                || memcmp(a->mData, b->mData, a->mSize)) {
+            ++numDifferent;
+        }
+
+        if (scaled[i] != NULL) {
+            CHECK_LE(scaled[i]->mWidth, (uint32_t)maxWidth);
+            CHECK_LE(scaled[i]->mHeight, (uint32_t)maxHeight);
+        }
+    }
+
+    printf("%zu frames of a %.2f sec clip, %s:\n",
+           numFrames, durationUs / 1E6,
+           option == MediaSource::ReadOptions::SEEK_CLOSEST
+                ? "closest frames" : "sync frames");
+
+    printf("getFrameAtTime %.2f ms, getFramesAtTimes %.2f ms (%.2fx), "
+           "scaled to %dx%d %.2f ms (%.2fx)\n",
+           singleUs / 1E3,
+           batchUs / 1E3, batchUs > 0 ? (double)singleUs / batchUs : 0.0,
+           maxWidth, maxHeight,
+           scaledUs / 1E3, scaledUs > 0 ? (double)singleUs / scaledUs : 0.0);
+
+    if (numMissing > 0 || numDifferent > 0) {
+        printf("%zu frames missing, %zu frames differ\n", numMissing, numDifferent);
+    }
+
+    FreeFrames(&scaled);
+    FreeFrames(&batch);
+    FreeFrames(&single);
+
+    return numDifferent > 0 ? 1 : 0;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    size_t numFrames = 20;
+    int32_t maxWidth = 320;
+    int32_t maxHeight = 180;
+    int option = MediaSource::ReadOptions::SEEK_CLOSEST_SYNC;
+
+    int res;
+    while ((res = getopt(argc, argv, "hn:s:c")) >= 0) {
+        switch (res) {
+            case 'n':
+            {
+                numFrames = strtoul(optarg, NULL, 10);
+                break;
+            }
+
+            case 's':
+            {
+                if (sscanf(optarg, "%dx%d", &maxWidth, &maxHeight) != 2) {
+                    usage(me);
+                }
+                break;
+            }
+
+            case 'c':
+            {
+                option = MediaSource::ReadOptions::SEEK_CLOSEST;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || numFrames == 0 || maxWidth <= 0 || maxHeight <= 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    return run(argv[0], numFrames, maxWidth, maxHeight, option);
+}
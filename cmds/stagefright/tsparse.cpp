@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "tsparse"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mpeg2ts/AnotherPacketSource.h"
+#include "mpeg2ts/ATSParser.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+
+// Throughput benchmark for ATSParser: streams a local transport stream file
+// through the parser, either one packet at a time or in bulk, and discards
+// the access units it produces.
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-1(packet at a time)]\n"
+                    "\t\t[-c chunk size in KB]\n"
+                    "\t\tfile\n",
+                    me);
+
+    exit(1);
+}
+
+namespace android {
+
+static const size_t kTSPacketSize = 188;
+
+static size_t DrainSource(
+        const sp<ATSParser> &parser, ATSParser::SourceType type,
+        int64_t *numBytes) {
+    sp<AnotherPacketSource> source =
+        static_cast<AnotherPacketSource *>(parser->getSource(type).get());
+
+    if (source == NULL) {
+        return 0;
+    }
+
+    size_t numAccessUnits = 0;
+
+    sp<ABuffer> accessUnit;
+    status_t finalResult;
+    while (source->hasBufferAvailable(&finalResult)
+            && source->dequeueAccessUnit(&accessUnit) == OK) {
+        ++numAccessUnits;
+        *numBytes += accessUnit->size();
+    }
+
+    return numAccessUnits;
+}
+
+static int parse(const char *path, bool packetAtATime, size_t chunkSize) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open '%s'.\n", path);
+        return 1;
+    }
+
+    // Round down to whole packets.
+    chunkSize -= chunkSize % kTSPacketSize;
+
+    uint8_t *chunk = (uint8_t *)malloc(chunkSize);
+    CHECK(chunk != NULL);
+
+    sp<ATSParser> parser = new ATSParser;
+
+    int64_t numBytes = 0;
+    size_t numAccessUnits = 0;
+    int64_t numAccessUnitBytes = 0;
+    int64_t parseTimeUs = 0;
+    int64_t startUs = ALooper::GetNowUs();
+
+    status_t err = OK;
+    size_t filled = 0;
+    for (;;) {
+        ssize_t n = read(fd, chunk + filled, chunkSize - filled);
+        if (n <= 0) {
+            break;
+        }
+
+        filled += n;
+
+        size_t size = filled - filled % kTSPacketSize;
+
+        int64_t parseStartUs = ALooper::GetNowUs();
+        if (packetAtATime) {
+            for (size_t offset = 0; offset < size; offset += kTSPacketSize) {
+                err = parser->feedTSPacket(chunk + offset, kTSPacketSize);
+                if (err != OK) {
+                    break;
+                }
+            }
+        } else {
+            err = parser->feedTSPackets(chunk, size);
+        }
+        parseTimeUs += ALooper::GetNowUs() - parseStartUs;
+
+        if (err != OK) {
+            fprintf(stderr, "parser returned error %d at offset %" PRId64 ".\n",
+                    err, numBytes);
+            break;
+        }
+
+        numBytes += size;
+
+        memmove(chunk, chunk + size, filled - size);
+        filled -= size;
+
+        numAccessUnits +=
+            DrainSource(parser, ATSParser::VIDEO, &numAccessUnitBytes);
+        numAccessUnits +=
+            DrainSource(parser, ATSParser::AUDIO, &numAccessUnitBytes);
+    }
+
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    printf("%" PRId64 " packets, %zu access units (%" PRId64 " bytes), %s\n",
+           numBytes / (int64_t)kTSPacketSize, numAccessUnits,
+           numAccessUnitBytes,
+           packetAtATime ? "packet at a time" : "bulk");
+
+    printf("parsing: %.2f ms, %.2f MB/sec (total %.2f ms, %.2f MB/sec)\n",
+           parseTimeUs / 1E3,
+           parseTimeUs > 0 ? numBytes / 1024.0 / 1024.0 * 1E6 / parseTimeUs : 0.0,
+           elapsedUs / 1E3,
+           elapsedUs > 0 ? numBytes / 1024.0 / 1024.0 * 1E6 / elapsedUs : 0.0);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        printf("max resident set size: %ld KB\n", usage.ru_maxrss);
+    }
+
+    free(chunk);
+    chunk = NULL;
+
+    close(fd);
+    fd = -1;
+
+    return err == OK ? 0 : 1;
+}
+
+}  // namespace android
+
+int main(int argc, char **argv) {
+    using namespace android;
+
+    const char *me = argv[0];
+
+    bool packetAtATime = false;
+    size_t chunkSize = 1024 * 1024;
+
+    int res;
+    while ((res = getopt(argc, argv, "h1c:")) >= 0) {
+        switch (res) {
+            case '1':
+            {
+                packetAtATime = true;
+                break;
+            }
+
+            case 'c':
+            {
+                chunkSize = strtoul(optarg, NULL, 10) * 1024;
+                break;
+            }
+
+            case '?':
+            case 'h':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || chunkSize < kTSPacketSize) {
+        usage(me);
+    }
+
+    return parse(argv[0], packetAtATime, chunkSize);
+}
@@ -164,7 +164,11 @@ enum media_parameter_keys {
     KEY_PARAMETER_PLAYBACK_RATE_PERMILLE = 1300,                // set only
 
     // Set a Parcel containing the value of a parcelled Java AudioAttribute instance
-    KEY_PARAMETER_AUDIO_ATTRIBUTES = 1400                       // set only
+    KEY_PARAMETER_AUDIO_ATTRIBUTES = 1400,                      // set only
+
+    // Set a Parcel containing a single int, non-zero to have seekTo() render from the
+    // requested position rather than from the sync frame before it.
+    KEY_PARAMETER_PRECISE_SEEK = 1500                           // set only
 };
 
 // Keep INVOKE_ID_* in sync with MediaPlayer.java.
@@ -22,6 +22,7 @@
 #include <utils/List.h>
 #include <utils/Errors.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 #include <pthread.h>
 
 struct dirent;
@@ -80,24 +81,68 @@ struct MediaScanner {
 
     void setLocale(const char *locale);
 
+    // With more than one thread (see "media.scanner.threads"),
+    // processDirectory() traverses the tree and extracts the metadata of
+    // the files in it on a pool of threads. The client is still only called
+    // on the calling thread, and metadata a file was found to have is
+    // replayed to it once it asks for it through processFile().
+    void setNumThreads(size_t numThreads);
+
+    // Remembers modification time and size of the files seen by parallel
+    // scans in |path| (see "media.scanner.cache"), files unchanged since
+    // the last scan are not extracted ahead of time.
+    status_t setScanCacheFile(const char *path);
+
     virtual MediaAlbumArt *extractAlbumArt(int fd) = 0;
 
 protected:
     const char *locale() const;
 
+    // Called on scanner threads to extract the metadata of |path| ahead of
+    // time, defaults to processFile().
+    virtual MediaScanResult extractFile(
+            const char *path, MediaScannerClient &client);
+
+    // Replays metadata extracted ahead of time for |path| to |client|,
+    // returns false if there is none.
+    bool replayExtractedFile(
+            const char *path, MediaScannerClient &client, MediaScanResult *result);
+
 private:
+    struct ParallelScan;
+    friend struct ParallelScan;
+
+    struct ScanCacheEntry {
+        String8 mPath;
+        long long mLastModified;
+        long long mFileSize;
+    };
+
     // current locale (like "ja_JP"), created/destroyed with strdup()/free()
     char *mLocale;
     char *mSkipList;
     int *mSkipIndex;
 
+    size_t mNumThreads;
+    ParallelScan *mParallelScan;
+
+    // sorted by path
+    Vector<ScanCacheEntry> mScanCache;
+    String8 mScanCacheFile;
+
     MediaScanResult doProcessDirectory(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia);
     MediaScanResult doProcessDirectoryEntry(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
             struct dirent* entry, char* fileSpot);
     void loadSkipList();
-    bool shouldSkipDirectory(char *path);
+    bool shouldSkipDirectory(const char *path) const;
+
+    static int CompareScanCacheEntries(const void *a, const void *b);
+    bool isUnchanged(const char *path, long long lastModified, long long fileSize) const;
+    void updateScanCache(const char *root, Vector<ScanCacheEntry> *seen);
+    void loadScanCache();
+    void saveScanCache() const;
 
 
     MediaScanner(const MediaScanner &);
@@ -33,6 +33,8 @@ struct ColorConverter {
 
     bool isValid() const;
 
+    // Scales down if the destination crop rectangle is smaller than the
+    // source's, picking the nearest source pixel for every destination pixel.
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -79,6 +81,9 @@ private:
     status_t convertTIYUV420PackedSemiPlanar(
             const BitmapParams &src, const BitmapParams &dst);
 
+    status_t convertScaled(
+            const BitmapParams &src, const BitmapParams &dst);
+
     ColorConverter(const ColorConverter &);
     ColorConverter &operator=(const ColorConverter &);
 };
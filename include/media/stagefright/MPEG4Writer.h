@@ -22,11 +22,13 @@
 
 #include <media/stagefright/MediaWriter.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 #include <utils/threads.h>
 #include <media/stagefright/ExtendedStats.h>
 
 namespace android {
 
+struct FileWriteBackBuffer;
 class MediaBuffer;
 class MediaSource;
 class MetaData;
@@ -74,6 +76,7 @@ private:
     class Track;
 
     int  mFd;
+    FileWriteBackBuffer *mWriteBackBuffer;  // Of the last recording
     status_t mInitCheck;
     bool mIsRealTimeRecording;
     bool mUse4ByteNalLength;
@@ -89,6 +92,7 @@ private:
     bool  mWriteMoovBoxToMemory;
     off64_t mFreeBoxOffset;
     bool mStreamableFile;
+    bool mFragmented;
     off64_t mEstimatedMoovBoxSize;
     uint32_t mInterleaveDurationUs;
     int32_t mTimeScale;
@@ -111,16 +115,29 @@ private:
     size_t numTracks();
     int64_t estimateMoovBoxSize(int32_t bitRate);
 
+    // What goes into the 'trun' box for a sample of a movie fragment
+    struct SampleInfo {
+        uint32_t mSize;             // Including the NAL length prefix
+        uint32_t mDurationTicks;    // Track timescale based
+        int32_t  mCttsOffsetTicks;  // Track timescale based
+        bool     mIsSync;
+    };
+
     struct Chunk {
         Track               *mTrack;        // Owner
         int64_t             mTimeStampUs;   // Timestamp of the 1st sample
         List<MediaBuffer *> mSamples;       // Sample data
 
+        // Fragmented files only
+        int64_t             mDecodingTimeTicks;  // Of the 1st sample
+        Vector<SampleInfo>  mSampleInfos;        // One per sample
+
         // Convenient constructor
-        Chunk(): mTrack(NULL), mTimeStampUs(0) {}
+        Chunk(): mTrack(NULL), mTimeStampUs(0), mDecodingTimeTicks(0) {}
 
         Chunk(Track *track, int64_t timeUs, List<MediaBuffer *> samples)
-            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples) {
+            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples),
+              mDecodingTimeTicks(0) {
         }
 
     };
@@ -142,6 +159,25 @@ private:
     List<ChunkInfo> mChunkInfos;            // Chunk infos
     Condition       mChunkReadyCondition;   // Signal that chunks are available
 
+    // How long writing out chunks kept the writer thread busy
+    uint32_t        mNumChunksWritten;
+    int64_t         mTotalChunkWriteTimeUs;
+    int64_t         mMaxChunkWriteTimeUs;
+
+    // Fragmented files: the moov box goes out right before the first
+    // fragment, and only the mehd box is fixed up at the end.
+    bool            mInitMoovWritten;
+    uint32_t        mFragmentSequence;      // Of the last moof written
+    off64_t         mMehdOffset;            // Of the fragment duration
+
+    // Sample table data the tracks moved out of memory goes to an
+    // unlinked temporary file, if the recording was given a directory
+    // for one.
+    int             mTableSpillFd;
+    off64_t         mTableSpillSize;
+    bool            mTableSpillFailed;      // Out of space, say
+    Mutex           mTableSpillLock;
+
     // Writer thread handling
     status_t startWriterThread();
     void stopWriterThread();
@@ -161,6 +197,11 @@ private:
     // Actually write the given chunk to the file.
     void writeChunkToFile(Chunk* chunk);
 
+    // Return whether the samples go out in movie fragments: a moof box
+    // followed by an mdat box for every chunk, with the moov box holding
+    // no sample tables.
+    bool isFragmented() const;
+
     // Adjust other track media clock (presumably wall clock)
     // based on audio track media clock with the drift time.
     int64_t mDriftTimeUs;
@@ -181,6 +222,23 @@ private:
     void lock();
     void unlock();
 
+    // Sets up the write-back buffer, if any, the file data from |offset|
+    // on goes through.
+    status_t startWriteBack(MetaData *param, off64_t offset);
+
+    // Rewrites |size| bytes already written at |offset|.
+    void overwrite(off64_t offset, const void *data, size_t size);
+
+    // Creates the file sample table data is spilled to, see
+    // kKeyTempFileDirectory.
+    void startTableSpill(MetaData *param);
+    void stopTableSpill();
+
+    // Appends |size| bytes of sample table data to the spill file.
+    // Returns where they went, or -1 if they could not be spilled.
+    off64_t spillTableData(const void *data, size_t size);
+    void readSpilledTableData(off64_t offset, void *data, size_t size);
+
     // Acquire lock before calling these methods
     off64_t addSample_l(MediaBuffer *buffer);
     off64_t addLengthPrefixedSample_l(MediaBuffer *buffer);
@@ -193,6 +251,8 @@ private:
     void writeCompositionMatrix(int32_t degrees);
     void writeMvhdBox(int64_t durationUs);
     void writeMoovBox(int64_t durationUs);
+    void writeMvexBox();
+    void writeMoofBox(const Chunk &chunk);
     void writeFtypBox(MetaData *param);
     void writeUdtaBox();
     void writeGeoDataBox();
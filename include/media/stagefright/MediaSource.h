@@ -115,6 +115,24 @@ struct MediaSource : public virtual RefBase {
         return ERROR_UNSUPPORTED;
     }
 
+    // Returns up to maxNumBuffers buffers of consecutive samples in one
+    // call, reading adjacent samples with as few reads of the underlying
+    // data as possible. At least one buffer is returned unless the result
+    // is an error, in which case none are. Unlike those returned by read(),
+    // these buffers can be held on to for as long as the caller likes
+    // without holding up the source.
+    // Only supported if supportReadMultiple() returns true.
+    virtual status_t readMultiple(
+            Vector<MediaBuffer *> * /* buffers */,
+            size_t /* maxNumBuffers */,
+            const ReadOptions * /* options */ = NULL) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    virtual bool supportReadMultiple() {
+        return false;
+    }
+
 protected:
     virtual ~MediaSource();
 
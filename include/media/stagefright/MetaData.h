@@ -114,6 +114,20 @@ enum {
     kKey64BitFileOffset   = 'fobt',  // int32_t (bool)
     kKey2ByteNalLength    = '2NAL',  // int32_t (bool)
 
+    // Set this key to author fragmented mp4 files, with a new fragment
+    // starting at the first sync frame past every fragment duration
+    kKeyFragmentDuration  = 'frgd',  // int64_t (usecs)
+
+    // How much of the sample data the writer may buffer before writing
+    // it out, 0 to write it straight to the file; and whether to write it
+    // with direct I/O, bypassing the page cache
+    kKeyWriteBackSize     = 'wbsz',  // int32_t (bytes)
+    kKeyDirectIO          = 'drio',  // int32_t (bool)
+
+    // A directory the writer may keep temporary files in, e.g. sample
+    // tables too large to keep in memory
+    kKeyTempFileDirectory = 'tmpd',  // cstring
+
     // Identify the file output format for authoring
     // Please see <media/mediarecorder.h> for the supported
     // file output formats.
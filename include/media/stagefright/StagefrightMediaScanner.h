@@ -32,6 +32,10 @@ struct StagefrightMediaScanner : public MediaScanner {
 
     virtual MediaAlbumArt *extractAlbumArt(int fd);
 
+protected:
+    virtual MediaScanResult extractFile(
+            const char *path, MediaScannerClient &client);
+
 private:
     StagefrightMediaScanner(const StagefrightMediaScanner &);
     StagefrightMediaScanner &operator=(const StagefrightMediaScanner &);
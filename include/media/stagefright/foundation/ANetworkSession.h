@@ -103,6 +103,7 @@ private:
     int32_t mNextSessionID;
 
     int mPipeFd[2];
+    int mEpollFd;
 
     KeyedVector<int32_t, sp<Session> > mSessions;
 
@@ -125,6 +126,10 @@ private:
     void threadLoop();
     void interrupt();
 
+    // Brings the epoll registration of the session's socket in line with
+    // what it currently wants to read or write.
+    void updateEvents_l(const sp<Session> &session);
+
     static status_t MakeSocketNonBlocking(int s);
 
     DISALLOW_EVIL_CONSTRUCTORS(ANetworkSession);
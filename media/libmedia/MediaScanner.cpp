@@ -16,6 +16,7 @@
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScanner"
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include <utils/Log.h>
 
@@ -23,12 +24,561 @@
 
 #include <sys/stat.h>
 #include <dirent.h>
+#include <stdio.h>
 
 namespace android {
 
+// Parallel scans keep a deque of tasks per thread, directories to traverse
+// and files to extract. Threads work off the back of their own deque and
+// steal from the front of the others' once it runs dry, which spreads the
+// traversal out over the tree. Everything ready to be reported to the
+// client is handed to the calling thread, which passes it on in batches.
+struct MediaScanner::ParallelScan {
+    ParallelScan(MediaScanner *scanner, size_t numThreads);
+    ~ParallelScan();
+
+    MediaScanResult run(const char *path, MediaScannerClient &client);
+
+    bool replay(const char *path, MediaScannerClient &client, MediaScanResult *result);
+
+private:
+    enum {
+        // Bounds the metadata extracted ahead of the client.
+        kMaxReadyFiles = 256,
+    };
+
+    struct Tag {
+        bool mIsMimeType;
+        String8 mName;
+        String8 mValue;
+    };
+
+    struct Entry {
+        String8 mPath;
+        long long mLastModified;
+        long long mFileSize;
+        bool mIsDirectory;
+        bool mNoMedia;
+        bool mExtracted;
+        MediaScanResult mResult;
+        List<Tag> mTags;
+    };
+
+    struct Task {
+        // The file to extract, or NULL to traverse the directory at mPath.
+        Entry *mFile;
+        String8 mPath;
+        bool mNoMedia;
+    };
+
+    struct Worker {
+        ParallelScan *mScan;
+        size_t mIndex;
+        pthread_t mThread;
+        Mutex mLock;
+        List<Task> mTasks;
+    };
+
+    // Records what extractFile() reports, for replay() to pass on.
+    struct RecordingClient : public MediaScannerClient {
+        RecordingClient(Entry *entry)
+            : mEntry(entry) {
+        }
+
+        virtual status_t scanFile(
+                const char * /* path */, long long /* lastModified */,
+                long long /* fileSize */, bool /* isDirectory */,
+                bool /* noMedia */) {
+            return OK;
+        }
+
+        virtual status_t handleStringTag(const char *name, const char *value) {
+            Tag tag;
+            tag.mIsMimeType = false;
+            tag.mName = name;
+            tag.mValue = value;
+            mEntry->mTags.push_back(tag);
+            return OK;
+        }
+
+        virtual status_t setMimeType(const char *mimeType) {
+            Tag tag;
+            tag.mIsMimeType = true;
+            tag.mValue = mimeType;
+            mEntry->mTags.push_back(tag);
+            return OK;
+        }
+
+    private:
+        Entry *mEntry;
+    };
+
+    MediaScanner *mScanner;
+    Vector<Worker *> mWorkers;
+
+    Mutex mLock;
+    Condition mTaskQueued;
+    Condition mReadyChanged;
+    Condition mReadySpace;
+
+    // Tasks sitting in any of the deques.
+    volatile int32_t mNumQueuedTasks;
+
+    // Tasks queued or being worked on, the scan is done once there are
+    // none left.
+    volatile int32_t mNumPendingTasks;
+
+    bool mAborted;
+    List<Entry *> mReady;
+    size_t mNumReadyFiles;
+    Entry *mDelivering;
+
+    static Entry *NewEntry(
+            const String8 &path, const struct stat &statbuf, bool isDirectory,
+            bool noMedia);
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry(Worker *worker);
+
+    void queueTask(Worker *worker, const Task &task);
+    bool dequeueTask(Worker *worker, Task *task);
+    void onTaskDone();
+
+    void traverse(Worker *worker, const Task &task);
+    void extract(Entry *file);
+    void postReady(const List<Entry *> &entries);
+
+    bool isAborted();
+    void abort();
+
+    ParallelScan(const ParallelScan &);
+    ParallelScan &operator=(const ParallelScan &);
+};
+
+MediaScanner::ParallelScan::ParallelScan(MediaScanner *scanner, size_t numThreads)
+    : mScanner(scanner),
+      mNumQueuedTasks(0),
+      mNumPendingTasks(0),
+      mAborted(false),
+      mNumReadyFiles(0),
+      mDelivering(NULL) {
+    for (size_t i = 0; i < numThreads; ++i) {
+        Worker *worker = new Worker;
+        worker->mScan = this;
+        worker->mIndex = i;
+        mWorkers.push(worker);
+    }
+}
+
+MediaScanner::ParallelScan::~ParallelScan() {
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        Worker *worker = mWorkers[i];
+        for (List<Task>::iterator it = worker->mTasks.begin();
+                it != worker->mTasks.end(); ++it) {
+            delete (*it).mFile;
+        }
+        delete worker;
+    }
+
+    for (List<Entry *>::iterator it = mReady.begin(); it != mReady.end(); ++it) {
+        delete *it;
+    }
+}
+
+// static
+MediaScanner::ParallelScan::Entry *MediaScanner::ParallelScan::NewEntry(
+        const String8 &path, const struct stat &statbuf, bool isDirectory,
+        bool noMedia) {
+    Entry *entry = new Entry;
+    entry->mPath = path;
+    entry->mLastModified = statbuf.st_mtime;
+    entry->mFileSize = isDirectory ? 0 : statbuf.st_size;
+    entry->mIsDirectory = isDirectory;
+    entry->mNoMedia = noMedia;
+    entry->mExtracted = false;
+    entry->mResult = MEDIA_SCAN_RESULT_SKIPPED;
+    return entry;
+}
+
+MediaScanResult MediaScanner::ParallelScan::run(
+        const char *path, MediaScannerClient &client) {
+    Task root;
+    root.mFile = NULL;
+    root.mPath = path;
+    root.mNoMedia = false;
+    queueTask(mWorkers[0], root);
+
+    size_t numThreads = 0;
+    for (; numThreads < mWorkers.size(); ++numThreads) {
+        if (pthread_create(&mWorkers[numThreads]->mThread, NULL,
+                    ThreadWrapper, mWorkers[numThreads]) != 0) {
+            break;
+        }
+    }
+
+    MediaScanResult result =
+        numThreads > 0 ? MEDIA_SCAN_RESULT_OK : MEDIA_SCAN_RESULT_ERROR;
+
+    Vector<ScanCacheEntry> seen;
+    while (result != MEDIA_SCAN_RESULT_ERROR) {
+        List<Entry *> batch;
+
+        {
+            Mutex::Autolock autoLock(mLock);
+            while (mReady.empty()
+                    && android_atomic_acquire_load(&mNumPendingTasks) > 0) {
+                mReadyChanged.wait(mLock);
+            }
+
+            if (mReady.empty()) {
+                break;
+            }
+
+            batch = mReady;
+            mReady.clear();
+        }
+
+        size_t numExtracted = 0;
+        for (List<Entry *>::iterator it = batch.begin(); it != batch.end(); ++it) {
+            Entry *entry = *it;
+
+            if (result != MEDIA_SCAN_RESULT_ERROR) {
+                {
+                    Mutex::Autolock autoLock(mLock);
+                    mDelivering = entry;
+                }
+
+                status_t status = client.scanFile(
+                        entry->mPath.string(), entry->mLastModified,
+                        entry->mFileSize, entry->mIsDirectory, entry->mNoMedia);
+
+                {
+                    Mutex::Autolock autoLock(mLock);
+                    mDelivering = NULL;
+                }
+
+                if (status) {
+                    result = MEDIA_SCAN_RESULT_ERROR;
+                } else if (!entry->mIsDirectory) {
+                    ScanCacheEntry cacheEntry;
+                    cacheEntry.mPath = entry->mPath;
+                    cacheEntry.mLastModified = entry->mLastModified;
+                    cacheEntry.mFileSize = entry->mFileSize;
+                    seen.push(cacheEntry);
+                }
+            }
+
+            if (entry->mExtracted) {
+                ++numExtracted;
+            }
+            delete entry;
+        }
+
+        if (numExtracted > 0) {
+            Mutex::Autolock autoLock(mLock);
+            mNumReadyFiles -= numExtracted;
+            mReadySpace.broadcast();
+        }
+    }
+
+    if (result == MEDIA_SCAN_RESULT_ERROR) {
+        abort();
+    }
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        pthread_join(mWorkers[i]->mThread, NULL);
+    }
+
+    if (result != MEDIA_SCAN_RESULT_ERROR) {
+        mScanner->updateScanCache(path, &seen);
+    }
+
+    return result;
+}
+
+bool MediaScanner::ParallelScan::replay(
+        const char *path, MediaScannerClient &client, MediaScanResult *result) {
+    Entry *entry;
+    {
+        Mutex::Autolock autoLock(mLock);
+        entry = mDelivering;
+    }
+
+    // Only the calling thread delivers and frees entries, this is called
+    // from within its scanFile() callback.
+    if (entry == NULL || !entry->mExtracted || strcmp(entry->mPath.string(), path)) {
+        return false;
+    }
+
+    for (List<Tag>::iterator it = entry->mTags.begin();
+            it != entry->mTags.end(); ++it) {
+        const Tag &tag = *it;
+        status_t status = tag.mIsMimeType
+            ? client.setMimeType(tag.mValue.string())
+            : client.addStringTag(tag.mName.string(), tag.mValue.string());
+
+        if (status != OK) {
+            *result = MEDIA_SCAN_RESULT_ERROR;
+            return true;
+        }
+    }
+
+    *result = entry->mResult;
+    return true;
+}
+
+// static
+void *MediaScanner::ParallelScan::ThreadWrapper(void *me) {
+    Worker *worker = static_cast<Worker *>(me);
+    worker->mScan->threadEntry(worker);
+    return NULL;
+}
+
+void MediaScanner::ParallelScan::threadEntry(Worker *worker) {
+    Task task;
+    while (!isAborted() && dequeueTask(worker, &task)) {
+        if (task.mFile != NULL) {
+            extract(task.mFile);
+        } else {
+            traverse(worker, task);
+        }
+
+        onTaskDone();
+    }
+}
+
+void MediaScanner::ParallelScan::queueTask(Worker *worker, const Task &task) {
+    // Counted as pending before anyone can steal it, the task being worked
+    // on by the caller keeps the count from dropping to zero meanwhile.
+    android_atomic_inc(&mNumPendingTasks);
+
+    {
+        Mutex::Autolock autoLock(worker->mLock);
+        worker->mTasks.push_back(task);
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    android_atomic_inc(&mNumQueuedTasks);
+    mTaskQueued.signal();
+}
+
+bool MediaScanner::ParallelScan::dequeueTask(Worker *worker, Task *task) {
+    for (;;) {
+        {
+            Mutex::Autolock autoLock(worker->mLock);
+            if (!worker->mTasks.empty()) {
+                List<Task>::iterator it = --worker->mTasks.end();
+                *task = *it;
+                worker->mTasks.erase(it);
+                android_atomic_dec(&mNumQueuedTasks);
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < mWorkers.size(); ++i) {
+            Worker *victim = mWorkers[(worker->mIndex + i) % mWorkers.size()];
+
+            Mutex::Autolock autoLock(victim->mLock);
+            if (!victim->mTasks.empty()) {
+                *task = *victim->mTasks.begin();
+                victim->mTasks.erase(victim->mTasks.begin());
+                android_atomic_dec(&mNumQueuedTasks);
+                return true;
+            }
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        while (android_atomic_acquire_load(&mNumQueuedTasks) <= 0
+                && android_atomic_acquire_load(&mNumPendingTasks) > 0
+                && !mAborted) {
+            mTaskQueued.wait(mLock);
+        }
+
+        if (mAborted || android_atomic_acquire_load(&mNumPendingTasks) == 0) {
+            return false;
+        }
+    }
+}
+
+void MediaScanner::ParallelScan::onTaskDone() {
+    if (android_atomic_dec(&mNumPendingTasks) == 1) {
+        Mutex::Autolock autoLock(mLock);
+        mTaskQueued.broadcast();
+        mReadyChanged.signal();
+    }
+}
+
+void MediaScanner::ParallelScan::traverse(Worker *worker, const Task &task) {
+    const char *path = task.mPath.string();
+
+    if (mScanner->shouldSkipDirectory(path)) {
+        ALOGD("Skipping: %s", path);
+        return;
+    }
+
+    // Treat all files as non-media in directories that contain a  ".nomedia" file
+    bool noMedia = task.mNoMedia;
+    String8 noMediaPath(task.mPath);
+    noMediaPath.append(".nomedia");
+    if (access(noMediaPath.string(), F_OK) == 0) {
+        ALOGV("found .nomedia, setting noMedia flag");
+        noMedia = true;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        ALOGW("Error opening directory '%s', skipping: %s.", path, strerror(errno));
+        return;
+    }
+
+    // Directories are reported before anything in them, their tasks are
+    // only queued once they have been.
+    List<Entry *> entries;
+    List<Task> directories;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        const char* name = entry->d_name;
+
+        // ignore "." and ".."
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
+        }
+
+        if (task.mPath.length() + strlen(name) + 1 > PATH_MAX) {
+            // path too long!
+            continue;
+        }
+
+        String8 childPath(task.mPath);
+        childPath.append(name);
+
+        struct stat statbuf;
+        bool haveStat = false;
+
+        int type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            if (stat(childPath.string(), &statbuf) == 0) {
+                haveStat = true;
+                if (S_ISREG(statbuf.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(statbuf.st_mode)) {
+                    type = DT_DIR;
+                }
+            } else {
+                ALOGD("stat() failed for %s: %s", childPath.string(), strerror(errno));
+            }
+        }
+
+        if (type == DT_DIR) {
+            bool childNoMedia = noMedia || name[0] == '.';
+
+            if (haveStat || stat(childPath.string(), &statbuf) == 0) {
+                entries.push_back(NewEntry(childPath, statbuf, true, childNoMedia));
+            }
+
+            Task child;
+            child.mFile = NULL;
+            child.mPath = childPath;
+            child.mPath.append("/");
+            child.mNoMedia = childNoMedia;
+            directories.push_back(child);
+        } else if (type == DT_REG) {
+            if (!haveStat && stat(childPath.string(), &statbuf) != 0) {
+                memset(&statbuf, 0, sizeof(statbuf));
+            }
+
+            Entry *file = NewEntry(childPath, statbuf, false, noMedia);
+
+            if (!noMedia && !mScanner->isUnchanged(
+                        file->mPath.string(), file->mLastModified, file->mFileSize)) {
+                Task extractTask;
+                extractTask.mFile = file;
+                extractTask.mNoMedia = noMedia;
+                queueTask(worker, extractTask);
+            } else {
+                entries.push_back(file);
+            }
+        }
+    }
+    closedir(dir);
+
+    postReady(entries);
+
+    for (List<Task>::iterator it = directories.begin(); it != directories.end(); ++it) {
+        queueTask(worker, *it);
+    }
+}
+
+void MediaScanner::ParallelScan::extract(Entry *file) {
+    {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumReadyFiles >= kMaxReadyFiles && !mAborted) {
+            mReadySpace.wait(mLock);
+        }
+
+        if (mAborted) {
+            delete file;
+            return;
+        }
+
+        ++mNumReadyFiles;
+    }
+
+    RecordingClient recorder(file);
+    recorder.setLocale(mScanner->locale());
+    file->mResult = mScanner->extractFile(file->mPath.string(), recorder);
+    file->mExtracted = true;
+
+    List<Entry *> entries;
+    entries.push_back(file);
+    postReady(entries);
+}
+
+void MediaScanner::ParallelScan::postReady(const List<Entry *> &entries) {
+    if (entries.empty()) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    for (List<Entry *>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (mAborted) {
+            delete *it;
+        } else {
+            mReady.push_back(*it);
+        }
+    }
+
+    mReadyChanged.signal();
+}
+
+bool MediaScanner::ParallelScan::isAborted() {
+    Mutex::Autolock autoLock(mLock);
+    return mAborted;
+}
+
+void MediaScanner::ParallelScan::abort() {
+    Mutex::Autolock autoLock(mLock);
+    mAborted = true;
+    mTaskQueued.broadcast();
+    mReadySpace.broadcast();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 MediaScanner::MediaScanner()
-    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL) {
+    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL),
+      mNumThreads(1), mParallelScan(NULL) {
     loadSkipList();
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.scanner.threads", value, NULL) > 0) {
+        setNumThreads(strtoul(value, NULL, 10));
+    }
+
+    if (property_get("media.scanner.cache", value, NULL) > 0) {
+        setScanCacheFile(value);
+    }
 }
 
 MediaScanner::~MediaScanner() {
@@ -51,6 +601,193 @@ const char *MediaScanner::locale() const {
     return mLocale;
 }
 
+void MediaScanner::setNumThreads(size_t numThreads) {
+    static const size_t kMaxNumThreads = 16;
+
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > kMaxNumThreads) {
+        numThreads = kMaxNumThreads;
+    }
+
+    mNumThreads = numThreads;
+}
+
+status_t MediaScanner::setScanCacheFile(const char *path) {
+    mScanCacheFile.setTo(path != NULL ? path : "");
+    mScanCache.clear();
+
+    if (mScanCacheFile.isEmpty()) {
+        return OK;
+    }
+
+    if (access(path, F_OK) != 0) {
+        // Nothing scanned yet.
+        return errno == ENOENT ? OK : -errno;
+    }
+
+    loadScanCache();
+    return OK;
+}
+
+MediaScanResult MediaScanner::extractFile(
+        const char *path, MediaScannerClient &client) {
+    return processFile(path, NULL /* mimeType */, client);
+}
+
+bool MediaScanner::replayExtractedFile(
+        const char *path, MediaScannerClient &client, MediaScanResult *result) {
+    if (mParallelScan == NULL) {
+        return false;
+    }
+
+    return mParallelScan->replay(path, client, result);
+}
+
+// static
+int MediaScanner::CompareScanCacheEntries(const void *a, const void *b) {
+    return strcmp(static_cast<const ScanCacheEntry *>(a)->mPath.string(),
+                  static_cast<const ScanCacheEntry *>(b)->mPath.string());
+}
+
+bool MediaScanner::isUnchanged(
+        const char *path, long long lastModified, long long fileSize) const {
+    ssize_t lo = 0;
+    ssize_t hi = (ssize_t)mScanCache.size() - 1;
+    while (lo <= hi) {
+        ssize_t mid = lo + (hi - lo) / 2;
+        const ScanCacheEntry &entry = mScanCache.itemAt(mid);
+
+        int res = strcmp(entry.mPath.string(), path);
+        if (res == 0) {
+            return entry.mLastModified == lastModified
+                && entry.mFileSize == fileSize;
+        } else if (res < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return false;
+}
+
+void MediaScanner::updateScanCache(const char *root, Vector<ScanCacheEntry> *seen) {
+    // String8 is safe to move around bytewise.
+    qsort(seen->editArray(), seen->size(), sizeof(ScanCacheEntry),
+          CompareScanCacheEntries);
+
+    // Whatever was remembered for |root| is superseded by what was seen in
+    // it this time around, including files that are gone now.
+    size_t rootLength = strlen(root);
+
+    Vector<ScanCacheEntry> merged;
+    merged.setCapacity(mScanCache.size() + seen->size());
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < mScanCache.size() || j < seen->size()) {
+        if (i < mScanCache.size()
+                && !strncmp(mScanCache[i].mPath.string(), root, rootLength)) {
+            ++i;
+        } else if (j == seen->size()
+                || (i < mScanCache.size()
+                    && CompareScanCacheEntries(&mScanCache[i], &seen->itemAt(j)) < 0)) {
+            merged.push(mScanCache[i++]);
+        } else {
+            merged.push(seen->itemAt(j++));
+        }
+    }
+
+    mScanCache = merged;
+
+    if (!mScanCacheFile.isEmpty()) {
+        saveScanCache();
+    }
+}
+
+void MediaScanner::loadScanCache() {
+    FILE *file = fopen(mScanCacheFile.string(), "r");
+    if (file == NULL) {
+        ALOGW("Error opening scan cache '%s': %s.",
+              mScanCacheFile.string(), strerror(errno));
+        return;
+    }
+
+    static const size_t kMaxLineLength = PATH_MAX + 64;
+    char *line = (char *)malloc(kMaxLineLength);
+
+    // One "<last modified> <file size> <path>" line per file, in order.
+    while (line != NULL && fgets(line, kMaxLineLength, file) != NULL) {
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            break;
+        }
+        line[length - 1] = '\0';
+
+        ScanCacheEntry entry;
+        int pathOffset = 0;
+        if (sscanf(line, "%lld %lld %n",
+                   &entry.mLastModified, &entry.mFileSize, &pathOffset) != 2
+                || pathOffset == 0 || line[pathOffset] != '/') {
+            break;
+        }
+        entry.mPath.setTo(&line[pathOffset]);
+
+        if (!mScanCache.isEmpty()
+                && CompareScanCacheEntries(&mScanCache.top(), &entry) >= 0) {
+            break;
+        }
+
+        mScanCache.push(entry);
+    }
+
+    if (line == NULL || !feof(file)) {
+        ALOGW("Scan cache '%s' is corrupt, ignoring it.", mScanCacheFile.string());
+        mScanCache.clear();
+    }
+
+    free(line);
+    line = NULL;
+
+    fclose(file);
+    file = NULL;
+}
+
+void MediaScanner::saveScanCache() const {
+    String8 tmpPath(mScanCacheFile);
+    tmpPath.append(".tmp");
+
+    FILE *file = fopen(tmpPath.string(), "w");
+    if (file == NULL) {
+        ALOGW("Error creating scan cache '%s': %s.", tmpPath.string(), strerror(errno));
+        return;
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < mScanCache.size() && !failed; ++i) {
+        const ScanCacheEntry &entry = mScanCache.itemAt(i);
+        if (strchr(entry.mPath.string(), '\n') != NULL) {
+            continue;
+        }
+
+        failed = fprintf(file, "%lld %lld %s\n",
+                         entry.mLastModified, entry.mFileSize,
+                         entry.mPath.string()) < 0;
+    }
+
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = NULL;
+
+    if (failed || rename(tmpPath.string(), mScanCacheFile.string()) != 0) {
+        ALOGW("Error writing scan cache '%s': %s.",
+              mScanCacheFile.string(), strerror(errno));
+        unlink(tmpPath.string());
+    }
+}
+
 void MediaScanner::loadSkipList() {
     mSkipList = (char *)malloc(PROPERTY_VALUE_MAX * sizeof(char));
     if (mSkipList) {
@@ -99,14 +836,22 @@ MediaScanResult MediaScanner::processDirectory(
 
     client.setLocale(locale());
 
-    MediaScanResult result = doProcessDirectory(pathBuffer, pathRemaining, client, false);
+    MediaScanResult result;
+    if (mNumThreads > 1) {
+        ParallelScan scan(this, mNumThreads);
+        mParallelScan = &scan;
+        result = scan.run(pathBuffer, client);
+        mParallelScan = NULL;
+    } else {
+        result = doProcessDirectory(pathBuffer, pathRemaining, client, false);
+    }
 
     free(pathBuffer);
 
     return result;
 }
 
-bool MediaScanner::shouldSkipDirectory(char *path) {
+bool MediaScanner::shouldSkipDirectory(const char *path) const {
     if (path && mSkipList && mSkipIndex) {
         int len = strlen(path);
         int idx = 0;
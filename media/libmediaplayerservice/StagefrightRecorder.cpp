@@ -506,6 +506,21 @@ status_t StagefrightRecorder::setParamInterleaveDuration(int32_t durationUs) {
     return OK;
 }
 
+status_t StagefrightRecorder::setParamFragmentDuration(int32_t durationUs) {
+    ALOGV("setParamFragmentDuration: %d", durationUs);
+    if (durationUs < 500000) {            //  500 ms
+        // Each fragment carries its own moof, too many of them waste space
+        ALOGE("Fragment duration is too small: %d us", durationUs);
+        return BAD_VALUE;
+    } else if (durationUs > 10000000) {   // 10 seconds
+        // Each fragment is held in memory until it is written out
+        ALOGE("Fragment duration is too large: %d us", durationUs);
+        return BAD_VALUE;
+    }
+    mFragmentDurationUs = durationUs;
+    return OK;
+}
+
 // If seconds <  0, only the first frame is I frame, and rest are all P frames
 // If seconds == 0, all frames are encoded as I frames. No P frames
 // If seconds >  0, it is the time spacing (seconds) between 2 neighboring I frames
@@ -661,6 +676,11 @@ status_t StagefrightRecorder::setParameter(
         if (safe_strtoi32(value.string(), &durationUs)) {
             return setParamInterleaveDuration(durationUs);
         }
+    } else if (key == "param-fragment-duration-us") {
+        int32_t durationUs;
+        if (safe_strtoi32(value.string(), &durationUs)) {
+            return setParamFragmentDuration(durationUs);
+        }
     } else if (key == "param-movie-time-scale") {
         int32_t timeScale;
         if (safe_strtoi32(value.string(), &timeScale)) {
@@ -1883,6 +1903,9 @@ void StagefrightRecorder::setupMPEG4orWEBMMetaData(sp<MetaData> *meta) {
         if (mRotationDegrees != 0) {
             (*meta)->setInt32(kKeyRotation, mRotationDegrees);
         }
+        if (mFragmentDurationUs > 0) {
+            (*meta)->setInt64(kKeyFragmentDuration, mFragmentDurationUs);
+        }
     }
 }
 
@@ -2013,6 +2036,7 @@ status_t StagefrightRecorder::reset() {
     mAudioChannels = 0;
     mAudioBitRate  = 0;
     mInterleaveDurationUs = 0;
+    mFragmentDurationUs = 0;
     mIFramesIntervalSec = 1;
     mAudioSourceNode = 0;
     mUse64BitFileOffset = false;
@@ -2083,6 +2107,8 @@ status_t StagefrightRecorder::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     Interleave duration (us): %d\n", mInterleaveDurationUs);
     result.append(buffer);
+    snprintf(buffer, SIZE, "     Fragment duration (us): %d\n", mFragmentDurationUs);
+    result.append(buffer);
     snprintf(buffer, SIZE, "     Progress notification: %" PRId64 " us\n", mTrackEveryTimeDurationUs);
     result.append(buffer);
     snprintf(buffer, SIZE, "   Audio\n");
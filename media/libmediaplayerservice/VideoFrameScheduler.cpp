@@ -69,6 +69,7 @@ VideoFrameScheduler::PLL::PLL()
       mPrimed(false),
       mSamplesUsedForPriming(0),
       mLastTime(-1),
+      mFitError(-1),
       mNumSamples(0) {
 }
 
@@ -298,6 +299,7 @@ nsecs_t VideoFrameScheduler::PLL::addSample(nsecs_t time) {
             }
 
             mRefitAt = time + kRefitRefreshPeriod;
+            mFitError = err < 0 ? 0 : err;
 
             mPhase += (mPeriod * b) >> kPrecision;
             mPeriod = (mPeriod * a) >> kPrecision;
@@ -316,6 +318,15 @@ nsecs_t VideoFrameScheduler::PLL::addSample(nsecs_t time) {
     return mPeriod;
 }
 
+int64_t VideoFrameScheduler::PLL::takeFitError() {
+    if (mFitError < 0) {
+        return -1;
+    }
+    int64_t errorPermille = (mFitError * 1000) >> (kPrecision * 2);
+    mFitError = -1;
+    return errorPermille;
+}
+
 /* ======================================================================= */
 /*                             Frame Scheduler                             */
 /* ======================================================================= */
@@ -382,6 +393,10 @@ nsecs_t VideoFrameScheduler::getVsyncPeriod() {
     return kDefaultVsyncPeriod;
 }
 
+int64_t VideoFrameScheduler::takePLLFitError() {
+    return mPll.takeFitError();
+}
+
 nsecs_t VideoFrameScheduler::schedule(nsecs_t renderTime) {
     nsecs_t origRenderTime = renderTime;
 
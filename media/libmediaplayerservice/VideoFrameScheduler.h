@@ -39,6 +39,10 @@ struct VideoFrameScheduler : public RefBase {
     // returns the vsync period for the main display
     nsecs_t getVsyncPeriod();
 
+    // returns the residual of the last PLL fit in 1/1000ths, if the PLL
+    // refit since the last call, or -1.
+    int64_t takePLLFitError();
+
     void release();
 
     static const size_t kHistorySize = 8;
@@ -56,6 +60,8 @@ private:
         void restart();
         // returns period
         nsecs_t addSample(nsecs_t time);
+        // returns residual of last fit in 1/1000ths, or -1 if already taken
+        int64_t takeFitError();
 
     private:
         nsecs_t mPeriod;
@@ -66,6 +72,7 @@ private:
 
         nsecs_t mLastTime;      // last input time
         nsecs_t mRefitAt;       // next input time to fit at
+        int64_t mFitError;      // residual of last fit, or -1 if taken
 
         size_t  mNumSamples;    // can go past kHistorySize
         nsecs_t mTimes[kHistorySize];
@@ -12,6 +12,7 @@ LOCAL_SRC_FILES:=                       \
         NuPlayerDriver.cpp              \
         NuPlayerRenderer.cpp            \
         NuPlayerStreamListener.cpp      \
+        RenderStats.cpp                 \
         RTSPSource.cpp                  \
         StreamingSource.cpp             \
 
@@ -46,6 +46,28 @@ static int64_t kHighWaterMarkUs = 5000000ll;  // 5secs
 static const ssize_t kLowWaterMarkBytes = 40000;
 static const ssize_t kHighWaterMarkBytes = 200000;
 
+// How many video access units to read at a time from local sources that
+// read adjacent samples together.
+static const size_t kMaxLocalVideoBuffersPerRead = 4;
+
+// Keeps a MediaBuffer handed on as an ABuffer alive until it is done with.
+struct MediaBufferHolder : public RefBase {
+    MediaBufferHolder(MediaBuffer *buffer)
+        : mBuffer(buffer) {
+    }
+
+protected:
+    virtual ~MediaBufferHolder() {
+        mBuffer->release();
+        mBuffer = NULL;
+    }
+
+private:
+    MediaBuffer *mBuffer;
+
+    DISALLOW_EVIL_CONSTRUCTORS(MediaBufferHolder);
+};
+
 NuPlayer::GenericSource::GenericSource(
         const sp<AMessage> &notify,
         bool uidValid,
@@ -1387,9 +1409,10 @@ status_t NuPlayer::GenericSource::doSelectTrack(size_t trackIndex, bool select,
     return INVALID_OPERATION;
 }
 
-status_t NuPlayer::GenericSource::seekTo(int64_t seekTimeUs) {
+status_t NuPlayer::GenericSource::seekTo(int64_t seekTimeUs, bool precise) {
     sp<AMessage> msg = new AMessage(kWhatSeek, id());
     msg->setInt64("seekTimeUs", seekTimeUs);
+    msg->setInt32("precise", precise);
 
     sp<AMessage> response;
     status_t err = msg->postAndAwaitResponse(&response);
@@ -1402,10 +1425,12 @@ status_t NuPlayer::GenericSource::seekTo(int64_t seekTimeUs) {
 
 void NuPlayer::GenericSource::onSeek(sp<AMessage> msg) {
     int64_t seekTimeUs;
+    int32_t precise;
     CHECK(msg->findInt64("seekTimeUs", &seekTimeUs));
+    CHECK(msg->findInt32("precise", &precise));
 
     sp<AMessage> response = new AMessage;
-    status_t err = doSeek(seekTimeUs);
+    status_t err = doSeek(seekTimeUs, precise);
     response->setInt32("err", err);
 
     uint32_t replyID;
@@ -1413,22 +1438,32 @@ void NuPlayer::GenericSource::onSeek(sp<AMessage> msg) {
     response->postReply(replyID);
 }
 
-status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs) {
+status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs, bool precise) {
     // If the Widevine source is stopped, do not attempt to read any
     // more buffers.
     if (mStopRead) {
         return INVALID_OPERATION;
     }
+
+    // Decoding from the previous sync sample is only worth it if the
+    // decoders don't have to go through protected content to get there.
+    precise = precise && !mIsSecure && !mIsWidevine;
+
     if (mVideoTrack.mSource != NULL) {
         int64_t actualTimeUs;
-        readBuffer(MEDIA_TRACK_TYPE_VIDEO, seekTimeUs, &actualTimeUs);
+        readBuffer(MEDIA_TRACK_TYPE_VIDEO, seekTimeUs, &actualTimeUs,
+                false /* formatChange */, precise);
 
-        seekTimeUs = actualTimeUs;
-        mVideoLastDequeueTimeUs = seekTimeUs;
+        if (!precise) {
+            // audio starts where video does.
+            seekTimeUs = actualTimeUs;
+        }
+        mVideoLastDequeueTimeUs = actualTimeUs;
     }
 
     if (mAudioTrack.mSource != NULL) {
-        readBuffer(MEDIA_TRACK_TYPE_AUDIO, seekTimeUs);
+        readBuffer(MEDIA_TRACK_TYPE_AUDIO, seekTimeUs, NULL /* actualTimeUs */,
+                false /* formatChange */, precise);
         mAudioLastDequeueTimeUs = seekTimeUs;
     }
 
@@ -1449,8 +1484,9 @@ status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs) {
 sp<ABuffer> NuPlayer::GenericSource::mediaBufferToABuffer(
         MediaBuffer* mb,
         media_track_type trackType,
-        int64_t /* seekTimeUs */,
-        int64_t *actualTimeUs) {
+        int64_t resumeAtMediaTimeUs,
+        int64_t *actualTimeUs,
+        bool canHoldBuffer) {
     bool audio = trackType == MEDIA_TRACK_TYPE_AUDIO;
     size_t outLength = mb->range_length();
 
@@ -1459,11 +1495,19 @@ sp<ABuffer> NuPlayer::GenericSource::mediaBufferToABuffer(
     }
 
     sp<ABuffer> ab;
+    bool handedOn = false;
     if (mIsSecure && !audio) {
         // data is already provided in the buffer
         ab = new ABuffer(NULL, mb->range_length());
         mb->add_ref();
         ab->setMediaBufferBase(mb);
+    } else if (canHoldBuffer && outLength == mb->range_length()) {
+        // Hand the data on as it is, the buffer is released along with
+        // the ABuffer.
+        ab = new ABuffer(
+                (uint8_t *)mb->data() + mb->range_offset(), mb->range_length());
+        ab->meta()->setObject("mediaBufferHolder", new MediaBufferHolder(mb));
+        handedOn = true;
     } else {
         ab = new ABuffer(outLength);
         memcpy(ab->data(),
@@ -1487,15 +1531,13 @@ sp<ABuffer> NuPlayer::GenericSource::mediaBufferToABuffer(
     CHECK(mb->meta_data()->findInt64(kKeyTime, &timeUs));
     meta->setInt64("timeUs", timeUs);
 
-#if 0
-    // Temporarily disable pre-roll till we have a full solution to handle
-    // both single seek and continous seek gracefully.
-    if (seekTimeUs > timeUs) {
+    // Pre-roll is only done for precise seeks, plain seeks start rendering
+    // at the sync sample, which keeps continuous seeks cheap.
+    if (resumeAtMediaTimeUs > timeUs) {
         sp<AMessage> extra = new AMessage;
-        extra->setInt64("resume-at-mediaTimeUs", seekTimeUs);
+        extra->setInt64("resume-at-mediaTimeUs", resumeAtMediaTimeUs);
         meta->setMessage("extra", extra);
     }
-#endif
 
     if (trackType == MEDIA_TRACK_TYPE_TIMEDTEXT) {
         const char *mime;
@@ -1517,7 +1559,9 @@ sp<ABuffer> NuPlayer::GenericSource::mediaBufferToABuffer(
         *actualTimeUs = timeUs;
     }
 
-    mb->release();
+    if (!handedOn) {
+        mb->release();
+    }
     mb = NULL;
 
     return ab;
@@ -1548,7 +1592,8 @@ void NuPlayer::GenericSource::onReadBuffer(sp<AMessage> msg) {
 }
 
 void NuPlayer::GenericSource::readBuffer(
-        media_track_type trackType, int64_t seekTimeUs, int64_t *actualTimeUs, bool formatChange) {
+        media_track_type trackType, int64_t seekTimeUs, int64_t *actualTimeUs,
+        bool formatChange, bool precise) {
     // Do not read data if Widevine source is stopped
     if (mStopRead) {
         return;
@@ -1602,13 +1647,37 @@ void NuPlayer::GenericSource::readBuffer(
         options.setNonBlocking();
     }
 
+    // Local audio and video are read several access units at a time where
+    // the source can, adjacent samples together, and handed on uncopied.
+    bool readMultiple = (trackType == MEDIA_TRACK_TYPE_AUDIO
+                || trackType == MEDIA_TRACK_TYPE_VIDEO)
+            && !mIsWidevine && !mIsSecure
+            && mHttpSource == NULL && mCachedSource == NULL
+            && track->mSource->supportReadMultiple();
+
+    if (readMultiple && trackType == MEDIA_TRACK_TYPE_VIDEO) {
+        maxBuffers = kMaxLocalVideoBuffersPerRead;
+    }
+
+    Vector<MediaBuffer *> mediaBuffers;
     for (size_t numBuffers = 0; numBuffers < maxBuffers; ) {
-        MediaBuffer *mbuf;
-        status_t err = track->mSource->read(&mbuf, &options);
+        status_t err;
+        if (readMultiple) {
+            err = track->mSource->readMultiple(
+                    &mediaBuffers, maxBuffers - numBuffers, &options);
+        } else {
+            MediaBuffer *mbuf;
+            err = track->mSource->read(&mbuf, &options);
+            if (err == OK) {
+                mediaBuffers.push(mbuf);
+            }
+        }
 
         options.clearSeekTo();
 
-        if (err == OK) {
+        for (size_t i = 0; i < mediaBuffers.size(); ++i) {
+            MediaBuffer *mbuf = mediaBuffers[i];
+
             int64_t timeUs;
             CHECK(mbuf->meta_data()->findInt64(kKeyTime, &timeUs));
             if (trackType == MEDIA_TRACK_TYPE_AUDIO) {
@@ -1629,8 +1698,11 @@ void NuPlayer::GenericSource::readBuffer(
                 track->mPackets->queueDiscontinuity( type, NULL, true /* discard */);
             }
 
-            sp<ABuffer> buffer = mediaBufferToABuffer(mbuf, trackType, seekTimeUs,
-                numBuffers == 0 ? actualTimeUs : NULL);
+            // Only the first access unit after a precise seek carries the
+            // time to resume rendering at.
+            sp<ABuffer> buffer = mediaBufferToABuffer(mbuf, trackType,
+                (precise && numBuffers == 0) ? seekTimeUs : -1ll,
+                numBuffers == 0 ? actualTimeUs : NULL, readMultiple);
             track->mPackets->queueAccessUnit(buffer);
             formatChange = false;
             seeking = false;
@@ -1639,7 +1711,10 @@ void NuPlayer::GenericSource::readBuffer(
             if (trackType == MEDIA_TRACK_TYPE_VIDEO) {
                 actualTimeUs = NULL;
             }
-        } else if (err == WOULD_BLOCK) {
+        }
+        mediaBuffers.clear();
+
+        if (err == WOULD_BLOCK) {
             break;
         } else if (err == INFO_FORMAT_CHANGED) {
 #if 0
@@ -1648,7 +1723,7 @@ void NuPlayer::GenericSource::readBuffer(
                     NULL,
                     false /* discard */);
 #endif
-        } else {
+        } else if (err != OK) {
             track->mPackets->signalEOS(err);
             break;
         }
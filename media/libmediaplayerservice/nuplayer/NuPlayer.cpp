@@ -28,6 +28,7 @@
 #include "NuPlayerDriver.h"
 #include "NuPlayerRenderer.h"
 #include "NuPlayerSource.h"
+#include "RenderStats.h"
 #include "RTSPSource.h"
 #include "StreamingSource.h"
 #include "GenericSource.h"
@@ -65,18 +66,20 @@ private:
 };
 
 struct NuPlayer::SeekAction : public Action {
-    SeekAction(int64_t seekTimeUs, bool needNotify)
+    SeekAction(int64_t seekTimeUs, bool needNotify, bool precise)
         : mSeekTimeUs(seekTimeUs),
-          mNeedNotify(needNotify) {
+          mNeedNotify(needNotify),
+          mPrecise(precise) {
     }
 
     virtual void execute(NuPlayer *player) {
-        player->performSeek(mSeekTimeUs, mNeedNotify);
+        player->performSeek(mSeekTimeUs, mNeedNotify, mPrecise);
     }
 
 private:
     int64_t mSeekTimeUs;
     bool mNeedNotify;
+    bool mPrecise;
 
     DISALLOW_EVIL_CONSTRUCTORS(SeekAction);
 };
@@ -208,9 +211,15 @@ NuPlayer::NuPlayer()
     clearFlushComplete();
     mPlayerExtendedStats = (PlayerExtendedStats *)ExtendedStats::Create(
             ExtendedStats::PLAYER, "NuPlayer", gettid());
+    mRenderStats = new RenderStats;
 }
 
 NuPlayer::~NuPlayer() {
+    // Leave the renderer's histograms behind for offline analysis.
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.render-stats", value, NULL) > 0) {
+        mRenderStats->writeToFile(value);
+    }
 }
 
 void NuPlayer::setUID(uid_t uid) {
@@ -367,13 +376,14 @@ void NuPlayer::resetAsync() {
     (new AMessage(kWhatReset, id()))->post();
 }
 
-void NuPlayer::seekToAsync(int64_t seekTimeUs, bool needNotify) {
+void NuPlayer::seekToAsync(int64_t seekTimeUs, bool needNotify, bool precise) {
     PLAYER_STATS(notifySeek, seekTimeUs);
     PLAYER_STATS(profileStart, STATS_PROFILE_SEEK);
 
     sp<AMessage> msg = new AMessage(kWhatSeek, id());
     msg->setInt64("seekTimeUs", seekTimeUs);
     msg->setInt32("needNotify", needNotify);
+    msg->setInt32("precise", precise);
     msg->post();
 }
 
@@ -601,7 +611,8 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
                     int64_t currentPositionUs = 0;
                     if (getCurrentPosition(&currentPositionUs) == OK) {
                         mDeferredActions.push_back(
-                                new SeekAction(currentPositionUs, false /* needNotify */));
+                                new SeekAction(currentPositionUs, false /* needNotify */,
+                                        false /* precise */));
                     }
                 }
 
@@ -995,18 +1006,20 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
         {
             int64_t seekTimeUs;
             int32_t needNotify;
+            int32_t precise;
             CHECK(msg->findInt64("seekTimeUs", &seekTimeUs));
             CHECK(msg->findInt32("needNotify", &needNotify));
+            CHECK(msg->findInt32("precise", &precise));
 
-            ALOGV("kWhatSeek seekTimeUs=%lld us, needNotify=%d",
-                    seekTimeUs, needNotify);
+            ALOGV("kWhatSeek seekTimeUs=%lld us, needNotify=%d, precise=%d",
+                    seekTimeUs, needNotify, precise);
 
             mDeferredActions.push_back(
                     new FlushDecoderAction(FLUSH_CMD_FLUSH /* audio */,
                                            FLUSH_CMD_FLUSH /* video */));
 
             mDeferredActions.push_back(
-                    new SeekAction(seekTimeUs, needNotify));
+                    new SeekAction(seekTimeUs, needNotify, precise));
 
             // After a flush without shutdown, decoder is paused.
             // Don't resume it until source seek is done, otherwise it could
@@ -1158,6 +1171,7 @@ void NuPlayer::onStart() {
     if (mPlayerExtendedStats != NULL) {
         notify->setObject(MEDIA_EXTENDED_STATS, mPlayerExtendedStats);
     }
+    notify->setObject("render-stats", mRenderStats);
     mRenderer = new Renderer(mAudioSink, notify, flags);
 
     mRendererLooper = new ALooper;
@@ -1656,6 +1670,10 @@ void NuPlayer::getStats(int64_t *numFramesTotal, int64_t *numFramesDropped) {
     }
 }
 
+sp<RenderStats> NuPlayer::getRenderStats() const {
+    return mRenderStats;
+}
+
 sp<MetaData> NuPlayer::getFileMeta() {
     return mSource->getFileFormatMeta();
 }
@@ -1693,11 +1711,12 @@ void NuPlayer::processDeferredActions() {
     }
 }
 
-void NuPlayer::performSeek(int64_t seekTimeUs, bool needNotify) {
-    ALOGV("performSeek seekTimeUs=%lld us (%.2f secs), needNotify(%d)",
+void NuPlayer::performSeek(int64_t seekTimeUs, bool needNotify, bool precise) {
+    ALOGV("performSeek seekTimeUs=%lld us (%.2f secs), needNotify(%d), precise(%d)",
           seekTimeUs,
           seekTimeUs / 1E6,
-          needNotify);
+          needNotify,
+          precise);
 
     if (mSource == NULL) {
         // This happens when reset occurs right before the loop mode
@@ -1707,7 +1726,7 @@ void NuPlayer::performSeek(int64_t seekTimeUs, bool needNotify) {
                 mAudioDecoder.get(), mVideoDecoder.get());
         return;
     }
-    mSource->seekTo(seekTimeUs);
+    mSource->seekTo(seekTimeUs, precise);
     ++mTimedTextGeneration;
 
     // everything's flushed, continue playback.
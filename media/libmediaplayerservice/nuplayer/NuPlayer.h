@@ -36,6 +36,7 @@ struct ABuffer;
 struct AMessage;
 struct MetaData;
 struct NuPlayerDriver;
+struct RenderStats;
 
 struct NuPlayer : public AHandler {
     NuPlayer();
@@ -69,7 +70,9 @@ struct NuPlayer : public AHandler {
 
     // Will notify the driver through "notifySeekComplete" once finished
     // and needNotify is true.
-    void seekToAsync(int64_t seekTimeUs, bool needNotify = false);
+    // If |precise|, playback resumes at |seekTimeUs| itself rather than at
+    // the sync frame before it, see Source::seekTo().
+    void seekToAsync(int64_t seekTimeUs, bool needNotify = false, bool precise = false);
 
     status_t setVideoScalingMode(int32_t mode);
     status_t getTrackInfo(Parcel* reply) const;
@@ -77,6 +80,7 @@ struct NuPlayer : public AHandler {
     status_t selectTrack(size_t trackIndex, bool select, int64_t timeUs);
     status_t getCurrentPosition(int64_t *mediaUs);
     void getStats(int64_t *mNumFramesTotal, int64_t *mNumFramesDropped);
+    sp<RenderStats> getRenderStats() const;
 
     sp<MetaData> getFileMeta();
     int64_t getServerTimeoutUs();
@@ -88,6 +92,7 @@ protected:
 
 public:
     struct NuPlayerStreamListener;
+    struct Renderer;
     struct Source;
 
 private:
@@ -97,7 +102,6 @@ private:
     struct CCDecoder;
     struct GenericSource;
     struct HTTPLiveSource;
-    struct Renderer;
     struct RTSPSource;
     struct StreamingSource;
     struct Action;
@@ -132,6 +136,7 @@ private:
         kWhatSelectTrack                = 'selT',
     };
     sp<PlayerExtendedStats> mPlayerExtendedStats;
+    sp<RenderStats> mRenderStats;
 
     wp<NuPlayerDriver> mDriver;
     bool mUIDValid;
@@ -248,7 +253,7 @@ private:
 
     void processDeferredActions();
 
-    void performSeek(int64_t seekTimeUs, bool needNotify);
+    void performSeek(int64_t seekTimeUs, bool needNotify, bool precise = false);
     void performDecoderFlush(FlushCommand audio, FlushCommand video);
     void performReset();
     void performScanSources();
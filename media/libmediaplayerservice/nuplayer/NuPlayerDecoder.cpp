@@ -506,22 +506,31 @@ bool NuPlayer::Decoder::handleAnOutputBuffer() {
     }
     // we do not expect CODECCONFIG or SYNCFRAME for decoder
 
-    sp<AMessage> reply = new AMessage(kWhatRenderBuffer, id());
-    reply->setSize("buffer-ix", bufferIx);
-    reply->setInt32("generation", mBufferGeneration);
-
     if (mSkipRenderingUntilMediaTimeUs >= 0) {
-        if (timeUs < mSkipRenderingUntilMediaTimeUs) {
+        if (timeUs < mSkipRenderingUntilMediaTimeUs
+                && !(flags & MediaCodec::BUFFER_FLAG_EOS)) {
             ALOGV("[%s] dropping buffer at time %lld as requested.",
                      mComponentName.c_str(), (long long)timeUs);
 
-            reply->post();
+            // Hand the buffer straight back, there's nothing to render and
+            // a precise seek may go through a whole GOP of these.
+            res = mCodec->releaseOutputBuffer(bufferIx);
+            if (res != OK) {
+                ALOGE("failed to release output buffer for %s (err=%d)",
+                        mComponentName.c_str(), res);
+                handleError(res);
+                return false;
+            }
             return true;
         }
 
         mSkipRenderingUntilMediaTimeUs = -1;
     }
 
+    sp<AMessage> reply = new AMessage(kWhatRenderBuffer, id());
+    reply->setSize("buffer-ix", bufferIx);
+    reply->setInt32("generation", mBufferGeneration);
+
     // wait until 1st frame comes out to signal resume complete
     notifyResumeCompleteIfNecessary();
 
@@ -575,6 +584,16 @@ bool NuPlayer::Decoder::isStaleReply(const sp<AMessage> &msg) {
     return generation != mBufferGeneration;
 }
 
+bool NuPlayer::Decoder::isSkippedBeforeResume(const sp<ABuffer> &accessUnit) const {
+    if (mSkipRenderingUntilMediaTimeUs < 0) {
+        return false;
+    }
+
+    int64_t timeUs;
+    CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
+    return timeUs < mSkipRenderingUntilMediaTimeUs;
+}
+
 status_t NuPlayer::Decoder::fetchInputData(sp<AMessage> &reply) {
     sp<ABuffer> accessUnit;
     bool dropAccessUnit;
@@ -650,11 +669,16 @@ status_t NuPlayer::Decoder::fetchInputData(sp<AMessage> &reply) {
         dropAccessUnit = false;
         if (!mIsAudio
                 && !mIsSecure
-                && mRenderer->getVideoLateByUs() > 100000ll
                 && mIsVideoAVC
                 && !IsAVCReferenceFrame(accessUnit)) {
-            dropAccessUnit = true;
-            ++mNumFramesDropped;
+            if (mRenderer->getVideoLateByUs() > 100000ll) {
+                dropAccessUnit = true;
+                ++mNumFramesDropped;
+            } else if (isSkippedBeforeResume(accessUnit)) {
+                // nothing refers to it and it wouldn't be rendered, don't
+                // even decode it.
+                dropAccessUnit = true;
+            }
         }
     } while (dropAccessUnit);
 
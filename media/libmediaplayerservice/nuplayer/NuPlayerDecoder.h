@@ -92,6 +92,7 @@ private:
     void releaseAndResetMediaBuffers();
     void requestCodecNotification();
     bool isStaleReply(const sp<AMessage> &msg);
+    bool isSkippedBeforeResume(const sp<ABuffer> &accessUnit) const;
 
     status_t fetchInputData(sp<AMessage> &reply);
     bool onInputBufferFetched(const sp<AMessage> &msg);
@@ -23,6 +23,7 @@
 
 #include "NuPlayer.h"
 #include "NuPlayerSource.h"
+#include "RenderStats.h"
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
@@ -42,6 +43,7 @@ NuPlayerDriver::NuPlayerDriver()
       mDurationUs(-1),
       mPositionUs(-1),
       mSeekInProgress(false),
+      mPreciseSeek(false),
       mLooper(new ALooper),
       mPlayerFlags(0),
       mAtEOS(false),
@@ -262,7 +264,8 @@ status_t NuPlayerDriver::start() {
             mPlayer->start();
 
             if (mStartupSeekTimeUs >= 0) {
-                mPlayer->seekToAsync(mStartupSeekTimeUs);
+                mPlayer->seekToAsync(
+                        mStartupSeekTimeUs, false /* needNotify */, mPreciseSeek);
                 mStartupSeekTimeUs = -1;
             }
             break;
@@ -375,7 +378,7 @@ status_t NuPlayerDriver::seekTo(int msec) {
             }
             // seeks can take a while, so we essentially paused
             notifyListener_l(MEDIA_PAUSED);
-            mPlayer->seekToAsync(seekTimeUs, true /* needNotify */);
+            mPlayer->seekToAsync(seekTimeUs, true /* needNotify */, mPreciseSeek);
             break;
         }
 
@@ -535,9 +538,18 @@ void NuPlayerDriver::setAudioSink(const sp<AudioSink> &audioSink) {
     mAudioSink = audioSink;
 }
 
-status_t NuPlayerDriver::setParameter(
-        int /* key */, const Parcel & /* request */) {
-    return INVALID_OPERATION;
+status_t NuPlayerDriver::setParameter(int key, const Parcel &request) {
+    switch (key) {
+        case KEY_PARAMETER_PRECISE_SEEK:
+        {
+            Mutex::Autolock autoLock(mLock);
+            mPreciseSeek = request.readInt32() != 0;
+            return OK;
+        }
+
+        default:
+            return INVALID_OPERATION;
+    }
 }
 
 status_t NuPlayerDriver::getParameter(int /* key */, Parcel * /* reply */) {
@@ -639,6 +651,8 @@ status_t NuPlayerDriver::dump(
                  numFramesTotal == 0
                     ? 0.0 : (double)numFramesDropped / numFramesTotal);
 
+    mPlayer->getRenderStats()->dump(out);
+
     fclose(out);
     out = NULL;
 
@@ -105,6 +105,7 @@ private:
     int64_t mDurationUs;
     int64_t mPositionUs;
     bool mSeekInProgress;
+    bool mPreciseSeek;
     // <<<
 
     sp<ALooper> mLooper;
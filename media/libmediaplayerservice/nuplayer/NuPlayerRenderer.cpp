@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include "NuPlayerRenderer.h"
+#include "RenderStats.h"
 
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -30,6 +31,8 @@
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
+#include <cutils/atomic.h>
+
 #include <VideoFrameScheduler.h>
 
 #include <inttypes.h>
@@ -96,9 +99,23 @@ NuPlayer::Renderer::Renderer(
       mCurrentPcmInfo(AUDIO_PCMINFO_INITIALIZER),
       mTotalBuffersQueued(0),
       mLastAudioBufferDrained(0),
-      mWakeLock(new AWakeLock()) {
+      mWakeLock(new AWakeLock()),
+      mOffloadRingHead(0),
+      mOffloadRingTail(0),
+      mOffloadFlushSequence(0),
+      mOffloadPaused(0),
+      mOffloadRefillPending(0),
+      mOffloadRenderingStartPending(1),
+      mOffloadHasEntry(false) {
 
     notify->findObject(MEDIA_EXTENDED_STATS, (sp<RefBase>*)&mPlayerExtendedStats);
+
+    sp<RefBase> obj;
+    if (notify->findObject("render-stats", &obj)) {
+        mRenderStats = static_cast<RenderStats *>(obj.get());
+    } else {
+        mRenderStats = new RenderStats;
+    }
 }
 
 NuPlayer::Renderer::~Renderer() {
@@ -411,6 +428,19 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatRefillOffloadRing:
+        {
+            Mutex::Autolock autoLock(mLock);
+            postDrainAudioQueue_l();
+            break;
+        }
+
+        case kWhatOffloadRenderingStart:
+        {
+            notifyIfMediaRenderingStarted();
+            break;
+        }
+
         case kWhatDrainAudioQueue:
         {
             int32_t generation;
@@ -564,8 +594,15 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
 }
 
 void NuPlayer::Renderer::postDrainAudioQueue_l(int64_t delayUs) {
+    if (offloadingAudio()) {
+        if (!mSyncQueues) {
+            refillOffloadRing_l();
+        }
+        return;
+    }
+
     if (mDrainAudioQueuePending || mSyncQueues || mPaused
-            || mAudioSinkStopped ||offloadingAudio()) {
+            || mAudioSinkStopped) {
         return;
     }
 
@@ -582,6 +619,7 @@ void NuPlayer::Renderer::postDrainAudioQueue_l(int64_t delayUs) {
 void NuPlayer::Renderer::prepareForMediaRenderingStart() {
     mAudioRenderingStartGeneration = mAudioQueueGeneration;
     mVideoRenderingStartGeneration = mVideoQueueGeneration;
+    android_atomic_release_store(1, &mOffloadRenderingStartPending);
 }
 
 void NuPlayer::Renderer::notifyIfMediaRenderingStarted() {
@@ -628,33 +666,32 @@ size_t NuPlayer::Renderer::AudioSinkCallback(
     return 0;
 }
 
+// Called on the AudioSink callback thread only. Runs without mLock, taking
+// its entries from mOffloadRing, see refillOffloadRing_l().
 size_t NuPlayer::Renderer::fillAudioBuffer(void *buffer, size_t size) {
-    Mutex::Autolock autoLock(mLock);
-
-    if (!offloadingAudio() || mPaused) {
+    if (android_atomic_acquire_load(&mOffloadPaused)) {
         return 0;
     }
 
+    int32_t sequence = android_atomic_acquire_load(&mOffloadFlushSequence);
+    int32_t head = mOffloadRingHead;
+
     bool hasEOS = false;
 
     size_t sizeCopied = 0;
-    bool firstEntry = true;
-    while (sizeCopied < size && !mAudioQueue.empty()) {
-        QueueEntry *entry = &*mAudioQueue.begin();
+    int64_t firstMediaTimeUs = -1;
+    while (sizeCopied < size && nextOffloadEntry(sequence)) {
+        QueueEntry *entry = &mOffloadEntry;
 
         if (entry->mBuffer == NULL) { // EOS
             hasEOS = true;
-            mAudioQueue.erase(mAudioQueue.begin());
-            entry = NULL;
+            releaseOffloadEntry(false /* notifyConsumed */);
             break;
         }
 
-        if (firstEntry && entry->mOffset == 0) {
-            firstEntry = false;
-            int64_t mediaTimeUs;
-            CHECK(entry->mBuffer->meta()->findInt64("timeUs", &mediaTimeUs));
-            ALOGV("rendering audio at media time %.2f secs", mediaTimeUs / 1E6);
-            setAudioFirstAnchorTimeIfNeeded(mediaTimeUs);
+        if (firstMediaTimeUs < 0 && entry->mOffset == 0) {
+            CHECK(entry->mBuffer->meta()->findInt64("timeUs", &firstMediaTimeUs));
+            ALOGV("rendering audio at media time %.2f secs", firstMediaTimeUs / 1E6);
         }
 
         size_t copy = entry->mBuffer->size() - entry->mOffset;
@@ -669,21 +706,50 @@ size_t NuPlayer::Renderer::fillAudioBuffer(void *buffer, size_t size) {
 
         entry->mOffset += copy;
         if (entry->mOffset == entry->mBuffer->size()) {
-            entry->mNotifyConsumed->post();
-            mAudioQueue.erase(mAudioQueue.begin());
-            entry = NULL;
+            releaseOffloadEntry(true /* notifyConsumed */);
         }
         sizeCopied += copy;
-        notifyIfMediaRenderingStarted();
     }
 
-    if (mAudioFirstAnchorTimeMediaUs >= 0) {
-        int64_t nowUs = ALooper::GetNowUs();
-        setAnchorTime(mAudioFirstAnchorTimeMediaUs, nowUs - getPlayedOutAudioDurationUs(nowUs));
+    if (sizeCopied > 0
+            && android_atomic_cmpxchg(1, 0, &mOffloadRenderingStartPending) == 0) {
+        (new AMessage(kWhatOffloadRenderingStart, id()))->post();
+    }
+
+    if (mOffloadRingHead != head
+            && android_atomic_cmpxchg(1, 0, &mOffloadRefillPending) == 0) {
+        (new AMessage(kWhatRefillOffloadRing, id()))->post();
+    }
+
+    int64_t nowUs = ALooper::GetNowUs();
+    int64_t playedOutDurationUs = getPlayedOutAudioDurationUs(nowUs);
+
+    bool underrun = false;
+    {
+        // Don't move the anchor with data a flush already dropped.
+        Mutex::Autolock autoLock(mTimeLock);
+        if (sequence == mOffloadFlushSequence) {
+            if (firstMediaTimeUs >= 0 && mAudioFirstAnchorTimeMediaUs == -1) {
+                mAudioFirstAnchorTimeMediaUs = firstMediaTimeUs;
+            }
+
+            if (mAudioFirstAnchorTimeMediaUs >= 0) {
+                mAnchorTimeMediaUs = mAudioFirstAnchorTimeMediaUs;
+                mAnchorTimeRealUs = nowUs - playedOutDurationUs;
+                mAnchorNumFramesWritten = -1;
+            }
+
+            // we don't know how much data we are queueing for offloaded tracks
+            mAnchorMaxMediaUs = -1;
+
+            // the sink asked for more than we had queued
+            underrun = sizeCopied < size && !hasEOS && mAudioFirstAnchorTimeMediaUs >= 0;
+        }
     }
 
-    // we don't know how much data we are queueing for offloaded tracks
-    mAnchorMaxMediaUs = -1;
+    if (underrun) {
+        mRenderStats->onAudioUnderrun();
+    }
 
     if (hasEOS) {
         (new AMessage(kWhatStopAudioSink, id()))->post();
@@ -692,6 +758,90 @@ size_t NuPlayer::Renderer::fillAudioBuffer(void *buffer, size_t size) {
     return sizeCopied;
 }
 
+// Makes mOffloadEntry the oldest entry queued under |sequence|, dropping
+// the ones queued before the flush that started it. Returns false if there
+// is none (yet).
+bool NuPlayer::Renderer::nextOffloadEntry(int32_t sequence) {
+    for (;;) {
+        if (mOffloadHasEntry) {
+            if (mOffloadEntry.mFlushSequence == sequence) {
+                return true;
+            }
+            if (mOffloadEntry.mFlushSequence - sequence > 0) {
+                // queued after a flush this callback hasn't seen yet.
+                return false;
+            }
+            releaseOffloadEntry(mOffloadEntry.mBuffer != NULL);
+        }
+
+        int32_t head = mOffloadRingHead;
+        if (head == android_atomic_acquire_load(&mOffloadRingTail)) {
+            return false;
+        }
+
+        QueueEntry *slot = &mOffloadRing[head & (kOffloadRingSize - 1)];
+        mOffloadEntry = *slot;
+        mOffloadHasEntry = true;
+        slot->mBuffer.clear();
+        slot->mNotifyConsumed.clear();
+
+        android_atomic_release_store(head + 1, &mOffloadRingHead);
+    }
+}
+
+void NuPlayer::Renderer::releaseOffloadEntry(bool notifyConsumed) {
+    if (notifyConsumed) {
+        mOffloadEntry.mNotifyConsumed->post();
+    }
+    mOffloadEntry.mBuffer.clear();
+    mOffloadEntry.mNotifyConsumed.clear();
+    mOffloadHasEntry = false;
+}
+
+// Moves as much of mAudioQueue into mOffloadRing as fits. Called on the
+// renderer thread only, the callback asks for more by posting
+// kWhatRefillOffloadRing once it made room.
+void NuPlayer::Renderer::refillOffloadRing_l() {
+    int32_t tail = mOffloadRingTail;
+    int32_t sequence = mOffloadFlushSequence;
+
+    while (!mAudioQueue.empty()
+            && tail - android_atomic_acquire_load(&mOffloadRingHead) < kOffloadRingSize) {
+        QueueEntry *slot = &mOffloadRing[tail & (kOffloadRingSize - 1)];
+        *slot = *mAudioQueue.begin();
+        slot->mFlushSequence = sequence;
+        mAudioQueue.erase(mAudioQueue.begin());
+
+        android_atomic_release_store(++tail, &mOffloadRingTail);
+    }
+
+    if (!mAudioQueue.empty()) {
+        android_atomic_release_store(1, &mOffloadRefillPending);
+    }
+}
+
+// Puts what the callback hasn't consumed back at the front of mAudioQueue,
+// dropping what was flushed. Only safe while the callback isn't running,
+// i.e. the sink is closed.
+void NuPlayer::Renderer::reclaimOffloadRing() {
+    Mutex::Autolock autoLock(mLock);
+    int32_t sequence = mOffloadFlushSequence;
+
+    List<QueueEntry> entries;
+    while (nextOffloadEntry(sequence)) {
+        entries.push_back(mOffloadEntry);
+        releaseOffloadEntry(false /* notifyConsumed */);
+    }
+
+    mAudioQueue.insert(mAudioQueue.begin(), entries.begin(), entries.end());
+    android_atomic_release_store(0, &mOffloadRefillPending);
+
+    if (offloadingAudio()) {
+        // for the callback of the sink about to be opened.
+        postDrainAudioQueue_l();
+    }
+}
+
 bool NuPlayer::Renderer::onDrainAudioQueue() {
     uint32_t numFramesPlayed;
     if(!mAudioSink->ready() && !mAudioQueue.empty()) {
@@ -713,14 +863,15 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
     ssize_t numFramesAvailableToWrite =
         mAudioSink->frameCount() - (mNumFramesWritten - numFramesPlayed);
 
-#if 0
-    if (numFramesAvailableToWrite == mAudioSink->frameCount()) {
-        ALOGI("audio sink underrun");
-    } else {
-        ALOGV("audio queue has %d frames left to play",
-             mAudioSink->frameCount() - numFramesAvailableToWrite);
+    uint32_t numFramesPending = mNumFramesWritten - numFramesPlayed;
+    if (numFramesPending == 0 && mNumFramesWritten > 0 && !mPaused
+            && mAudioRenderingStartGeneration != mAudioQueueGeneration) {
+        // Not just flushed or started, the sink ran dry while playing.
+        ALOGV("audio sink underrun");
+        mRenderStats->onAudioUnderrun();
     }
-#endif
+    mRenderStats->onAudioSinkLevel(
+            (int64_t)(numFramesPending * 1000LL * mAudioSink->msecsPerFrame()));
 
     size_t numBytesAvailableToWrite =
         numFramesAvailableToWrite * mAudioSink->frameSize();
@@ -917,6 +1068,12 @@ void NuPlayer::Renderer::postDrainVideoQueue_l() {
 
     realTimeUs = mVideoScheduler->schedule(realTimeUs * 1000) / 1000;
     int64_t twoVsyncsUs = 2 * (mVideoScheduler->getVsyncPeriod() / 1000);
+    entry.mScheduledRealTimeUs = realTimeUs;
+
+    int64_t fitErrorPermille = mVideoScheduler->takePLLFitError();
+    if (fitErrorPermille >= 0) {
+        mRenderStats->onPLLFitError(fitErrorPermille);
+    }
 
     delayUs = realTimeUs - nowUs;
 
@@ -975,6 +1132,20 @@ void NuPlayer::Renderer::onDrainVideoQueue() {
                     (mFlags & FLAG_REAL_TIME ? realTimeUs :
                     (realTimeUs + mAnchorTimeMediaUs - mAnchorTimeRealUs)) / 1E6);
         }
+
+        mRenderStats->onVideoFrame(mVideoLateByUs, tooLate);
+
+        if (!tooLate && mHasAudio && !(mFlags & FLAG_REAL_TIME)) {
+            // Where audio will be when the frame reaches the display, taking
+            // the vsync the scheduler aimed for as when that happens.
+            int64_t displayTimeUs = max(nowUs, entry->mScheduledRealTimeUs);
+            int64_t audioPositionUs;
+            if (getCurrentPositionOnLooper(
+                    &audioPositionUs, displayTimeUs,
+                    true /* allowPastQueuedVideo */) == OK) {
+                mRenderStats->onAVSyncError(mediaTimeUs - audioPositionUs);
+            }
+        }
     } else {
         setVideoLateByUs(0);
         if (!mVideoSampleReceived && !mHasAudio) {
@@ -1055,6 +1226,8 @@ void NuPlayer::Renderer::onQueueBuffer(const sp<AMessage> &msg) {
     entry.mOffset = 0;
     entry.mFinalResult = OK;
     entry.mBufferOrdinal = ++mTotalBuffersQueued;
+    entry.mScheduledRealTimeUs = -1;
+    entry.mFlushSequence = -1;
 
     Mutex::Autolock autoLock(mLock);
     if (audio) {
@@ -1131,6 +1304,8 @@ void NuPlayer::Renderer::onQueueEOS(const sp<AMessage> &msg) {
     QueueEntry entry;
     entry.mOffset = 0;
     entry.mFinalResult = finalResult;
+    entry.mScheduledRealTimeUs = -1;
+    entry.mFlushSequence = -1;
 
     Mutex::Autolock autoLock(mLock);
     if (audio) {
@@ -1193,7 +1368,13 @@ void NuPlayer::Renderer::onFlush(const sp<AMessage> &msg) {
             prepareForMediaRenderingStart();
 
             if (offloadingAudio()) {
-                setAudioFirstAnchorTime(-1);
+                // The callback drops what is left in the ring from here on,
+                // and won't move the anchor with what it already took.
+                Mutex::Autolock autoLock(mTimeLock);
+                android_atomic_inc(&mOffloadFlushSequence);
+                mAudioFirstAnchorTimeMediaUs = -1;
+                mAnchorTimeMediaUs = -1;
+                mAnchorTimeRealUs = -1;
             }
         }
 
@@ -1323,6 +1504,7 @@ void NuPlayer::Renderer::onPause() {
         ++mVideoQueueGeneration;
         prepareForMediaRenderingStart();
         mPaused = true;
+        android_atomic_release_store(1, &mOffloadPaused);
         setPauseStartedTimeRealUs(ALooper::GetNowUs());
     }
 
@@ -1358,6 +1540,7 @@ void NuPlayer::Renderer::onResume() {
 
     Mutex::Autolock autoLock(mLock);
     mPaused = false;
+    android_atomic_release_store(0, &mOffloadPaused);
     if (mPauseStartedTimeRealUs != -1) {
         int64_t newAnchorRealUs =
             mAnchorTimeRealUs + ALooper::GetNowUs() - mPauseStartedTimeRealUs;
@@ -1581,6 +1764,7 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
             offloadFlags &= ~AUDIO_OUTPUT_FLAG_DEEP_BUFFER;
             audioSinkChanged = true;
             mAudioSink->close();
+            reclaimOffloadRing();
             err = mAudioSink->open(
                     sampleRate,
                     numChannels,
@@ -1608,6 +1792,7 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
                 // Clean up, fall back to non offload mode.
                 mAudioSink->close();
                 onDisableOffloadAudio();
+                reclaimOffloadRing();
                 mCurrentOffloadInfo = AUDIO_INFO_INITIALIZER;
                 ALOGV("openAudioSink: offload failed");
             }
@@ -1638,6 +1823,7 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
 
         audioSinkChanged = true;
         mAudioSink->close();
+        reclaimOffloadRing();
         mCurrentOffloadInfo = AUDIO_INFO_INITIALIZER;
         status_t err = mAudioSink->open(
                     sampleRate,
@@ -1668,6 +1854,7 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
 
 void NuPlayer::Renderer::onCloseAudioSink() {
     mAudioSink->close();
+    reclaimOffloadRing();
     mCurrentOffloadInfo = AUDIO_INFO_INITIALIZER;
     mCurrentPcmInfo = AUDIO_PCMINFO_INITIALIZER;
 }
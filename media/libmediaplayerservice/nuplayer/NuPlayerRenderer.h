@@ -24,6 +24,7 @@ namespace android {
 
 struct ABuffer;
 class  AWakeLock;
+struct RenderStats;
 struct VideoFrameScheduler;
 
 struct NuPlayer::Renderer : public AHandler {
@@ -120,6 +121,8 @@ private:
         kWhatDisableOffloadAudio = 'noOA',
         kWhatEnableOffloadAudio  = 'enOA',
         kWhatSetVideoFrameRate   = 'sVFR',
+        kWhatRefillOffloadRing   = 'rfOR',
+        kWhatOffloadRenderingStart = 'oRSt',
     };
 
     struct QueueEntry {
@@ -128,11 +131,14 @@ private:
         size_t mOffset;
         status_t mFinalResult;
         int32_t mBufferOrdinal;
+        int64_t mScheduledRealTimeUs;  // video only, where the scheduler put it
+        int32_t mFlushSequence;        // offloaded audio only
     };
 
     static const int64_t kMinPositionUpdateDelayUs;
 
     sp<PlayerExtendedStats> mPlayerExtendedStats;
+    sp<RenderStats> mRenderStats;
     sp<MediaPlayerBase::AudioSink> mAudioSink;
     sp<AMessage> mNotify;
     Mutex mLock;
@@ -201,6 +207,26 @@ private:
     bool mAudioSinkStopped;
     sp<AWakeLock> mWakeLock;
 
+    // Offloaded audio is handed from mAudioQueue to the AudioSink callback
+    // through a single producer (renderer thread), single consumer (callback)
+    // ring, so that the callback never waits for mLock. A flush bumps
+    // mOffloadFlushSequence, and the callback drops whatever it finds queued
+    // under an older sequence.
+    enum {
+        kOffloadRingSize = 64,  // power of 2
+    };
+    QueueEntry mOffloadRing[kOffloadRingSize];
+    volatile int32_t mOffloadRingHead;      // advanced by the callback only
+    volatile int32_t mOffloadRingTail;      // advanced by renderer thread only
+    volatile int32_t mOffloadFlushSequence; // bumped under mTimeLock
+    volatile int32_t mOffloadPaused;
+    volatile int32_t mOffloadRefillPending;
+    volatile int32_t mOffloadRenderingStartPending;
+
+    // owned by the callback, or by the renderer thread while the sink is closed.
+    QueueEntry mOffloadEntry;
+    bool mOffloadHasEntry;
+
     status_t getCurrentPositionOnLooper(int64_t *mediaUs);
     status_t getCurrentPositionOnLooper(
             int64_t *mediaUs, int64_t nowUs, bool allowPastQueuedVideo = false);
@@ -209,6 +235,10 @@ private:
             int64_t *mediaUs, int64_t nowUs, bool allowPastQueuedVideo = false);
 
     size_t fillAudioBuffer(void *buffer, size_t size);
+    bool nextOffloadEntry(int32_t sequence);
+    void releaseOffloadEntry(bool notifyConsumed);
+    void refillOffloadRing_l();
+    void reclaimOffloadRing();
 
     bool onDrainAudioQueue();
     int64_t getPendingAudioPlayoutDurationUs(int64_t nowUs);
@@ -106,7 +106,10 @@ struct NuPlayer::Source : public AHandler {
         return INVALID_OPERATION;
     }
 
-    virtual status_t seekTo(int64_t /* seekTimeUs */) {
+    // If |precise|, the first access units after the seek are marked so
+    // that decoders don't render anything before |seekTimeUs|, rather than
+    // starting at the previous sync sample.
+    virtual status_t seekTo(int64_t /* seekTimeUs */, bool /* precise */ = false) {
         return INVALID_OPERATION;
     }
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "RenderStats"
+#include <utils/Log.h>
+
+#include "RenderStats.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+
+namespace android {
+
+// Bucket boundaries, a bucket holds values v with edge[i - 1] <= v < edge[i].
+static const int64_t kTimingEdgesUs[] = {
+    -40000, -20000, -10000, -5000, -2000, 2000, 5000, 10000, 20000, 40000, 100000,
+};
+
+static const int64_t kAudioSinkLevelEdgesUs[] = {
+    1, 10000, 20000, 40000, 80000, 160000, 320000,
+};
+
+static const int64_t kPLLFitErrorEdgesPermille[] = {
+    1, 2, 5, 10, 20, 50, 100, 200,
+};
+
+#define INIT_HISTOGRAM(histogram, name, edges) \
+    histogram.init(name, edges, sizeof(edges) / sizeof(edges[0]))
+
+void RenderStats::Histogram::init(
+        const char *name, const int64_t *edges, size_t numEdges) {
+    CHECK_LT(numEdges, (size_t)kMaxBuckets);
+
+    mName = name;
+    mEdges = edges;
+    mNumEdges = numEdges;
+
+    reset();
+}
+
+void RenderStats::Histogram::reset() {
+    memset(mCounts, 0, sizeof(mCounts));
+    mCount = 0;
+    mSum = 0;
+    mMin = INT64_MAX;
+    mMax = INT64_MIN;
+}
+
+void RenderStats::Histogram::add(int64_t value) {
+    size_t bucket = 0;
+    while (bucket < mNumEdges && value >= mEdges[bucket]) {
+        ++bucket;
+    }
+
+    ++mCounts[bucket];
+    ++mCount;
+    mSum += value;
+
+    if (value < mMin) {
+        mMin = value;
+    }
+    if (value > mMax) {
+        mMax = value;
+    }
+}
+
+void RenderStats::Histogram::dump(FILE *out) const {
+    if (mCount == 0) {
+        fprintf(out, "   %s: no samples\n", mName);
+        return;
+    }
+
+    fprintf(out, "   %s: count(%" PRIu64 "), mean(%.2f), min(%" PRId64 "), "
+                 "max(%" PRId64 ")\n",
+                 mName, mCount, (double)mSum / mCount, mMin, mMax);
+
+    for (size_t i = 0; i <= mNumEdges; ++i) {
+        if (mCounts[i] == 0) {
+            continue;
+        }
+
+        if (i == 0) {
+            fprintf(out, "    [      -inf, %10" PRId64 ")", mEdges[0]);
+        } else if (i == mNumEdges) {
+            fprintf(out, "    [%10" PRId64 ",        inf)", mEdges[i - 1]);
+        } else {
+            fprintf(out, "    [%10" PRId64 ", %10" PRId64 ")",
+                    mEdges[i - 1], mEdges[i]);
+        }
+
+        fprintf(out, " %10" PRIu64 " %6.2f%%\n",
+                mCounts[i], 100.0 * mCounts[i] / mCount);
+    }
+}
+
+RenderStats::RenderStats()
+    : mNumVideoFramesDropped(0),
+      mNumAudioUnderruns(0) {
+    INIT_HISTOGRAM(mVideoLateness, "videoLateness(us)", kTimingEdgesUs);
+    INIT_HISTOGRAM(mAVSyncError, "avSyncError(us)", kTimingEdgesUs);
+    INIT_HISTOGRAM(mAudioSinkLevel, "audioSinkLevel(us)", kAudioSinkLevelEdgesUs);
+    INIT_HISTOGRAM(mPLLFitError, "pllFitError(permille)", kPLLFitErrorEdgesPermille);
+}
+
+RenderStats::~RenderStats() {
+}
+
+void RenderStats::onVideoFrame(int64_t lateUs, bool dropped) {
+    Mutex::Autolock autoLock(mLock);
+    mVideoLateness.add(lateUs);
+    if (dropped) {
+        ++mNumVideoFramesDropped;
+    }
+}
+
+void RenderStats::onAVSyncError(int64_t errorUs) {
+    Mutex::Autolock autoLock(mLock);
+    mAVSyncError.add(errorUs);
+}
+
+void RenderStats::onAudioSinkLevel(int64_t queuedUs) {
+    Mutex::Autolock autoLock(mLock);
+    mAudioSinkLevel.add(queuedUs);
+}
+
+void RenderStats::onAudioUnderrun() {
+    Mutex::Autolock autoLock(mLock);
+    ++mNumAudioUnderruns;
+}
+
+void RenderStats::onPLLFitError(int64_t errorPermille) {
+    Mutex::Autolock autoLock(mLock);
+    mPLLFitError.add(errorPermille);
+}
+
+void RenderStats::reset() {
+    Mutex::Autolock autoLock(mLock);
+    mVideoLateness.reset();
+    mAVSyncError.reset();
+    mAudioSinkLevel.reset();
+    mPLLFitError.reset();
+    mNumVideoFramesDropped = 0;
+    mNumAudioUnderruns = 0;
+}
+
+void RenderStats::dump(FILE *out) const {
+    Mutex::Autolock autoLock(mLock);
+
+    fprintf(out, "  Renderer\n");
+    fprintf(out, "   numVideoFramesDropped(%" PRIu64 "), numAudioUnderruns(%" PRIu64 ")\n",
+            mNumVideoFramesDropped, mNumAudioUnderruns);
+
+    mVideoLateness.dump(out);
+    mAVSyncError.dump(out);
+    mAudioSinkLevel.dump(out);
+    mPLLFitError.dump(out);
+}
+
+status_t RenderStats::writeToFile(const char *path) const {
+    FILE *out = fopen(path, "a");
+    if (out == NULL) {
+        status_t err = -errno;
+        ALOGW("unable to open '%s' (%s)", path, strerror(-err));
+        return err;
+    }
+
+    dump(out);
+
+    fclose(out);
+    out = NULL;
+
+    return OK;
+}
+
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RENDER_STATS_H_
+
+#define RENDER_STATS_H_
+
+#include <stdio.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+// Fixed bucket histograms of how smoothly the renderer is playing back,
+// cheap enough to be recorded for every frame. Recorded from the
+// renderer's looper and the audio sink's callback thread, read from
+// dumpsys; all accesses are serialized by an internal lock.
+struct RenderStats : public RefBase {
+    RenderStats();
+
+    // How late (positive) or early (negative) a video frame was drained,
+    // and whether it was dropped for being too late.
+    void onVideoFrame(int64_t lateUs, bool dropped);
+
+    // Video media time minus the audio position at the time the frame is
+    // expected on screen, i.e. positive if video is ahead of audio.
+    void onAVSyncError(int64_t errorUs);
+
+    // Audio queued in the sink but not yet played out, sampled whenever
+    // the sink is fed.
+    void onAudioSinkLevel(int64_t queuedUs);
+
+    // The sink had played out everything it was given while playing.
+    void onAudioUnderrun();
+
+    // Residual of the video frame scheduler's PLL fit, in 1/1000ths.
+    void onPLLFitError(int64_t errorPermille);
+
+    void reset();
+
+    void dump(FILE *out) const;
+
+    // Appends the dump to |path|, creating it if needed.
+    status_t writeToFile(const char *path) const;
+
+protected:
+    virtual ~RenderStats();
+
+private:
+    enum {
+        kMaxBuckets = 16,
+    };
+
+    struct Histogram {
+        void init(const char *name, const int64_t *edges, size_t numEdges);
+        void reset();
+        void add(int64_t value);
+        void dump(FILE *out) const;
+
+        const char *mName;
+        const int64_t *mEdges;  // ascending bucket boundaries
+        size_t mNumEdges;       // buckets are mNumEdges + 1
+        uint64_t mCounts[kMaxBuckets];
+        uint64_t mCount;
+        int64_t mSum;
+        int64_t mMin;
+        int64_t mMax;
+    };
+
+    mutable Mutex mLock;
+
+    Histogram mVideoLateness;
+    Histogram mAVSyncError;
+    Histogram mAudioSinkLevel;
+    Histogram mPLLFitError;
+
+    uint64_t mNumVideoFramesDropped;
+    uint64_t mNumAudioUnderruns;
+
+    DISALLOW_EVIL_CONSTRUCTORS(RenderStats);
+};
+
+}  // namespace android
+
+#endif  // RENDER_STATS_H_
@@ -660,6 +660,11 @@ status_t ACodec::allocateBuffersOnPort(OMX_U32 portIndex) {
 
                     info.mData = new ABuffer(ptr, bufSize);
                 } else if (mQuirks & requiresAllocateBufferBit) {
+                    // Copies between mem and a component buffer on every
+                    // transfer, except for the in-process software
+                    // components OMXNodeInstance lets use mem in place.
+                    // Those don't normally carry the quirk though, and
+                    // take the useBuffer() path below.
                     err = mOMX->allocateBufferWithBackup(
                             mNode, portIndex, mem, &info.mBufferID);
                 } else {
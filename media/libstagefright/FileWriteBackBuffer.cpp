@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FileWriteBackBuffer"
+#include <inttypes.h>
+#include <utils/Log.h>
+
+#include "include/FileWriteBackBuffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Upper bounds of all but the last latency bucket.
+static const size_t kNumLatencyBucketEdges = 9;
+static const int64_t kLatencyBucketEdgesUs[kNumLatencyBucketEdges] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+};
+
+// Keeps a single writev() call within any IOV_MAX.
+static const int kMaxNumIOVecs = 64;
+
+static int64_t getNowUs() {
+    return systemTime() / 1000;
+}
+
+void FileWriteBackBuffer::LatencyStats::add(int64_t latencyUs) {
+    ++mCount;
+    mTotalUs += latencyUs;
+    if (latencyUs > mMaxUs) {
+        mMaxUs = latencyUs;
+    }
+
+    size_t i = 0;
+    while (i < kNumLatencyBucketEdges && latencyUs >= kLatencyBucketEdgesUs[i]) {
+        ++i;
+    }
+    ++mBuckets[i];
+}
+
+void FileWriteBackBuffer::LatencyStats::dump(const char *name, int fd) const {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+    snprintf(buffer, SIZE, "       %s: %" PRIu64 ", mean %.2f ms, max %.2f ms\n",
+            name, mCount, mCount > 0 ? mTotalUs / 1E3 / mCount : 0.0, mMaxUs / 1E3);
+    result.append(buffer);
+    if (mCount > 0) {
+        result.append("        ");
+        for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+            if (i < kNumLatencyBucketEdges) {
+                snprintf(buffer, SIZE, " <%" PRId64 "ms: %" PRIu64,
+                        kLatencyBucketEdgesUs[i] / 1000, mBuckets[i]);
+            } else {
+                snprintf(buffer, SIZE, " more: %" PRIu64, mBuckets[i]);
+            }
+            result.append(buffer);
+        }
+        result.append("\n");
+    }
+    ::write(fd, result.string(), result.size());
+}
+
+FileWriteBackBuffer::FileWriteBackBuffer(
+        int fd, size_t bufferSize, size_t numBuffers, bool directIO)
+    : mFd(fd),
+      mDirectFd(-1),
+      mBufferSize(bufferSize),
+      mMaxNumBuffers(numBuffers),
+      mDirectIORequested(directIO),
+      mDirectIO(false),
+      mNumBuffers(0),
+      mCurrentBuffer(NULL),
+      mOffset(0),
+      mStarted(false),
+      mDone(false),
+      mError(OK),
+      mNumBytesWritten(0) {
+    CHECK_GT(mBufferSize, 0u);
+    CHECK_EQ(mBufferSize % kAlignment, 0u);
+    // One to append to while another is written out.
+    CHECK_GE(mMaxNumBuffers, 2u);
+
+    memset(&mWriteLatency, 0, sizeof(mWriteLatency));
+    memset(&mStallLatency, 0, sizeof(mStallLatency));
+}
+
+FileWriteBackBuffer::~FileWriteBackBuffer() {
+    stop();
+
+    if (mCurrentBuffer != NULL) {
+        mFreeBuffers.push_back(mCurrentBuffer);
+        mCurrentBuffer = NULL;
+    }
+    CHECK(mQueuedBuffers.empty() && mWritingBuffers.empty());
+    CHECK_EQ(mFreeBuffers.size(), mNumBuffers);
+
+    while (!mFreeBuffers.empty()) {
+        List<Buffer *>::iterator it = mFreeBuffers.begin();
+        free((*it)->mData);
+        delete *it;
+        mFreeBuffers.erase(it);
+    }
+}
+
+status_t FileWriteBackBuffer::start(off64_t offset) {
+    CHECK(!mStarted);
+
+    mOffset = offset;
+    mDone = false;
+    mError = OK;
+
+    if (mDirectIORequested) {
+        // A description of its own, O_DIRECT must not leak into the
+        // caller's one.
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", mFd);
+        mDirectFd = open(path, O_WRONLY | O_LARGEFILE | O_DIRECT);
+        mDirectIO = mDirectFd >= 0;
+        if (mDirectFd < 0) {
+            ALOGW("No direct I/O on fd %d (%s), using the page cache",
+                    mFd, strerror(errno));
+        }
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    int err = pthread_create(&mThread, &attr, ThreadWrapper, this);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0) {
+        if (mDirectFd >= 0) {
+            close(mDirectFd);
+            mDirectFd = -1;
+            mDirectIO = false;
+        }
+        return -err;
+    }
+
+    mStarted = true;
+    return OK;
+}
+
+status_t FileWriteBackBuffer::stop() {
+    if (!mStarted) {
+        return OK;
+    }
+
+    status_t err = flush();
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDone = true;
+        mQueueChanged.signal();
+    }
+
+    void *dummy;
+    pthread_join(mThread, &dummy);
+    mStarted = false;
+
+    if (mDirectFd >= 0) {
+        close(mDirectFd);
+        mDirectFd = -1;
+    }
+
+    ALOGV("%" PRIu64 " bytes written in %" PRIu64 " writes, max %" PRId64 " us",
+            mNumBytesWritten, mWriteLatency.mCount, mWriteLatency.mMaxUs);
+
+    return err;
+}
+
+void FileWriteBackBuffer::append(const void *data, size_t size) {
+    CHECK(mStarted);
+
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        if (mCurrentBuffer == NULL) {
+            Mutex::Autolock autoLock(mLock);
+            mCurrentBuffer = getFreeBuffer_l();
+            mCurrentBuffer->mOffset = mOffset - mOffset % kAlignment;
+            mCurrentBuffer->mStart = mOffset - mCurrentBuffer->mOffset;
+            mCurrentBuffer->mEnd = mCurrentBuffer->mStart;
+        }
+
+        // mCurrentBuffer is ours alone until queued.
+        size_t copy = mBufferSize - mCurrentBuffer->mEnd;
+        if (copy > size) {
+            copy = size;
+        }
+        memcpy(mCurrentBuffer->mData + mCurrentBuffer->mEnd, ptr, copy);
+        mCurrentBuffer->mEnd += copy;
+        mOffset += copy;
+        ptr += copy;
+        size -= copy;
+
+        if (mCurrentBuffer->mEnd == mBufferSize) {
+            Mutex::Autolock autoLock(mLock);
+            queueCurrentBuffer_l();
+        }
+    }
+}
+
+void FileWriteBackBuffer::overwrite(
+        off64_t offset, const void *data, size_t size) {
+    CHECK(mStarted);
+    CHECK_LE(offset + (off64_t)size, mOffset);
+
+    const uint8_t *ptr = (const uint8_t *)data;
+    off64_t end = offset + size;
+
+    Mutex::Autolock autoLock(mLock);
+
+    // Whatever precedes the first buffer still in memory is in the file,
+    // once the buffers being written out are.
+    off64_t inMemoryOffset;
+    for (;;) {
+        const Buffer *first = !mQueuedBuffers.empty() ? *mQueuedBuffers.begin() : mCurrentBuffer;
+        inMemoryOffset = first != NULL ? first->mOffset + first->mStart : mOffset;
+        if (offset >= inMemoryOffset || mWritingBuffers.empty()) {
+            break;
+        }
+        mBufferWritten.wait(mLock);
+    }
+
+    if (offset < inMemoryOffset) {
+        size_t n = (end < inMemoryOffset ? end : inMemoryOffset) - offset;
+        if (mError == OK && pwrite64(mFd, ptr, n, offset) != (ssize_t)n) {
+            ALOGE("Failed to overwrite %zu bytes at %" PRId64 " (%s)",
+                    n, offset, strerror(errno));
+            mError = ERROR_IO;
+        }
+        offset += n;
+        ptr += n;
+    }
+
+    List<Buffer *>::iterator it = mQueuedBuffers.begin();
+    while (offset < end) {
+        Buffer *buffer = it != mQueuedBuffers.end() ? *it++ : mCurrentBuffer;
+        CHECK(buffer != NULL);
+
+        off64_t bufferEnd = buffer->mOffset + buffer->mEnd;
+        if (offset >= bufferEnd) {
+            continue;
+        }
+        size_t n = (end < bufferEnd ? end : bufferEnd) - offset;
+        memcpy(buffer->mData + (offset - buffer->mOffset), ptr, n);
+        offset += n;
+        ptr += n;
+    }
+}
+
+void FileWriteBackBuffer::push() {
+    if (mCurrentBuffer == NULL || mCurrentBuffer->mEnd == mCurrentBuffer->mStart) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    queueCurrentBuffer_l();
+}
+
+status_t FileWriteBackBuffer::flush() {
+    push();
+
+    Mutex::Autolock autoLock(mLock);
+    while (!mQueuedBuffers.empty() || !mWritingBuffers.empty()) {
+        mBufferWritten.wait(mLock);
+    }
+    return mError;
+}
+
+void FileWriteBackBuffer::dump(int fd) const {
+    Mutex::Autolock autoLock(mLock);
+
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    snprintf(buffer, SIZE,
+            "     Write-back: %zu x %zu KB buffers allocated, %s, %" PRIu64 " bytes written\n",
+            mNumBuffers, mBufferSize / 1024,
+            mDirectIO ? "direct I/O" : "page cache", mNumBytesWritten);
+    ::write(fd, buffer, strlen(buffer));
+
+    mWriteLatency.dump("writes", fd);
+    mStallLatency.dump("stalls", fd);
+}
+
+// static
+void *FileWriteBackBuffer::ThreadWrapper(void *me) {
+    static_cast<FileWriteBackBuffer *>(me)->threadFunc();
+    return NULL;
+}
+
+void FileWriteBackBuffer::threadFunc() {
+    prctl(PR_SET_NAME, (unsigned long)"FileWriteBack", 0, 0, 0);
+
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (mQueuedBuffers.empty() && !mDone) {
+            mQueueChanged.wait(mLock);
+        }
+        if (mQueuedBuffers.empty()) {
+            break;
+        }
+
+        // Everything queued up meanwhile goes out in one go.
+        while (!mQueuedBuffers.empty()) {
+            mWritingBuffers.push_back(*mQueuedBuffers.begin());
+            mQueuedBuffers.erase(mQueuedBuffers.begin());
+        }
+
+        status_t err = mError;
+        if (err == OK) {
+            mLock.unlock();
+            err = writeBuffers(mWritingBuffers);
+            mLock.lock();
+        }
+        if (mError == OK) {
+            mError = err;
+        }
+
+        while (!mWritingBuffers.empty()) {
+            mFreeBuffers.push_back(*mWritingBuffers.begin());
+            mWritingBuffers.erase(mWritingBuffers.begin());
+        }
+        mBufferWritten.broadcast();
+    }
+}
+
+FileWriteBackBuffer::Buffer *FileWriteBackBuffer::getFreeBuffer_l() {
+    if (mFreeBuffers.empty() && mNumBuffers == mMaxNumBuffers) {
+        int64_t startUs = getNowUs();
+        do {
+            mBufferWritten.wait(mLock);
+        } while (mFreeBuffers.empty());
+        mStallLatency.add(getNowUs() - startUs);
+    }
+
+    if (!mFreeBuffers.empty()) {
+        Buffer *buffer = *mFreeBuffers.begin();
+        mFreeBuffers.erase(mFreeBuffers.begin());
+        return buffer;
+    }
+
+    Buffer *buffer = new Buffer;
+    void *data = NULL;
+    CHECK_EQ(posix_memalign(&data, kAlignment, mBufferSize), 0);
+    buffer->mData = (uint8_t *)data;
+    ++mNumBuffers;
+    return buffer;
+}
+
+void FileWriteBackBuffer::queueCurrentBuffer_l() {
+    mQueuedBuffers.push_back(mCurrentBuffer);
+    mCurrentBuffer = NULL;
+    mQueueChanged.signal();
+}
+
+status_t FileWriteBackBuffer::writeBuffers(const List<Buffer *> &buffers) {
+    // A run of buffers goes out in a single writev(). With direct I/O, a
+    // run only continues across aligned offsets, so that every iovec
+    // but the unaligned edges of the run is aligned.
+    List<Buffer *>::const_iterator it = buffers.begin();
+    while (it != buffers.end()) {
+        Vector<Buffer *> run;
+        run.push(*it++);
+        while (it != buffers.end()) {
+            off64_t runEnd = run.top()->mOffset + run.top()->mEnd;
+            CHECK_EQ(runEnd, (*it)->mOffset + (off64_t)(*it)->mStart);
+            if (mDirectFd >= 0 && runEnd % kAlignment != 0) {
+                break;
+            }
+            run.push(*it++);
+        }
+
+        const Buffer *first = run[0];
+        const Buffer *last = run.top();
+        off64_t start = first->mOffset + first->mStart;
+        off64_t end = last->mOffset + last->mEnd;
+
+        off64_t alignedStart = start;
+        off64_t alignedEnd = end;
+        if (mDirectFd >= 0) {
+            alignedStart = (start + kAlignment - 1) / kAlignment * kAlignment;
+            if (alignedStart > end) {
+                alignedStart = end;
+            }
+            alignedEnd = end / kAlignment * kAlignment;
+            if (alignedEnd < alignedStart) {
+                alignedEnd = alignedStart;
+            }
+        }
+
+        Vector<struct iovec> iovecs;
+        for (size_t i = 0; i < run.size(); ++i) {
+            off64_t from = run[i]->mOffset + run[i]->mStart;
+            off64_t to = run[i]->mOffset + run[i]->mEnd;
+            if (from < alignedStart) {
+                from = alignedStart;
+            }
+            if (to > alignedEnd) {
+                to = alignedEnd;
+            }
+            if (from < to) {
+                struct iovec iov;
+                iov.iov_base = run[i]->mData + (from - run[i]->mOffset);
+                iov.iov_len = to - from;
+                iovecs.push(iov);
+            }
+        }
+
+        status_t err = writeEdge(start, first->mData + first->mStart, alignedStart - start);
+        if (err == OK && !iovecs.isEmpty()) {
+            Vector<struct iovec> copy = iovecs;
+            err = writeRange(
+                    mDirectFd >= 0 ? mDirectFd : mFd, alignedStart,
+                    copy.editArray(), copy.size(), alignedEnd - alignedStart);
+            if (err != OK && mDirectFd >= 0) {
+                ALOGW("Direct write failed (%d), using the page cache", err);
+                {
+                    Mutex::Autolock autoLock(mLock);
+                    mDirectIO = false;
+                }
+                close(mDirectFd);
+                mDirectFd = -1;
+                err = writeRange(
+                        mFd, alignedStart, iovecs.editArray(), iovecs.size(),
+                        alignedEnd - alignedStart);
+            }
+        }
+        if (err == OK) {
+            err = writeEdge(
+                    alignedEnd, last->mData + (alignedEnd - last->mOffset), end - alignedEnd);
+        }
+        if (err != OK) {
+            ALOGE("Failed to write %" PRId64 " bytes at %" PRId64 " (%d)",
+                    end - start, start, err);
+            return err;
+        }
+    }
+    return OK;
+}
+
+status_t FileWriteBackBuffer::writeRange(
+        int fd, off64_t offset, struct iovec *iov, int iovcnt, size_t size) {
+    // This thread owns the file position while started.
+    if (lseek64(fd, offset, SEEK_SET) < 0) {
+        return -errno;
+    }
+
+    while (size > 0) {
+        int64_t startUs = getNowUs();
+        ssize_t n = writev(fd, iov, iovcnt < kMaxNumIOVecs ? iovcnt : kMaxNumIOVecs);
+        int64_t latencyUs = getNowUs() - startUs;
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        } else if (n == 0) {
+            return ERROR_IO;
+        }
+
+        {
+            Mutex::Autolock autoLock(mLock);
+            mWriteLatency.add(latencyUs);
+            mNumBytesWritten += n;
+        }
+
+        size -= n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return OK;
+}
+
+status_t FileWriteBackBuffer::writeEdge(
+        off64_t offset, const uint8_t *data, size_t size) {
+    // Through the page cache, whatever the alignment.
+    while (size > 0) {
+        int64_t startUs = getNowUs();
+        ssize_t n = pwrite64(mFd, data, size, offset);
+        int64_t latencyUs = getNowUs() - startUs;
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        } else if (n == 0) {
+            return ERROR_IO;
+        }
+
+        {
+            Mutex::Autolock autoLock(mLock);
+            mWriteLatency.add(latencyUs);
+            mNumBytesWritten += n;
+        }
+
+        offset += n;
+        data += n;
+        size -= n;
+    }
+    return OK;
+}
+
+}  // namespace android
@@ -120,6 +120,11 @@ public:
     virtual status_t read(MediaBuffer **buffer, const ReadOptions *options = NULL);
     virtual status_t fragmentedRead(MediaBuffer **buffer, const ReadOptions *options = NULL);
 
+    virtual status_t readMultiple(
+            Vector<MediaBuffer *> *buffers, size_t maxNumBuffers,
+            const ReadOptions *options = NULL);
+    virtual bool supportReadMultiple();
+
 protected:
     virtual ~MPEG4Source();
 
@@ -163,6 +168,7 @@ private:
     bool mStarted;
 
     MediaBufferGroup *mGroup;
+    size_t mMaxInputSize;
 
     MediaBuffer *mBuffer;
 
@@ -171,6 +177,10 @@ private:
     uint8_t *mSrcBuffer;
 
     size_t parseNALSize(const uint8_t *data) const;
+    ssize_t convertNALsInPlace(uint8_t *data, size_t size) const;
+    status_t seekToSample(
+            int64_t seekTimeUs, ReadOptions::SeekMode mode,
+            int64_t *targetSampleTimeUs);
     status_t parseChunk(off64_t *offset);
     status_t parseTrackFragmentHeader(off64_t offset, off64_t size);
     status_t parseTrackFragmentRun(off64_t offset, off64_t size);
@@ -3354,6 +3364,7 @@ MPEG4Source::MPEG4Source(
       mNALLengthSize(0),
       mStarted(false),
       mGroup(NULL),
+      mMaxInputSize(0),
       mBuffer(NULL),
       mWantsNALFragments(false),
       mSrcBuffer(NULL) {
@@ -3450,6 +3461,7 @@ status_t MPEG4Source::start(MetaData *params) {
     }
     mGroup = new MediaBufferGroup;
     mGroup->add_buffer(new MediaBuffer(max_size));
+    mMaxInputSize = max_size;
 
     mSrcBuffer = new (std::nothrow) uint8_t[max_size];
     if (mSrcBuffer == NULL) {
@@ -4071,6 +4083,91 @@ size_t MPEG4Source::parseNALSize(const uint8_t *data) const {
     return 0;
 }
 
+// Moves on to the sync sample to start reading at when seeking to
+// |seekTimeUs|, the time of the sample to skip ahead to in *targetSampleTimeUs
+// if seeking to the closest sample.
+status_t MPEG4Source::seekToSample(
+        int64_t seekTimeUs, ReadOptions::SeekMode mode,
+        int64_t *targetSampleTimeUs) {
+    uint32_t findFlags = 0;
+    switch (mode) {
+        case ReadOptions::SEEK_PREVIOUS_SYNC:
+            findFlags = SampleTable::kFlagBefore;
+            break;
+        case ReadOptions::SEEK_NEXT_SYNC:
+            findFlags = SampleTable::kFlagAfter;
+            break;
+        case ReadOptions::SEEK_CLOSEST_SYNC:
+        case ReadOptions::SEEK_CLOSEST:
+            findFlags = SampleTable::kFlagClosest;
+            break;
+        default:
+            CHECK(!"Should not be here.");
+            break;
+    }
+
+    uint32_t sampleIndex;
+    status_t err = mSampleTable->findSampleAtTime(
+            seekTimeUs, 1000000, mTimescale,
+            &sampleIndex, findFlags);
+
+    if (mode == ReadOptions::SEEK_CLOSEST) {
+        // We found the closest sample already, now we want the sync
+        // sample preceding it (or the sample itself of course), even
+        // if the subsequent sync sample is closer.
+        findFlags = SampleTable::kFlagBefore;
+    }
+
+    uint32_t syncSampleIndex;
+    if (err == OK) {
+        err = mSampleTable->findSyncSampleNear(
+                sampleIndex, &syncSampleIndex, findFlags);
+    }
+
+    uint32_t sampleTime;
+    if (err == OK) {
+        err = mSampleTable->getMetaDataForSample(
+                sampleIndex, NULL, NULL, &sampleTime);
+    }
+
+    if (err != OK) {
+        if (err == ERROR_OUT_OF_RANGE) {
+            // An attempt to seek past the end of the stream would
+            // normally cause this ERROR_OUT_OF_RANGE error. Propagating
+            // this all the way to the MediaPlayer would cause abnormal
+            // termination. Legacy behaviour appears to be to behave as if
+            // we had seeked to the end of stream, ending normally.
+            err = ERROR_END_OF_STREAM;
+        }
+        ALOGV("end of stream");
+        return err;
+    }
+
+    if (mode == ReadOptions::SEEK_CLOSEST) {
+        *targetSampleTimeUs = (sampleTime * 1000000ll) / mTimescale;
+    }
+
+#if 0
+    uint32_t syncSampleTime;
+    CHECK_EQ(OK, mSampleTable->getMetaDataForSample(
+                syncSampleIndex, NULL, NULL, &syncSampleTime));
+
+    ALOGI("seek to time %lld us => sample at time %lld us, "
+         "sync sample at time %lld us",
+         seekTimeUs,
+         sampleTime * 1000000ll / mTimescale,
+         syncSampleTime * 1000000ll / mTimescale);
+#endif
+
+    mCurrentSampleIndex = syncSampleIndex;
+    if (mBuffer != NULL) {
+        mBuffer->release();
+        mBuffer = NULL;
+    }
+
+    return OK;
+}
+
 status_t MPEG4Source::read(
         MediaBuffer **out, const ReadOptions *options) {
     Mutex::Autolock autoLock(mLock);
@@ -4088,82 +4185,11 @@ status_t MPEG4Source::read(
     int64_t seekTimeUs;
     ReadOptions::SeekMode mode;
     if (options && options->getSeekTo(&seekTimeUs, &mode)) {
-        uint32_t findFlags = 0;
-        switch (mode) {
-            case ReadOptions::SEEK_PREVIOUS_SYNC:
-                findFlags = SampleTable::kFlagBefore;
-                break;
-            case ReadOptions::SEEK_NEXT_SYNC:
-                findFlags = SampleTable::kFlagAfter;
-                break;
-            case ReadOptions::SEEK_CLOSEST_SYNC:
-            case ReadOptions::SEEK_CLOSEST:
-                findFlags = SampleTable::kFlagClosest;
-                break;
-            default:
-                CHECK(!"Should not be here.");
-                break;
-        }
-
-        uint32_t sampleIndex;
-        status_t err = mSampleTable->findSampleAtTime(
-                seekTimeUs, 1000000, mTimescale,
-                &sampleIndex, findFlags);
-
-        if (mode == ReadOptions::SEEK_CLOSEST) {
-            // We found the closest sample already, now we want the sync
-            // sample preceding it (or the sample itself of course), even
-            // if the subsequent sync sample is closer.
-            findFlags = SampleTable::kFlagBefore;
-        }
-
-        uint32_t syncSampleIndex;
-        if (err == OK) {
-            err = mSampleTable->findSyncSampleNear(
-                    sampleIndex, &syncSampleIndex, findFlags);
-        }
-
-        uint32_t sampleTime;
-        if (err == OK) {
-            err = mSampleTable->getMetaDataForSample(
-                    sampleIndex, NULL, NULL, &sampleTime);
-        }
-
+        status_t err = seekToSample(seekTimeUs, mode, &targetSampleTimeUs);
         if (err != OK) {
-            if (err == ERROR_OUT_OF_RANGE) {
-                // An attempt to seek past the end of the stream would
-                // normally cause this ERROR_OUT_OF_RANGE error. Propagating
-                // this all the way to the MediaPlayer would cause abnormal
-                // termination. Legacy behaviour appears to be to behave as if
-                // we had seeked to the end of stream, ending normally.
-                err = ERROR_END_OF_STREAM;
-            }
-            ALOGV("end of stream");
             return err;
         }
 
-        if (mode == ReadOptions::SEEK_CLOSEST) {
-            targetSampleTimeUs = (sampleTime * 1000000ll) / mTimescale;
-        }
-
-#if 0
-        uint32_t syncSampleTime;
-        CHECK_EQ(OK, mSampleTable->getMetaDataForSample(
-                    syncSampleIndex, NULL, NULL, &syncSampleTime));
-
-        ALOGI("seek to time %lld us => sample at time %lld us, "
-             "sync sample at time %lld us",
-             seekTimeUs,
-             sampleTime * 1000000ll / mTimescale,
-             syncSampleTime * 1000000ll / mTimescale);
-#endif
-
-        mCurrentSampleIndex = syncSampleIndex;
-        if (mBuffer != NULL) {
-            mBuffer->release();
-            mBuffer = NULL;
-        }
-
         // fall through
     }
 
@@ -4368,6 +4394,217 @@ status_t MPEG4Source::read(
     }
 }
 
+// Replaces the 4 byte NAL length prefixes of the |size| bytes at |data|
+// with start codes, dropping empty NAL units the way read() does, and
+// returns the resulting size or a negative value if the data is malformed.
+ssize_t MPEG4Source::convertNALsInPlace(uint8_t *data, size_t size) const {
+    CHECK_EQ(mNALLengthSize, 4u);
+
+    size_t srcOffset = 0;
+    size_t dstOffset = 0;
+    while (srcOffset < size) {
+        if (size - srcOffset < mNALLengthSize) {
+            return -1;
+        }
+
+        size_t nalLength = parseNALSize(&data[srcOffset]);
+        srcOffset += mNALLengthSize;
+
+        if (nalLength > size - srcOffset) {
+            return -1;
+        }
+
+        if (nalLength == 0) {
+            continue;
+        }
+
+        // The output never overtakes the input, the start code only ever
+        // overwrites length prefixes already parsed.
+        data[dstOffset++] = 0;
+        data[dstOffset++] = 0;
+        data[dstOffset++] = 0;
+        data[dstOffset++] = 1;
+        if (dstOffset != srcOffset) {
+            memmove(&data[dstOffset], &data[srcOffset], nalLength);
+        }
+        srcOffset += nalLength;
+        dstOffset += nalLength;
+    }
+
+    return dstOffset;
+}
+
+// The samples returned by readMultiple are clones of the buffer they were
+// read into together, which is freed once the last of them is released.
+struct SampleRunObserver : public MediaBufferObserver {
+    SampleRunObserver() {}
+
+    virtual void signalBufferReturned(MediaBuffer *buffer) {
+        buffer->setObserver(NULL);
+        buffer->release();
+    }
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(SampleRunObserver);
+};
+
+static SampleRunObserver gSampleRunObserver;
+
+// Upper bound on how much readMultiple reads at once.
+static const size_t kMaxSampleRunSize = 2 * 1024 * 1024;
+
+struct SampleRunEntry {
+    size_t mSize;
+    uint32_t mCTS;
+    uint32_t mSTTS;
+    bool mIsSyncSample;
+};
+
+bool MPEG4Source::supportReadMultiple() {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mFirstMoofOffset > 0 || mWantsNALFragments) {
+        return false;
+    }
+
+    if ((mIsAVC || mIsHEVC) && mNALLengthSize != 4) {
+        return false;
+    }
+
+    int32_t drm = 0;
+    return !mFormat->findInt32(kKeyIsDRM, &drm) || drm == 0;
+}
+
+status_t MPEG4Source::readMultiple(
+        Vector<MediaBuffer *> *buffers, size_t maxNumBuffers,
+        const ReadOptions *options) {
+    buffers->clear();
+
+    if (!supportReadMultiple()) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    CHECK(mStarted);
+
+    int64_t targetSampleTimeUs = -1;
+
+    int64_t seekTimeUs;
+    ReadOptions::SeekMode mode;
+    if (options && options->getSeekTo(&seekTimeUs, &mode)) {
+        status_t err = seekToSample(seekTimeUs, mode, &targetSampleTimeUs);
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    // Gather the run of samples stored back to back from here on.
+    Vector<SampleRunEntry> samples;
+
+    off64_t runOffset = 0;
+    size_t runSize = 0;
+    while (samples.size() < maxNumBuffers || samples.empty()) {
+        off64_t offset;
+        SampleRunEntry info;
+        status_t err = mSampleTable->getMetaDataForSample(
+                mCurrentSampleIndex + samples.size(), &offset, &info.mSize,
+                &info.mCTS, &info.mIsSyncSample, &info.mSTTS);
+
+        if (err != OK) {
+            if (samples.empty()) {
+                return err;
+            }
+            break;
+        }
+
+        if (samples.empty()) {
+            if (info.mSize > mMaxInputSize) {
+                ALOGE("buffer too small: %zu > %zu", info.mSize, mMaxInputSize);
+                return ERROR_BUFFER_TOO_SMALL;
+            }
+
+            runOffset = offset;
+        } else if (offset != runOffset + (off64_t)runSize
+                || info.mSize > mMaxInputSize
+                || info.mSize > kMaxSampleRunSize - runSize) {
+            break;
+        }
+
+        runSize += info.mSize;
+        samples.push(info);
+    }
+
+    MediaBuffer *run = new MediaBuffer(runSize);
+    if (mDataSource->readAt(runOffset, run->data(), runSize) < (ssize_t)runSize) {
+        run->release();
+        run = NULL;
+
+        return ERROR_IO;
+    }
+
+    // Convert the NAL units to start codes where they are, the run only
+    // ever shrinks.
+    Vector<size_t> offsets;
+    Vector<size_t> sizes;
+    size_t sampleOffset = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        size_t size = samples[i].mSize;
+
+        if (mIsAVC || mIsHEVC) {
+            ssize_t n = convertNALsInPlace(
+                    (uint8_t *)run->data() + sampleOffset, size);
+
+            if (n < 0) {
+                ALOGE("Video is malformed");
+                break;
+            }
+            offsets.push(sampleOffset);
+            sizes.push(n);
+        } else {
+            offsets.push(sampleOffset);
+            sizes.push(size);
+        }
+
+        sampleOffset += size;
+    }
+
+    if (offsets.empty()) {
+        run->release();
+        run = NULL;
+
+        return ERROR_MALFORMED;
+    }
+
+    run->setObserver(&gSampleRunObserver);
+
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        const SampleRunEntry &info = samples[i];
+
+        MediaBuffer *buffer = run->clone();
+        buffer->set_range(offsets[i], sizes[i]);
+        buffer->meta_data()->setInt64(
+                kKeyTime, ((int64_t)info.mCTS * 1000000) / mTimescale);
+        buffer->meta_data()->setInt64(
+                kKeyDuration, ((int64_t)info.mSTTS * 1000000) / mTimescale);
+
+        if (i == 0 && targetSampleTimeUs >= 0) {
+            buffer->meta_data()->setInt64(
+                    kKeyTargetTime, targetSampleTimeUs);
+        }
+
+        if (info.mIsSyncSample) {
+            buffer->meta_data()->setInt32(kKeyIsSyncFrame, 1);
+        }
+
+        buffers->push(buffer);
+    }
+
+    mCurrentSampleIndex += offsets.size();
+
+    return OK;
+}
+
 status_t MPEG4Source::fragmentedRead(
         MediaBuffer **out, const ReadOptions *options) {
 
@@ -18,8 +18,10 @@
 #define LOG_TAG "MPEG4Writer"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
@@ -41,6 +43,8 @@
 
 #include "include/ESDS.h"
 #include "include/ExtendedUtils.h"
+#include "include/FileWriteBackBuffer.h"
+#include "include/StartCodeScanner.h"
 
 
 #ifndef __predict_false
@@ -63,6 +67,19 @@ static const uint8_t kNalUnitTypeSeqParamSet = 0x07;
 static const uint8_t kNalUnitTypePicParamSet = 0x08;
 static const int64_t kInitialDelayTimeUs     = 700000LL;
 
+// Write-back buffering of the sample data, unless kKeyWriteBackSize says
+// otherwise: about a second worth of it, within these bounds.
+static const int32_t kWriteBackBufferSize = 256 * 1024;
+static const int32_t kMinWriteBackSize = 1024 * 1024;
+static const int32_t kMaxWriteBackSize = 16 * 1024 * 1024;
+
+// Fragments end at the first sync frame past the fragment duration. With
+// sync frames far apart, or none but the first (an I frame interval of
+// -1), they end at whatever frame reaches either of these instead, for
+// their samples are held in memory until then.
+static const int64_t kMaxFragmentDurationFactor = 2;
+static const size_t kMaxFragmentSizeBytes = 32 * 1024 * 1024;
+
 class MPEG4Writer::Track {
 public:
     Track(MPEG4Writer *owner, const sp<MediaSource> &source, size_t trackId);
@@ -84,6 +101,12 @@ public:
     bool isHEVC() const { return mIsHEVC; }
     void addChunkOffset(off64_t offset);
     int32_t getTrackId() const { return mTrackId; }
+
+    // Fragmented files only
+    void writeTrexBox();
+    // Returns the file offset of the data offset in the trun box,
+    // which depends on the size of the enclosing moof box.
+    off64_t writeTrafBox(const Chunk &chunk, int64_t moovStartTimeUs);
     status_t dump(int fd, const Vector<String16>& args) const;
 
 private:
@@ -92,86 +115,89 @@ private:
         kSampleArraySize = 1000,
     };
 
-    // A helper class to handle faster write box with table entries
+    // A helper class to keep the sample table entries, which number in
+    // the millions for hours long recordings, compactly until the boxes
+    // are written out. Every value is kept as the zigzag varint coded
+    // difference from the value at the same position in the previous
+    // entry, a byte or two for most of them, in blocks that grow with the
+    // table. Past kMaxBytesInMemory, the full blocks are spilled to the
+    // owner's temporary file, if it has one, and read back in write().
     template<class TYPE>
     struct ListTableEntries {
-        ListTableEntries(uint32_t elementCapacity, uint32_t entryCapacity)
-            : mElementCapacity(elementCapacity),
+        ListTableEntries(MPEG4Writer *owner, uint32_t entryCapacity)
+            : mOwner(owner),
             mEntryCapacity(entryCapacity),
             mTotalNumTableEntries(0),
             mNumValuesInCurrEntry(0),
-            mCurrTableEntriesElement(NULL) {
-            CHECK_GT(mElementCapacity, 0);
+            mNumBytes(0),
+            mNumBytesInMemory(0),
+            mNumBytesSpilled(0),
+            mCurrBlock(NULL) {
             CHECK_GT(mEntryCapacity, 0);
+            CHECK_LE(mEntryCapacity, kMaxEntryCapacity);
+            memset(mFirstEntry, 0, sizeof(mFirstEntry));
+            memset(mLastEntry, 0, sizeof(mLastEntry));
         }
 
         // Free the allocated memory.
         ~ListTableEntries() {
-            while (!mTableEntryList.empty()) {
-                typename List<TYPE *>::iterator it = mTableEntryList.begin();
-                delete[] (*it);
-                mTableEntryList.erase(it);
+            while (!mBlocks.empty()) {
+                typename List<Block *>::iterator it = mBlocks.begin();
+                delete[] (*it)->mData;
+                delete *it;
+                mBlocks.erase(it);
             }
         }
 
         // Replace the value at the given position by the given value.
-        // There must be an existing value at the given position.
-        // @arg value must be in network byte order
+        // Only the values of the first entry can be replaced.
+        // @arg value in host byte order
         // @arg pos location the value must be in.
         void set(const TYPE& value, uint32_t pos) {
-            CHECK_LT(pos, mTotalNumTableEntries * mEntryCapacity);
-
-            typename List<TYPE *>::iterator it = mTableEntryList.begin();
-            uint32_t iterations = (pos / (mElementCapacity * mEntryCapacity));
-            while (it != mTableEntryList.end() && iterations > 0) {
-                ++it;
-                --iterations;
-            }
-            CHECK(it != mTableEntryList.end());
-            CHECK_EQ(iterations, 0);
-
-            (*it)[(pos % (mElementCapacity * mEntryCapacity))] = value;
+            CHECK_GT(mTotalNumTableEntries, 0);
+            CHECK_LT(pos, mEntryCapacity);
+            mFirstEntry[pos] = value;
         }
 
-        // Get the value at the given position by the given value.
-        // @arg value the retrieved value at the position in network byte order.
+        // Get the value at the given position, in the first entry.
+        // @arg value the retrieved value at the position in host byte order.
         // @arg pos location the value must be in.
         // @return true if a value is found.
         bool get(TYPE& value, uint32_t pos) const {
-            if (pos >= mTotalNumTableEntries * mEntryCapacity) {
+            CHECK_LT(pos, mEntryCapacity);
+            if (mTotalNumTableEntries == 0) {
                 return false;
             }
-
-            typename List<TYPE *>::iterator it = mTableEntryList.begin();
-            uint32_t iterations = (pos / (mElementCapacity * mEntryCapacity));
-            while (it != mTableEntryList.end() && iterations > 0) {
-                ++it;
-                --iterations;
-            }
-            CHECK(it != mTableEntryList.end());
-            CHECK_EQ(iterations, 0);
-
-            value = (*it)[(pos % (mElementCapacity * mEntryCapacity))];
+            value = mFirstEntry[pos];
             return true;
         }
 
         // Store a single value.
-        // @arg value must be in network byte order.
+        // @arg value in host byte order.
         void add(const TYPE& value) {
-            CHECK_LT(mNumValuesInCurrEntry, mElementCapacity);
-            uint32_t nEntries = mTotalNumTableEntries % mElementCapacity;
-            uint32_t nValues  = mNumValuesInCurrEntry % mEntryCapacity;
-            if (nEntries == 0 && nValues == 0) {
-                mCurrTableEntriesElement = new TYPE[mEntryCapacity * mElementCapacity];
-                CHECK(mCurrTableEntriesElement != NULL);
-                mTableEntryList.push_back(mCurrTableEntriesElement);
+            if (mCurrBlock == NULL
+                    || mCurrBlock->mSize + kMaxCodedValueSize > mCurrBlock->mCapacity) {
+                addBlock();
+            }
+
+            uint32_t nValues = mNumValuesInCurrEntry;
+            if (mTotalNumTableEntries == 0) {
+                mFirstEntry[nValues] = value;
             }
 
-            uint32_t pos = nEntries * mEntryCapacity + nValues;
-            mCurrTableEntriesElement[pos] = value;
+            uint64_t x = zigzag(value - mLastEntry[nValues]);
+            mLastEntry[nValues] = value;
+            size_t size = mCurrBlock->mSize;
+            while (x >= 0x80) {
+                mCurrBlock->mData[size++] = (x & 0x7f) | 0x80;
+                x >>= 7;
+            }
+            mCurrBlock->mData[size++] = x;
+            mNumBytes += size - mCurrBlock->mSize;
+            mCurrBlock->mSize = size;
 
             ++mNumValuesInCurrEntry;
-            if ((mNumValuesInCurrEntry % mEntryCapacity) == 0) {
+            if (mNumValuesInCurrEntry == mEntryCapacity) {
                 ++mTotalNumTableEntries;
                 mNumValuesInCurrEntry = 0;
             }
@@ -179,35 +205,168 @@ private:
 
         // Write out the table entries:
         // 1. the number of entries goes first
-        // 2. followed by the values in the table enties in order
+        // 2. followed by the values in the table enties in order,
+        //    in network byte order
         // @arg writer the writer to actual write to the storage
         void write(MPEG4Writer *writer) const {
-            CHECK_EQ(mNumValuesInCurrEntry % mEntryCapacity, 0);
-            uint32_t nEntries = mTotalNumTableEntries;
-            writer->writeInt32(nEntries);
-            for (typename List<TYPE *>::iterator it = mTableEntryList.begin();
-                it != mTableEntryList.end(); ++it) {
-                CHECK_GT(nEntries, 0);
-                if (nEntries >= mElementCapacity) {
-                    writer->write(*it, sizeof(TYPE) * mEntryCapacity, mElementCapacity);
-                    nEntries -= mElementCapacity;
-                } else {
-                    writer->write(*it, sizeof(TYPE) * mEntryCapacity, nEntries);
-                    break;
+            CHECK_EQ(mNumValuesInCurrEntry, 0);
+            writer->writeInt32(mTotalNumTableEntries);
+
+            uint8_t *spilled = NULL;
+            TYPE values[kNumValuesPerWrite];
+            TYPE last[kMaxEntryCapacity];
+            memset(last, 0, sizeof(last));
+            uint32_t nEntries = 0;
+            uint32_t nValues = 0;
+            size_t n = 0;
+            for (typename List<Block *>::const_iterator it = mBlocks.begin();
+                 it != mBlocks.end(); ++it) {
+                const Block *block = *it;
+                const uint8_t *data = block->mData;
+                if (data == NULL) {
+                    if (spilled == NULL) {
+                        spilled = new uint8_t[kMaxBlockSize];
+                    }
+                    CHECK_LE(block->mSize, (size_t)kMaxBlockSize);
+                    writer->readSpilledTableData(
+                            block->mSpillOffset, spilled, block->mSize);
+                    data = spilled;
+                }
+
+                // Values never straddle blocks.
+                size_t offset = 0;
+                while (offset < block->mSize) {
+                    uint64_t x = data[offset++];
+                    if (x & 0x80) {
+                        x &= 0x7f;
+                        for (size_t shift = 7;; shift += 7) {
+                            uint8_t byte = data[offset++];
+                            x |= (uint64_t)(byte & 0x7f) << shift;
+                            if (!(byte & 0x80)) {
+                                break;
+                            }
+                        }
+                    }
+                    last[nValues] += unzigzag(x, last[nValues]);
+                    values[n++] = hostToNetwork(
+                            nEntries == 0 ? mFirstEntry[nValues] : last[nValues]);
+
+                    if (++nValues == mEntryCapacity) {
+                        nValues = 0;
+                        ++nEntries;
+                        if (n + mEntryCapacity > kNumValuesPerWrite) {
+                            writer->write(values, sizeof(TYPE) * mEntryCapacity,
+                                    n / mEntryCapacity);
+                            n = 0;
+                        }
+                    }
                 }
             }
+            if (n > 0) {
+                writer->write(values, sizeof(TYPE) * mEntryCapacity, n / mEntryCapacity);
+            }
+            CHECK_EQ(nEntries, mTotalNumTableEntries);
+            delete[] spilled;
         }
 
         // Return the number of entries in the table.
         uint32_t count() const { return mTotalNumTableEntries; }
 
+        // Bytes the entries take, in memory and in the spill file.
+        size_t numBytesInMemory() const { return mNumBytesInMemory; }
+        size_t numBytesSpilled() const { return mNumBytesSpilled; }
+
     private:
-        uint32_t         mElementCapacity;  // # entries in an element
+        enum {
+            kMaxEntryCapacity = 3,
+            kMaxCodedValueSize = 10,  // A varint coded uint64_t
+            kMinBlockSize = 256,
+            kMaxBlockSize = 64 * 1024,
+            kMaxBytesInMemory = 256 * 1024,
+            kNumValuesPerWrite = 1024,
+        };
+
+        struct Block {
+            uint8_t *mData;        // NULL once spilled
+            size_t  mCapacity;
+            size_t  mSize;
+            off64_t mSpillOffset;
+        };
+
+        MPEG4Writer      *mOwner;
         uint32_t         mEntryCapacity;    // # of values in each entry
         uint32_t         mTotalNumTableEntries;
         uint32_t         mNumValuesInCurrEntry;  // up to mEntryCapacity
-        TYPE             *mCurrTableEntriesElement;
-        mutable List<TYPE *>     mTableEntryList;
+        TYPE             mFirstEntry[kMaxEntryCapacity];  // As set()
+        TYPE             mLastEntry[kMaxEntryCapacity];   // As added
+        size_t           mNumBytes;         // Coded
+        size_t           mNumBytesInMemory; // Allocated
+        size_t           mNumBytesSpilled;
+        Block            *mCurrBlock;
+        List<Block *>    mBlocks;
+
+        static uint64_t zigzag(uint32_t delta) {
+            return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+        }
+
+        static uint64_t zigzag(int64_t delta) {
+            return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        }
+
+        // The second argument only picks the type to decode to.
+        static uint32_t unzigzag(uint64_t x, uint32_t) {
+            return (uint32_t)(x >> 1) ^ -(uint32_t)(x & 1);
+        }
+
+        static int64_t unzigzag(uint64_t x, int64_t) {
+            return (int64_t)((x >> 1) ^ -(x & 1));
+        }
+
+        static uint32_t hostToNetwork(uint32_t x) { return htonl(x); }
+        static int64_t hostToNetwork(int64_t x) { return hton64(x); }
+
+        void addBlock() {
+            // Blocks double in size with the table, up to the maximum.
+            size_t capacity = mNumBytes;
+            if (capacity < kMinBlockSize) {
+                capacity = kMinBlockSize;
+            } else if (capacity > kMaxBlockSize) {
+                capacity = kMaxBlockSize;
+            }
+
+            if (mNumBytesInMemory + capacity > kMaxBytesInMemory) {
+                spillBlocks();
+            }
+
+            mCurrBlock = new Block;
+            mCurrBlock->mData = new uint8_t[capacity];
+            mCurrBlock->mCapacity = capacity;
+            mCurrBlock->mSize = 0;
+            mCurrBlock->mSpillOffset = -1;
+            mBlocks.push_back(mCurrBlock);
+            mNumBytesInMemory += capacity;
+        }
+
+        // Moves the full blocks still in memory to the spill file, for
+        // as long as there is one to take them.
+        void spillBlocks() {
+            for (typename List<Block *>::iterator it = mBlocks.begin();
+                 it != mBlocks.end(); ++it) {
+                Block *block = *it;
+                if (block->mData == NULL) {
+                    continue;
+                }
+                off64_t offset = mOwner->spillTableData(block->mData, block->mSize);
+                if (offset < 0) {
+                    return;
+                }
+                delete[] block->mData;
+                block->mData = NULL;
+                block->mSpillOffset = offset;
+                mNumBytesInMemory -= block->mCapacity;
+                mNumBytesSpilled += block->mSize;
+            }
+        }
 
         DISALLOW_EVIL_CONSTRUCTORS(ListTableEntries);
     };
@@ -238,6 +397,12 @@ private:
 
     List<MediaBuffer *> mChunkSamples;
 
+    // Fragmented files only
+    Vector<SampleInfo>  mChunkSampleInfos;
+    int64_t             mChunkDecodingTimeTicks;
+
+    uint32_t            mNumSamples;
+    uint32_t            mNumSyncSamples;
     bool                mSamplesHaveSameSize;
     ListTableEntries<uint32_t> *mStszTableEntries;
 
@@ -280,7 +445,7 @@ private:
     // Update the audio track's drift information.
     void updateDriftTime(const sp<MetaData>& meta);
 
-    int32_t getStartTimeOffsetScaledTime() const;
+    int32_t getStartTimeOffsetScaledTime(int64_t moovStartTimeUs) const;
 
     static void *ThreadWrapper(void *me);
     status_t threadEntry();
@@ -351,6 +516,7 @@ private:
 
 MPEG4Writer::MPEG4Writer(const char *filename)
     : mFd(-1),
+      mWriteBackBuffer(NULL),
       mInitCheck(NO_INIT),
       mIsRealTimeRecording(true),
       mUse4ByteNalLength(true),
@@ -361,6 +527,7 @@ MPEG4Writer::MPEG4Writer(const char *filename)
       mWriterThreadStarted(false),
       mOffset(0),
       mMdatOffset(0),
+      mFragmented(false),
       mEstimatedMoovBoxSize(0),
       mInterleaveDurationUs(1000000),
       mLatitudex10000(0),
@@ -368,6 +535,12 @@ MPEG4Writer::MPEG4Writer(const char *filename)
       mAreGeoTagsAvailable(false),
       mStartTimeOffsetMs(-1),
       mHFRRatio(1),
+      mNumChunksWritten(0),
+      mTotalChunkWriteTimeUs(0),
+      mMaxChunkWriteTimeUs(0),
+      mTableSpillFd(-1),
+      mTableSpillSize(0),
+      mTableSpillFailed(false),
       mIsVideoHEVC(false),
       mIsAudioAMR(false) {
 
@@ -379,6 +552,7 @@ MPEG4Writer::MPEG4Writer(const char *filename)
 
 MPEG4Writer::MPEG4Writer(int fd)
     : mFd(dup(fd)),
+      mWriteBackBuffer(NULL),
       mInitCheck(mFd < 0? NO_INIT: OK),
       mIsRealTimeRecording(true),
       mUse4ByteNalLength(true),
@@ -389,6 +563,7 @@ MPEG4Writer::MPEG4Writer(int fd)
       mWriterThreadStarted(false),
       mOffset(0),
       mMdatOffset(0),
+      mFragmented(false),
       mEstimatedMoovBoxSize(0),
       mInterleaveDurationUs(1000000),
       mLatitudex10000(0),
@@ -396,12 +571,20 @@ MPEG4Writer::MPEG4Writer(int fd)
       mAreGeoTagsAvailable(false),
       mStartTimeOffsetMs(-1),
       mHFRRatio(1),
+      mNumChunksWritten(0),
+      mTotalChunkWriteTimeUs(0),
+      mMaxChunkWriteTimeUs(0),
+      mTableSpillFd(-1),
+      mTableSpillSize(0),
+      mTableSpillFailed(false),
       mIsVideoHEVC(false),
       mIsAudioAMR(false) {
 }
 
 MPEG4Writer::~MPEG4Writer() {
     reset();
+    delete mWriteBackBuffer;
+    mWriteBackBuffer = NULL;
 
     while (!mTracks.empty()) {
         List<Track *>::iterator it = mTracks.begin();
@@ -421,7 +604,15 @@ status_t MPEG4Writer::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     mStarted: %s\n", mStarted? "true": "false");
     result.append(buffer);
+    snprintf(buffer, SIZE, "     Chunks written: %u, mean %.2f ms, max %.2f ms\n",
+            mNumChunksWritten,
+            mNumChunksWritten > 0? mTotalChunkWriteTimeUs / 1E3 / mNumChunksWritten: 0.0,
+            mMaxChunkWriteTimeUs / 1E3);
+    result.append(buffer);
     ::write(fd, result.string(), result.size());
+    if (mWriteBackBuffer != NULL) {
+        mWriteBackBuffer->dump(fd);
+    }
     for (List<Track *>::iterator it = mTracks.begin();
          it != mTracks.end(); ++it) {
         (*it)->dump(fd, args);
@@ -439,10 +630,27 @@ status_t MPEG4Writer::Track::dump(
     snprintf(buffer, SIZE, "       reached EOS: %s\n",
             mReachedEOS? "true": "false");
     result.append(buffer);
-    snprintf(buffer, SIZE, "       frames encoded : %d\n", mStszTableEntries->count());
+    snprintf(buffer, SIZE, "       frames encoded : %d\n", mNumSamples);
     result.append(buffer);
     snprintf(buffer, SIZE, "       duration encoded : %" PRId64 " us\n", mTrackDurationUs);
     result.append(buffer);
+    size_t inMemory = mStszTableEntries->numBytesInMemory()
+            + mStcoTableEntries->numBytesInMemory()
+            + mCo64TableEntries->numBytesInMemory()
+            + mStscTableEntries->numBytesInMemory()
+            + mStssTableEntries->numBytesInMemory()
+            + mSttsTableEntries->numBytesInMemory()
+            + mCttsTableEntries->numBytesInMemory();
+    size_t spilled = mStszTableEntries->numBytesSpilled()
+            + mStcoTableEntries->numBytesSpilled()
+            + mCo64TableEntries->numBytesSpilled()
+            + mStscTableEntries->numBytesSpilled()
+            + mStssTableEntries->numBytesSpilled()
+            + mSttsTableEntries->numBytesSpilled()
+            + mCttsTableEntries->numBytesSpilled();
+    snprintf(buffer, SIZE, "       sample tables : %zu KB in memory, %zu KB spilled\n",
+            inMemory / 1024, spilled / 1024);
+    result.append(buffer);
     ::write(fd, result.string(), result.size());
     return OK;
 }
@@ -616,7 +824,22 @@ status_t MPEG4Writer::start(MetaData *param) {
         mUse32BitOffset = false;
     }
 
-    if (mUse32BitOffset) {
+    int64_t fragmentDurationUs;
+    if (param &&
+        param->findInt64(kKeyFragmentDuration, &fragmentDurationUs) &&
+        fragmentDurationUs > 0) {
+        if (fragmentDurationUs > UINT32_MAX) {
+            ALOGE("Fragment duration is too large: %" PRId64 " us", fragmentDurationUs);
+            return BAD_VALUE;
+        }
+
+        // The track chunks become the fragments.
+        mFragmented = true;
+        mInterleaveDurationUs = fragmentDurationUs;
+    }
+
+    // Fragments only hold offsets relative to their moof box.
+    if (mUse32BitOffset && !mFragmented) {
         // Implicit 32 bit file size limit
         if (mMaxFileSizeLimitBytes == 0) {
             mMaxFileSizeLimitBytes = kMax32BitFileSize;
@@ -667,7 +890,7 @@ status_t MPEG4Writer::start(MetaData *param) {
      * to make the file streamable. mStreamableFile does not tell
      * whether the actual recorded file is streamable or not.
      */
-    mStreamableFile =
+    mStreamableFile = !mFragmented &&
         (mMaxFileSizeLimitBytes != 0 &&
          mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes);
 
@@ -735,13 +958,28 @@ status_t MPEG4Writer::start(MetaData *param) {
 
     mOffset = mMdatOffset;
     lseek64(mFd, mMdatOffset, SEEK_SET);
-    if (mUse32BitOffset) {
+    status_t err = startWriteBack(param, mMdatOffset);
+    if (err != OK) {
+        return err;
+    }
+
+    if (!mFragmented) {
+        startTableSpill(param);
+    }
+
+    if (mFragmented) {
+        // The moov box has to wait for the codec specific data, see
+        // writeChunkToFile(), and every fragment has its own mdat box.
+        mInitMoovWritten = false;
+        mFragmentSequence = 0;
+        mMehdOffset = 0;
+    } else if (mUse32BitOffset) {
         write("????mdat", 8);
     } else {
         write("\x00\x00\x00\x01mdat????????", 16);
     }
 
-    status_t err = startWriterThread();
+    err = startWriterThread();
     if (err != OK) {
         return err;
     }
@@ -847,6 +1085,11 @@ void MPEG4Writer::writeCompositionMatrix(int degrees) {
 }
 
 void MPEG4Writer::release() {
+    if (mWriteBackBuffer != NULL) {
+        // Kept around for dump()
+        mWriteBackBuffer->stop();
+    }
+    stopTableSpill();
     close(mFd);
     mFd = -1;
     mInitCheck = NO_INIT;
@@ -893,12 +1136,35 @@ status_t MPEG4Writer::reset() {
 
     stopWriterThread();
 
+    // Everything from here on is written straight to the file.
+    if (mWriteBackBuffer != NULL) {
+        status_t status = mWriteBackBuffer->stop();
+        if (err == OK && status != OK) {
+            err = status;
+        }
+    }
+
     // Do not write out movie header on error.
     if (err != OK) {
         release();
         return err;
     }
 
+    if (mFragmented) {
+        // Everything else went out with the fragments.
+        if (mMehdOffset != 0) {
+            lseek64(mFd, mMehdOffset, SEEK_SET);
+            uint64_t duration =
+                (maxDurationUs * (mTimeScale / mHFRRatio) + 5E5) / 1E6;
+            duration = hton64(duration);
+            ::write(mFd, &duration, 8);
+        }
+        CHECK(mBoxes.empty());
+
+        release();
+        return err;
+    }
+
     // Fix up the size of the 'mdat' chunk.
     if (mUse32BitOffset) {
         lseek64(mFd, mMdatOffset, SEEK_SET);
@@ -1008,9 +1274,44 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
         it != mTracks.end(); ++it, ++id) {
         (*it)->writeTrackHeader(mUse32BitOffset);
     }
+    if (mFragmented) {
+        writeMvexBox();
+    }
     endBox();  // moov
 }
 
+void MPEG4Writer::writeMvexBox() {
+    beginBox("mvex");
+    beginBox("mehd");
+    writeInt32(0x01000000);    // version=1, flags=0
+    mMehdOffset = mOffset;
+    writeInt64(0);             // fragment duration, fixed up in reset()
+    endBox();  // mehd
+    for (List<Track *>::iterator it = mTracks.begin();
+        it != mTracks.end(); ++it) {
+        (*it)->writeTrexBox();
+    }
+    endBox();  // mvex
+}
+
+void MPEG4Writer::writeMoofBox(const Chunk &chunk) {
+    off64_t moofOffset = mOffset;
+    beginBox("moof");
+    beginBox("mfhd");
+    writeInt32(0);                     // version=0, flags=0
+    writeInt32(++mFragmentSequence);   // sequence number starts with 1
+    endBox();  // mfhd
+    // Every track has started by the first fragment, so the start time
+    // is settled. Not getStartTimestampUs(), mLock may be held already.
+    off64_t dataOffsetOffset = chunk.mTrack->writeTrafBox(chunk, mStartTimestampUs);
+    endBox();  // moof
+
+    // The sample data starts right after the header of the mdat box
+    // that follows.
+    int32_t dataOffset = htonl(mOffset - moofOffset + 8);
+    overwrite(dataOffsetOffset, &dataOffset, 4);
+}
+
 void MPEG4Writer::writeFtypBox(MetaData *param) {
     beginBox("ftyp");
 
@@ -1077,15 +1378,133 @@ void MPEG4Writer::unlock() {
     mLock.unlock();
 }
 
+status_t MPEG4Writer::startWriteBack(MetaData *param, off64_t offset) {
+    int32_t bitRate = -1;
+    int32_t size;
+    if (!param || !param->findInt32(kKeyWriteBackSize, &size)) {
+        // About a second worth of data
+        if (param) {
+            param->findInt32(kKeyBitRate, &bitRate);
+        }
+        size = bitRate > 0 ? bitRate / 8 : 0;
+        if (size < kMinWriteBackSize) {
+            size = kMinWriteBackSize;
+        } else if (size > kMaxWriteBackSize) {
+            size = kMaxWriteBackSize;
+        }
+    }
+
+    delete mWriteBackBuffer;
+    mWriteBackBuffer = NULL;
+    if (size <= 0) {
+        return OK;
+    }
+
+    int32_t directIO = false;
+    if (param) {
+        param->findInt32(kKeyDirectIO, &directIO);
+    }
+
+    size_t numBuffers = size / kWriteBackBufferSize;
+    if (numBuffers < 2) {
+        numBuffers = 2;
+    }
+    mWriteBackBuffer = new FileWriteBackBuffer(
+            mFd, kWriteBackBufferSize, numBuffers, directIO);
+    status_t err = mWriteBackBuffer->start(offset);
+    if (err != OK) {
+        ALOGE("Failed to start the write-back buffer (%d)", err);
+        delete mWriteBackBuffer;
+        mWriteBackBuffer = NULL;
+        return err;
+    }
+
+    ALOGV("Writing back through %zu x %d byte buffers, direct I/O %s",
+            numBuffers, kWriteBackBufferSize,
+            mWriteBackBuffer->isDirectIO() ? "on" : "off");
+    return OK;
+}
+
+void MPEG4Writer::overwrite(off64_t offset, const void *data, size_t size) {
+    if (mWriteBackBuffer != NULL && mWriteBackBuffer->isStarted()) {
+        mWriteBackBuffer->overwrite(offset, data, size);
+    } else {
+        lseek64(mFd, offset, SEEK_SET);
+        ::write(mFd, data, size);
+        lseek64(mFd, mOffset, SEEK_SET);
+    }
+}
+
+void MPEG4Writer::startTableSpill(MetaData *param) {
+    stopTableSpill();
+
+    const char *dir;
+    if (!param || !param->findCString(kKeyTempFileDirectory, &dir)) {
+        return;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/MPEG4Writer.XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        ALOGW("Unable to create a sample table file in %s: %s",
+                dir, strerror(errno));
+        return;
+    }
+
+    // Gone with the last reference to it, whatever happens to us.
+    unlink(path);
+
+    Mutex::Autolock autoLock(mTableSpillLock);
+    mTableSpillFd = fd;
+    mTableSpillSize = 0;
+    mTableSpillFailed = false;
+}
+
+void MPEG4Writer::stopTableSpill() {
+    Mutex::Autolock autoLock(mTableSpillLock);
+    if (mTableSpillFd >= 0) {
+        ALOGV("%" PRId64 " bytes of sample table data were spilled",
+                mTableSpillSize);
+        close(mTableSpillFd);
+        mTableSpillFd = -1;
+    }
+}
+
+off64_t MPEG4Writer::spillTableData(const void *data, size_t size) {
+    Mutex::Autolock autoLock(mTableSpillLock);
+    if (mTableSpillFd < 0 || mTableSpillFailed) {
+        return -1;
+    }
+
+    ssize_t n = pwrite64(mTableSpillFd, data, size, mTableSpillSize);
+    if (n != (ssize_t)size) {
+        // Most likely out of space, keep the rest in memory. What has
+        // been spilled so far is still needed.
+        ALOGW("Unable to spill sample table data: %s",
+                n < 0 ? strerror(errno) : "short write");
+        mTableSpillFailed = true;
+        return -1;
+    }
+
+    off64_t offset = mTableSpillSize;
+    mTableSpillSize += size;
+    return offset;
+}
+
+void MPEG4Writer::readSpilledTableData(
+        off64_t offset, void *data, size_t size) {
+    Mutex::Autolock autoLock(mTableSpillLock);
+    CHECK_GE(mTableSpillFd, 0);
+    CHECK_EQ(pread64(mTableSpillFd, data, size, offset), (ssize_t)size);
+}
+
 off64_t MPEG4Writer::addSample_l(MediaBuffer *buffer) {
     off64_t old_offset = mOffset;
 
-    ::write(mFd,
-          (const uint8_t *)buffer->data() + buffer->range_offset(),
+    write((const uint8_t *)buffer->data() + buffer->range_offset(),
           buffer->range_length());
 
-    mOffset += buffer->range_length();
-
     return old_offset;
 }
 
@@ -1109,30 +1528,12 @@ off64_t MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
     size_t length = buffer->range_length();
 
     if (mUse4ByteNalLength) {
-        uint8_t x = length >> 24;
-        ::write(mFd, &x, 1);
-        x = (length >> 16) & 0xff;
-        ::write(mFd, &x, 1);
-        x = (length >> 8) & 0xff;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-
-        ::write(mFd,
-              (const uint8_t *)buffer->data() + buffer->range_offset(),
-              length);
-
-        mOffset += length + 4;
+        writeInt32(length);
     } else {
         CHECK_LT(length, 65536);
-
-        uint8_t x = length >> 8;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-        ::write(mFd, (const uint8_t *)buffer->data() + buffer->range_offset(), length);
-        mOffset += length + 2;
+        writeInt16(length);
     }
+    write((const uint8_t *)buffer->data() + buffer->range_offset(), length);
 
     return old_offset;
 }
@@ -1168,6 +1569,9 @@ size_t MPEG4Writer::write(
             memcpy(mMoovBoxBuffer + mMoovBoxBufferOffset, ptr, bytes);
             mMoovBoxBufferOffset += bytes;
         }
+    } else if (mWriteBackBuffer != NULL && mWriteBackBuffer->isStarted()) {
+        mWriteBackBuffer->append(ptr, bytes);
+        mOffset += bytes;
     } else {
         ::write(mFd, ptr, size * nmemb);
         mOffset += bytes;
@@ -1195,10 +1599,8 @@ void MPEG4Writer::endBox() {
        int32_t x = htonl(mMoovBoxBufferOffset - offset);
        memcpy(mMoovBoxBuffer + offset, &x, 4);
     } else {
-        lseek64(mFd, offset, SEEK_SET);
-        writeInt32(mOffset - offset);
-        mOffset -= 4;
-        lseek64(mFd, mOffset, SEEK_SET);
+        int32_t x = htonl(mOffset - offset);
+        overwrite(offset, &x, 4);
     }
 }
 
@@ -1310,6 +1712,10 @@ bool MPEG4Writer::isFileStreamable() const {
     return mStreamableFile;
 }
 
+bool MPEG4Writer::isFragmented() const {
+    return mFragmented;
+}
+
 bool MPEG4Writer::exceedsFileSizeLimit() {
     // No limit
     if (mMaxFileSizeLimitBytes == 0) {
@@ -1394,14 +1800,17 @@ MPEG4Writer::Track::Track(
       mTrackId(trackId),
       mTrackDurationUs(0),
       mEstimatedTrackSizeBytes(0),
+      mChunkDecodingTimeTicks(0),
+      mNumSamples(0),
+      mNumSyncSamples(0),
       mSamplesHaveSameSize(true),
-      mStszTableEntries(new ListTableEntries<uint32_t>(1000, 1)),
-      mStcoTableEntries(new ListTableEntries<uint32_t>(1000, 1)),
-      mCo64TableEntries(new ListTableEntries<off64_t>(1000, 1)),
-      mStscTableEntries(new ListTableEntries<uint32_t>(1000, 3)),
-      mStssTableEntries(new ListTableEntries<uint32_t>(1000, 1)),
-      mSttsTableEntries(new ListTableEntries<uint32_t>(1000, 2)),
-      mCttsTableEntries(new ListTableEntries<uint32_t>(1000, 2)),
+      mStszTableEntries(new ListTableEntries<uint32_t>(owner, 1)),
+      mStcoTableEntries(new ListTableEntries<uint32_t>(owner, 1)),
+      mCo64TableEntries(new ListTableEntries<off64_t>(owner, 1)),
+      mStscTableEntries(new ListTableEntries<uint32_t>(owner, 3)),
+      mStssTableEntries(new ListTableEntries<uint32_t>(owner, 1)),
+      mSttsTableEntries(new ListTableEntries<uint32_t>(owner, 2)),
+      mCttsTableEntries(new ListTableEntries<uint32_t>(owner, 2)),
       mCodecSpecificData(NULL),
       mCodecSpecificDataSize(0),
       mGotAllCodecSpecificData(false),
@@ -1432,7 +1841,10 @@ void MPEG4Writer::Track::updateTrackSizeEstimate() {
     int64_t stszBoxSizeBytes = mSamplesHaveSameSize? 4: (mStszTableEntries->count() * 4);
 
     mEstimatedTrackSizeBytes = mMdatSizeBytes;  // media data size
-    if (!mOwner->isFileStreamable()) {
+    if (mOwner->isFragmented()) {
+        // A trun box entry per sample, besides the moof and mdat headers
+        mEstimatedTrackSizeBytes += mNumSamples * 16;
+    } else if (!mOwner->isFileStreamable()) {
         // Reserved free space is not large enough to hold
         // all meta data and thus wasted.
         mEstimatedTrackSizeBytes += mStscTableEntries->count() * 12 +  // stsc box size
@@ -1444,44 +1856,60 @@ void MPEG4Writer::Track::updateTrackSizeEstimate() {
     }
 }
 
+// Fragmented files keep none of the sample tables, the fragments
+// describe the samples.
 void MPEG4Writer::Track::addOneStscTableEntry(
         size_t chunkId, size_t sampleId) {
 
-        mStscTableEntries->add(htonl(chunkId));
-        mStscTableEntries->add(htonl(sampleId));
-        mStscTableEntries->add(htonl(1));
+        if (mOwner->isFragmented()) {
+            return;
+        }
+
+        mStscTableEntries->add(chunkId);
+        mStscTableEntries->add(sampleId);
+        mStscTableEntries->add(1);
 }
 
 void MPEG4Writer::Track::addOneStssTableEntry(size_t sampleId) {
-    mStssTableEntries->add(htonl(sampleId));
+    ++mNumSyncSamples;
+    if (mOwner->isFragmented()) {
+        return;
+    }
+    mStssTableEntries->add(sampleId);
 }
 
 void MPEG4Writer::Track::addOneSttsTableEntry(
         size_t sampleCount, int32_t duration) {
 
+    if (mOwner->isFragmented()) {
+        return;
+    }
     if (duration == 0) {
         ALOGW("0-duration samples found: %zu", sampleCount);
     }
-    mSttsTableEntries->add(htonl(sampleCount));
-    mSttsTableEntries->add(htonl(duration));
+    mSttsTableEntries->add(sampleCount);
+    mSttsTableEntries->add(duration);
 }
 
 void MPEG4Writer::Track::addOneCttsTableEntry(
         size_t sampleCount, int32_t duration) {
 
-    if (mIsAudio) {
+    if (mIsAudio || mOwner->isFragmented()) {
         return;
     }
-    mCttsTableEntries->add(htonl(sampleCount));
-    mCttsTableEntries->add(htonl(duration));
+    mCttsTableEntries->add(sampleCount);
+    mCttsTableEntries->add(duration);
 }
 
 void MPEG4Writer::Track::addChunkOffset(off64_t offset) {
+    if (mOwner->isFragmented()) {
+        return;
+    }
     if (mOwner->use32BitFileOffset()) {
         uint32_t value = offset;
-        mStcoTableEntries->add(htonl(value));
+        mStcoTableEntries->add(value);
     } else {
-        mCo64TableEntries->add(hton64(offset));
+        mCo64TableEntries->add(offset);
     }
 }
 
@@ -1623,6 +2051,19 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     ALOGV("writeChunkToFile: %" PRId64 " from %s track",
         chunk->mTimeStampUs, chunk->mTrack->isAudio()? "audio": "video");
 
+    int64_t startTimeUs = systemTime() / 1000;
+
+    if (mFragmented) {
+        if (!mInitMoovWritten) {
+            // Without any durations, nor sample tables: the samples
+            // are all described by the fragments.
+            writeMoovBox(0);
+            mInitMoovWritten = true;
+        }
+        writeMoofBox(*chunk);
+        beginBox("mdat");
+    }
+
     int32_t isFirstSample = true;
     while (!chunk->mSamples.empty()) {
         List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
@@ -1641,6 +2082,22 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
         chunk->mSamples.erase(it);
     }
     chunk->mSamples.clear();
+
+    if (mFragmented) {
+        endBox();  // mdat
+
+        // Readers of the file should not have to wait for the next one.
+        if (mWriteBackBuffer != NULL) {
+            mWriteBackBuffer->push();
+        }
+    }
+
+    int64_t writeTimeUs = systemTime() / 1000 - startTimeUs;
+    ++mNumChunksWritten;
+    mTotalChunkWriteTimeUs += writeTimeUs;
+    if (writeTimeUs > mMaxChunkWriteTimeUs) {
+        mMaxChunkWriteTimeUs = writeTimeUs;
+    }
 }
 
 void MPEG4Writer::writeAllChunks() {
@@ -1661,6 +2118,17 @@ void MPEG4Writer::writeAllChunks() {
 bool MPEG4Writer::findChunkToWrite(Chunk *chunk) {
     ALOGV("findChunkToWrite");
 
+    if (mFragmented && !mInitMoovWritten && !mDone) {
+        // The moov box goes out before the first fragment, and needs the
+        // codec specific data of every track that is going to have samples.
+        for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+             it != mChunkInfos.end(); ++it) {
+            if (it->mChunks.empty() && !it->mTrack->reachedEOS()) {
+                return false;
+            }
+        }
+    }
+
     int64_t minTimestampUs = 0x7FFFFFFFFFFFFFFFLL;
     Track *track = NULL;
     for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
@@ -1740,6 +2208,9 @@ status_t MPEG4Writer::startWriterThread() {
 
     mDone = false;
     mIsFirstChunk = true;
+    mNumChunksWritten = 0;
+    mTotalChunkWriteTimeUs = 0;
+    mMaxChunkWriteTimeUs = 0;
     mDriftTimeUs = 0;
     for (List<Track *>::iterator it = mTracks.begin();
          it != mTracks.end(); ++it) {
@@ -1858,7 +2329,7 @@ status_t MPEG4Writer::Track::stop() {
     pthread_join(mThread, &dummy);
     status_t err = static_cast<status_t>(reinterpret_cast<uintptr_t>(dummy));
 
-    if (mOwner->exceedsFileSizeLimit() && mStszTableEntries->count() == 0) {
+    if (mOwner->exceedsFileSizeLimit() && mNumSamples == 0) {
         ALOGE(" Filesize limit exceeded and zero samples written ");
         return ERROR_END_OF_STREAM;
     }
@@ -1889,15 +2360,24 @@ static const uint8_t *findNextStartCode(
 
     ALOGV("findNextStartCode: %p %zu", data, length);
 
-    size_t bytesLeft = length;
-    while (bytesLeft > 4  &&
-            memcmp("\x00\x00\x00\x01", &data[length - bytesLeft], 4)) {
-        --bytesLeft;
-    }
-    if (bytesLeft <= 4) {
-        bytesLeft = 0; // Last parameter set
+    // Look for 0x00 0x00 0x00 0x01 followed by at least one more byte, i.e.
+    // for a 3 byte startcode in data[1 .. length - 2] preceded by 0x00.
+    size_t offset = 0;
+    while (offset + 5 <= length) {
+        ssize_t pos = FindStartCode(&data[offset + 1], length - offset - 2);
+        if (pos < 0) {
+            break;
+        }
+
+        offset += pos;
+        if (data[offset] == 0x00) {
+            return &data[offset];
+        }
+
+        ++offset;
     }
-    return &data[length - bytesLeft];
+
+    return &data[length]; // Last parameter set
 }
 
 const uint8_t *MPEG4Writer::Track::parseParamSet(
@@ -2143,6 +2623,7 @@ status_t MPEG4Writer::Track::threadEntry() {
     int32_t count = 0;
     const int64_t interleaveDurationUs = mOwner->interleaveDuration();
     const bool hasMultipleTracks = (mOwner->numTracks() > 1);
+    const bool fragmented = mOwner->isFragmented();
     int64_t chunkTimestampUs = 0;
     int32_t nChunks = 0;
     int32_t nZeroLengthFrames = 0;
@@ -2159,6 +2640,9 @@ status_t MPEG4Writer::Track::threadEntry() {
     int64_t lastCttsOffsetTimeTicks = -1;  // Timescale based ticks
     int32_t cttsSampleCount = 0;           // Sample count in the current ctts table entry
     uint32_t lastSamplesPerChunk = 0;
+    int64_t decodingTimeTicks = 0;         // Timescale based ticks
+    size_t fragmentSizeBytes = 0;          // Of the samples in mChunkSamples
+    bool syncFramesTooFarApart = false;
 
     if (mIsAudio) {
         prctl(PR_SET_NAME, (unsigned long)"AudioTrackEncoding", 0, 0, 0);
@@ -2285,7 +2769,7 @@ status_t MPEG4Writer::Track::threadEntry() {
         CHECK(meta_data->findInt64(kKeyTime, &timestampUs));
 
 ////////////////////////////////////////////////////////////////////////////////
-        if (mStszTableEntries->count() == 0) {
+        if (mNumSamples == 0) {
             mFirstSampleTimeRealUs = systemTime() / 1000;
             mStartTimestampUs = timestampUs;
             mOwner->setStartTimestampUs(mStartTimestampUs);
@@ -2330,7 +2814,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                 return ERROR_MALFORMED;
             }
 
-            if (mStszTableEntries->count() == 0) {
+            if (mNumSamples == 0) {
                 // Force the first ctts table entry to have one single entry
                 // so that we can do adjustment for the initial track start
                 // time offset easily in writeCttsBox().
@@ -2348,7 +2832,7 @@ status_t MPEG4Writer::Track::threadEntry() {
             }
 
             // Update ctts time offset range
-            if (mStszTableEntries->count() == 0) {
+            if (mNumSamples == 0) {
                 mMinCttsOffsetTimeUs = currCttsOffsetTimeTicks;
                 mMaxCttsOffsetTimeUs = currCttsOffsetTimeTicks;
             } else {
@@ -2413,12 +2897,15 @@ status_t MPEG4Writer::Track::threadEntry() {
             }
         }
 
-        mStszTableEntries->add(htonl(sampleSize));
-        if (mStszTableEntries->count() > 2) {
+        ++mNumSamples;
+        if (!fragmented) {
+            mStszTableEntries->add(sampleSize);
+        }
+        if (mNumSamples > 2) {
 
             // Force the first sample to have its own stts entry so that
             // we can adjust its value later to maintain the A/V sync.
-            if (mStszTableEntries->count() == 3 || currDurationTicks != lastDurationTicks) {
+            if (mNumSamples == 3 || currDurationTicks != lastDurationTicks) {
                 addOneSttsTableEntry(sampleCount, lastDurationTicks);
                 sampleCount = 1;
             } else {
@@ -2427,7 +2914,7 @@ status_t MPEG4Writer::Track::threadEntry() {
 
         }
         if (mSamplesHaveSameSize) {
-            if (mStszTableEntries->count() >= 2 && previousSampleSize != sampleSize) {
+            if (mNumSamples >= 2 && previousSampleSize != sampleSize) {
                 mSamplesHaveSameSize = false;
             }
             previousSampleSize = sampleSize;
@@ -2437,9 +2924,10 @@ status_t MPEG4Writer::Track::threadEntry() {
         lastDurationUs = timestampUs - lastTimestampUs;
         lastDurationTicks = currDurationTicks;
         lastTimestampUs = timestampUs;
+        decodingTimeTicks += currDurationTicks;
 
         if (isSync != 0) {
-            addOneStssTableEntry(mStszTableEntries->count());
+            addOneStssTableEntry(mNumSamples);
         }
 
         if (mTrackingProgressStatus) {
@@ -2448,6 +2936,54 @@ status_t MPEG4Writer::Track::threadEntry() {
             }
             trackProgressStatus(timestampUs);
         }
+        if (fragmented) {
+            if (!mChunkSampleInfos.isEmpty()) {
+                // The previous sample lasts until this one.
+                mChunkSampleInfos.editTop().mDurationTicks = currDurationTicks;
+
+                // Start a new fragment at a sync frame, so that each
+                // fragment can be decoded on its own.
+                int64_t chunkDurationUs = timestampUs - chunkTimestampUs;
+                bool endFragment = chunkDurationUs >= interleaveDurationUs &&
+                    (mIsAudio || isSync);
+                if (!endFragment &&
+                    (chunkDurationUs >= kMaxFragmentDurationFactor * interleaveDurationUs ||
+                     fragmentSizeBytes >= kMaxFragmentSizeBytes)) {
+                    // The next fragment depends on this one to decode.
+                    if (!syncFramesTooFarApart) {
+                        ALOGW("%s track: no sync frame in %" PRId64 " us, "
+                                "ending fragments at any frame",
+                                trackName, chunkDurationUs);
+                        syncFramesTooFarApart = true;
+                    }
+                    endFragment = true;
+                }
+                if (endFragment) {
+                    if (chunkDurationUs > mMaxChunkDurationUs) {
+                        mMaxChunkDurationUs = chunkDurationUs;
+                    }
+                    ++nChunks;
+                    bufferChunk(chunkTimestampUs);
+                    fragmentSizeBytes = 0;
+                }
+            }
+            if (mChunkSampleInfos.isEmpty()) {
+                chunkTimestampUs = timestampUs;
+                mChunkDecodingTimeTicks = decodingTimeTicks;
+            }
+
+            // Until the next sample shows up, assume this one lasts
+            // as long as the previous one.
+            SampleInfo info;
+            info.mSize = sampleSize;
+            info.mDurationTicks = currDurationTicks;
+            info.mCttsOffsetTicks = currCttsOffsetTimeTicks;
+            info.mIsSync = mIsAudio || isSync;
+            mChunkSampleInfos.push(info);
+            mChunkSamples.push_back(copy);
+            fragmentSizeBytes += sampleSize;
+            continue;
+        }
         if (!hasMultipleTracks) {
             off64_t offset = (mIsAvc | mIsHEVC) ? mOwner->addLengthPrefixedSample_l(copy)
                                  : mOwner->addSample_l(copy);
@@ -2498,8 +3034,13 @@ status_t MPEG4Writer::Track::threadEntry() {
     mOwner->trackProgressStatus(mTrackId, -1, err);
 
     // Last chunk
-    if (!hasMultipleTracks) {
-        addOneStscTableEntry(1, mStszTableEntries->count());
+    if (fragmented) {
+        if (!mChunkSamples.empty()) {
+            ++nChunks;
+            bufferChunk(chunkTimestampUs);
+        }
+    } else if (!hasMultipleTracks) {
+        addOneStscTableEntry(1, mNumSamples);
     } else if (!mChunkSamples.empty()) {
         addOneStscTableEntry(++nChunks, mChunkSamples.size());
         bufferChunk(timestampUs);
@@ -2508,14 +3049,14 @@ status_t MPEG4Writer::Track::threadEntry() {
     // We don't really know how long the last frame lasts, since
     // there is no frame time after it, just repeat the previous
     // frame's duration.
-    if (mStszTableEntries->count() == 1) {
+    if (mNumSamples == 1) {
         lastDurationUs = 0;  // A single sample's duration
         lastDurationTicks = 0;
     } else {
         ++sampleCount;  // Count for the last sample
     }
 
-    if (mStszTableEntries->count() <= 2) {
+    if (mNumSamples <= 2) {
         addOneSttsTableEntry(1, lastDurationTicks);
         if (sampleCount - 1 > 0) {
             addOneSttsTableEntry(sampleCount - 1, lastDurationTicks);
@@ -2538,7 +3079,7 @@ status_t MPEG4Writer::Track::threadEntry() {
     sendTrackSummary(hasMultipleTracks);
 
     ALOGI("Received total/0-length (%d/%d) buffers and encoded %d frames. - %s",
-            count, nZeroLengthFrames, mStszTableEntries->count(), trackName);
+            count, nZeroLengthFrames, mNumSamples, trackName);
     if (mIsAudio) {
         ALOGI("Audio track drift time: %" PRId64 " us", mOwner->getDriftTimeUs());
     }
@@ -2550,12 +3091,12 @@ status_t MPEG4Writer::Track::threadEntry() {
 }
 
 bool MPEG4Writer::Track::isTrackMalFormed() const {
-    if (mStszTableEntries->count() == 0) {                      // no samples written
+    if (mNumSamples == 0) {                                     // no samples written
         ALOGE("The number of recorded samples is 0");
         return true;
     }
 
-    if (!mIsAudio && mStssTableEntries->count() == 0) {  // no sync frames for video
+    if (!mIsAudio && mNumSyncSamples == 0) {            // no sync frames for video
         ALOGE("There are no sync frames for video track");
         return true;
     }
@@ -2586,7 +3127,7 @@ void MPEG4Writer::Track::sendTrackSummary(bool hasMultipleTracks) {
 
     mOwner->notify(MEDIA_RECORDER_TRACK_EVENT_INFO,
                     trackNum | MEDIA_RECORDER_TRACK_INFO_ENCODED_FRAMES,
-                    mStszTableEntries->count());
+                    mNumSamples);
 
     {
         // The system delay time excluding the requested initial delay that
@@ -2684,6 +3225,11 @@ void MPEG4Writer::Track::bufferChunk(int64_t timestampUs) {
     ALOGV("bufferChunk");
 
     Chunk chunk(this, timestampUs, mChunkSamples);
+    if (mOwner->isFragmented()) {
+        chunk.mDecodingTimeTicks = mChunkDecodingTimeTicks;
+        chunk.mSampleInfos = mChunkSampleInfos;
+        mChunkSampleInfos.clear();
+    }
     mOwner->bufferChunk(chunk);
     mChunkSamples.clear();
 }
@@ -2758,6 +3304,28 @@ void MPEG4Writer::Track::writeStblBox(bool use32BitOffset) {
         writeVideoFourCCBox();
     }
     mOwner->endBox();  // stsd
+    if (mOwner->isFragmented()) {
+        // The fragments describe all the samples.
+        mOwner->beginBox("stts");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stts
+        mOwner->beginBox("stsc");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stsc
+        mOwner->beginBox("stsz");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // sample size
+        mOwner->writeInt32(0);  // sample count
+        mOwner->endBox();  // stsz
+        mOwner->beginBox("stco");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stco
+        mOwner->endBox();  // stbl
+        return;
+    }
     writeSttsBox();
     writeCttsBox();
     if (!mIsAudio) {
@@ -2963,7 +3531,8 @@ void MPEG4Writer::Track::writeTkhdBox(uint32_t now) {
     mOwner->writeInt32(now);           // modification time
     mOwner->writeInt32(mTrackId);      // track id starts with 1
     mOwner->writeInt32(0);             // reserved
-    int64_t trakDurationUs = getDurationUs();
+    // Unknown yet for fragmented files, see the mehd box
+    int64_t trakDurationUs = mOwner->isFragmented()? 0: getDurationUs();
     int32_t mvhdTimeScale = mOwner->getTimeScale();
     int32_t tkhdDuration =
         (trakDurationUs * mvhdTimeScale + 5E5) / 1E6;
@@ -3024,7 +3593,7 @@ void MPEG4Writer::Track::writeHdlrBox() {
 }
 
 void MPEG4Writer::Track::writeMdhdBox(uint32_t now) {
-    int64_t trakDurationUs = getDurationUs();
+    int64_t trakDurationUs = mOwner->isFragmented()? 0: getDurationUs();
     mOwner->beginBox("mdhd");
     mOwner->writeInt32(0);             // version=0, flags=0
     mOwner->writeInt32(now);           // creation time
@@ -3107,10 +3676,9 @@ void MPEG4Writer::Track::writePaspBox() {
     mOwner->endBox();  // pasp
 }
 
-int32_t MPEG4Writer::Track::getStartTimeOffsetScaledTime() const {
+int32_t MPEG4Writer::Track::getStartTimeOffsetScaledTime(int64_t moovStartTimeUs) const {
     int64_t trackStartTimeOffsetUs = 0;
-    int64_t moovStartTimeUs = mOwner->getStartTimestampUs();
-    if (mStartTimestampUs != moovStartTimeUs && mStszTableEntries->count() != 0) {
+    if (mStartTimestampUs != moovStartTimeUs && mNumSamples != 0) {
         CHECK_GT(mStartTimestampUs, moovStartTimeUs);
         trackStartTimeOffsetUs = mStartTimestampUs - moovStartTimeUs;
     }
@@ -3122,8 +3690,7 @@ void MPEG4Writer::Track::writeSttsBox() {
     mOwner->writeInt32(0);  // version=0, flags=0
     uint32_t duration;
     CHECK(mSttsTableEntries->get(duration, 1));
-    duration = htonl(duration);  // Back to host byte order
-    mSttsTableEntries->set(htonl(duration + getStartTimeOffsetScaledTime()), 1);
+    mSttsTableEntries->set(duration + getStartTimeOffsetScaledTime(mOwner->getStartTimestampUs()), 1);
     mSttsTableEntries->write(mOwner);
     mOwner->endBox();  // stts
 }
@@ -3150,8 +3717,7 @@ void MPEG4Writer::Track::writeCttsBox() {
     mOwner->writeInt32(0);  // version=0, flags=0
     uint32_t duration;
     CHECK(mCttsTableEntries->get(duration, 1));
-    duration = htonl(duration);  // Back host byte order
-    mCttsTableEntries->set(htonl(duration + getStartTimeOffsetScaledTime() - mMinCttsOffsetTimeUs), 1);
+    mCttsTableEntries->set(duration + getStartTimeOffsetScaledTime(mOwner->getStartTimestampUs()) - mMinCttsOffsetTimeUs, 1);
     mCttsTableEntries->write(mOwner);
     mOwner->endBox();  // ctts
 }
@@ -3189,6 +3755,77 @@ void MPEG4Writer::Track::writeStcoBox(bool use32BitOffset) {
     mOwner->endBox();  // stco or co64
 }
 
+void MPEG4Writer::Track::writeTrexBox() {
+    if (mMdatSizeBytes == 0) {  // No trak box either
+        return;
+    }
+
+    mOwner->beginBox("trex");
+    mOwner->writeInt32(0);         // version=0, flags=0
+    mOwner->writeInt32(mTrackId);
+    mOwner->writeInt32(1);         // default sample description index
+    mOwner->writeInt32(0);         // default sample duration
+    mOwner->writeInt32(0);         // default sample size
+    mOwner->writeInt32(0);         // default sample flags
+    mOwner->endBox();  // trex
+}
+
+off64_t MPEG4Writer::Track::writeTrafBox(
+        const Chunk &chunk, int64_t moovStartTimeUs) {
+    const Vector<SampleInfo> &infos = chunk.mSampleInfos;
+    CHECK_EQ(infos.size(), chunk.mSamples.size());
+
+    mOwner->beginBox("traf");
+
+    mOwner->beginBox("tfhd");
+    mOwner->writeInt32(0x020000);      // version=0, flags=default-base-is-moof
+    mOwner->writeInt32(mTrackId);
+    mOwner->endBox();  // tfhd
+
+    mOwner->beginBox("tfdt");
+    mOwner->writeInt32(0x01000000);    // version=1, flags=0
+    mOwner->writeInt64(
+            chunk.mDecodingTimeTicks + getStartTimeOffsetScaledTime(moovStartTimeUs));
+    mOwner->endBox();  // tfdt
+
+    // Data offset, and then duration, size, flags and, for video,
+    // composition time offset of each sample. Version 1 has signed
+    // composition time offsets.
+    uint32_t flags = 0x000001 | 0x000100 | 0x000200 | 0x000400;
+    size_t numValues = 3;
+    if (!mIsAudio) {
+        flags |= 0x000800;
+        numValues = 4;
+    }
+
+    mOwner->beginBox("trun");
+    mOwner->writeInt32(0x01000000 | flags);
+    mOwner->writeInt32(infos.size());
+    off64_t dataOffsetOffset = mOwner->mOffset;
+    mOwner->writeInt32(0);             // data offset, fixed up by the owner
+
+    uint32_t *values = new uint32_t[infos.size() * numValues];
+    uint32_t *value = values;
+    for (size_t i = 0; i < infos.size(); ++i) {
+        const SampleInfo &info = infos[i];
+        *value++ = htonl(info.mDurationTicks);
+        *value++ = htonl(info.mSize);
+        // sample_depends_on, sample_is_non_sync_sample
+        *value++ = htonl(info.mIsSync? 0x02000000: 0x01010000);
+        if (!mIsAudio) {
+            *value++ = htonl(info.mCttsOffsetTicks);
+        }
+    }
+    mOwner->write(values, sizeof(uint32_t) * numValues, infos.size());
+    delete[] values;
+    values = NULL;
+
+    mOwner->endBox();  // trun
+
+    mOwner->endBox();  // traf
+    return dataOffsetOffset;
+}
+
 void MPEG4Writer::writeUdtaBox() {
     beginBox("udta");
     writeGeoDataBox();
@@ -2127,6 +2127,7 @@ status_t OMXCodec::allocateBuffersOnPort(OMX_U32 portIndex) {
                         mNode, portIndex, def.nBufferSize, &buffer,
                         &info.mData);
             } else {
+                // See ACodec::allocateBuffersOnPort() on when this copies.
                 err = mOMX->allocateBufferWithBackup(
                         mNode, portIndex, mem, &buffer);
             }
@@ -116,11 +116,19 @@ MediaScanResult StagefrightMediaScanner::processFile(
 
     client.setLocale(locale());
     client.beginFile();
-    MediaScanResult result = processFileInternal(path, mimeType, client);
+    MediaScanResult result;
+    if (!replayExtractedFile(path, client, &result)) {
+        result = processFileInternal(path, mimeType, client);
+    }
     client.endFile();
     return result;
 }
 
+MediaScanResult StagefrightMediaScanner::extractFile(
+        const char *path, MediaScannerClient &client) {
+    return processFileInternal(path, NULL /* mimeType */, client);
+}
+
 MediaScanResult StagefrightMediaScanner::processFileInternal(
         const char *path, const char * /* mimeType */,
         MediaScannerClient &client) {
@@ -147,14 +147,11 @@ static bool isYUV420PlanarSupported(
     return false;
 }
 
-static VideoFrame *extractVideoFrameWithCodecFlags(
+static sp<MediaSource> createVideoDecoder(
         OMXClient *client,
         const sp<MetaData> &trackMeta,
         const sp<MediaSource> &source,
-        uint32_t flags,
-        int64_t frameTimeUs,
-        int seekMode) {
-
+        uint32_t flags) {
     sp<MetaData> format = source->getFormat();
 
 #ifndef MTK_HARDWARE
@@ -186,82 +183,26 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         return NULL;
     }
 
-    // Read one output buffer, ignore format change notifications
-    // and spurious empty buffers.
-
-    MediaSource::ReadOptions options;
-    if (seekMode < MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC ||
-        seekMode > MediaSource::ReadOptions::SEEK_CLOSEST) {
-
-        ALOGE("Unknown seek mode: %d", seekMode);
-        return NULL;
-    }
-
-    MediaSource::ReadOptions::SeekMode mode =
-            static_cast<MediaSource::ReadOptions::SeekMode>(seekMode);
-
-    int64_t thumbNailTime;
-    if (frameTimeUs < 0) {
-        if (!trackMeta->findInt64(kKeyThumbnailTime, &thumbNailTime)
-                || thumbNailTime < 0) {
-            thumbNailTime = 0;
-        }
-        options.setSeekTo(thumbNailTime, mode);
-    } else {
-        thumbNailTime = -1;
-        options.setSeekTo(frameTimeUs, mode);
-    }
-
-    MediaBuffer *buffer = NULL;
-    do {
-        if (buffer != NULL) {
-            buffer->release();
-            buffer = NULL;
-        }
-        err = decoder->read(&buffer, &options);
-        options.clearSeekTo();
-    } while (err == INFO_FORMAT_CHANGED
-             || (buffer != NULL && buffer->range_length() == 0));
-
-    if (err != OK) {
-        CHECK(buffer == NULL);
-
-        ALOGV("decoding frame failed.");
-        decoder->stop();
-
-        return NULL;
-    }
-
-    ALOGV("successfully decoded video frame.");
+    return decoder;
+}
 
+// Converts a decoded |buffer| to RGB565, scaled down to fit within
+// maxWidth x maxHeight if either is positive.
+static VideoFrame *convertVideoFrame(
+        const sp<MetaData> &trackMeta,
+        const sp<MetaData> &meta,
+        MediaBuffer *buffer,
+        int32_t maxWidth,
+        int32_t maxHeight) {
     int32_t unreadable;
     if (buffer->meta_data()->findInt32(kKeyIsUnreadable, &unreadable)
             && unreadable != 0) {
         ALOGV("video frame is unreadable, decoder does not give us access "
              "to the video data.");
 
-        buffer->release();
-        buffer = NULL;
-
-        decoder->stop();
-
         return NULL;
     }
 
-    int64_t timeUs;
-    CHECK(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
-    if (thumbNailTime >= 0) {
-        if (timeUs != thumbNailTime) {
-            const char *mime;
-            CHECK(trackMeta->findCString(kKeyMIMEType, &mime));
-
-            ALOGV("thumbNailTime = %" PRId64 " us, timeUs = %" PRId64 " us, mime = %s",
-                 thumbNailTime, timeUs, mime);
-        }
-    }
-
-    sp<MetaData> meta = decoder->getFormat();
-
     int32_t width, height;
     CHECK(meta->findInt32(kKeyWidth, &width));
     CHECK(meta->findInt32(kKeyHeight, &height));
@@ -285,8 +226,6 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
     frame->mHeight = crop_bottom - crop_top + 1;
     frame->mDisplayWidth = frame->mWidth;
     frame->mDisplayHeight = frame->mHeight;
-    frame->mSize = frame->mWidth * frame->mHeight * 2;
-    frame->mData = new uint8_t[frame->mSize];
     frame->mRotationAngle = rotationAngle;
 
     int32_t displayWidth, displayHeight;
@@ -297,6 +236,37 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         frame->mDisplayHeight = displayHeight;
     }
 
+    // Scale by the same factor in both dimensions, keeping the dimensions
+    // even.
+    uint32_t scaleNum = 1;
+    uint32_t scaleDenom = 1;
+    if (maxWidth > 0 && frame->mWidth > (uint32_t)maxWidth) {
+        scaleNum = maxWidth;
+        scaleDenom = frame->mWidth;
+    }
+    if (maxHeight > 0
+            && (uint64_t)frame->mHeight * scaleNum > (uint64_t)maxHeight * scaleDenom) {
+        scaleNum = maxHeight;
+        scaleDenom = frame->mHeight;
+    }
+
+    if (scaleNum != scaleDenom) {
+        frame->mWidth = ((uint64_t)frame->mWidth * scaleNum / scaleDenom) & ~1;
+        frame->mHeight = ((uint64_t)frame->mHeight * scaleNum / scaleDenom) & ~1;
+        frame->mDisplayWidth =
+            (uint64_t)frame->mDisplayWidth * scaleNum / scaleDenom;
+        frame->mDisplayHeight =
+            (uint64_t)frame->mDisplayHeight * scaleNum / scaleDenom;
+
+        if (frame->mWidth == 0 || frame->mHeight == 0) {
+            delete frame;
+            return NULL;
+        }
+    }
+
+    frame->mSize = frame->mWidth * frame->mHeight * 2;
+    frame->mData = new uint8_t[frame->mSize];
+
     int32_t srcFormat;
     CHECK(meta->findInt32(kKeyColorFormat, &srcFormat));
 
@@ -316,6 +286,7 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
     ColorConverter converter(
             (OMX_COLOR_FORMATTYPE)srcFormat, OMX_COLOR_Format16bitRGB565);
 
+    status_t err;
     if (converter.isValid()) {
         err = converter.convert(
                 (const uint8_t *)buffer->data() + buffer->range_offset(),
@@ -333,11 +304,6 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         err = ERROR_UNSUPPORTED;
     }
 
-    buffer->release();
-    buffer = NULL;
-
-    decoder->stop();
-
     if (err != OK) {
         ALOGE("Colorconverter failed to convert frame.");
 
@@ -348,27 +314,236 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
     return frame;
 }
 
-VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
-        int64_t timeUs, int option) {
+static VideoFrame *extractVideoFrameWithCodecFlags(
+        OMXClient *client,
+        const sp<MetaData> &trackMeta,
+        const sp<MediaSource> &source,
+        uint32_t flags,
+        int64_t frameTimeUs,
+        int seekMode) {
+    // Read one output buffer, ignore format change notifications
+    // and spurious empty buffers.
 
-    ALOGV("getFrameAtTime: %" PRId64 " us option: %d", timeUs, option);
+    MediaSource::ReadOptions options;
+    if (seekMode < MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC ||
+        seekMode > MediaSource::ReadOptions::SEEK_CLOSEST) {
+
+        ALOGE("Unknown seek mode: %d", seekMode);
+        return NULL;
+    }
+
+    sp<MediaSource> decoder = createVideoDecoder(client, trackMeta, source, flags);
+    if (decoder == NULL) {
+        return NULL;
+    }
+
+    MediaSource::ReadOptions::SeekMode mode =
+            static_cast<MediaSource::ReadOptions::SeekMode>(seekMode);
 
+    int64_t thumbNailTime;
+    if (frameTimeUs < 0) {
+        if (!trackMeta->findInt64(kKeyThumbnailTime, &thumbNailTime)
+                || thumbNailTime < 0) {
+            thumbNailTime = 0;
+        }
+        options.setSeekTo(thumbNailTime, mode);
+    } else {
+        thumbNailTime = -1;
+        options.setSeekTo(frameTimeUs, mode);
+    }
+
+    status_t err;
+    MediaBuffer *buffer = NULL;
+    do {
+        if (buffer != NULL) {
+            buffer->release();
+            buffer = NULL;
+        }
+        err = decoder->read(&buffer, &options);
+        options.clearSeekTo();
+    } while (err == INFO_FORMAT_CHANGED
+             || (buffer != NULL && buffer->range_length() == 0));
+
+    if (err != OK) {
+        CHECK(buffer == NULL);
+
+        ALOGV("decoding frame failed.");
+        decoder->stop();
+
+        return NULL;
+    }
+
+    ALOGV("successfully decoded video frame.");
+
+    int64_t timeUs;
+    CHECK(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+    if (thumbNailTime >= 0) {
+        if (timeUs != thumbNailTime) {
+            const char *mime;
+            CHECK(trackMeta->findCString(kKeyMIMEType, &mime));
+
+            ALOGV("thumbNailTime = %" PRId64 " us, timeUs = %" PRId64 " us, mime = %s",
+                 thumbNailTime, timeUs, mime);
+        }
+    }
+
+    VideoFrame *frame = convertVideoFrame(
+            trackMeta, decoder->getFormat(), buffer,
+            0 /* maxWidth */, 0 /* maxHeight */);
+
+    buffer->release();
+    buffer = NULL;
+
+    decoder->stop();
+
+    return frame;
+}
+
+struct FrameRequest {
+    int64_t mTimeUs;
+    size_t mIndex;
+};
+
+static int compareFrameRequests(const FrameRequest *a, const FrameRequest *b) {
+    if (a->mTimeUs != b->mTimeUs) {
+        return a->mTimeUs < b->mTimeUs ? -1 : 1;
+    }
+
+    return a->mIndex < b->mIndex ? -1 : a->mIndex > b->mIndex;
+}
+
+// Decodes the frames |requests| (sorted by time) ask for that are still
+// missing from |frames|, all with the same decoder.
+static void extractVideoFramesWithCodecFlags(
+        OMXClient *client,
+        const sp<MetaData> &trackMeta,
+        const sp<MediaSource> &source,
+        uint32_t flags,
+        const Vector<FrameRequest> &requests,
+        int seekMode,
+        int32_t maxWidth,
+        int32_t maxHeight,
+        Vector<VideoFrame *> *frames) {
+    // Decoding on from the last frame beats seeking back to the preceding
+    // sync frame for targets at most this far ahead.
+    static const int64_t kMaxDecodeAheadUs = 1000000ll;
+
+    sp<MediaSource> decoder = createVideoDecoder(client, trackMeta, source, flags);
+    if (decoder == NULL) {
+        return;
+    }
+
+    MediaSource::ReadOptions::SeekMode mode =
+            static_cast<MediaSource::ReadOptions::SeekMode>(seekMode);
+
+    int64_t prevTargetUs = -1;
+    int64_t lastTimeUs = -1;
+    const VideoFrame *lastFrame = NULL;
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const FrameRequest &request = requests.itemAt(i);
+        if (frames->itemAt(request.mIndex) != NULL) {
+            continue;
+        }
+
+        int64_t targetUs = request.mTimeUs;
+
+        // No frame lies between the previous target and the last frame,
+        // that was the first one at or after it.
+        if (lastFrame != NULL
+                && (targetUs == prevTargetUs
+                    || (mode == MediaSource::ReadOptions::SEEK_CLOSEST
+                        && targetUs <= lastTimeUs))) {
+            frames->editItemAt(request.mIndex) = new VideoFrame(*lastFrame);
+            continue;
+        }
+
+        bool seeking = mode != MediaSource::ReadOptions::SEEK_CLOSEST
+            || lastTimeUs < 0
+            || targetUs - lastTimeUs > kMaxDecodeAheadUs;
+
+        MediaSource::ReadOptions options;
+        if (seeking) {
+            options.setSeekTo(targetUs, mode);
+        }
+
+        // Ignore format change notifications and spurious empty buffers,
+        // as well as the frames before the target when decoding on.
+        MediaBuffer *buffer = NULL;
+        status_t err;
+        for (;;) {
+            err = decoder->read(&buffer, &options);
+            options.clearSeekTo();
+
+            if (err == INFO_FORMAT_CHANGED) {
+                continue;
+            } else if (err != OK) {
+                break;
+            }
+
+            int64_t timeUs;
+            if (buffer->range_length() == 0
+                    || (!seeking
+                        && buffer->meta_data()->findInt64(kKeyTime, &timeUs)
+                        && timeUs < targetUs)) {
+                buffer->release();
+                buffer = NULL;
+                continue;
+            }
+
+            break;
+        }
+
+        if (err != OK) {
+            CHECK(buffer == NULL);
+
+            ALOGV("decoding frame failed.");
+            break;
+        }
+
+        int64_t timeUs;
+        CHECK(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+
+        VideoFrame *frame;
+        if (lastFrame != NULL && timeUs == lastTimeUs) {
+            // Back at the same sync frame.
+            frame = new VideoFrame(*lastFrame);
+        } else {
+            frame = convertVideoFrame(
+                    trackMeta, decoder->getFormat(), buffer, maxWidth, maxHeight);
+        }
+
+        buffer->release();
+        buffer = NULL;
+
+        frames->editItemAt(request.mIndex) = frame;
+
+        prevTargetUs = targetUs;
+        lastTimeUs = timeUs;
+        lastFrame = frame;
+    }
+
+    decoder->stop();
+}
+
+status_t StagefrightMetadataRetriever::getVideoTrack(
+        sp<MetaData> *trackMeta, sp<MediaSource> *source) {
     if (mExtractor.get() == NULL) {
         ALOGV("no extractor.");
-        return NULL;
+        return NO_INIT;
     }
 
     sp<MetaData> fileMeta = mExtractor->getMetaData();
 
     if (fileMeta == NULL) {
         ALOGV("extractor doesn't publish metadata, failed to initialize?");
-        return NULL;
+        return NO_INIT;
     }
 
     int32_t drm = 0;
     if (fileMeta->findInt32(kKeyIsDRM, &drm) && drm != 0) {
         ALOGE("frame grab not allowed.");
-        return NULL;
+        return PERMISSION_DENIED;
     }
 
     size_t n = mExtractor->countTracks();
@@ -390,17 +565,17 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
 
     if (i == n) {
         ALOGV("no video track found.");
-        return NULL;
+        return ERROR_UNSUPPORTED;
     }
 
-    sp<MetaData> trackMeta = mExtractor->getTrackMetaData(
+    *trackMeta = mExtractor->getTrackMetaData(
             i, MediaExtractor::kIncludeExtensiveMetaData);
 
-    sp<MediaSource> source = mExtractor->getTrack(i);
+    *source = mExtractor->getTrack(i);
 
-    if (source.get() == NULL) {
+    if (source->get() == NULL) {
         ALOGV("unable to instantiate video track.");
-        return NULL;
+        return UNKNOWN_ERROR;
     }
 
     const void *data;
@@ -411,6 +586,20 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
         mAlbumArt = MediaAlbumArt::fromData(dataSize, data);
     }
 
+    return OK;
+}
+
+VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
+        int64_t timeUs, int option) {
+
+    ALOGV("getFrameAtTime: %" PRId64 " us option: %d", timeUs, option);
+
+    sp<MetaData> trackMeta;
+    sp<MediaSource> source;
+    if (getVideoTrack(&trackMeta, &source) != OK) {
+        return NULL;
+    }
+
     VideoFrame *frame =
         extractVideoFrameWithCodecFlags(
                 &mClient, trackMeta, source, OMXCodec::kSoftwareCodecsOnly,
@@ -427,6 +616,70 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
     return frame;
 }
 
+status_t StagefrightMetadataRetriever::getFramesAtTimes(
+        const Vector<int64_t> &timesUs, int option,
+        int32_t maxWidth, int32_t maxHeight,
+        Vector<VideoFrame *> *frames) {
+    ALOGV("getFramesAtTimes: %zu frames option: %d max %dx%d",
+          timesUs.size(), option, maxWidth, maxHeight);
+
+    frames->clear();
+
+    if (option < MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC ||
+        option > MediaSource::ReadOptions::SEEK_CLOSEST) {
+        ALOGE("Unknown seek mode: %d", option);
+        return BAD_VALUE;
+    }
+
+    sp<MetaData> trackMeta;
+    sp<MediaSource> source;
+    status_t err = getVideoTrack(&trackMeta, &source);
+    if (err != OK) {
+        return err;
+    }
+
+    int64_t thumbNailTime;
+    if (!trackMeta->findInt64(kKeyThumbnailTime, &thumbNailTime)
+            || thumbNailTime < 0) {
+        thumbNailTime = 0;
+    }
+
+    // Visiting the frames in order keeps the seeks going forward and lets
+    // frames close to each other share the decoding.
+    Vector<FrameRequest> requests;
+    for (size_t i = 0; i < timesUs.size(); ++i) {
+        FrameRequest request;
+        request.mTimeUs = timesUs[i] < 0 ? thumbNailTime : timesUs[i];
+        request.mIndex = i;
+        requests.push(request);
+
+        frames->push(NULL);
+    }
+    requests.sort(compareFrameRequests);
+
+    extractVideoFramesWithCodecFlags(
+            &mClient, trackMeta, source, OMXCodec::kSoftwareCodecsOnly,
+            requests, option, maxWidth, maxHeight, frames);
+
+    size_t numMissing = 0;
+    for (size_t i = 0; i < frames->size(); ++i) {
+        if (frames->itemAt(i) == NULL) {
+            ++numMissing;
+        }
+    }
+
+    if (numMissing > 0) {
+        ALOGV("Software decoder failed to extract %zu thumbnails, "
+              "trying hardware decoder.", numMissing);
+
+        extractVideoFramesWithCodecFlags(
+                &mClient, trackMeta, source, 0,
+                requests, option, maxWidth, maxHeight, frames);
+    }
+
+    return OK;
+}
+
 MediaAlbumArt *StagefrightMetadataRetriever::extractAlbumArt() {
     ALOGV("extractAlbumArt (extractor: %s)", mExtractor.get() != NULL ? "YES" : "NO");
 
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "StartCodeScanner"
+#include <utils/Log.h>
+
+#include "include/StartCodeScanner.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON 1
+#endif
+
+namespace android {
+
+// The vector loops below compare the block starting at "i" against the
+// blocks starting at "i + 1" and "i + 2", so a block is only examined if
+// all of those bytes are in range. Whatever is left over is handed to the
+// scalar loops, starting at the first position not yet examined.
+
+static ssize_t FindStartCodeFrom(
+        const uint8_t *data, size_t size, size_t start) {
+    for (size_t i = start; i + 2 < size; ++i) {
+        if (data[i + 2] > 1) {
+            // None of i, i + 1 and i + 2 can start a start code.
+            i += 2;
+        } else if (data[i + 2] == 1 && data[i] == 0x00 && data[i + 1] == 0x00) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static ssize_t FindSyncWordFrom(
+        const uint8_t *data, size_t size, size_t start,
+        uint8_t mask, uint8_t value) {
+    for (size_t i = start; i + 1 < size; ++i) {
+        if (data[i] == 0xff && (data[i + 1] & mask) == value) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+ssize_t FindStartCodeScalar(const uint8_t *data, size_t size) {
+    return FindStartCodeFrom(data, size, 0);
+}
+
+ssize_t FindSyncWordScalar(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    return FindSyncWordFrom(data, size, 0, mask, value);
+}
+
+#if defined(__AVX2__)
+
+ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+
+    size_t i = 0;
+    for (; i + 2 + 32 <= size; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(data + i + 2));
+
+        // Most blocks contain no 0x01 at all, skip those cheaply.
+        __m256i isOne = _mm256_cmpeq_epi8(c, one);
+        if (_mm256_testz_si256(isOne, isOne)) {
+            continue;
+        }
+
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+
+        __m256i match = _mm256_and_si256(
+                isOne,
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)));
+
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(match);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return FindStartCodeFrom(data, size, i);
+}
+
+ssize_t FindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    const __m256i ff = _mm256_set1_epi8((char)0xff);
+    const __m256i maskVec = _mm256_set1_epi8((char)mask);
+    const __m256i valueVec = _mm256_set1_epi8((char)value);
+
+    size_t i = 0;
+    for (; i + 1 + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+
+        __m256i isFF = _mm256_cmpeq_epi8(a, ff);
+        if (_mm256_testz_si256(isFF, isFF)) {
+            continue;
+        }
+
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+
+        __m256i match = _mm256_and_si256(
+                isFF,
+                _mm256_cmpeq_epi8(_mm256_and_si256(b, maskVec), valueVec));
+
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(match);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return FindSyncWordFrom(data, size, i, mask, value);
+}
+
+#elif defined(__SSE2__)
+
+ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    size_t i = 0;
+    for (; i + 2 + 16 <= size; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(data + i + 2));
+
+        // Most blocks contain no 0x01 at all, skip those cheaply.
+        __m128i isOne = _mm_cmpeq_epi8(c, one);
+        if (_mm_movemask_epi8(isOne) == 0) {
+            continue;
+        }
+
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + 1));
+
+        __m128i match = _mm_and_si128(
+                isOne,
+                _mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)));
+
+        unsigned bits = (unsigned)_mm_movemask_epi8(match);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return FindStartCodeFrom(data, size, i);
+}
+
+ssize_t FindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    const __m128i maskVec = _mm_set1_epi8((char)mask);
+    const __m128i valueVec = _mm_set1_epi8((char)value);
+
+    size_t i = 0;
+    for (; i + 1 + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+
+        __m128i isFF = _mm_cmpeq_epi8(a, ff);
+        if (_mm_movemask_epi8(isFF) == 0) {
+            continue;
+        }
+
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + 1));
+
+        __m128i match = _mm_and_si128(
+                isFF, _mm_cmpeq_epi8(_mm_and_si128(b, maskVec), valueVec));
+
+        unsigned bits = (unsigned)_mm_movemask_epi8(match);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return FindSyncWordFrom(data, size, i, mask, value);
+}
+
+#elif defined(USE_NEON)
+
+static inline bool AnyLaneSet(uint8x16_t v) {
+    uint64x2_t v64 = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(v64, 0) | vgetq_lane_u64(v64, 1)) != 0;
+}
+
+ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    size_t i = 0;
+    for (; i + 2 + 16 <= size; i += 16) {
+        uint8x16_t isOne = vceqq_u8(vld1q_u8(data + i + 2), one);
+        if (!AnyLaneSet(isOne)) {
+            continue;
+        }
+
+        uint8x16_t match = vandq_u8(
+                isOne,
+                vandq_u8(vceqq_u8(vld1q_u8(data + i), zero),
+                         vceqq_u8(vld1q_u8(data + i + 1), zero)));
+
+        if (AnyLaneSet(match)) {
+            // NEON has no movemask, the scalar loop picks out the first
+            // match, which is known to be within this block.
+            return FindStartCodeFrom(data, size, i);
+        }
+    }
+
+    return FindStartCodeFrom(data, size, i);
+}
+
+ssize_t FindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    const uint8x16_t ff = vdupq_n_u8(0xff);
+    const uint8x16_t maskVec = vdupq_n_u8(mask);
+    const uint8x16_t valueVec = vdupq_n_u8(value);
+
+    size_t i = 0;
+    for (; i + 1 + 16 <= size; i += 16) {
+        uint8x16_t isFF = vceqq_u8(vld1q_u8(data + i), ff);
+        if (!AnyLaneSet(isFF)) {
+            continue;
+        }
+
+        uint8x16_t match = vandq_u8(
+                isFF,
+                vceqq_u8(vandq_u8(vld1q_u8(data + i + 1), maskVec), valueVec));
+
+        if (AnyLaneSet(match)) {
+            return FindSyncWordFrom(data, size, i, mask, value);
+        }
+    }
+
+    return FindSyncWordFrom(data, size, i, mask, value);
+}
+
+#else
+
+ssize_t FindStartCode(const uint8_t *data, size_t size) {
+    return FindStartCodeFrom(data, size, 0);
+}
+
+ssize_t FindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    return FindSyncWordFrom(data, size, 0, mask, value);
+}
+
+#endif
+
+}  // namespace android
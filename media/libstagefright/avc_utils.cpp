@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include "include/avc_utils.h"
+#include "include/StartCodeScanner.h"
 
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -230,43 +231,27 @@ status_t getNextNALUnit(
         return -EAGAIN;
     }
 
-    size_t offset = 0;
-
     // A valid startcode consists of at least two 0x00 bytes followed by 0x01.
-    for (; offset + 2 < size; ++offset) {
-        if (data[offset + 2] == 0x01 && data[offset] == 0x00
-                && data[offset + 1] == 0x00) {
-            break;
-        }
-    }
-    if (offset + 2 >= size) {
-        *_data = &data[offset];
+    ssize_t pos = FindStartCode(data, size);
+    if (pos < 0) {
+        *_data = &data[size - 2];
         *_size = 2;
         return -EAGAIN;
     }
-    offset += 3;
-
-    size_t startOffset = offset;
-
-    for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
 
-        if (offset == size) {
-            if (startCodeFollows) {
-                offset = size + 2;
-                break;
-            }
+    size_t startOffset = pos + 3;
 
+    // "offset" ends up pointing at the 0x01 of the next startcode.
+    size_t offset;
+    pos = FindStartCode(&data[startOffset], size - startOffset);
+    if (pos < 0) {
+        if (!startCodeFollows) {
             return -EAGAIN;
         }
 
-        if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
-            break;
-        }
-
-        ++offset;
+        offset = size + 2;
+    } else {
+        offset = startOffset + pos + 2;
     }
 
     size_t endOffset = offset - 2;
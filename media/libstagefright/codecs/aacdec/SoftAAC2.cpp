@@ -425,18 +425,22 @@ bool SoftAAC2::isConfigured() const {
     return mInputBufferCount > 0;
 }
 
-void SoftAAC2::configureDownmix() const {
+static void ConfigureDownmix(HANDLE_AACDECODER decoder) {
     char value[PROPERTY_VALUE_MAX];
     if (!(property_get("media.aac_51_output_enabled", value, NULL)
             && (!strcmp(value, "1") || !strcasecmp(value, "true")))) {
         ALOGI("limiting to stereo output");
-        aacDecoder_SetParam(mAACDecoder, AAC_PCM_MAX_OUTPUT_CHANNELS, 2);
+        aacDecoder_SetParam(decoder, AAC_PCM_MAX_OUTPUT_CHANNELS, 2);
         // By default, the decoder creates a 5.1 channel downmix signal
         // for seven and eight channel input streams. To enable 6.1 and 7.1 channel output
-        // use aacDecoder_SetParam(mAACDecoder, AAC_PCM_MAX_OUTPUT_CHANNELS, -1)
+        // use aacDecoder_SetParam(decoder, AAC_PCM_MAX_OUTPUT_CHANNELS, -1)
     }
 }
 
+void SoftAAC2::configureDownmix() const {
+    ConfigureDownmix(mAACDecoder);
+}
+
 bool SoftAAC2::outputDelayRingBufferPutSamples(INT_PCM *samples, int32_t numSamples) {
     if (numSamples == 0) {
         return true;
@@ -1099,6 +1103,141 @@ void SoftAAC2::onPortEnableCompleted(OMX_U32 portIndex, bool enabled) {
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+SoftAAC2BatchDecoder::SoftAAC2BatchDecoder()
+    : mAACDecoder(NULL),
+      mStreamInfo(NULL),
+      mConfigured(false),
+      mOutputDelayToCompensate(0),
+      mOutputDelayKnown(false) {
+    mAACDecoder = aacDecoder_Open(TT_MP4_ADIF, /* num layers */ 1);
+    if (mAACDecoder != NULL) {
+        mStreamInfo = aacDecoder_GetStreamInfo(mAACDecoder);
+    }
+}
+
+SoftAAC2BatchDecoder::~SoftAAC2BatchDecoder() {
+    if (mAACDecoder != NULL) {
+        aacDecoder_Close(mAACDecoder);
+        mAACDecoder = NULL;
+    }
+}
+
+status_t SoftAAC2BatchDecoder::initCheck() const {
+    return (mAACDecoder != NULL && mStreamInfo != NULL) ? OK : NO_INIT;
+}
+
+status_t SoftAAC2BatchDecoder::addCodecSpecificData(
+        const uint8_t *data, size_t size) {
+    UCHAR *inBuffer[FILEREAD_MAX_LAYERS] = { const_cast<UCHAR *>(data) };
+    UINT inBufferLength[FILEREAD_MAX_LAYERS] = { (UINT)size };
+
+    AAC_DECODER_ERROR decoderErr =
+        aacDecoder_ConfigRaw(mAACDecoder, inBuffer, inBufferLength);
+
+    if (decoderErr != AAC_DEC_OK) {
+        ALOGW("aacDecoder_ConfigRaw decoderErr = 0x%4.4x", decoderErr);
+        return ERROR_MALFORMED;
+    }
+
+    ConfigureDownmix(mAACDecoder);
+    mConfigured = true;
+
+    return OK;
+}
+
+size_t SoftAAC2BatchDecoder::maxOutputSizePerUnit() const {
+    // a frame big enough for MAX_CHANNEL_COUNT channels of decoded HE-AAC
+    return 2048 * MAX_CHANNEL_COUNT * sizeof(INT_PCM);
+}
+
+void SoftAAC2BatchDecoder::getOutputFormat(
+        int32_t *numChannels, int32_t *sampleRate) const {
+    *numChannels = mStreamInfo->numChannels;
+    *sampleRate = mStreamInfo->sampleRate;
+}
+
+void SoftAAC2BatchDecoder::flush() {
+    aacDecoder_SetParam(mAACDecoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+    mOutputDelayToCompensate = 0;
+    mOutputDelayKnown = false;
+}
+
+status_t SoftAAC2BatchDecoder::decode(
+        const AccessUnit *units, size_t numUnits,
+        int16_t *pcm, size_t pcmSize,
+        size_t *numUnitsConsumed, size_t *pcmBytesWritten) {
+    *numUnitsConsumed = 0;
+    *pcmBytesWritten = 0;
+
+    if (!mConfigured) {
+        return NO_INIT;
+    }
+
+    const size_t kMaxSamplesPerFrame = 2048 * MAX_CHANNEL_COUNT;
+    const size_t outCapacity = pcmSize / sizeof(INT_PCM);
+    size_t outOffset = 0;  // in samples
+
+    size_t i = 0;
+    for (; i < numUnits && outCapacity - outOffset >= kMaxSamplesPerFrame; ++i) {
+        UCHAR *inBuffer[FILEREAD_MAX_LAYERS] = {
+            const_cast<UCHAR *>(units[i].mData) };
+        UINT inBufferLength[FILEREAD_MAX_LAYERS] = { (UINT)units[i].mSize };
+        UINT bytesValid[FILEREAD_MAX_LAYERS] = { (UINT)units[i].mSize };
+
+        if (units[i].mSize == 0) {
+            continue;
+        }
+
+        aacDecoder_Fill(mAACDecoder, inBuffer, inBufferLength, bytesValid);
+
+        INT_PCM *out = pcm + outOffset;
+        AAC_DECODER_ERROR decoderErr =
+            aacDecoder_DecodeFrame(mAACDecoder, out, kMaxSamplesPerFrame, 0 /* flags */);
+
+        if (decoderErr == AAC_DEC_NOT_ENOUGH_BITS) {
+            continue;
+        }
+
+        size_t numSamples = mStreamInfo->frameSize * mStreamInfo->numChannels;
+        if (numSamples > kMaxSamplesPerFrame) {
+            ALOGE("unexpected AAC frame size %zu", numSamples);
+            return ERROR_MALFORMED;
+        }
+
+        if (decoderErr != AAC_DEC_OK) {
+            ALOGW("AAC decoder returned error 0x%4.4x, substituting silence", decoderErr);
+            memset(out, 0, numSamples * sizeof(INT_PCM));
+            aacDecoder_SetParam(mAACDecoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+        }
+
+        if (!mOutputDelayKnown && mStreamInfo->numChannels > 0) {
+            mOutputDelayToCompensate =
+                mStreamInfo->outputDelay * mStreamInfo->numChannels;
+            mOutputDelayKnown = true;
+        }
+
+        if (mOutputDelayToCompensate > 0) {
+            // discard outputDelay at the beginning, see SoftAAC2::onQueueFilled
+            size_t discard = mOutputDelayToCompensate;
+            if (discard > numSamples) {
+                discard = numSamples;
+            }
+            memmove(out, out + discard, (numSamples - discard) * sizeof(INT_PCM));
+            numSamples -= discard;
+            mOutputDelayToCompensate -= discard;
+        }
+
+        outOffset += numSamples;
+    }
+
+    *numUnitsConsumed = i;
+    *pcmBytesWritten = outOffset * sizeof(INT_PCM);
+
+    return OK;
+}
+
 }  // namespace android
 
 android::SoftOMXComponent *createSoftOMXComponent(
@@ -1106,3 +1245,8 @@ android::SoftOMXComponent *createSoftOMXComponent(
         OMX_PTR appData, OMX_COMPONENTTYPE **component) {
     return new android::SoftAAC2(name, callbacks, appData, component);
 }
+
+android::SoftAudioBatchDecoder *createSoftAudioBatchDecoder(
+        const char * /* name */) {
+    return new android::SoftAAC2BatchDecoder;
+}
@@ -18,6 +18,7 @@
 #define SOFT_AAC_2_H_
 
 #include "SimpleSoftOMXComponent.h"
+#include "SoftAudioBatchDecoder.h"
 
 #include "aacdecoder_lib.h"
 #include "DrcPresModeWrap.h"
@@ -94,6 +95,35 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(SoftAAC2);
 };
 
+struct SoftAAC2BatchDecoder : public SoftAudioBatchDecoder {
+    SoftAAC2BatchDecoder();
+    virtual ~SoftAAC2BatchDecoder();
+
+    virtual status_t initCheck() const;
+    virtual status_t addCodecSpecificData(const uint8_t *data, size_t size);
+
+    virtual status_t decode(
+            const AccessUnit *units, size_t numUnits,
+            int16_t *pcm, size_t pcmSize,
+            size_t *numUnitsConsumed, size_t *pcmBytesWritten);
+
+    virtual size_t maxOutputSizePerUnit() const;
+    virtual void getOutputFormat(int32_t *numChannels, int32_t *sampleRate) const;
+    virtual void flush();
+
+private:
+    HANDLE_AACDECODER mAACDecoder;
+    CStreamInfo *mStreamInfo;
+    bool mConfigured;
+
+    // Number of interleaved samples still to be trimmed off the output to
+    // compensate for the decoder delay.
+    int32_t mOutputDelayToCompensate;
+    bool mOutputDelayKnown;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SoftAAC2BatchDecoder);
+};
+
 }  // namespace android
 
 #endif  // SOFT_AAC_2_H_
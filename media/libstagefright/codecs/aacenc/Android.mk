@@ -55,6 +55,12 @@ LOCAL_SRC_FILES += \
 	src/asm/ARMV7/Radix4FFT_v7.s
 endif
 
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+LOCAL_SRC_FILES += \
+	src/asm/X86/band_nrg_sse.c \
+	src/asm/X86/PrePostMDCT_sse.c
+endif
+
 LOCAL_MODULE := libstagefright_aacenc
 
 LOCAL_ARM_MODE := arm
@@ -82,6 +88,10 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/asm/ARMV5E
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/asm/ARMV7
 endif
 
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+LOCAL_CFLAGS += -DX86_SSE
+endif
+
 LOCAL_CFLAGS += -Werror
 
 include $(BUILD_STATIC_LIBRARY)
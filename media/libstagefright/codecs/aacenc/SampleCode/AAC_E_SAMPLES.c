@@ -147,6 +147,8 @@ int main(int argc, char **argv)
 	int							bytesLeft, nRead;
 	int							EncoderdFrame = 0;
 	int							total = 0;
+	long long					totalBytesRead = 0;
+	double						encodeSecs, audioSecs;
 	int							isOutput = 1;
 	int							returnCode;
 	AACENC_PARAM				aacpara;
@@ -219,6 +221,7 @@ int main(int argc, char **argv)
 
 	inData.Buffer = inBuf;
 	bytesLeft = ReadFile2Buf(infile,inData.Buffer,READ_SIZE);
+	totalBytesRead += bytesLeft;
 
 //#######################################    Encoding Section   #########################################
 
@@ -260,6 +263,7 @@ int main(int argc, char **argv)
 		if (!eofFile) {
 			nRead = ReadFile2Buf(infile, inBuf,READ_SIZE);
 			bytesLeft = nRead;
+			totalBytesRead += nRead;
 			inData.Buffer = inBuf;
 			if (feof(infile))
 				eofFile = 1;
@@ -271,6 +275,15 @@ int main(int argc, char **argv)
 //################################################  End Encoding Section  #######################################################
 	returnCode = AudioAPI.Uninit(hCodec);
 
+	// encode speed, counting only the time spent inside the encoder
+	encodeSecs = (double)total / CLOCKS_PER_SEC;
+	audioSecs = (double)totalBytesRead / (2 * aacpara.nChannels) / aacpara.sampleRate;
+	printf("%d frames, %.2f secs of audio encoded in %.3f secs of cpu time",
+			EncoderdFrame, audioSecs, encodeSecs);
+	if (encodeSecs > 0)
+		printf(", %.1fx realtime", audioSecs / encodeSecs);
+	printf("\n");
+
 	fclose(infile);
 	if (outfile)
     {
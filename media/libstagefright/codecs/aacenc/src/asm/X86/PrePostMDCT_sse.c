@@ -0,0 +1,231 @@
+/*
+ ** Copyright 2003-2010, VisualOn, Inc.
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		PrePostMDCT_sse.c
+
+	Content:	PreMDCT and PostMDCT functions, SSE2
+
+	Four butterflies are processed per step. The twiddles and the samples
+	from both ends of the buffer are de-interleaved so that each of the
+	eight MULHIGH products of the C reference becomes one vector multiply.
+
+*******************************************************************************/
+
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "basic_op.h"
+
+/* MULHIGH on four lanes */
+__inline __m128i mulHigh(__m128i a, __m128i b)
+{
+  __m128i even, odd;
+
+#ifdef __SSE4_1__
+  even = _mm_mul_epi32(a, b);
+  odd = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+#else
+  even = _mm_mul_epu32(a, b);
+  odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+#endif
+
+  even = _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 3, 1));
+  odd = _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 3, 1));
+  even = _mm_unpacklo_epi32(even, odd);
+
+#ifndef __SSE4_1__
+  /* turn the unsigned high word into the signed one */
+  even = _mm_sub_epi32(even, _mm_and_si128(_mm_srai_epi32(a, 31), b));
+  even = _mm_sub_epi32(even, _mm_and_si128(_mm_srai_epi32(b, 31), a));
+#endif
+
+  return even;
+}
+
+/* loads four {cosa, sina, cosb, sinb} twiddle sets and transposes them */
+__inline void loadTwiddles(const int *csptr,
+                                  __m128i *cosa, __m128i *sina,
+                                  __m128i *cosb, __m128i *sinb)
+{
+  __m128i c0 = _mm_loadu_si128((const __m128i *)(csptr + 0));
+  __m128i c1 = _mm_loadu_si128((const __m128i *)(csptr + 4));
+  __m128i c2 = _mm_loadu_si128((const __m128i *)(csptr + 8));
+  __m128i c3 = _mm_loadu_si128((const __m128i *)(csptr + 12));
+  __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+  __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+  __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+  __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+  *cosa = _mm_unpacklo_epi64(t0, t1);
+  *sina = _mm_unpackhi_epi64(t0, t1);
+  *cosb = _mm_unpacklo_epi64(t2, t3);
+  *sinb = _mm_unpackhi_epi64(t2, t3);
+}
+
+/* buf0[0..7] as four pairs, split into the first and second of each pair */
+__inline void loadFront(const int *buf0, __m128i *first, __m128i *second)
+{
+  __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(buf0 + 0)),
+                                 _MM_SHUFFLE(3, 1, 2, 0));
+  __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(buf0 + 4)),
+                                 _MM_SHUFFLE(3, 1, 2, 0));
+
+  *first = _mm_unpacklo_epi64(v0, v1);
+  *second = _mm_unpackhi_epi64(v0, v1);
+}
+
+/* buf1[-7..0] as four pairs walking backwards, split into *(buf1 - 1)
+   and *buf1 of each pair */
+__inline void loadBack(const int *buf1, __m128i *lower, __m128i *upper)
+{
+  __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(buf1 - 3)),
+                                 _MM_SHUFFLE(1, 3, 0, 2));
+  __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(buf1 - 7)),
+                                 _MM_SHUFFLE(1, 3, 0, 2));
+
+  *lower = _mm_unpacklo_epi64(v0, v1);
+  *upper = _mm_unpackhi_epi64(v0, v1);
+}
+
+__inline void storeFront(int *buf0, __m128i first, __m128i second)
+{
+  _mm_storeu_si128((__m128i *)(buf0 + 0), _mm_unpacklo_epi32(first, second));
+  _mm_storeu_si128((__m128i *)(buf0 + 4), _mm_unpackhi_epi32(first, second));
+}
+
+__inline void storeBack(int *buf1, __m128i lower, __m128i upper)
+{
+  _mm_storeu_si128((__m128i *)(buf1 - 3),
+                   _mm_shuffle_epi32(_mm_unpacklo_epi32(lower, upper),
+                                     _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_storeu_si128((__m128i *)(buf1 - 7),
+                   _mm_shuffle_epi32(_mm_unpackhi_epi32(lower, upper),
+                                     _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+/*********************************************************************************
+*
+* function name: PreMDCT
+* description:  prepare MDCT process for next FFT compute
+*
+**********************************************************************************/
+void PreMDCT(int *buf0, int num, const int *csptr)
+{
+	int i;
+	int tr1, ti1, tr2, ti2;
+	int cosa, sina, cosb, sinb;
+	int *buf1;
+
+	buf1 = buf0 + num - 1;
+
+	for(i = num >> 2; i >= 4; i -= 4)
+	{
+		__m128i vcosa, vsina, vcosb, vsinb;
+		__m128i vtr1, vti1, vtr2, vti2;
+
+		loadTwiddles(csptr, &vcosa, &vsina, &vcosb, &vsinb);
+		loadFront(buf0, &vtr1, &vti2);
+		loadBack(buf1, &vtr2, &vti1);
+
+		storeFront(buf0,
+				_mm_add_epi32(mulHigh(vcosa, vtr1), mulHigh(vsina, vti1)),
+				_mm_sub_epi32(mulHigh(vcosa, vti1), mulHigh(vsina, vtr1)));
+		storeBack(buf1,
+				_mm_add_epi32(mulHigh(vcosb, vtr2), mulHigh(vsinb, vti2)),
+				_mm_sub_epi32(mulHigh(vcosb, vti2), mulHigh(vsinb, vtr2)));
+
+		csptr += 16;
+		buf0 += 8;
+		buf1 -= 8;
+	}
+
+	for(; i != 0; i--)
+	{
+		cosa = *csptr++;
+		sina = *csptr++;
+		cosb = *csptr++;
+		sinb = *csptr++;
+
+		tr1 = *(buf0 + 0);
+		ti2 = *(buf0 + 1);
+		tr2 = *(buf1 - 1);
+		ti1 = *(buf1 + 0);
+
+		*buf0++ = MULHIGH(cosa, tr1) + MULHIGH(sina, ti1);
+		*buf0++ = MULHIGH(cosa, ti1) - MULHIGH(sina, tr1);
+
+		*buf1-- = MULHIGH(cosb, ti2) - MULHIGH(sinb, tr2);
+		*buf1-- = MULHIGH(cosb, tr2) + MULHIGH(sinb, ti2);
+	}
+}
+
+/*********************************************************************************
+*
+* function name: PostMDCT
+* description:   post MDCT process after next FFT for MDCT
+*
+**********************************************************************************/
+void PostMDCT(int *buf0, int num, const int *csptr)
+{
+	int i;
+	int tr1, ti1, tr2, ti2;
+	int cosa, sina, cosb, sinb;
+	int *buf1;
+
+	buf1 = buf0 + num - 1;
+
+	for(i = num >> 2; i >= 4; i -= 4)
+	{
+		__m128i vcosa, vsina, vcosb, vsinb;
+		__m128i vtr1, vti1, vtr2, vti2;
+
+		loadTwiddles(csptr, &vcosa, &vsina, &vcosb, &vsinb);
+		loadFront(buf0, &vtr1, &vti1);
+		loadBack(buf1, &vtr2, &vti2);
+
+		storeFront(buf0,
+				_mm_add_epi32(mulHigh(vcosa, vtr1), mulHigh(vsina, vti1)),
+				_mm_sub_epi32(mulHigh(vsinb, vtr2), mulHigh(vcosb, vti2)));
+		storeBack(buf1,
+				_mm_add_epi32(mulHigh(vcosb, vtr2), mulHigh(vsinb, vti2)),
+				_mm_sub_epi32(mulHigh(vsina, vtr1), mulHigh(vcosa, vti1)));
+
+		csptr += 16;
+		buf0 += 8;
+		buf1 -= 8;
+	}
+
+	for(; i != 0; i--)
+	{
+		cosa = *csptr++;
+		sina = *csptr++;
+		cosb = *csptr++;
+		sinb = *csptr++;
+
+		tr1 = *(buf0 + 0);
+		ti1 = *(buf0 + 1);
+		ti2 = *(buf1 + 0);
+		tr2 = *(buf1 - 1);
+
+		*buf0++ = MULHIGH(cosa, tr1) + MULHIGH(sina, ti1);
+		*buf1-- = MULHIGH(sina, tr1) - MULHIGH(cosa, ti1);
+
+		*buf0++ = MULHIGH(sinb, tr2) - MULHIGH(cosb, ti2);
+		*buf1-- = MULHIGH(cosb, tr2) + MULHIGH(sinb, ti2);
+	}
+}
@@ -0,0 +1,185 @@
+/*
+ ** Copyright 2003-2010, VisualOn, Inc.
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*******************************************************************************
+	File:		band_nrg_sse.c
+
+	Content:	CalcBandEnergy and CalcBandEnergyMS functions, SSE2/AVX2
+
+	The squared lines are never negative, so the saturating L_add chain of
+	the C reference equals a plain 64 bit sum clipped to MAX_32 once at
+	the end of each band. This keeps the result bit-exact.
+
+*******************************************************************************/
+
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "basic_op.h"
+#include "band_nrg.h"
+
+__inline Word32 clip32(Word64 accu)
+{
+  return accu > MAX_32 ? MAX_32 : (Word32)accu;
+}
+
+/* MULHIGH(x, x) of four lanes, accumulated into two 64 bit lanes.
+   |MIN_32| wraps to 0x80000000, which is still exact as an unsigned value */
+__inline __m128i sqrHighAcc(__m128i accu, __m128i x)
+{
+  __m128i s = _mm_srai_epi32(x, 31);
+  __m128i a = _mm_sub_epi32(_mm_xor_si128(x, s), s);
+  __m128i b = _mm_srli_epi64(a, 32);
+
+  accu = _mm_add_epi64(accu, _mm_srli_epi64(_mm_mul_epu32(a, a), 32));
+  accu = _mm_add_epi64(accu, _mm_srli_epi64(_mm_mul_epu32(b, b), 32));
+
+  return accu;
+}
+
+__inline Word64 sumLanes(__m128i accu)
+{
+  Word64 sum;
+
+  accu = _mm_add_epi64(accu, _mm_unpackhi_epi64(accu, accu));
+  _mm_storel_epi64((__m128i *)&sum, accu);
+
+  return sum;
+}
+
+#ifdef __AVX2__
+__inline __m256i sqrHighAcc256(__m256i accu, __m256i x)
+{
+  __m256i a = _mm256_abs_epi32(x);
+  __m256i b = _mm256_srli_epi64(a, 32);
+
+  accu = _mm256_add_epi64(accu, _mm256_srli_epi64(_mm256_mul_epu32(a, a), 32));
+  accu = _mm256_add_epi64(accu, _mm256_srli_epi64(_mm256_mul_epu32(b, b), 32));
+
+  return accu;
+}
+
+__inline __m128i foldLanes256(__m256i accu)
+{
+  return _mm_add_epi64(_mm256_castsi256_si128(accu),
+                       _mm256_extracti128_si256(accu, 1));
+}
+#endif
+
+/********************************************************************************
+*
+* function name: CalcBandEnergy
+* description:   Calc sfb-bandwise mdct-energies for left and right channel
+*
+**********************************************************************************/
+void CalcBandEnergy(const Word32 *mdctSpectrum,
+                    const Word16 *bandOffset,
+                    const Word16  numBands,
+                    Word32       *bandEnergy,
+                    Word32       *bandEnergySum)
+{
+  Word32 i, j;
+  Word64 accuSum = 0;
+
+  for (i=0; i<numBands; i++) {
+    __m128i accu4 = _mm_setzero_si128();
+    Word64 accu;
+    Word32 end = bandOffset[i+1];
+
+    j = bandOffset[i];
+#ifdef __AVX2__
+    {
+      __m256i accu8 = _mm256_setzero_si256();
+      for (; j + 8 <= end; j += 8)
+        accu8 = sqrHighAcc256(accu8, _mm256_loadu_si256((const __m256i *)&mdctSpectrum[j]));
+      accu4 = foldLanes256(accu8);
+    }
+#endif
+    for (; j + 4 <= end; j += 4)
+      accu4 = sqrHighAcc(accu4, _mm_loadu_si128((const __m128i *)&mdctSpectrum[j]));
+
+    accu = sumLanes(accu4);
+    for (; j < end; j++)
+      accu += MULHIGH(mdctSpectrum[j], mdctSpectrum[j]);
+
+    accu = clip32(accu);
+    accu = clip32(accu + accu);
+    accuSum += accu;
+    bandEnergy[i] = (Word32)accu;
+  }
+  *bandEnergySum = clip32(accuSum);
+}
+
+/********************************************************************************
+*
+* function name: CalcBandEnergyMS
+* description:   Calc sfb-bandwise mdct-energies for left add or minus right channel
+*
+**********************************************************************************/
+void CalcBandEnergyMS(const Word32 *mdctSpectrumLeft,
+                      const Word32 *mdctSpectrumRight,
+                      const Word16 *bandOffset,
+                      const Word16  numBands,
+                      Word32       *bandEnergyMid,
+                      Word32       *bandEnergyMidSum,
+                      Word32       *bandEnergySide,
+                      Word32       *bandEnergySideSum)
+{
+  Word32 i, j;
+  Word64 accuMidSum = 0;
+  Word64 accuSideSum = 0;
+
+  for(i=0; i<numBands; i++) {
+    __m128i accuMid4 = _mm_setzero_si128();
+    __m128i accuSide4 = _mm_setzero_si128();
+    Word64 accuMid, accuSide;
+    Word32 end = bandOffset[i+1];
+
+    for (j=bandOffset[i]; j + 4 <= end; j += 4) {
+      __m128i l = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)&mdctSpectrumLeft[j]), 1);
+      __m128i r = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)&mdctSpectrumRight[j]), 1);
+
+      accuMid4 = sqrHighAcc(accuMid4, _mm_add_epi32(l, r));
+      accuSide4 = sqrHighAcc(accuSide4, _mm_sub_epi32(l, r));
+    }
+
+    accuMid = sumLanes(accuMid4);
+    accuSide = sumLanes(accuSide4);
+    for (; j < end; j++) {
+      Word32 specm, specs;
+      Word32 l, r;
+
+      l = mdctSpectrumLeft[j] >> 1;
+      r = mdctSpectrumRight[j] >> 1;
+      specm = l + r;
+      specs = l - r;
+      accuMid += MULHIGH(specm, specm);
+      accuSide += MULHIGH(specs, specs);
+    }
+
+    accuMid = clip32(accuMid);
+    accuMid = clip32(accuMid + accuMid);
+    accuSide = clip32(accuSide);
+    accuSide = clip32(accuSide + accuSide);
+    bandEnergyMid[i] = (Word32)accuMid;
+    accuMidSum += accuMid;
+    bandEnergySide[i] = (Word32)accuSide;
+    accuSideSum += accuSide;
+  }
+  *bandEnergyMidSum = clip32(accuMidSum);
+  *bandEnergySideSum = clip32(accuSideSum);
+}
@@ -23,7 +23,7 @@
 #include "basic_op.h"
 #include "band_nrg.h"
 
-#ifndef ARMV5E
+#if !defined(ARMV5E) && !defined(X86_SSE)
 /********************************************************************************
 *
 * function name: CalcBandEnergy
@@ -20,6 +20,10 @@
 
 *******************************************************************************/
 
+#ifdef X86_SSE
+#include <emmintrin.h>
+#endif
+
 #include "typedef.h"
 #include "basic_op.h"
 #include "oper_32b.h"
@@ -119,7 +123,56 @@ static void quantizeLines(const Word16 gain,
 
   if(g >= 0)
   {
-	for (line=0; line<noOfLines; line++) {
+	line = 0;
+#ifdef X86_SSE
+	{
+	  /* lines quantizing to 0..3 only need the border comparisons, the
+	     rare larger ones are finished by quantizeSingleLine. Shifts of
+	     32 and up are left to the scalar loop, whose result depends on
+	     how the target handles oversized shift counts. */
+	  const __m128i border0 = _mm_set1_epi32(pquat[0]);
+	  const __m128i border1 = _mm_set1_epi32(pquat[1]);
+	  const __m128i border2 = _mm_set1_epi32(pquat[2]);
+	  const __m128i border3 = _mm_set1_epi32(pquat[3]);
+	  const __m128i shift = _mm_cvtsi32_si128(g);
+
+	  for (; g < INT_BITS && line + 4 <= noOfLines; line += 4) {
+		__m128i spec = _mm_loadu_si128((const __m128i *)&mdctSpectrum[line]);
+		__m128i sign = _mm_srai_epi32(spec, 31);
+		__m128i sa, saShft, qua, large;
+		int largeMask, k;
+
+		/* L_abs, including MIN_32 -> MAX_32 */
+		sa = _mm_sub_epi32(_mm_xor_si128(spec, sign), sign);
+		sa = _mm_add_epi32(sa, _mm_srai_epi32(sa, 31));
+		saShft = _mm_sra_epi32(sa, shift);
+
+		qua = _mm_add_epi32(_mm_cmpgt_epi32(saShft, border0),
+		                    _mm_andnot_si128(_mm_cmpgt_epi32(border1, saShft),
+		                                     _mm_set1_epi32(-1)));
+		qua = _mm_add_epi32(qua,
+		                    _mm_andnot_si128(_mm_cmpgt_epi32(border2, saShft),
+		                                     _mm_set1_epi32(-1)));
+		qua = _mm_sub_epi32(_mm_setzero_si128(), qua);
+		qua = _mm_sub_epi32(_mm_xor_si128(qua, sign), sign);
+
+		_mm_storel_epi64((__m128i *)&quaSpectrum[line], _mm_packs_epi32(qua, qua));
+
+		large = _mm_andnot_si128(_mm_cmpgt_epi32(border3, saShft), _mm_set1_epi32(-1));
+		largeMask = _mm_movemask_epi8(large);
+		for (k = 0; largeMask != 0; k++, largeMask >>= 4) {
+		  if (largeMask & 1) {
+			Word16 q;
+
+			mdctSpeL = mdctSpectrum[line + k];
+			q = quantizeSingleLine(gain, L_abs(mdctSpeL));
+			quaSpectrum[line + k] = mdctSpeL < 0 ? -q : q;
+		  }
+		}
+	  }
+	}
+#endif
+	for (; line<noOfLines; line++) {
 	  Word32 qua;
 	  qua = 0;
 
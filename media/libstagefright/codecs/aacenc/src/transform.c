@@ -270,6 +270,7 @@ static void Radix4FFT(int *buf, int num, int bgn, int *twidTab)
 	}
 }
 
+#ifndef X86_SSE
 /*********************************************************************************
 *
 * function name: PreMDCT
@@ -340,6 +341,10 @@ static void PostMDCT(int *buf0, int num, const int *csptr)
 	}
 }
 #else
+void PreMDCT(int *buf0, int num, const int *csptr);
+void PostMDCT(int *buf0, int num, const int *csptr);
+#endif
+#else
 void Radix4First(int *buf, int num);
 void Radix8First(int *buf, int num);
 void Radix4FFT(int *buf, int num, int bgn, int *twidTab);
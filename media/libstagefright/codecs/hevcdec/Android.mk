@@ -19,6 +19,7 @@ LOCAL_SHARED_LIBRARIES  += libstagefright_omx
 LOCAL_SHARED_LIBRARIES  += libstagefright_foundation
 LOCAL_SHARED_LIBRARIES  += libutils
 LOCAL_SHARED_LIBRARIES  += liblog
+LOCAL_SHARED_LIBRARIES  += libcutils
 
 # We need this because the current asm generates the following link error:
 # requires unsupported dynamic reloc R_ARM_REL32; recompile with -fPIC
@@ -25,6 +25,7 @@
 #include "ihevcd_cxa.h"
 #include "SoftHEVC.h"
 
+#include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/MediaDefs.h>
@@ -103,6 +104,19 @@ static size_t GetCPUCoreCount() {
     return (size_t)cpuCoreCount;
 }
 
+// One decoder thread per core unless overridden for benchmarking, the
+// codec itself supports at most CODEC_MAX_NUM_CORES.
+static size_t GetDecoderThreadCount() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("debug.stagefright.vdec-threads", value, NULL) > 0) {
+        int threads = atoi(value);
+        if (threads > 0) {
+            return (size_t)threads;
+        }
+    }
+    return GetCPUCoreCount();
+}
+
 void SoftHEVC::logVersion() {
     ivd_ctl_getversioninfo_ip_t s_ctl_ip;
     ivd_ctl_getversioninfo_op_t s_ctl_op;
@@ -248,7 +262,7 @@ status_t SoftHEVC::initDecoder() {
     UWORD32 u4_share_disp_buf;
     WORD32 i4_level;
 
-    mNumCores = GetCPUCoreCount();
+    mNumCores = GetDecoderThreadCount();
 
     /* Initialize number of ref and reorder modes (for HEVC) */
     u4_num_reorder_frames = 16;
@@ -22,6 +22,7 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
 
 #include "include/pvmp3decoder_api.h"
 
@@ -433,6 +434,139 @@ void SoftMP3::onReset() {
     mOutputPortSettingsChange = NONE;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+SoftMP3BatchDecoder::SoftMP3BatchDecoder()
+    : mConfig(new tPVMP3DecoderExternal),
+      mDecoderBuf(NULL),
+      mNumChannels(2),
+      mSamplingRate(44100),
+      mUnitOffset(0),
+      mIsFirst(true) {
+    mConfig->equalizerType = flat;
+    mConfig->crcEnabled = false;
+    mConfig->samplingRate = mSamplingRate;
+    mDecoderBuf = malloc(pvmp3_decoderMemRequirements());
+
+    if (mDecoderBuf != NULL) {
+        pvmp3_InitDecoder(mConfig, mDecoderBuf);
+    }
+}
+
+SoftMP3BatchDecoder::~SoftMP3BatchDecoder() {
+    if (mDecoderBuf != NULL) {
+        free(mDecoderBuf);
+        mDecoderBuf = NULL;
+    }
+
+    delete mConfig;
+    mConfig = NULL;
+}
+
+status_t SoftMP3BatchDecoder::initCheck() const {
+    return mDecoderBuf != NULL ? OK : NO_MEMORY;
+}
+
+status_t SoftMP3BatchDecoder::addCodecSpecificData(
+        const uint8_t * /* data */, size_t /* size */) {
+    // mp3 is self-describing, there is nothing to configure.
+    return OK;
+}
+
+size_t SoftMP3BatchDecoder::maxOutputSizePerUnit() const {
+    return kMaxOutputFrameSize;
+}
+
+void SoftMP3BatchDecoder::getOutputFormat(
+        int32_t *numChannels, int32_t *sampleRate) const {
+    *numChannels = mNumChannels;
+    *sampleRate = mSamplingRate;
+}
+
+void SoftMP3BatchDecoder::flush() {
+    pvmp3_InitDecoder(mConfig, mDecoderBuf);
+    mUnitOffset = 0;
+    mIsFirst = true;
+}
+
+status_t SoftMP3BatchDecoder::decode(
+        const AccessUnit *units, size_t numUnits,
+        int16_t *pcm, size_t pcmSize,
+        size_t *numUnitsConsumed, size_t *pcmBytesWritten) {
+    *numUnitsConsumed = 0;
+    *pcmBytesWritten = 0;
+
+    uint8_t *out = (uint8_t *)pcm;
+    size_t outOffset = 0;
+    status_t err = OK;
+
+    size_t i = 0;
+    while (i < numUnits && pcmSize - outOffset >= kMaxOutputFrameSize) {
+        const AccessUnit &unit = units[i];
+
+        if (mUnitOffset >= unit.mSize) {
+            mUnitOffset = 0;
+            ++i;
+            continue;
+        }
+
+        mConfig->pInputBuffer = const_cast<uint8_t *>(unit.mData) + mUnitOffset;
+        mConfig->inputBufferCurrentLength = unit.mSize - mUnitOffset;
+        mConfig->inputBufferMaxLength = 0;
+        mConfig->inputBufferUsedLength = 0;
+        mConfig->outputFrameSize = kMaxOutputFrameSize / sizeof(int16_t);
+        mConfig->pOutputBuffer = (int16_t *)(out + outOffset);
+
+        ERROR_CODE decoderErr = pvmp3_framedecoder(mConfig, mDecoderBuf);
+        if (decoderErr != NO_DECODING_ERROR) {
+            ALOGV("mp3 decoder returned error %d", decoderErr);
+
+            if (decoderErr != NO_ENOUGH_MAIN_DATA_ERROR
+                    && decoderErr != SIDE_INFO_ERROR
+                    && decoderErr != SYNCH_LOST_ERROR) {
+                ALOGE("mp3 decoder returned error %d", decoderErr);
+                err = ERROR_MALFORMED;
+                break;
+            }
+
+            // Recoverable, substitute silence for this frame just like the
+            // OMX component does.
+            mConfig->outputFrameSize = kMaxOutputFrameSize / sizeof(int16_t);
+            memset(out + outOffset, 0, mConfig->outputFrameSize * sizeof(int16_t));
+            mConfig->inputBufferUsedLength = unit.mSize - mUnitOffset;
+        } else {
+            mSamplingRate = mConfig->samplingRate;
+            mNumChannels = mConfig->num_channels;
+        }
+
+        size_t frameBytes = mConfig->outputFrameSize * sizeof(int16_t);
+        if (mIsFirst) {
+            mIsFirst = false;
+            // Trim the decoder delay off the start of the stream, see
+            // SoftMP3::onQueueFilled.
+            size_t delayBytes = kPVMP3DecoderDelay * mNumChannels * sizeof(int16_t);
+            if (delayBytes > frameBytes) {
+                delayBytes = frameBytes;
+            }
+            memmove(out + outOffset, out + outOffset + delayBytes,
+                    frameBytes - delayBytes);
+            frameBytes -= delayBytes;
+        }
+        outOffset += frameBytes;
+
+        mUnitOffset += mConfig->inputBufferUsedLength;
+        if (mConfig->inputBufferUsedLength == 0 || mUnitOffset >= unit.mSize) {
+            mUnitOffset = 0;
+            ++i;
+        }
+    }
+
+    *numUnitsConsumed = i;
+    *pcmBytesWritten = outOffset;
+
+    return (i == 0 && outOffset == 0) ? err : OK;
+}
+
 }  // namespace android
 
 android::SoftOMXComponent *createSoftOMXComponent(
@@ -440,3 +574,8 @@ android::SoftOMXComponent *createSoftOMXComponent(
         OMX_PTR appData, OMX_COMPONENTTYPE **component) {
     return new android::SoftMP3(name, callbacks, appData, component);
 }
+
+android::SoftAudioBatchDecoder *createSoftAudioBatchDecoder(
+        const char * /* name */) {
+    return new android::SoftMP3BatchDecoder;
+}
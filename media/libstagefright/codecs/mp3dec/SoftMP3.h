@@ -19,6 +19,7 @@
 #define SOFT_MP3_H_
 
 #include "SimpleSoftOMXComponent.h"
+#include "SoftAudioBatchDecoder.h"
 
 struct tPVMP3DecoderExternal;
 
@@ -77,6 +78,42 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(SoftMP3);
 };
 
+struct SoftMP3BatchDecoder : public SoftAudioBatchDecoder {
+    SoftMP3BatchDecoder();
+    virtual ~SoftMP3BatchDecoder();
+
+    virtual status_t initCheck() const;
+    virtual status_t addCodecSpecificData(const uint8_t *data, size_t size);
+
+    virtual status_t decode(
+            const AccessUnit *units, size_t numUnits,
+            int16_t *pcm, size_t pcmSize,
+            size_t *numUnitsConsumed, size_t *pcmBytesWritten);
+
+    virtual size_t maxOutputSizePerUnit() const;
+    virtual void getOutputFormat(int32_t *numChannels, int32_t *sampleRate) const;
+    virtual void flush();
+
+private:
+    enum {
+        kMaxOutputFrameSize = 4608 * 2,
+        kPVMP3DecoderDelay = 529 // frames
+    };
+
+    tPVMP3DecoderExternal *mConfig;
+    void *mDecoderBuf;
+
+    int32_t mNumChannels;
+    int32_t mSamplingRate;
+
+    // Offset into the first access unit of the next decode() call, in case
+    // the previous call ran out of output space in the middle of a unit.
+    size_t mUnitOffset;
+    bool mIsFirst;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SoftMP3BatchDecoder);
+};
+
 }  // namespace android
 
 #endif  // SOFT_MP3_H_
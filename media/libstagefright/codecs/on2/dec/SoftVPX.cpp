@@ -20,6 +20,7 @@
 
 #include "SoftVPX.h"
 
+#include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
 
@@ -37,8 +38,11 @@ SoftVPX::SoftVPX(
             name, componentRole, codingType,
             NULL /* profileLevels */, 0 /* numProfileLevels */,
             320 /* width */, 240 /* height */, callbacks, appData, component),
+      mEOSStatus(INPUT_DATA_AVAILABLE),
       mMode(codingType == OMX_VIDEO_CodingVP8 ? MODE_VP8 : MODE_VP9),
       mCtx(NULL),
+      mFrameParallelMode(false),
+      mTimeStampIdx(0),
       mImg(NULL) {
     // arbitrary from avc/hevc as vpx does not specify a min compression ratio
     const size_t kMinCompressionRatio = mMode == MODE_VP8 ? 2 : 4;
@@ -51,9 +55,7 @@ SoftVPX::SoftVPX(
 }
 
 SoftVPX::~SoftVPX() {
-    vpx_codec_destroy((vpx_codec_ctx_t *)mCtx);
-    delete (vpx_codec_ctx_t *)mCtx;
-    mCtx = NULL;
+    destroyDecoder();
 }
 
 static int GetCPUCoreCount() {
@@ -69,106 +71,219 @@ static int GetCPUCoreCount() {
     return cpuCoreCount;
 }
 
+// One decoder thread per core unless overridden for benchmarking.
+static int GetDecoderThreadCount() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("debug.stagefright.vdec-threads", value, NULL) > 0) {
+        int threads = atoi(value);
+        if (threads > 0) {
+            return threads;
+        }
+    }
+    return GetCPUCoreCount();
+}
+
 status_t SoftVPX::initDecoder() {
     mCtx = new vpx_codec_ctx_t;
     vpx_codec_err_t vpx_err;
     vpx_codec_dec_cfg_t cfg;
+    vpx_codec_flags_t flags = 0;
     memset(&cfg, 0, sizeof(vpx_codec_dec_cfg_t));
-    cfg.threads = GetCPUCoreCount();
+    cfg.threads = GetDecoderThreadCount();
+
+#ifdef VPX_CODEC_USE_FRAME_THREADING
+    // Frame parallel decoding keeps several VP9 frames in flight, trading
+    // latency for throughput, so it is opt-in.
+    if (mMode == MODE_VP9 && cfg.threads > 1) {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.stagefright.vp9.frame-parallel", value, "0");
+        mFrameParallelMode = atoi(value) != 0;
+        if (mFrameParallelMode) {
+            flags |= VPX_CODEC_USE_FRAME_THREADING;
+        }
+    }
+#endif
+
     if ((vpx_err = vpx_codec_dec_init(
                 (vpx_codec_ctx_t *)mCtx,
                  mMode == MODE_VP8 ? &vpx_codec_vp8_dx_algo : &vpx_codec_vp9_dx_algo,
-                 &cfg, 0))) {
+                 &cfg, flags))) {
         ALOGE("on2 decoder failed to initialize. (%d)", vpx_err);
         return UNKNOWN_ERROR;
     }
 
+#ifdef VP9D_SET_ROW_MT
+    // Tiles are decoded in parallel already, row based multi-threading
+    // also spreads streams with few tile columns over all threads.
+    if (mMode == MODE_VP9 && cfg.threads > 1 && !mFrameParallelMode) {
+        vpx_codec_control((vpx_codec_ctx_t *)mCtx, VP9D_SET_ROW_MT, 1);
+    }
+#endif
+
+    ALOGI("%s decoder using %u threads%s",
+            mMode == MODE_VP8 ? "vp8" : "vp9", cfg.threads,
+            mFrameParallelMode ? " in frame parallel mode" : "");
+
+    return OK;
+}
+
+status_t SoftVPX::destroyDecoder() {
+    vpx_codec_destroy((vpx_codec_ctx_t *)mCtx);
+    delete (vpx_codec_ctx_t *)mCtx;
+    mCtx = NULL;
     return OK;
 }
 
+bool SoftVPX::outputBuffers(bool flushDecoder, bool display, bool eos, bool *portWillReset) {
+    List<BufferInfo *> &outQueue = getPortQueue(1);
+    vpx_codec_iter_t iter = NULL;
+
+    if (flushDecoder && mFrameParallelMode) {
+        // Passing no data makes the decoder finish all frames in flight.
+        if (vpx_codec_decode((vpx_codec_ctx_t *)mCtx, NULL, 0, NULL, 0)) {
+            ALOGE("Failed to flush on2 decoder.");
+            return false;
+        }
+    }
+
+    if (!display) {
+        if (!flushDecoder) {
+            ALOGE("Invalid operation.");
+            return false;
+        }
+        // Drop all the decoded frames in decoder.
+        mImg = NULL;
+        while (vpx_codec_get_frame((vpx_codec_ctx_t *)mCtx, &iter) != NULL) {
+        }
+        return true;
+    }
+
+    // With several frames in flight a single decode call may complete more
+    // than one of them, hand out as many as there are output buffers for.
+    // A frame that does not fit is kept in mImg until the next call.
+    while (!outQueue.empty()) {
+        if (mImg == NULL) {
+            mImg = vpx_codec_get_frame((vpx_codec_ctx_t *)mCtx, &iter);
+            if (mImg == NULL) {
+                break;
+            }
+        }
+
+        CHECK_EQ(mImg->fmt, VPX_IMG_FMT_I420);
+
+        uint32_t width = mImg->d_w;
+        uint32_t height = mImg->d_h;
+        handlePortSettingsChange(portWillReset, width, height);
+        if (*portWillReset) {
+            return true;
+        }
+
+        BufferInfo *outInfo = *outQueue.begin();
+        OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
+
+        outHeader->nOffset = 0;
+        outHeader->nFilledLen = (outputBufferWidth() * outputBufferHeight() * 3) / 2;
+        outHeader->nFlags = 0;
+        outHeader->nTimeStamp = *(OMX_TICKS *)mImg->user_priv;
+        if (outputBufferSafe(outHeader)) {
+            uint8_t *dst = outHeader->pBuffer;
+            const uint8_t *srcY = (const uint8_t *)mImg->planes[VPX_PLANE_Y];
+            const uint8_t *srcU = (const uint8_t *)mImg->planes[VPX_PLANE_U];
+            const uint8_t *srcV = (const uint8_t *)mImg->planes[VPX_PLANE_V];
+            size_t srcYStride = mImg->stride[VPX_PLANE_Y];
+            size_t srcUStride = mImg->stride[VPX_PLANE_U];
+            size_t srcVStride = mImg->stride[VPX_PLANE_V];
+            copyYV12FrameToOutputBuffer(dst, srcY, srcU, srcV, srcYStride, srcUStride, srcVStride);
+        } else {
+            outHeader->nFilledLen = 0;
+        }
+
+        mImg = NULL;
+        outInfo->mOwnedByUs = false;
+        outQueue.erase(outQueue.begin());
+        outInfo = NULL;
+        notifyFillBufferDone(outHeader);
+        outHeader = NULL;
+    }
+
+    if (!eos) {
+        return true;
+    }
+
+    // All frames have been delivered, signal EOS on an empty buffer.
+    if (!outQueue.empty() && mImg == NULL) {
+        BufferInfo *outInfo = *outQueue.begin();
+        outQueue.erase(outQueue.begin());
+        OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
+        outHeader->nTimeStamp = 0;
+        outHeader->nFilledLen = 0;
+        outHeader->nFlags = OMX_BUFFERFLAG_EOS;
+        outInfo->mOwnedByUs = false;
+        notifyFillBufferDone(outHeader);
+        mEOSStatus = OUTPUT_FRAMES_FLUSHED;
+    }
+    return true;
+}
+
 void SoftVPX::onQueueFilled(OMX_U32 /* portIndex */) {
-    if (mOutputPortSettingsChange != NONE) {
+    if (mOutputPortSettingsChange != NONE || mEOSStatus == OUTPUT_FRAMES_FLUSHED) {
         return;
     }
 
     List<BufferInfo *> &inQueue = getPortQueue(0);
     List<BufferInfo *> &outQueue = getPortQueue(1);
-    bool EOSseen = false;
+    bool portWillReset = false;
+    const bool flushDecoder = mFrameParallelMode;
+
+    if (mEOSStatus == INPUT_EOS_SEEN) {
+        // Keep draining the decoder until all frames are out, a pending
+        // frame would not survive another flush.
+        if (!outputBuffers(flushDecoder && mImg == NULL, true /* display */,
+                    true /* eos */, &portWillReset)) {
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+        }
+        return;
+    }
 
-    while (!inQueue.empty() && !outQueue.empty()) {
+    // A frame left over from the last call is only valid until the next
+    // vpx_codec_decode(), deliver it first.
+    if (mImg != NULL) {
+        if (!outputBuffers(false /* flushDecoder */, true /* display */,
+                    false /* eos */, &portWillReset)) {
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+            return;
+        }
+        if (portWillReset || mImg != NULL) {
+            return;
+        }
+    }
+
+    while (!outQueue.empty() && !inQueue.empty()) {
         BufferInfo *inInfo = *inQueue.begin();
         OMX_BUFFERHEADERTYPE *inHeader = inInfo->mHeader;
 
-        BufferInfo *outInfo = *outQueue.begin();
-        OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
-
         if (inHeader->nFlags & OMX_BUFFERFLAG_EOS) {
-            EOSseen = true;
-            if (inHeader->nFilledLen == 0) {
-                inQueue.erase(inQueue.begin());
-                inInfo->mOwnedByUs = false;
-                notifyEmptyBufferDone(inHeader);
-
-                outHeader->nFilledLen = 0;
-                outHeader->nFlags = OMX_BUFFERFLAG_EOS;
-
-                outQueue.erase(outQueue.begin());
-                outInfo->mOwnedByUs = false;
-                notifyFillBufferDone(outHeader);
-                return;
-            }
+            mEOSStatus = INPUT_EOS_SEEN;
         }
 
-        if (mImg == NULL) {
+        if (inHeader->nFilledLen > 0) {
+            // The timestamp travels with the frame through the decoder, so
+            // that frames completing out of submission order are stamped
+            // correctly.
+            mTimeStamps[mTimeStampIdx] = inHeader->nTimeStamp;
+
             if (vpx_codec_decode(
                         (vpx_codec_ctx_t *)mCtx,
                         inHeader->pBuffer + inHeader->nOffset,
                         inHeader->nFilledLen,
-                        NULL,
+                        &mTimeStamps[mTimeStampIdx],
                         0)) {
                 ALOGE("on2 decoder failed to decode frame.");
 
                 notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
                 return;
             }
-            vpx_codec_iter_t iter = NULL;
-            mImg = vpx_codec_get_frame((vpx_codec_ctx_t *)mCtx, &iter);
-        }
-
-        if (mImg != NULL) {
-            CHECK_EQ(mImg->fmt, VPX_IMG_FMT_I420);
-
-            uint32_t width = mImg->d_w;
-            uint32_t height = mImg->d_h;
-            bool portWillReset = false;
-            handlePortSettingsChange(&portWillReset, width, height);
-            if (portWillReset) {
-                return;
-            }
-
-            outHeader->nOffset = 0;
-            outHeader->nFilledLen = (outputBufferWidth() * outputBufferHeight() * 3) / 2;
-            outHeader->nFlags = EOSseen ? OMX_BUFFERFLAG_EOS : 0;
-            outHeader->nTimeStamp = inHeader->nTimeStamp;
-            if (outputBufferSafe(outHeader)) {
-                uint8_t *dst = outHeader->pBuffer;
-                const uint8_t *srcY = (const uint8_t *)mImg->planes[VPX_PLANE_Y];
-                const uint8_t *srcU = (const uint8_t *)mImg->planes[VPX_PLANE_U];
-                const uint8_t *srcV = (const uint8_t *)mImg->planes[VPX_PLANE_V];
-                size_t srcYStride = mImg->stride[VPX_PLANE_Y];
-                size_t srcUStride = mImg->stride[VPX_PLANE_U];
-                size_t srcVStride = mImg->stride[VPX_PLANE_V];
-                copyYV12FrameToOutputBuffer(dst, srcY, srcU, srcV, srcYStride, srcUStride, srcVStride);
-            } else {
-                outHeader->nFilledLen = 0;
-            }
-
-            mImg = NULL;
-            outInfo->mOwnedByUs = false;
-            outQueue.erase(outQueue.begin());
-            outInfo = NULL;
-            notifyFillBufferDone(outHeader);
-            outHeader = NULL;
+            mTimeStampIdx = (mTimeStampIdx + 1) % kNumTimeStamps;
         }
 
         inInfo->mOwnedByUs = false;
@@ -176,7 +291,41 @@ void SoftVPX::onQueueFilled(OMX_U32 /* portIndex */) {
         inInfo = NULL;
         notifyEmptyBufferDone(inHeader);
         inHeader = NULL;
+
+        bool eos = mEOSStatus == INPUT_EOS_SEEN;
+        if (!outputBuffers(eos && flushDecoder, true /* display */, eos, &portWillReset)) {
+            ALOGE("on2 decoder failed to output frame.");
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+            return;
+        }
+        if (portWillReset || eos || mImg != NULL) {
+            return;
+        }
+    }
+}
+
+void SoftVPX::onPortFlushCompleted(OMX_U32 portIndex) {
+    if (portIndex == kOutputPortIndex) {
+        // Frames still held by the decoder belong to the flushed content.
+        if (!outputBuffers(true /* flushDecoder */, false /* display */,
+                    false /* eos */, NULL)) {
+            ALOGE("Failed to flush decoder.");
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+        }
+        mEOSStatus = INPUT_DATA_AVAILABLE;
+    }
+}
+
+void SoftVPX::onReset() {
+    bool portWillReset;
+    if (!outputBuffers(true /* flushDecoder */, false /* display */,
+                false /* eos */, &portWillReset)) {
+        ALOGW("Failed to flush decoder. Try to hard reset decoder");
+        destroyDecoder();
+        initDecoder();
     }
+    mEOSStatus = INPUT_DATA_AVAILABLE;
+    SoftVideoDecoderOMXComponent::onReset();
 }
 
 bool SoftVPX::outputBufferSafe(OMX_BUFFERHEADERTYPE *outHeader) {
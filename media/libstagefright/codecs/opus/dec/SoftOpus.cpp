@@ -24,6 +24,7 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
 
 extern "C" {
     #include <opus.h>
@@ -552,6 +553,155 @@ void SoftOpus::onPortEnableCompleted(OMX_U32 portIndex, bool enabled) {
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+SoftOpusBatchDecoder::SoftOpusBatchDecoder()
+    : mNumHeaders(0),
+      mDecoder(NULL),
+      mCodecDelay(0),
+      mSeekPreRoll(0),
+      mSamplesToDiscard(0) {
+    memset(&mHeader, 0, sizeof(mHeader));
+}
+
+SoftOpusBatchDecoder::~SoftOpusBatchDecoder() {
+    if (mDecoder != NULL) {
+        opus_multistream_decoder_destroy(mDecoder);
+        mDecoder = NULL;
+    }
+}
+
+status_t SoftOpusBatchDecoder::initCheck() const {
+    return OK;
+}
+
+status_t SoftOpusBatchDecoder::addCodecSpecificData(
+        const uint8_t *data, size_t size) {
+    if (mNumHeaders == 0) {
+        if (!ParseOpusHeader(data, size, &mHeader)) {
+            ALOGV("Parsing Opus Header failed.");
+            return ERROR_MALFORMED;
+        }
+
+        uint8_t channel_mapping[kMaxChannels] = {0};
+        memcpy(&channel_mapping,
+               kDefaultOpusChannelLayout,
+               kMaxChannelsWithDefaultLayout);
+
+        int status = OPUS_INVALID_STATE;
+        mDecoder = opus_multistream_decoder_create(kRate,
+                                                   mHeader.channels,
+                                                   mHeader.num_streams,
+                                                   mHeader.num_coupled,
+                                                   channel_mapping,
+                                                   &status);
+        if (!mDecoder || status != OPUS_OK) {
+            ALOGV("opus_multistream_decoder_create failed status=%s",
+                  opus_strerror(status));
+            return ERROR_MALFORMED;
+        }
+
+        status = opus_multistream_decoder_ctl(
+                mDecoder, OPUS_SET_GAIN(mHeader.gain_db));
+        if (status != OPUS_OK) {
+            ALOGV("Failed to set OPUS header gain; status=%s",
+                  opus_strerror(status));
+            return ERROR_MALFORMED;
+        }
+    } else if (mNumHeaders < 3) {
+        int64_t ns;
+        if (size < sizeof(ns)) {
+            return ERROR_MALFORMED;
+        }
+        memcpy(&ns, data, sizeof(ns));
+
+        if (mNumHeaders == 1) {
+            mCodecDelay = ns_to_samples(ns, kRate);
+            mSamplesToDiscard = mCodecDelay;
+        } else {
+            mSeekPreRoll = ns_to_samples(ns, kRate);
+        }
+    }
+
+    ++mNumHeaders;
+
+    return OK;
+}
+
+size_t SoftOpusBatchDecoder::maxOutputSizePerUnit() const {
+    return kMaxOpusOutputPacketSizeSamples * sizeof(int16_t) * mHeader.channels;
+}
+
+void SoftOpusBatchDecoder::getOutputFormat(
+        int32_t *numChannels, int32_t *sampleRate) const {
+    *numChannels = mHeader.channels;
+    *sampleRate = kRate;
+}
+
+void SoftOpusBatchDecoder::flush() {
+    if (mDecoder != NULL) {
+        opus_multistream_decoder_ctl(mDecoder, OPUS_RESET_STATE);
+    }
+    mSamplesToDiscard = mSeekPreRoll;
+}
+
+status_t SoftOpusBatchDecoder::decode(
+        const AccessUnit *units, size_t numUnits,
+        int16_t *pcm, size_t pcmSize,
+        size_t *numUnitsConsumed, size_t *pcmBytesWritten) {
+    *numUnitsConsumed = 0;
+    *pcmBytesWritten = 0;
+
+    if (mDecoder == NULL) {
+        return NO_INIT;
+    }
+
+    const size_t channels = mHeader.channels;
+    const size_t outCapacity = pcmSize / sizeof(int16_t) / channels;
+    size_t outOffset = 0;  // in frames
+
+    size_t i = 0;
+    for (; i < numUnits
+            && outCapacity - outOffset >= (size_t)kMaxOpusOutputPacketSizeSamples;
+            ++i) {
+        int numFrames = opus_multistream_decode(
+                mDecoder,
+                units[i].mData,
+                units[i].mSize,
+                pcm + outOffset * channels,
+                kMaxOpusOutputPacketSizeSamples,
+                0);
+
+        if (numFrames < 0) {
+            ALOGE("opus_multistream_decode returned %d", numFrames);
+            if (i == 0) {
+                return ERROR_MALFORMED;
+            }
+            break;
+        }
+
+        if (mSamplesToDiscard > 0) {
+            if (mSamplesToDiscard >= numFrames) {
+                mSamplesToDiscard -= numFrames;
+                numFrames = 0;
+            } else {
+                numFrames -= mSamplesToDiscard;
+                memmove(pcm + outOffset * channels,
+                        pcm + (outOffset + mSamplesToDiscard) * channels,
+                        numFrames * channels * sizeof(int16_t));
+                mSamplesToDiscard = 0;
+            }
+        }
+
+        outOffset += numFrames;
+    }
+
+    *numUnitsConsumed = i;
+    *pcmBytesWritten = outOffset * channels * sizeof(int16_t);
+
+    return OK;
+}
+
 }  // namespace android
 
 android::SoftOMXComponent *createSoftOMXComponent(
@@ -559,3 +709,8 @@ android::SoftOMXComponent *createSoftOMXComponent(
         OMX_PTR appData, OMX_COMPONENTTYPE **component) {
     return new android::SoftOpus(name, callbacks, appData, component);
 }
+
+android::SoftAudioBatchDecoder *createSoftAudioBatchDecoder(
+        const char * /* name */) {
+    return new android::SoftOpusBatchDecoder;
+}
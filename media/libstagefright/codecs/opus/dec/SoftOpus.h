@@ -24,6 +24,7 @@
 #define SOFT_OPUS_H_
 
 #include "SimpleSoftOMXComponent.h"
+#include "SoftAudioBatchDecoder.h"
 
 struct OpusMSDecoder;
 
@@ -89,6 +90,35 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(SoftOpus);
 };
 
+struct SoftOpusBatchDecoder : public SoftAudioBatchDecoder {
+    SoftOpusBatchDecoder();
+    virtual ~SoftOpusBatchDecoder();
+
+    virtual status_t initCheck() const;
+    virtual status_t addCodecSpecificData(const uint8_t *data, size_t size);
+
+    virtual status_t decode(
+            const AccessUnit *units, size_t numUnits,
+            int16_t *pcm, size_t pcmSize,
+            size_t *numUnitsConsumed, size_t *pcmBytesWritten);
+
+    virtual size_t maxOutputSizePerUnit() const;
+    virtual void getOutputFormat(int32_t *numChannels, int32_t *sampleRate) const;
+    virtual void flush();
+
+private:
+    size_t mNumHeaders;
+
+    OpusMSDecoder *mDecoder;
+    OpusHeader mHeader;
+
+    int64_t mCodecDelay;
+    int64_t mSeekPreRoll;
+    int64_t mSamplesToDiscard;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SoftOpusBatchDecoder);
+};
+
 }  // namespace android
 
 #endif  // SOFT_OPUS_H_
@@ -22,6 +22,7 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
 
 extern "C" {
     #include <Tremolo/codec_internal.h>
@@ -495,6 +496,189 @@ void SoftVorbis::onPortEnableCompleted(OMX_U32 portIndex, bool enabled) {
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+SoftVorbisBatchDecoder::SoftVorbisBatchDecoder()
+    : mNumHeaders(0),
+      mState(NULL),
+      mVi(NULL),
+      mNumFramesLeftOnPage(-1) {
+}
+
+SoftVorbisBatchDecoder::~SoftVorbisBatchDecoder() {
+    if (mState != NULL) {
+        vorbis_dsp_clear(mState);
+        delete mState;
+        mState = NULL;
+    }
+
+    if (mVi != NULL) {
+        vorbis_info_clear(mVi);
+        delete mVi;
+        mVi = NULL;
+    }
+}
+
+status_t SoftVorbisBatchDecoder::initCheck() const {
+    return OK;
+}
+
+status_t SoftVorbisBatchDecoder::addCodecSpecificData(
+        const uint8_t *data, size_t size) {
+    if (mNumHeaders >= 2) {
+        // The comment header, if present, carries nothing we need.
+        return OK;
+    }
+
+    if (size < 7) {
+        ALOGE("Too small codec specific data: %zu bytes", size);
+        return ERROR_MALFORMED;
+    }
+
+    ogg_buffer buf;
+    ogg_reference ref;
+    oggpack_buffer bits;
+
+    makeBitReader(data + 7, size - 7, &buf, &ref, &bits);
+
+    if (mNumHeaders == 0) {
+        mVi = new vorbis_info;
+        vorbis_info_init(mVi);
+
+        if (_vorbis_unpack_info(mVi, &bits) != 0) {
+            vorbis_info_clear(mVi);
+            delete mVi;
+            mVi = NULL;
+            return ERROR_MALFORMED;
+        }
+    } else {
+        // Either way the identification header has to come again, the
+        // books are unpacked into mVi.
+        if (_vorbis_unpack_books(mVi, &bits) != 0) {
+            vorbis_info_clear(mVi);
+            delete mVi;
+            mVi = NULL;
+            mNumHeaders = 0;
+            return ERROR_MALFORMED;
+        }
+
+        mState = new vorbis_dsp_state;
+        if (vorbis_dsp_init(mState, mVi) != 0) {
+            delete mState;
+            mState = NULL;
+            vorbis_info_clear(mVi);
+            delete mVi;
+            mVi = NULL;
+            mNumHeaders = 0;
+            return ERROR_MALFORMED;
+        }
+    }
+
+    ++mNumHeaders;
+
+    return OK;
+}
+
+size_t SoftVorbisBatchDecoder::maxOutputSizePerUnit() const {
+    return kMaxNumSamplesPerBuffer * sizeof(int16_t);
+}
+
+void SoftVorbisBatchDecoder::getOutputFormat(
+        int32_t *numChannels, int32_t *sampleRate) const {
+    *numChannels = mVi != NULL ? mVi->channels : 0;
+    *sampleRate = mVi != NULL ? mVi->rate : 0;
+}
+
+void SoftVorbisBatchDecoder::flush() {
+    if (mState != NULL) {
+        vorbis_dsp_restart(mState);
+    }
+    mNumFramesLeftOnPage = -1;
+}
+
+status_t SoftVorbisBatchDecoder::decode(
+        const AccessUnit *units, size_t numUnits,
+        int16_t *pcm, size_t pcmSize,
+        size_t *numUnitsConsumed, size_t *pcmBytesWritten) {
+    *numUnitsConsumed = 0;
+    *pcmBytesWritten = 0;
+
+    if (mState == NULL) {
+        return NO_INIT;
+    }
+
+    size_t outOffset = 0;  // in samples
+    const size_t outCapacity = pcmSize / sizeof(int16_t);
+
+    size_t i = 0;
+    for (; i < numUnits && outCapacity - outOffset >= kMaxNumSamplesPerBuffer; ++i) {
+        const AccessUnit &unit = units[i];
+
+        // Each access unit carries the number of valid samples on its page
+        // as a trailing int32, see NuMediaExtractor::readSampleData.
+        if (unit.mSize < sizeof(int32_t)) {
+            continue;
+        }
+
+        int32_t numPageSamples;
+        size_t size = unit.mSize - sizeof(numPageSamples);
+        memcpy(&numPageSamples, unit.mData + size, sizeof(numPageSamples));
+
+        if (numPageSamples >= 0) {
+            mNumFramesLeftOnPage = numPageSamples;
+        }
+
+        ogg_buffer buf;
+        buf.data = const_cast<uint8_t *>(unit.mData);
+        buf.size = size;
+        buf.refcount = 1;
+        buf.ptr.owner = NULL;
+
+        ogg_reference ref;
+        ref.buffer = &buf;
+        ref.begin = 0;
+        ref.length = buf.size;
+        ref.next = NULL;
+
+        ogg_packet pack;
+        pack.packet = &ref;
+        pack.bytes = ref.length;
+        pack.b_o_s = 0;
+        pack.e_o_s = 0;
+        pack.granulepos = 0;
+        pack.packetno = 0;
+
+        int numFrames = 0;
+        int err = vorbis_dsp_synthesis(mState, &pack, 1);
+        if (err != 0) {
+            ALOGV("vorbis_dsp_synthesis returned %d", err);
+        } else {
+            numFrames = vorbis_dsp_pcmout(
+                    mState, pcm + outOffset,
+                    kMaxNumSamplesPerBuffer / mVi->channels);
+
+            if (numFrames < 0) {
+                ALOGE("vorbis_dsp_pcmout returned %d", numFrames);
+                numFrames = 0;
+            }
+        }
+
+        if (mNumFramesLeftOnPage >= 0) {
+            if (numFrames > mNumFramesLeftOnPage) {
+                numFrames = mNumFramesLeftOnPage;
+            }
+            mNumFramesLeftOnPage -= numFrames;
+        }
+
+        outOffset += numFrames * mVi->channels;
+    }
+
+    *numUnitsConsumed = i;
+    *pcmBytesWritten = outOffset * sizeof(int16_t);
+
+    return OK;
+}
+
 }  // namespace android
 
 android::SoftOMXComponent *createSoftOMXComponent(
@@ -502,3 +686,8 @@ android::SoftOMXComponent *createSoftOMXComponent(
         OMX_PTR appData, OMX_COMPONENTTYPE **component) {
     return new android::SoftVorbis(name, callbacks, appData, component);
 }
+
+android::SoftAudioBatchDecoder *createSoftAudioBatchDecoder(
+        const char * /* name */) {
+    return new android::SoftVorbisBatchDecoder;
+}
@@ -19,6 +19,7 @@
 #define SOFT_VORBIS_H_
 
 #include "SimpleSoftOMXComponent.h"
+#include "SoftAudioBatchDecoder.h"
 
 struct vorbis_dsp_state;
 struct vorbis_info;
@@ -75,6 +76,37 @@ private:
     DISALLOW_EVIL_CONSTRUCTORS(SoftVorbis);
 };
 
+struct SoftVorbisBatchDecoder : public SoftAudioBatchDecoder {
+    SoftVorbisBatchDecoder();
+    virtual ~SoftVorbisBatchDecoder();
+
+    virtual status_t initCheck() const;
+    virtual status_t addCodecSpecificData(const uint8_t *data, size_t size);
+
+    virtual status_t decode(
+            const AccessUnit *units, size_t numUnits,
+            int16_t *pcm, size_t pcmSize,
+            size_t *numUnitsConsumed, size_t *pcmBytesWritten);
+
+    virtual size_t maxOutputSizePerUnit() const;
+    virtual void getOutputFormat(int32_t *numChannels, int32_t *sampleRate) const;
+    virtual void flush();
+
+private:
+    enum {
+        kMaxNumSamplesPerBuffer = 8192 * 2
+    };
+
+    size_t mNumHeaders;
+
+    vorbis_dsp_state *mState;
+    vorbis_info *mVi;
+
+    int32_t mNumFramesLeftOnPage;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SoftVorbisBatchDecoder);
+};
+
 }  // namespace android
 
 #endif  // SOFT_VORBIS_H_
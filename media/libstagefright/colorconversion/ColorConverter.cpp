@@ -99,6 +99,11 @@ status_t ColorConverter::convert(
             dstWidth, dstHeight,
             dstCropLeft, dstCropTop, dstCropRight, dstCropBottom);
 
+    if (src.cropWidth() != dst.cropWidth()
+            || src.cropHeight() != dst.cropHeight()) {
+        return convertScaled(src, dst);
+    }
+
     status_t err;
 
     switch (mSrcFormat) {
@@ -506,6 +511,115 @@ status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
     return OK;
 }
 
+status_t ColorConverter::convertScaled(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (!((src.mCropLeft & 1) == 0
+            && dst.cropWidth() <= src.cropWidth()
+            && dst.cropHeight() <= src.cropHeight())) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    // Addresses the planes the same way the unscaled conversions do, and
+    // like them emits red and blue swapped for the semi planar formats.
+    const uint8_t *src_y;
+    const uint8_t *src_u;
+    const uint8_t *src_v = NULL;
+    size_t chromaStride;
+    bool vFirst = false;
+    bool swapRedBlue = false;
+
+    switch (mSrcFormat) {
+        case OMX_COLOR_FormatYUV420Planar:
+            src_y = (const uint8_t *)src.mBits
+                + src.mCropTop * src.mWidth + src.mCropLeft;
+            src_u = src_y + src.mWidth * src.mHeight
+                + src.mCropTop * (src.mWidth / 2) + src.mCropLeft / 2;
+            src_v = src_u + (src.mWidth / 2) * (src.mHeight / 2);
+            chromaStride = src.mWidth / 2;
+            break;
+
+        case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        case OMX_COLOR_FormatYUV420SemiPlanar:
+            src_y = (const uint8_t *)src.mBits
+                + src.mCropTop * src.mWidth + src.mCropLeft;
+            src_u = src_y + src.mWidth * src.mHeight
+                + src.mCropTop * src.mWidth + src.mCropLeft;
+            chromaStride = src.mWidth;
+            vFirst = mSrcFormat == OMX_COLOR_FormatYUV420SemiPlanar;
+            swapRedBlue = true;
+            break;
+
+        case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
+            src_y = (const uint8_t *)src.mBits;
+            src_u = src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
+            chromaStride = src.mWidth;
+            break;
+
+        default:
+            return ERROR_UNSUPPORTED;
+    }
+
+    uint8_t *kAdjustedClip = initClip();
+
+    // Source column to sample for every destination column, centered.
+    size_t *src_x = new size_t[dst.cropWidth()];
+    for (size_t x = 0; x < dst.cropWidth(); ++x) {
+        src_x[x] = (2 * x + 1) * src.cropWidth() / (2 * dst.cropWidth());
+    }
+
+    uint16_t *dst_ptr = (uint16_t *)dst.mBits
+        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+
+    for (size_t y = 0; y < dst.cropHeight(); ++y) {
+        size_t row = (2 * y + 1) * src.cropHeight() / (2 * dst.cropHeight());
+
+        const uint8_t *row_y = src_y + row * src.mWidth;
+        const uint8_t *row_u = src_u + (row / 2) * chromaStride;
+        const uint8_t *row_v = src_v != NULL ? src_v + (row / 2) * chromaStride : NULL;
+
+        for (size_t x = 0; x < dst.cropWidth(); ++x) {
+            size_t col = src_x[x];
+
+            signed y1 = (signed)row_y[col] - 16;
+
+            signed u, v;
+            if (row_v != NULL) {
+                u = (signed)row_u[col / 2] - 128;
+                v = (signed)row_v[col / 2] - 128;
+            } else if (vFirst) {
+                v = (signed)row_u[col & ~1] - 128;
+                u = (signed)row_u[(col & ~1) + 1] - 128;
+            } else {
+                u = (signed)row_u[col & ~1] - 128;
+                v = (signed)row_u[(col & ~1) + 1] - 128;
+            }
+
+            signed tmp1 = y1 * 298;
+            signed b1 = (tmp1 + u * 517) / 256;
+            signed g1 = (tmp1 - v * 208 - u * 100) / 256;
+            signed r1 = (tmp1 + v * 409) / 256;
+
+            if (swapRedBlue) {
+                signed tmp = r1;
+                r1 = b1;
+                b1 = tmp;
+            }
+
+            dst_ptr[x] =
+                ((kAdjustedClip[r1] >> 3) << 11)
+                | ((kAdjustedClip[g1] >> 2) << 5)
+                | (kAdjustedClip[b1] >> 3);
+        }
+
+        dst_ptr += dst.mWidth;
+    }
+
+    delete[] src_x;
+    src_x = NULL;
+
+    return OK;
+}
+
 uint8_t *ColorConverter::initClip() {
     static const signed kClipMin = -278;
     static const signed kClipMax = 535;
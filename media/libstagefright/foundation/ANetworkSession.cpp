@@ -27,6 +27,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 
@@ -52,6 +53,13 @@ static uint64_t U64_AT(const uint8_t *ptr) {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// Most datagrams moved by a single recvmmsg()/sendmmsg() call.
+static const size_t kMaxDatagramBatchSize = 32;
+
+// Session ids start at 1, the interrupt pipe is registered under 0.
+static const uint32_t kPipeEventID = 0;
+static const int kMaxEvents = 64;
+
 struct ANetworkSession::NetworkThread : public Thread {
     NetworkThread(ANetworkSession *session);
 
@@ -96,6 +104,11 @@ struct ANetworkSession::Session : public RefBase {
     bool wantsToRead();
     bool wantsToWrite();
 
+    // The epoll events this session's socket is currently registered for,
+    // -1 if it has not been registered yet.
+    int64_t registeredEvents() const;
+    void setRegisteredEvents(uint32_t events);
+
     status_t readMore();
     status_t writeMore();
 
@@ -129,10 +142,16 @@ private:
 
     List<Fragment> mOutFragments;
 
+    // Datagrams are received straight into these, the ones that made it
+    // into a notification are replaced before the next recvmmsg().
+    Vector<sp<ABuffer> > mInDatagrams;
+
     AString mInBuffer;
 
     int64_t mLastStallReportUs;
 
+    int64_t mRegisteredEvents;
+
     void notifyError(bool send, status_t err, const char *detail);
     void notify(NotificationReason reason);
 
@@ -170,7 +189,8 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
-      mLastStallReportUs(-1ll) {
+      mLastStallReportUs(-1ll),
+      mRegisteredEvents(-1ll) {
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
         socklen_t localAddrLen = sizeof(localAddr);
@@ -265,53 +285,95 @@ bool ANetworkSession::Session::wantsToWrite() {
             || (mState == DATAGRAM && !mOutFragments.empty()));
 }
 
+int64_t ANetworkSession::Session::registeredEvents() const {
+    return mRegisteredEvents;
+}
+
+void ANetworkSession::Session::setRegisteredEvents(uint32_t events) {
+    mRegisteredEvents = events;
+}
+
 status_t ANetworkSession::Session::readMore() {
     if (mState == DATAGRAM) {
         CHECK_EQ(mMode, MODE_DATAGRAM);
 
         status_t err;
         do {
-            sp<ABuffer> buf = new ABuffer(kMaxUDPSize);
+            while (mInDatagrams.size() < kMaxDatagramBatchSize) {
+                mInDatagrams.push(new ABuffer(kMaxUDPSize));
+            }
 
-            struct sockaddr_in remoteAddr;
-            socklen_t remoteAddrLen = sizeof(remoteAddr);
+            struct mmsghdr msgs[kMaxDatagramBatchSize];
+            struct iovec iovs[kMaxDatagramBatchSize];
+            struct sockaddr_in remoteAddrs[kMaxDatagramBatchSize];
+            memset(msgs, 0, sizeof(msgs));
 
-            ssize_t n;
+            for (size_t i = 0; i < kMaxDatagramBatchSize; ++i) {
+                iovs[i].iov_base = mInDatagrams[i]->base();
+                iovs[i].iov_len = mInDatagrams[i]->capacity();
+
+                msgs[i].msg_hdr.msg_name = &remoteAddrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(remoteAddrs[i]);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int n;
             do {
-                n = recvfrom(
-                        mSocket, buf->data(), buf->capacity(), 0,
-                        (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+                n = recvmmsg(
+                        mSocket, msgs, kMaxDatagramBatchSize, MSG_DONTWAIT,
+                        NULL);
             } while (n < 0 && errno == EINTR);
 
             err = OK;
             if (n < 0) {
                 err = -errno;
-            } else if (n == 0) {
-                err = -ECONNRESET;
             } else {
-                buf->setRange(0, n);
+                mUDPRetries = kMaxUDPRetries;
 
                 int64_t nowUs = ALooper::GetNowUs();
-                buf->meta()->setInt64("arrivalTimeUs", nowUs);
 
-                sp<AMessage> notify = mNotify->dup();
-                notify->setInt32("sessionID", mSessionID);
-                notify->setInt32("reason", kWhatDatagram);
+                for (int i = 0; i < n; ++i) {
+                    if (msgs[i].msg_len == 0) {
+                        err = -ECONNRESET;
+                        break;
+                    }
 
-                uint32_t ip = ntohl(remoteAddr.sin_addr.s_addr);
-                notify->setString(
-                        "fromAddr",
-                        StringPrintf(
-                            "%u.%u.%u.%u",
-                            ip >> 24,
-                            (ip >> 16) & 0xff,
-                            (ip >> 8) & 0xff,
-                            ip & 0xff).c_str());
+                    sp<ABuffer> buf = mInDatagrams[i];
+                    buf->setRange(0, msgs[i].msg_len);
+                    buf->meta()->setInt64("arrivalTimeUs", nowUs);
+
+                    sp<AMessage> notify = mNotify->dup();
+                    notify->setInt32("sessionID", mSessionID);
+                    notify->setInt32("reason", kWhatDatagram);
+
+                    uint32_t ip = ntohl(remoteAddrs[i].sin_addr.s_addr);
+                    notify->setString(
+                            "fromAddr",
+                            StringPrintf(
+                                "%u.%u.%u.%u",
+                                ip >> 24,
+                                (ip >> 16) & 0xff,
+                                (ip >> 8) & 0xff,
+                                ip & 0xff).c_str());
+
+                    notify->setInt32(
+                            "fromPort", ntohs(remoteAddrs[i].sin_port));
+
+                    notify->setBuffer("data", buf);
+                    notify->post();
+                }
 
-                notify->setInt32("fromPort", ntohs(remoteAddr.sin_port));
+                mInDatagrams.removeItemsAt(0, n);
+            }
 
-                notify->setBuffer("data", buf);
-                notify->post();
+            if (err != OK && err != -EAGAIN && mUDPRetries > 0) {
+                // Keep reading, the socket is only reported again once
+                // more data arrives.
+                mUDPRetries--;
+                ALOGE("Recvfrom failed, %d/%d retries left",
+                        mUDPRetries, kMaxUDPRetries);
+                err = OK;
             }
         } while (err == OK);
 
@@ -320,41 +382,40 @@ status_t ANetworkSession::Session::readMore() {
         }
 
         if (err != OK) {
-            if (!mUDPRetries) {
-                notifyError(false /* send */, err, "Recvfrom failed.");
-                mSawReceiveFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Recvfrom failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
-            }
-        } else {
-            mUDPRetries = kMaxUDPRetries;
+            notifyError(false /* send */, err, "Recvfrom failed.");
+            mSawReceiveFailure = true;
         }
 
         return err;
     }
 
-    char tmp[512];
-    ssize_t n;
-    do {
-        n = recv(mSocket, tmp, sizeof(tmp), 0);
-    } while (n < 0 && errno == EINTR);
-
+    // Read everything there is, the socket is edge triggered.
     status_t err = OK;
+    for (;;) {
+        char tmp[512];
+        ssize_t n;
+        do {
+            n = recv(mSocket, tmp, sizeof(tmp), 0);
+        } while (n < 0 && errno == EINTR);
 
-    if (n > 0) {
-        mInBuffer.append(tmp, n);
+        if (n > 0) {
+            mInBuffer.append(tmp, n);
 
 #if 0
-        ALOGI("in:");
-        hexdump(tmp, n);
+            ALOGI("in:");
+            hexdump(tmp, n);
 #endif
-    } else if (n < 0) {
-        err = -errno;
-    } else {
-        err = -ECONNRESET;
+            continue;
+        }
+
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                err = -errno;
+            }
+        } else {
+            err = -ECONNRESET;
+        }
+        break;
     }
 
     if (mMode == MODE_DATAGRAM) {
@@ -554,27 +615,61 @@ status_t ANetworkSession::Session::writeMore() {
 
         status_t err;
         do {
-            const Fragment &frag = *mOutFragments.begin();
-            const sp<ABuffer> &datagram = frag.mBuffer;
+            // Hand as many queued datagrams to the kernel as possible in a
+            // single sendmmsg() call, an RTP sender queues a burst of them
+            // for every access unit.
+            struct mmsghdr msgs[kMaxDatagramBatchSize];
+            struct iovec iovs[kMaxDatagramBatchSize];
+
+            size_t numMsgs = 0;
+            for (List<Fragment>::iterator it = mOutFragments.begin();
+                    it != mOutFragments.end()
+                        && numMsgs < kMaxDatagramBatchSize; ++it) {
+                const sp<ABuffer> &datagram = (*it).mBuffer;
+
+                iovs[numMsgs].iov_base = datagram->data();
+                iovs[numMsgs].iov_len = datagram->size();
+
+                memset(&msgs[numMsgs], 0, sizeof(msgs[numMsgs]));
+                msgs[numMsgs].msg_hdr.msg_iov = &iovs[numMsgs];
+                msgs[numMsgs].msg_hdr.msg_iovlen = 1;
+
+                ++numMsgs;
+            }
 
             int n;
             do {
-                n = send(mSocket, datagram->data(), datagram->size(), 0);
+                n = sendmmsg(mSocket, msgs, numMsgs, 0);
             } while (n < 0 && errno == EINTR);
 
             err = OK;
 
             if (n > 0) {
-                if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
-                    dumpFragmentStats(frag);
-                }
+                mUDPRetries = kMaxUDPRetries;
+
+                for (int i = 0; i < n; ++i) {
+                    const Fragment &frag = *mOutFragments.begin();
+
+                    if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
+                        dumpFragmentStats(frag);
+                    }
 
-                mOutFragments.erase(mOutFragments.begin());
+                    mOutFragments.erase(mOutFragments.begin());
+                }
             } else if (n < 0) {
                 err = -errno;
             } else if (n == 0) {
                 err = -ECONNRESET;
             }
+
+            if (err != OK && err != -EAGAIN && mUDPRetries > 0) {
+                // Retry right away, a still writable socket is not
+                // reported again.
+                mUDPRetries--;
+                ALOGE("Send datagram failed, %d/%d retries left",
+                        mUDPRetries, kMaxUDPRetries);
+                err = OK;
+            }
         } while (err == OK && !mOutFragments.empty());
 
         if (err == -EAGAIN) {
@@ -585,17 +680,8 @@ status_t ANetworkSession::Session::writeMore() {
         }
 
         if (err != OK) {
-            if (!mUDPRetries) {
-                notifyError(true /* send */, err, "Send datagram failed.");
-                mSawSendFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Send datagram failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
-            }
-        } else {
-            mUDPRetries = kMaxUDPRetries;
+            notifyError(true /* send */, err, "Send datagram failed.");
+            mSawSendFailure = true;
         }
 
         return err;
@@ -652,7 +738,11 @@ status_t ANetworkSession::Session::writeMore() {
     status_t err = OK;
 
     if (n < 0) {
-        err = -errno;
+        // A full socket buffer is fine, the socket is reported again once
+        // it becomes writable.
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            err = -errno;
+        }
     } else if (n == 0) {
         err = -ECONNRESET;
     }
@@ -800,10 +890,21 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ANetworkSession::ANetworkSession()
     : mNextSessionID(1) {
     mPipeFd[0] = mPipeFd[1] = -1;
+
+    // Sessions may be created before start(), so this cannot wait.
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        ALOGE("epoll_create1 failed w/ error %d (%s)", errno, strerror(errno));
+    }
 }
 
 ANetworkSession::~ANetworkSession() {
     stop();
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
 }
 
 status_t ANetworkSession::start() {
@@ -811,12 +912,29 @@ status_t ANetworkSession::start() {
         return INVALID_OPERATION;
     }
 
+    if (mEpollFd < 0) {
+        return NO_INIT;
+    }
+
     int res = pipe(mPipeFd);
     if (res != 0) {
         mPipeFd[0] = mPipeFd[1] = -1;
         return -errno;
     }
 
+    // Level triggered, so that interrupts are never lost.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = kPipeEventID;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &event) < 0) {
+        status_t err = -errno;
+        close(mPipeFd[0]);
+        close(mPipeFd[1]);
+        mPipeFd[0] = mPipeFd[1] = -1;
+        return err;
+    }
+
     mThread = new NetworkThread(this);
 
     status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
@@ -937,9 +1055,12 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
-    mSessions.removeItemsAt(index);
+    const sp<Session> session = mSessions.valueAt(index);
+    if (session->registeredEvents() >= 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, session->socket(), NULL);
+    }
 
-    interrupt();
+    mSessions.removeItemsAt(index);
 
     return OK;
 }
@@ -1150,7 +1271,8 @@ status_t ANetworkSession::createClientOrServer(
 
     mSessions.add(session->sessionID(), session);
 
-    interrupt();
+    // Registering the socket wakes up the network thread if needed.
+    updateEvents_l(session);
 
     *sessionID = session->sessionID();
 
@@ -1217,7 +1339,9 @@ status_t ANetworkSession::sendRequest(
 
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
 
-    interrupt();
+    // Only touches the registration if the session did not already
+    // have data queued.
+    updateEvents_l(session);
 
     return err;
 }
@@ -1248,43 +1372,46 @@ void ANetworkSession::interrupt() {
     }
 }
 
-void ANetworkSession::threadLoop() {
-    fd_set rs, ws;
-    FD_ZERO(&rs);
-    FD_ZERO(&ws);
-
-    FD_SET(mPipeFd[0], &rs);
-    int maxFd = mPipeFd[0];
+void ANetworkSession::updateEvents_l(const sp<Session> &session) {
+    // Edge triggered, so readMore()/writeMore() drain the socket, and the
+    // registration only changes when the session's interest does.
+    uint32_t events = EPOLLET;
+    if (session->wantsToRead()) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (session->wantsToWrite()) {
+        events |= EPOLLOUT;
+    }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+    int64_t registeredEvents = session->registeredEvents();
+    if (registeredEvents == (int64_t)events) {
+        return;
+    }
 
-        for (size_t i = 0; i < mSessions.size(); ++i) {
-            const sp<Session> &session = mSessions.valueAt(i);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u32 = session->sessionID();
 
-            int s = session->socket();
+    int res = epoll_ctl(
+            mEpollFd,
+            registeredEvents < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+            session->socket(),
+            &event);
 
-            if (s < 0) {
-                continue;
-            }
+    if (res < 0) {
+        ALOGE("epoll_ctl on socket %d failed w/ error %d (%s)",
+              session->socket(), errno, strerror(errno));
+        return;
+    }
 
-            if (session->wantsToRead()) {
-                FD_SET(s, &rs);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
+    session->setRegisteredEvents(events);
+}
 
-            if (session->wantsToWrite()) {
-                FD_SET(s, &ws);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
-        }
-    }
+void ANetworkSession::threadLoop() {
+    struct epoll_event events[kMaxEvents];
 
-    int res = select(maxFd + 1, &rs, &ws, NULL, NULL /* tv */);
+    int res = epoll_wait(mEpollFd, events, kMaxEvents, -1 /* timeout */);
 
     if (res == 0) {
         return;
@@ -1295,116 +1422,129 @@ void ANetworkSession::threadLoop() {
             return;
         }
 
-        ALOGE("select failed w/ error %d (%s)", errno, strerror(errno));
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
         return;
     }
 
-    if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
-
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
-        }
+    Mutex::Autolock autoLock(mLock);
 
-        --res;
-    }
+    List<sp<Session> > sessionsToAdd;
 
-    {
-        Mutex::Autolock autoLock(mLock);
+    for (int i = 0; i < res; ++i) {
+        if (events[i].data.u32 == kPipeEventID) {
+            char tmp[64];
+            ssize_t n;
+            do {
+                n = read(mPipeFd[0], tmp, sizeof(tmp));
+            } while (n < 0 && errno == EINTR);
 
-        List<sp<Session> > sessionsToAdd;
+            if (n < 0) {
+                ALOGW("Error reading from pipe (%s)", strerror(errno));
+            }
+            continue;
+        }
 
-        for (size_t i = mSessions.size(); res > 0 && i-- > 0;) {
-            const sp<Session> &session = mSessions.valueAt(i);
+        // The session may have been destroyed since the event was queued.
+        ssize_t index = mSessions.indexOfKey(events[i].data.u32);
+        if (index < 0) {
+            continue;
+        }
 
-            int s = session->socket();
+        const sp<Session> session = mSessions.valueAt(index);
 
-            if (s < 0) {
-                continue;
-            }
+        int s = session->socket();
 
-            if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
-                --res;
-            }
+        // Like select(), report errors and hangups as readable and writable
+        // so that the next read or write surfaces them.
+        uint32_t flags = events[i].events;
+        bool readable = flags & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP);
+        bool writable = flags & (EPOLLOUT | EPOLLERR | EPOLLHUP);
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+        if (readable && session->wantsToRead()) {
+            if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+                for (;;) {
                     struct sockaddr_in remoteAddr;
                     socklen_t remoteAddrLen = sizeof(remoteAddr);
 
                     int clientSocket = accept(
                             s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
 
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
+                    if (clientSocket < 0) {
+                        if (errno == EINTR) {
+                            continue;
                         }
-                    } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            ALOGE("accept returned error %d (%s)",
+                                  errno, strerror(errno));
+                        }
+                        break;
                     }
-                } else {
-                    status_t err = session->readMore();
+
+                    status_t err = MakeSocketNonBlocking(clientSocket);
+
                     if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
+                        ALOGE("Unable to make client socket non blocking, "
+                              "failed w/ error %d (%s)",
+                              err, strerror(-err));
+
+                        close(clientSocket);
+                        clientSocket = -1;
+                        continue;
                     }
-                }
-            }
 
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
+                    in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+                    ALOGI("incoming connection from %d.%d.%d.%d:%d "
+                          "(socket %d)",
+                          (addr >> 24),
+                          (addr >> 16) & 0xff,
+                          (addr >> 8) & 0xff,
+                          addr & 0xff,
+                          ntohs(remoteAddr.sin_port),
+                          clientSocket);
+
+                    sp<Session> clientSession =
+                        new Session(
+                                mNextSessionID++,
+                                Session::CONNECTED,
+                                clientSocket,
+                                session->getNotificationMessage());
+
+                    clientSession->setMode(
+                            session->isRTSPServer()
+                                ? Session::MODE_RTSP
+                                : Session::MODE_DATAGRAM);
+
+                    sessionsToAdd.push_back(clientSession);
+                }
+            } else {
+                status_t err = session->readMore();
                 if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                    ALOGE("readMore on socket %d failed w/ error %d (%s)",
                           s, err, strerror(-err));
                 }
             }
         }
 
-        while (!sessionsToAdd.empty()) {
-            sp<Session> session = *sessionsToAdd.begin();
-            sessionsToAdd.erase(sessionsToAdd.begin());
+        if (writable && session->wantsToWrite()) {
+            status_t err = session->writeMore();
+            if (err != OK) {
+                ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                      s, err, strerror(-err));
+            }
+        }
 
-            mSessions.add(session->sessionID(), session);
+        updateEvents_l(session);
+    }
 
-            ALOGI("added clientSession %d", session->sessionID());
-        }
+    while (!sessionsToAdd.empty()) {
+        sp<Session> session = *sessionsToAdd.begin();
+        sessionsToAdd.erase(sessionsToAdd.begin());
+
+        mSessions.add(session->sessionID(), session);
+        updateEvents_l(session);
+
+        ALOGI("added clientSession %d", session->sessionID());
     }
 }
 
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AES128Decryptor"
+#include <utils/Log.h>
+
+#include "AES128Decryptor.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+
+namespace android {
+
+AES128Decryptor::AES128Decryptor()
+    : mInitialized(false) {
+    EVP_CIPHER_CTX_init(&mContext);
+}
+
+AES128Decryptor::~AES128Decryptor() {
+    EVP_CIPHER_CTX_cleanup(&mContext);
+}
+
+status_t AES128Decryptor::init(const uint8_t *key, const uint8_t *iv) {
+    mInitialized = false;
+
+    if (EVP_DecryptInit_ex(
+                &mContext, EVP_aes_128_cbc(), NULL /* engine */, key, iv) != 1) {
+        ALOGE("failed to set AES decryption key.");
+        return UNKNOWN_ERROR;
+    }
+
+    // HLS padding is checked and removed by the caller once the entire
+    // segment has been decrypted, don't let EVP hold back the last block.
+    EVP_CIPHER_CTX_set_padding(&mContext, 0);
+
+    mInitialized = true;
+
+    return OK;
+}
+
+status_t AES128Decryptor::decrypt(uint8_t *data, size_t size) {
+    CHECK(mInitialized);
+    CHECK_EQ(size % 16, 0u);
+
+    // Keep each call within what an int can express.
+    static const size_t kMaxChunkSize = 1 << 30;
+
+    while (size > 0) {
+        size_t chunkSize = size < kMaxChunkSize ? size : kMaxChunkSize;
+
+        int outSize;
+        if (EVP_DecryptUpdate(
+                    &mContext, data, &outSize, data, (int)chunkSize) != 1
+                || (size_t)outSize != chunkSize) {
+            ALOGE("AES decryption failed.");
+            return UNKNOWN_ERROR;
+        }
+
+        data += chunkSize;
+        size -= chunkSize;
+    }
+
+    return OK;
+}
+
+}  // namespace android
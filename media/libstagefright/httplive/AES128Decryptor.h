@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AES128_DECRYPTOR_H_
+
+#define AES128_DECRYPTOR_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+
+#include <openssl/evp.h>
+
+namespace android {
+
+// AES-128-CBC decryption of a media segment as it arrives, without padding
+// removal. Goes through EVP so that libcrypto can use the AES instructions
+// of the CPU (AES-NI, ARMv8 crypto extensions) where it supports them.
+struct AES128Decryptor {
+    AES128Decryptor();
+    ~AES128Decryptor();
+
+    // Starts a new cipher block chain.
+    status_t init(const uint8_t *key, const uint8_t *iv);
+
+    // Decrypts "size" bytes in place, "size" must be a multiple of 16.
+    // Successive calls continue the chain where the previous one left off.
+    status_t decrypt(uint8_t *data, size_t size);
+
+private:
+    EVP_CIPHER_CTX mContext;
+    bool mInitialized;
+
+    DISALLOW_EVIL_CONSTRUCTORS(AES128Decryptor);
+};
+
+}  // namespace android
+
+#endif  // AES128_DECRYPTOR_H_
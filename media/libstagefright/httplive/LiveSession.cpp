@@ -83,8 +83,17 @@ LiveSession::LiveSession(
 
     for (size_t i = 0; i < kMaxStreams; ++i) {
         mDiscontinuities.add(indexToType(i), new AnotherPacketSource(NULL /* meta */));
-        mPacketSources.add(indexToType(i), new AnotherPacketSource(NULL /* meta */));
-        mPacketSources2.add(indexToType(i), new AnotherPacketSource(NULL /* meta */));
+
+        // Access units are queued by the fetchers, which all run on this
+        // session's looper, and dequeued on the player's.
+        sp<AnotherPacketSource> source = new AnotherPacketSource(NULL /* meta */);
+        source->enableSingleProducerMode();
+        mPacketSources.add(indexToType(i), source);
+
+        source = new AnotherPacketSource(NULL /* meta */);
+        source->enableSingleProducerMode();
+        mPacketSources2.add(indexToType(i), source);
+
         mBuffering[i] = false;
     }
 
@@ -827,7 +836,8 @@ ssize_t LiveSession::fetchFile(
         int64_t range_offset, int64_t range_length,
         uint32_t block_size, /* download block size */
         sp<DataSource> *source, /* to return and reuse source */
-        String8 *actualUrl) {
+        String8 *actualUrl,
+        const sp<HTTPBase> &httpDataSource) {
     off64_t size;
     sp<DataSource> temp_source;
     if (source == NULL) {
@@ -853,13 +863,16 @@ ssize_t LiveSession::fetchFile(
                                     ? "" : StringPrintf("%lld",
                                             range_offset + range_length - 1).c_str()).c_str()));
             }
-            status_t err = mHTTPDataSource->connect(url, &headers);
+            sp<HTTPBase> http =
+                httpDataSource != NULL ? httpDataSource : mHTTPDataSource;
+
+            status_t err = http->connect(url, &headers);
 
             if (err != OK) {
                 return err;
             }
 
-            *source = mHTTPDataSource;
+            *source = http;
         }
     }
 
@@ -940,7 +953,8 @@ ssize_t LiveSession::fetchFile(
 }
 
 sp<M3UParser> LiveSession::fetchPlaylist(
-        const char *url, uint8_t *curPlaylistHash, bool *unchanged) {
+        const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+        const sp<M3UParser> &curPlaylist) {
     ALOGV("fetchPlaylist '%s'", url);
 
     *unchanged = false;
@@ -977,6 +991,15 @@ sp<M3UParser> LiveSession::fetchPlaylist(
     }
 #endif
 
+    if (curPlaylist != NULL
+            && curPlaylist->append(
+                actualUrl.string(), buffer->data(), buffer->size()) == OK) {
+        ALOGV("playlist '%s' grew to %zu items",
+              uriDebugString(url).c_str(), curPlaylist->size());
+
+        return curPlaylist;
+    }
+
     sp<M3UParser> playlist =
         new M3UParser(actualUrl.string(), buffer->data(), buffer->size());
 
@@ -98,6 +98,7 @@ protected:
 
 private:
     friend struct PlaylistFetcher;
+    friend struct SegmentDownloader;
 
     enum {
         kWhatConnect                    = 'conn',
@@ -231,6 +232,9 @@ private:
     //
     // For reused HTTP sources, the caller must download a file sequentially without
     // any overlaps or gaps to prevent reconnection.
+    //
+    // If given a non-NULL httpDataSource, a new HTTP source is connected over that
+    // connection instead of the session's own, so that fetches can run concurrently.
     ssize_t fetchFile(
             const char *url, sp<ABuffer> *out,
             /* request/open a file starting at range_offset for range_length bytes */
@@ -239,10 +243,15 @@ private:
             uint32_t block_size = 0,
             /* reuse DataSource if doing partial fetch */
             sp<DataSource> *source = NULL,
-            String8 *actualUrl = NULL);
+            String8 *actualUrl = NULL,
+            /* connection to use instead of the session's own */
+            const sp<HTTPBase> &httpDataSource = NULL);
 
+    // If given, "curPlaylist" is brought up to date and returned in case
+    // the playlist merely grew since it was last fetched.
     sp<M3UParser> fetchPlaylist(
-            const char *url, uint8_t *curPlaylistHash, bool *unchanged);
+            const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+            const sp<M3UParser> &curPlaylist = NULL);
 
     size_t getBandwidthIndex();
     int64_t latestMediaSegmentStartTimeUs();
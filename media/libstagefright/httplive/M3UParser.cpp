@@ -21,6 +21,7 @@
 #include "M3UParser.h"
 #include <binder/Parcel.h>
 #include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaDefs.h>
@@ -251,8 +252,18 @@ M3UParser::M3UParser(
       mIsComplete(false),
       mIsEvent(false),
       mDiscontinuitySeq(0),
-      mSelectedIndex(-1) {
+      mSelectedIndex(-1),
+      mTotalDurationUs(0ll),
+      mResumeOffset(0),
+      mResumeNumItems(0),
+      mResumeSegmentRangeOffset(0) {
     mInitCheck = parse(data, size);
+
+    if (mInitCheck == OK && !mIsVariantPlaylist && !mIsComplete) {
+        // A live or event playlist, it will be reloaded.
+        mData = new ABuffer(size);
+        memcpy(mData->data(), data, size);
+    }
 }
 
 M3UParser::~M3UParser() {
@@ -314,6 +325,149 @@ bool M3UParser::itemAt(size_t index, AString *uri, sp<AMessage> *meta) {
     return true;
 }
 
+int64_t M3UParser::getSegmentStartTimeUs(size_t index) const {
+    CHECK(!mIsVariantPlaylist);
+    CHECK_LE(index, mItemStartTimesUs.size());
+
+    if (index == mItemStartTimesUs.size()) {
+        return mTotalDurationUs;
+    }
+
+    return mItemStartTimesUs.itemAt(index);
+}
+
+int64_t M3UParser::getTotalDurationUs() const {
+    return mTotalDurationUs;
+}
+
+size_t M3UParser::getItemIndexForTime(int64_t timeUs) const {
+    CHECK(!mIsVariantPlaylist);
+
+    if (timeUs >= mTotalDurationUs) {
+        return mItemStartTimesUs.size();
+    }
+
+    // Find the last item starting at or before "timeUs", skipping items
+    // of zero duration in front of it.
+    size_t lo = 0;
+    size_t hi = mItemStartTimesUs.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mItemStartTimesUs.itemAt(mid) <= timeUs) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+ssize_t M3UParser::getCipherItemIndex(size_t index) const {
+    // Find the last cipher run starting at or before "index".
+    size_t lo = 0;
+    size_t hi = mCipherItems.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mCipherItems.itemAt(mid) <= index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo > 0 ? (ssize_t)mCipherItems.itemAt(lo - 1) : -1;
+}
+
+status_t M3UParser::append(
+        const char *baseURI, const void *data, size_t size) {
+    if (mInitCheck != OK || mData == NULL || !(mBaseURI == baseURI)
+            || size < mResumeOffset
+            || memcmp(data, mData->data(), mResumeOffset)) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    // Anything following the resume point is parsed again, remember
+    // enough to undo that should the new data turn out to be malformed.
+    Vector<Item> tail;
+    for (size_t i = mResumeNumItems; i < mItems.size(); ++i) {
+        tail.push(mItems.itemAt(i));
+    }
+
+    sp<AMessage> meta = mMeta != NULL ? mMeta->dup() : NULL;
+    bool isComplete = mIsComplete;
+    bool isEvent = mIsEvent;
+    size_t discontinuitySeq = mDiscontinuitySeq;
+    size_t resumeOffset = mResumeOffset;
+    size_t resumeNumItems = mResumeNumItems;
+    uint64_t resumeSegmentRangeOffset = mResumeSegmentRangeOffset;
+
+    truncate(mResumeNumItems);
+
+    status_t err = parse(data, size, mResumeOffset);
+
+    if (err != OK) {
+        truncate(resumeNumItems);
+        for (size_t i = 0; i < tail.size(); ++i) {
+            pushItem(tail.itemAt(i));
+        }
+
+        mMeta = meta;
+        mIsComplete = isComplete;
+        mIsEvent = isEvent;
+        mDiscontinuitySeq = discontinuitySeq;
+        mResumeOffset = resumeOffset;
+        mResumeNumItems = resumeNumItems;
+        mResumeSegmentRangeOffset = resumeSegmentRangeOffset;
+
+        return err;
+    }
+
+    if (mIsComplete) {
+        mData.clear();
+    } else {
+        mData = new ABuffer(size);
+        memcpy(mData->data(), data, size);
+    }
+
+    return OK;
+}
+
+void M3UParser::pushItem(const Item &item) {
+    if (!mIsVariantPlaylist) {
+        int64_t durationUs;
+        CHECK(item.mMeta->findInt64("durationUs", &durationUs));
+
+        mItemStartTimesUs.push(mTotalDurationUs);
+        mTotalDurationUs += durationUs;
+
+        AString method;
+        if (item.mMeta->findString("cipher-method", &method)) {
+            mCipherItems.push(mItems.size());
+        }
+    }
+
+    mItems.push(item);
+}
+
+void M3UParser::truncate(size_t numItems) {
+    if (numItems >= mItems.size()) {
+        return;
+    }
+
+    if (!mIsVariantPlaylist) {
+        mTotalDurationUs = mItemStartTimesUs.itemAt(numItems);
+        mItemStartTimesUs.removeItemsAt(
+                numItems, mItemStartTimesUs.size() - numItems);
+
+        while (!mCipherItems.isEmpty() && mCipherItems.top() >= numItems) {
+            mCipherItems.pop();
+        }
+    }
+
+    mItems.removeItemsAt(numItems, mItems.size() - numItems);
+}
+
 void M3UParser::pickRandomMediaItems() {
     for (size_t i = 0; i < mMediaGroups.size(); ++i) {
         mMediaGroups.valueAt(i)->pickRandomMediaItems();
@@ -515,14 +669,14 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
     return true;
 }
 
-status_t M3UParser::parse(const void *_data, size_t size) {
-    int32_t lineNo = 0;
+status_t M3UParser::parse(const void *_data, size_t size, size_t offset) {
+    // When resuming, the first line has long been seen.
+    int32_t lineNo = offset > 0 ? 1 : 0;
 
     sp<AMessage> itemMeta;
 
     const char *data = (const char *)_data;
-    size_t offset = 0;
-    uint64_t segmentRangeOffset = 0;
+    uint64_t segmentRangeOffset = offset > 0 ? mResumeSegmentRangeOffset : 0;
     while (offset < size) {
         size_t offsetLF = offset;
         while (offsetLF < size && data[offsetLF] != '\n') {
@@ -630,14 +784,19 @@ status_t M3UParser::parse(const void *_data, size_t size) {
                 }
             }
 
-            mItems.push();
-            Item *item = &mItems.editItemAt(mItems.size() - 1);
-
-            CHECK(MakeURL(mBaseURI.c_str(), line.c_str(), &item->mURI));
+            Item item;
+            CHECK(MakeURL(mBaseURI.c_str(), line.c_str(), &item.mURI));
+            item.mMeta = itemMeta;
 
-            item->mMeta = itemMeta;
+            pushItem(item);
 
             itemMeta.clear();
+
+            if (offsetLF < size) {
+                mResumeOffset = offsetLF + 1;
+                mResumeNumItems = mItems.size();
+                mResumeSegmentRangeOffset = segmentRangeOffset;
+            }
         }
 
         offset = offsetLF + 1;
@@ -26,6 +26,8 @@
 
 namespace android {
 
+struct ABuffer;
+
 struct M3UParser : public RefBase {
     M3UParser(const char *baseURI, const void *data, size_t size);
 
@@ -42,6 +44,27 @@ struct M3UParser : public RefBase {
     size_t size();
     bool itemAt(size_t index, AString *uri, sp<AMessage> *meta = NULL);
 
+    // Start time of item "index" relative to the start of the playlist,
+    // index == size() yields the duration of the entire playlist.
+    int64_t getSegmentStartTimeUs(size_t index) const;
+    int64_t getTotalDurationUs() const;
+
+    // Index of the item playing at "timeUs", size() if the playlist
+    // ends at or before "timeUs".
+    size_t getItemIndexForTime(int64_t timeUs) const;
+
+    // Index of the item at or before "index" carrying the "cipher-method"
+    // in effect for item "index", -1 if there is none.
+    ssize_t getCipherItemIndex(size_t index) const;
+
+    // Brings the playlist up to date with a reloaded version of it, "data".
+    // Only supported if the reloaded playlist merely grew, i.e. it starts
+    // with everything up to and including the last item parsed before,
+    // in which case only the new lines are parsed and OK is returned.
+    // Otherwise the playlist is left unchanged and an error is returned,
+    // the caller is expected to parse "data" from scratch then.
+    status_t append(const char *baseURI, const void *data, size_t size);
+
     void pickRandomMediaItems();
     status_t selectTrack(size_t index, bool select);
     size_t getTrackCount() const;
@@ -75,10 +98,28 @@ private:
     Vector<Item> mItems;
     ssize_t mSelectedIndex;
 
+    // Start time of each item of a media playlist, and the indices of
+    // the items starting a new cipher run, both kept up to date as items
+    // are parsed so that seeking and decryption don't have to walk the
+    // playlist.
+    Vector<int64_t> mItemStartTimesUs;
+    int64_t mTotalDurationUs;
+    Vector<size_t> mCipherItems;
+
+    // What append() needs to pick up parsing where it left off: the data
+    // parsed so far, the offset into it just past the last item line that
+    // was terminated, and the number of items up to there.
+    sp<ABuffer> mData;
+    size_t mResumeOffset;
+    size_t mResumeNumItems;
+    uint64_t mResumeSegmentRangeOffset;
+
     // Media groups keyed by group ID.
     KeyedVector<AString, sp<MediaGroup> > mMediaGroups;
 
-    status_t parse(const void *data, size_t size);
+    status_t parse(const void *data, size_t size, size_t offset = 0);
+    void pushItem(const Item &item);
+    void truncate(size_t numItems);
 
     static status_t parseMetaData(
             const AString &line, sp<AMessage> *meta, const char *key);
@@ -23,6 +23,7 @@
 #include "LiveDataSource.h"
 #include "LiveSession.h"
 #include "M3UParser.h"
+#include "SegmentDownloader.h"
 
 #include "include/avc_utils.h"
 #include "include/ExtendedUtils.h"
@@ -30,19 +31,21 @@
 #include "include/ID3.h"
 #include "mpeg2ts/AnotherPacketSource.h"
 
+#include <cutils/properties.h>
+#include <media/IMediaHTTPService.h>
 #include <media/IStreamSource.h>
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaHTTP.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
 #include <ctype.h>
 #include <inttypes.h>
-#include <openssl/aes.h>
 #include <openssl/md5.h>
 
 namespace android {
@@ -78,15 +81,38 @@ PlaylistFetcher::PlaylistFetcher(
       mMonitorQueueGeneration(0),
       mSubtitleGeneration(subtitleGeneration),
       mRefreshState(INITIAL_MINIMUM_RELOAD_DELAY),
+      mNumPrefetchSegments(kNumPrefetchSegments),
+      mWaitingForPrefetch(false),
       mFirstPTSValid(false),
       mAbsoluteTimeAnchorUs(0ll),
       mVideoBuffer(new AnotherPacketSource(NULL)) {
     memset(mPlaylistHash, 0, sizeof(mPlaylistHash));
     mStartTimeUsNotify->setInt32("what", kWhatStartedAt);
     mStartTimeUsNotify->setInt32("streamMask", 0);
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.httplive.prefetch-segments", value, NULL)) {
+        char *end;
+        long numSegments = strtol(value, &end, 10);
+        if (end > value && *end == '\0' && numSegments >= 0) {
+            mNumPrefetchSegments = numSegments < kMaxNumPrefetchSegments
+                    ? numSegments : kMaxNumPrefetchSegments;
+        }
+    }
 }
 
 PlaylistFetcher::~PlaylistFetcher() {
+    // Interrupt all downloads in flight first, stopping a looper waits for
+    // its download to return.
+    for (size_t i = 0; i < mPrefetchSlots.size(); ++i) {
+        mPrefetchSlots.itemAt(i).mDownloader->disconnect();
+    }
+
+    for (size_t i = 0; i < mPrefetchSlots.size(); ++i) {
+        const PrefetchSlot &slot = mPrefetchSlots.itemAt(i);
+        slot.mLooper->unregisterHandler(slot.mDownloader->id());
+        slot.mLooper->stop();
+    }
 }
 
 int64_t PlaylistFetcher::getSegmentStartTimeUs(int32_t seqNumber) const {
@@ -104,20 +130,8 @@ int64_t PlaylistFetcher::getSegmentStartTimeUs(int32_t seqNumber) const {
     CHECK_GE(seqNumber, firstSeqNumberInPlaylist);
     CHECK_LE(seqNumber, lastSeqNumberInPlaylist);
 
-    int64_t segmentStartUs = 0ll;
-    for (int32_t index = 0;
-            index < seqNumber - firstSeqNumberInPlaylist; ++index) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        segmentStartUs += itemDurationUs;
-    }
-
-    return segmentStartUs;
+    return mPlaylist->getSegmentStartTimeUs(
+            seqNumber - firstSeqNumberInPlaylist);
 }
 
 int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
@@ -184,32 +198,23 @@ int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
     return delayUs > 0ll ? delayUs : 0ll;
 }
 
-status_t PlaylistFetcher::decryptBuffer(
-        size_t playlistIndex, const sp<ABuffer> &buffer,
-        bool first) {
+status_t PlaylistFetcher::getCipherParams(
+        size_t playlistIndex, int32_t seqNumber,
+        AString *method, sp<ABuffer> *key, uint8_t *iv) {
     sp<AMessage> itemMeta;
-    bool found = false;
-    AString method;
-
-    for (ssize_t i = playlistIndex; i >= 0; --i) {
-        AString uri;
-        CHECK(mPlaylist->itemAt(i, &uri, &itemMeta));
-
-        if (itemMeta->findString("cipher-method", &method)) {
-            found = true;
-            break;
-        }
-    }
 
-    if (!found) {
-        method = "NONE";
+    ssize_t cipherIndex = mPlaylist->getCipherItemIndex(playlistIndex);
+    if (cipherIndex >= 0) {
+        CHECK(mPlaylist->itemAt(cipherIndex, NULL /* uri */, &itemMeta));
+        CHECK(itemMeta->findString("cipher-method", method));
+    } else {
+        *method = "NONE";
     }
-    buffer->meta()->setString("cipher-method", method.c_str());
 
-    if (method == "NONE") {
+    if (*method == "NONE") {
         return OK;
-    } else if (!(method == "AES-128")) {
-        ALOGE("Unsupported cipher method '%s'", method.c_str());
+    } else if (!(*method == "AES-128")) {
+        ALOGE("Unsupported cipher method '%s'", method->c_str());
         return ERROR_UNSUPPORTED;
     }
 
@@ -221,74 +226,93 @@ status_t PlaylistFetcher::decryptBuffer(
 
     ssize_t index = mAESKeyForURI.indexOfKey(keyURI);
 
-    sp<ABuffer> key;
     if (index >= 0) {
-        key = mAESKeyForURI.valueAt(index);
+        *key = mAESKeyForURI.valueAt(index);
     } else {
-        ssize_t err = mSession->fetchFile(keyURI.c_str(), &key);
+        key->clear();
+        ssize_t err = mSession->fetchFile(keyURI.c_str(), key);
 
         if (err < 0) {
             ALOGE("failed to fetch cipher key from '%s'.", keyURI.c_str());
             return ERROR_IO;
-        } else if (key->size() != 16) {
+        } else if ((*key)->size() != 16) {
             ALOGE("key file '%s' wasn't 16 bytes in size.", keyURI.c_str());
             return ERROR_MALFORMED;
         }
 
-        mAESKeyForURI.add(keyURI, key);
+        mAESKeyForURI.add(keyURI, *key);
     }
 
-    AES_KEY aes_key;
-    if (AES_set_decrypt_key(key->data(), 128, &aes_key) != 0) {
-        ALOGE("failed to set AES decryption key.");
-        return UNKNOWN_ERROR;
-    }
+    AString ivString;
+    if (itemMeta->findString("cipher-iv", &ivString)) {
+        if ((!ivString.startsWith("0x") && !ivString.startsWith("0X"))
+                || ivString.size() != 16 * 2 + 2) {
+            ALOGE("malformed cipher IV '%s'.", ivString.c_str());
+            return ERROR_MALFORMED;
+        }
 
-    size_t n = buffer->size();
-    if (!n) {
-        return OK;
+        memset(iv, 0, 16);
+        for (size_t i = 0; i < 16; ++i) {
+            char c1 = tolower(ivString.c_str()[2 + 2 * i]);
+            char c2 = tolower(ivString.c_str()[3 + 2 * i]);
+            if (!isxdigit(c1) || !isxdigit(c2)) {
+                ALOGE("malformed cipher IV '%s'.", ivString.c_str());
+                return ERROR_MALFORMED;
+            }
+            uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
+            uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
+
+            iv[i] = nibble1 << 4 | nibble2;
+        }
+    } else {
+        memset(iv, 0, 16);
+        iv[15] = seqNumber & 0xff;
+        iv[14] = (seqNumber >> 8) & 0xff;
+        iv[13] = (seqNumber >> 16) & 0xff;
+        iv[12] = (seqNumber >> 24) & 0xff;
     }
-    CHECK(n % 16 == 0);
 
+    return OK;
+}
+
+status_t PlaylistFetcher::decryptBuffer(
+        size_t playlistIndex, const sp<ABuffer> &buffer,
+        bool first) {
     if (first) {
         // If decrypting the first block in a file, read the iv from the manifest
         // or derive the iv from the file's sequence number.
 
-        AString iv;
-        if (itemMeta->findString("cipher-iv", &iv)) {
-            if ((!iv.startsWith("0x") && !iv.startsWith("0X"))
-                    || iv.size() != 16 * 2 + 2) {
-                ALOGE("malformed cipher IV '%s'.", iv.c_str());
-                return ERROR_MALFORMED;
-            }
+        sp<ABuffer> key;
+        uint8_t iv[16];
+        status_t err = getCipherParams(
+                playlistIndex, mSeqNumber, &mCipherMethod, &key, iv);
 
-            memset(mAESInitVec, 0, sizeof(mAESInitVec));
-            for (size_t i = 0; i < 16; ++i) {
-                char c1 = tolower(iv.c_str()[2 + 2 * i]);
-                char c2 = tolower(iv.c_str()[3 + 2 * i]);
-                if (!isxdigit(c1) || !isxdigit(c2)) {
-                    ALOGE("malformed cipher IV '%s'.", iv.c_str());
-                    return ERROR_MALFORMED;
-                }
-                uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
-                uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
+        if (err != OK) {
+            return err;
+        }
 
-                mAESInitVec[i] = nibble1 << 4 | nibble2;
+        if (mCipherMethod == "AES-128") {
+            err = mDecryptor.init(key->data(), iv);
+
+            if (err != OK) {
+                return err;
             }
-        } else {
-            memset(mAESInitVec, 0, sizeof(mAESInitVec));
-            mAESInitVec[15] = mSeqNumber & 0xff;
-            mAESInitVec[14] = (mSeqNumber >> 8) & 0xff;
-            mAESInitVec[13] = (mSeqNumber >> 16) & 0xff;
-            mAESInitVec[12] = (mSeqNumber >> 24) & 0xff;
         }
     }
 
-    AES_cbc_encrypt(
-            buffer->data(), buffer->data(), buffer->size(),
-            &aes_key, mAESInitVec, AES_DECRYPT);
+    buffer->meta()->setString("cipher-method", mCipherMethod.c_str());
 
-    return OK;
+    if (mCipherMethod == "NONE") {
+        return OK;
+    }
+
+    size_t n = buffer->size();
+    if (!n) {
+        return OK;
+    }
+    CHECK(n % 16 == 0);
+
+    return mDecryptor.decrypt(buffer->data(), n);
 }
 
 status_t PlaylistFetcher::checkDecryptPadding(const sp<ABuffer> &buffer) {
@@ -333,6 +357,7 @@ void PlaylistFetcher::postMonitorQueue(int64_t delayUs, int64_t minDelayUs) {
 
 void PlaylistFetcher::cancelMonitorQueue() {
     ++mMonitorQueueGeneration;
+    mWaitingForPrefetch = false;
 }
 
 void PlaylistFetcher::startAsync(
@@ -444,12 +469,19 @@ void PlaylistFetcher::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatPrefetched:
+        {
+            onSegmentPrefetched(msg);
+            break;
+        }
+
         default:
             TRESPASS();
     }
 }
 
 status_t PlaylistFetcher::onStart(const sp<AMessage> &msg) {
+    unbindPacketSources();
     mPacketSources.clear();
 
     uint32_t streamTypeMask;
@@ -493,6 +525,13 @@ status_t PlaylistFetcher::onStart(const sp<AMessage> &msg) {
 
     mStreamTypeMask = streamTypeMask;
 
+    // The sources outlive fetchers. Those of a session all run on its
+    // looper, which stays bound as the producer as long as one of them
+    // has the source, e.g. across a bandwidth switch.
+    for (size_t i = 0; i < mPacketSources.size(); ++i) {
+        mPacketSources.valueAt(i)->bindProducer();
+    }
+
     mSegmentStartTimeUs = segmentStartTimeUs;
     mDiscontinuitySeq = startDiscontinuitySeq;
 
@@ -509,6 +548,12 @@ status_t PlaylistFetcher::onStart(const sp<AMessage> &msg) {
     return OK;
 }
 
+void PlaylistFetcher::unbindPacketSources() {
+    for (size_t i = 0; i < mPacketSources.size(); ++i) {
+        mPacketSources.valueAt(i)->unbindProducer();
+    }
+}
+
 void PlaylistFetcher::onPause() {
     cancelMonitorQueue();
 }
@@ -525,8 +570,13 @@ void PlaylistFetcher::onStop(const sp<AMessage> &msg) {
         }
     }
 
+    unbindPacketSources();
     mPacketSources.clear();
     mStreamTypeMask = 0;
+
+    for (size_t i = 0; i < mPrefetchSlots.size(); ++i) {
+        releasePrefetchSlot(&mPrefetchSlots.editItemAt(i));
+    }
 }
 
 // Resume until we have reached the boundary timestamps listed in `msg`; when
@@ -695,7 +745,7 @@ status_t PlaylistFetcher::refreshPlaylist() {
     if (delayUsToRefreshPlaylist() <= 0) {
         bool unchanged;
         sp<M3UParser> playlist = mSession->fetchPlaylist(
-                mURI.c_str(), mPlaylistHash, &unchanged);
+                mURI.c_str(), mPlaylistHash, &unchanged, mPlaylist);
 
         if (playlist == NULL) {
             if (unchanged) {
@@ -878,6 +928,24 @@ void PlaylistFetcher::onDownloadNext() {
                 &uri,
                 &itemMeta));
 
+    startPrefetching(firstSeqNumberInPlaylist, lastSeqNumberInPlaylist);
+
+    // If this segment is already on its way, wait for it rather than
+    // downloading it a second time. onSegmentPrefetched() resumes us.
+    sp<ABuffer> prefetchedBuffer;
+    ssize_t slotIndex = findPrefetchSlot(mSeqNumber, uri);
+    if (slotIndex >= 0) {
+        PrefetchSlot *slot = &mPrefetchSlots.editItemAt(slotIndex);
+        if (slot->mPending && !discontinuity) {
+            ALOGV("waiting for segment %d to be prefetched", mSeqNumber);
+            mWaitingForPrefetch = true;
+            return;
+        }
+
+        prefetchedBuffer = slot->mBuffer;
+        releasePrefetchSlot(slot);
+    }
+
     int32_t val;
     if (itemMeta->findInt32("discontinuity", &val) && val != 0) {
         mDiscontinuitySeq++;
@@ -894,13 +962,15 @@ void PlaylistFetcher::onDownloadNext() {
     ALOGV("fetching segment %d from (%d .. %d)",
           mSeqNumber, firstSeqNumberInPlaylist, lastSeqNumberInPlaylist);
 
-    ALOGI("fetching '%s'", uri.c_str());
+    ALOGI("fetching '%s'%s", uri.c_str(),
+          prefetchedBuffer != NULL ? " (prefetched)" : "");
 
     sp<DataSource> source;
     sp<ABuffer> buffer, tsBuffer;
     // decrypt a junk buffer to prefetch key; since a session uses only one http connection,
-    // this avoids interleaved connections to the key and segment file.
-    {
+    // this avoids interleaved connections to the key and segment file. Prefetched
+    // segments arrive decrypted already.
+    if (prefetchedBuffer == NULL) {
         sp<ABuffer> junk = new ABuffer(16);
         junk->setRange(0, 16);
         status_t err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, junk,
@@ -911,12 +981,30 @@ void PlaylistFetcher::onDownloadNext() {
         }
     }
 
+    // A prefetched segment is handed to the parser in the same blocks a
+    // download would have delivered, minus the decryption.
+    size_t prefetchedSize = 0;
+    if (prefetchedBuffer != NULL) {
+        buffer = prefetchedBuffer;
+        prefetchedSize = buffer->size();
+        buffer->setRange(0, 0);
+    }
+
     // block-wise download
     bool startup = mStartup;
     ssize_t bytesRead;
     do {
-        bytesRead = mSession->fetchFile(
-                uri.c_str(), &buffer, range_offset, range_length, kDownloadBlockSize, &source);
+        if (prefetchedBuffer != NULL) {
+            bytesRead = prefetchedSize - buffer->size();
+            if (bytesRead > kDownloadBlockSize) {
+                bytesRead = kDownloadBlockSize;
+            }
+            buffer->setRange(0, buffer->size() + bytesRead);
+        } else {
+            bytesRead = mSession->fetchFile(
+                    uri.c_str(), &buffer, range_offset, range_length,
+                    kDownloadBlockSize, &source);
+        }
 
         if (bytesRead < 0) {
             status_t err = bytesRead;
@@ -928,12 +1016,15 @@ void PlaylistFetcher::onDownloadNext() {
         CHECK(buffer != NULL);
 
         size_t size = buffer->size();
-        // Set decryption range.
-        buffer->setRange(size - bytesRead, bytesRead);
-        status_t err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, buffer,
-                buffer->offset() == 0 /* first */);
-        // Unset decryption range.
-        buffer->setRange(0, size);
+        status_t err = OK;
+        if (prefetchedBuffer == NULL) {
+            // Set decryption range.
+            buffer->setRange(size - bytesRead, bytesRead);
+            err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, buffer,
+                    buffer->offset() == 0 /* first */);
+            // Unset decryption range.
+            buffer->setRange(0, size);
+        }
 
         if (err != OK) {
             ALOGE("decryptBuffer failed w/ error %d", err);
@@ -1023,7 +1114,11 @@ void PlaylistFetcher::onDownloadNext() {
                       srcType == ATSParser::VIDEO ? "video" : "audio");
 
                 mStreamTypeMask &= ~streamType;
-                mPacketSources.removeItem(streamType);
+                ssize_t index = mPacketSources.indexOfKey(streamType);
+                if (index >= 0) {
+                    mPacketSources.valueAt(index)->unbindProducer();
+                    mPacketSources.removeItemsAt(index);
+                }
             }
         }
 
@@ -1072,6 +1167,166 @@ void PlaylistFetcher::onDownloadNext() {
     postMonitorQueue();
 }
 
+void PlaylistFetcher::startPrefetching(
+        int32_t firstSeqNumberInPlaylist, int32_t lastSeqNumberInPlaylist) {
+    if (mNumPrefetchSegments == 0) {
+        return;
+    }
+
+    if (mPrefetchSlots.isEmpty()) {
+        for (size_t i = 0; i < mNumPrefetchSegments; ++i) {
+            PrefetchSlot slot;
+            slot.mLooper = new ALooper;
+            slot.mLooper->setName("segment prefetch");
+            slot.mLooper->start();
+
+            slot.mDownloader = new SegmentDownloader(
+                    mSession,
+                    new MediaHTTP(mSession->mHTTPService->makeHTTPConnection()));
+            slot.mLooper->registerHandler(slot.mDownloader);
+
+            slot.mSeqNumber = -1;
+            slot.mPending = false;
+
+            mPrefetchSlots.push(slot);
+        }
+    }
+
+    int32_t lastSeqNumberToPrefetch = mSeqNumber + (int32_t)mNumPrefetchSegments;
+    if (lastSeqNumberToPrefetch > lastSeqNumberInPlaylist) {
+        lastSeqNumberToPrefetch = lastSeqNumberInPlaylist;
+    }
+
+    // Let go of whatever is no longer ahead of us, e.g. after a seek.
+    for (size_t i = 0; i < mPrefetchSlots.size(); ++i) {
+        PrefetchSlot *slot = &mPrefetchSlots.editItemAt(i);
+        if (slot->mSeqNumber >= 0
+                && (slot->mSeqNumber < mSeqNumber
+                    || slot->mSeqNumber > mSeqNumber + (int32_t)mNumPrefetchSegments)) {
+            releasePrefetchSlot(slot);
+        }
+    }
+
+    for (int32_t seqNumber = mSeqNumber + 1;
+            seqNumber <= lastSeqNumberToPrefetch; ++seqNumber) {
+        AString uri;
+        sp<AMessage> itemMeta;
+        CHECK(mPlaylist->itemAt(
+                    seqNumber - firstSeqNumberInPlaylist, &uri, &itemMeta));
+
+        if (findPrefetchSlot(seqNumber, uri) >= 0) {
+            continue;
+        }
+
+        size_t index = 0;
+        while (index < mPrefetchSlots.size()
+                && (mPrefetchSlots[index].mSeqNumber >= 0
+                    || mPrefetchSlots[index].mPending)) {
+            ++index;
+        }
+
+        if (index == mPrefetchSlots.size()) {
+            break;
+        }
+
+        int64_t rangeOffset, rangeLength;
+        if (!itemMeta->findInt64("range-offset", &rangeOffset)
+                || !itemMeta->findInt64("range-length", &rangeLength)) {
+            rangeOffset = 0;
+            rangeLength = -1;
+        }
+
+        // This also gets the key into mAESKeyForURI before it is needed.
+        AString method;
+        sp<ABuffer> key;
+        uint8_t iv[16];
+        if (getCipherParams(
+                    seqNumber - firstSeqNumberInPlaylist, seqNumber,
+                    &method, &key, iv) != OK) {
+            // onDownloadNext() reports the error once it gets here.
+            break;
+        }
+
+        ALOGV("prefetching segment %d", seqNumber);
+
+        PrefetchSlot *slot = &mPrefetchSlots.editItemAt(index);
+        slot->mSeqNumber = seqNumber;
+        slot->mURI = uri;
+        slot->mPending = true;
+
+        sp<AMessage> notify = new AMessage(kWhatPrefetched, id());
+        notify->setSize("slot", index);
+        notify->setInt32("seqNumber", seqNumber);
+        slot->mDownloader->downloadAsync(
+                notify, uri.c_str(), rangeOffset, rangeLength,
+                key /* NULL unless AES-128 */, iv);
+    }
+}
+
+ssize_t PlaylistFetcher::findPrefetchSlot(
+        int32_t seqNumber, const AString &uri) const {
+    for (size_t i = 0; i < mPrefetchSlots.size(); ++i) {
+        const PrefetchSlot &slot = mPrefetchSlots.itemAt(i);
+        if (slot.mSeqNumber == seqNumber && slot.mURI == uri) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void PlaylistFetcher::releasePrefetchSlot(PrefetchSlot *slot) {
+    if (slot->mPending) {
+        // The slot stays busy until the download has been abandoned.
+        slot->mDownloader->cancel();
+    }
+
+    slot->mSeqNumber = -1;
+    slot->mURI.clear();
+    slot->mBuffer.clear();
+}
+
+void PlaylistFetcher::onSegmentPrefetched(const sp<AMessage> &msg) {
+    size_t index;
+    int32_t seqNumber;
+    int32_t err;
+    int64_t durationUs;
+    CHECK(msg->findSize("slot", &index));
+    CHECK(msg->findInt32("seqNumber", &seqNumber));
+    CHECK(msg->findInt32("err", &err));
+    CHECK(msg->findInt64("durationUs", &durationUs));
+
+    PrefetchSlot *slot = &mPrefetchSlots.editItemAt(index);
+    slot->mPending = false;
+
+    if (slot->mSeqNumber != seqNumber) {
+        // Released while the download was in flight.
+        return;
+    }
+
+    if (err == OK) {
+        CHECK(msg->findBuffer("buffer", &slot->mBuffer));
+
+        ALOGV("prefetched segment %d, %zu bytes in %" PRId64 " us",
+              seqNumber, slot->mBuffer->size(), durationUs);
+
+        // Make the throughput of the extra connections count towards the
+        // session's bandwidth estimate.
+        mSession->mHTTPDataSource->addBandwidthMeasurement(
+                slot->mBuffer->size(), durationUs);
+    } else {
+        ALOGW("failed to prefetch segment %d (err %d), will fetch it again",
+              seqNumber, err);
+
+        releasePrefetchSlot(slot);
+    }
+
+    if (mWaitingForPrefetch && seqNumber == mSeqNumber) {
+        mWaitingForPrefetch = false;
+        postMonitorQueue();
+    }
+}
+
 int32_t PlaylistFetcher::getSeqNumberWithAnchorTime(int64_t anchorTimeUs) const {
     int32_t firstSeqNumberInPlaylist, lastSeqNumberInPlaylist;
     if (mPlaylist->meta() == NULL
@@ -1139,24 +1394,7 @@ int32_t PlaylistFetcher::getSeqNumberForTime(int64_t timeUs) const {
         firstSeqNumberInPlaylist = 0;
     }
 
-    size_t index = 0;
-    int64_t segmentStartUs = 0;
-    while (index < mPlaylist->size()) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        if (timeUs < segmentStartUs + itemDurationUs) {
-            break;
-        }
-
-        segmentStartUs += itemDurationUs;
-        ++index;
-    }
-
+    size_t index = mPlaylist->getItemIndexForTime(timeUs);
     if (index >= mPlaylist->size()) {
         index = mPlaylist->size() - 1;
     }
@@ -1206,20 +1444,16 @@ status_t PlaylistFetcher::extractAndQueueAccessUnitsFromTs(const sp<ABuffer> &bu
         mFirstPTSValid = false;
     }
 
-    size_t offset = 0;
-    while (offset + 188 <= buffer->size()) {
-        status_t err = mTSParser->feedTSPacket(buffer->data() + offset, 188);
-
-        if (err != OK) {
-            return err;
-        }
+    size_t offset = buffer->size() - buffer->size() % 188;
+    status_t err = mTSParser->feedTSPackets(buffer->data(), offset);
 
-        offset += 188;
+    if (err != OK) {
+        return err;
     }
+
     // setRange to indicate consumed bytes.
     buffer->setRange(buffer->offset() + offset, buffer->size() - offset);
 
-    status_t err = OK;
     // During SEEK video always starts from closest preceding IDR frame
     // Adjust mStartTimeUs( seek time ) to lastIDRTimeUs so that audio
     // also starts from same time.
@@ -1393,6 +1627,7 @@ status_t PlaylistFetcher::extractAndQueueAccessUnitsFromTs(const sp<ABuffer> &bu
                         || (discontinuitySeq == mDiscontinuitySeq
                                 && timeUs >= stopTimeUs)) {
                     packetSource->queueAccessUnit(mSession->createFormatChangeBuffer());
+                    packetSource->unbindProducer();
                     mStreamTypeMask &= ~stream;
                     mPacketSources.removeItemsAt(i);
                     break;
@@ -1671,6 +1906,7 @@ status_t PlaylistFetcher::extractAndQueueAccessUnits(
                     || (discontinuitySeq == mDiscontinuitySeq && unitTimeUs >= stopTimeUs)) {
                 packetSource->queueAccessUnit(mSession->createFormatChangeBuffer());
                 mStreamTypeMask = 0;
+                unbindPacketSources();
                 mPacketSources.clear();
                 return ERROR_OUT_OF_RANGE;
             }
@@ -1688,17 +1924,7 @@ status_t PlaylistFetcher::extractAndQueueAccessUnits(
 }
 
 void PlaylistFetcher::updateDuration() {
-    int64_t durationUs = 0ll;
-    for (size_t index = 0; index < mPlaylist->size(); ++index) {
-        sp<AMessage> itemMeta;
-        CHECK(mPlaylist->itemAt(
-                    index, NULL /* uri */, &itemMeta));
-
-        int64_t itemDurationUs;
-        CHECK(itemMeta->findInt64("durationUs", &itemDurationUs));
-
-        durationUs += itemDurationUs;
-    }
+    int64_t durationUs = mPlaylist->getTotalDurationUs();
 
     sp<AMessage> msg = mNotify->dup();
     msg->setInt32("what", kWhatDurationUpdate);
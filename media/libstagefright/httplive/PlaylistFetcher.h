@@ -21,16 +21,19 @@
 #include <media/stagefright/foundation/AHandler.h>
 
 #include "mpeg2ts/ATSParser.h"
+#include "AES128Decryptor.h"
 #include "LiveSession.h"
 
 namespace android {
 
 struct ABuffer;
+struct ALooper;
 struct AnotherPacketSource;
 struct DataSource;
 struct HTTPBase;
 struct LiveDataSource;
 struct M3UParser;
+struct SegmentDownloader;
 struct String8;
 
 struct PlaylistFetcher : public AHandler {
@@ -83,7 +86,9 @@ protected:
 
 private:
     enum {
-        kMaxNumRetries         = 5,
+        kMaxNumRetries          = 5,
+        kNumPrefetchSegments    = 2,
+        kMaxNumPrefetchSegments = 8,
     };
 
     enum {
@@ -93,6 +98,7 @@ private:
         kWhatMonitorQueue   = 'moni',
         kWhatResumeUntil    = 'rsme',
         kWhatDownloadNext   = 'dlnx',
+        kWhatPrefetched     = 'pfch',
     };
 
     static const int64_t kMaxMonitorDelayUs;
@@ -149,21 +155,44 @@ private:
 
     sp<ATSParser> mTSParser;
 
+    // Segments following the one being downloaded are fetched ahead of time,
+    // each over a connection of its own.
+    struct PrefetchSlot {
+        sp<ALooper> mLooper;
+        sp<SegmentDownloader> mDownloader;
+        int32_t mSeqNumber;     // -1 if the slot is free
+        AString mURI;
+        bool mPending;          // a download is in flight
+        sp<ABuffer> mBuffer;    // the segment, once downloaded
+    };
+    size_t mNumPrefetchSegments;
+    Vector<PrefetchSlot> mPrefetchSlots;
+    bool mWaitingForPrefetch;
+
     bool mFirstPTSValid;
     uint64_t mFirstPTS;
     int64_t mFirstTimeUs;
     int64_t mAbsoluteTimeAnchorUs;
     sp<AnotherPacketSource> mVideoBuffer;
 
-    // Stores the initialization vector to decrypt the next block of cipher text, which can
-    // either be derived from the sequence number, read from the manifest, or copied from
-    // the last block of cipher text (cipher-block chaining).
-    unsigned char mAESInitVec[16];
+    // Cipher method and AES state of the segment being decrypted. The
+    // decryptor carries the cipher-block chaining from one call to
+    // decryptBuffer to the next.
+    AString mCipherMethod;
+    AES128Decryptor mDecryptor;
+
+    // Determines how the segment at playlistIndex is encrypted: the cipher
+    // method and, for AES-128, the key (fetched unless cached) and the
+    // initialization vector, which is either read from the manifest or
+    // derived from the sequence number.
+    status_t getCipherParams(
+            size_t playlistIndex, int32_t seqNumber,
+            AString *method, sp<ABuffer> *key, uint8_t *iv);
 
     // Set first to true if decrypting the first segment of a playlist segment. When
-    // first is true, reset the initialization vector based on the available
-    // information in the manifest; otherwise, use the initialization vector as
-    // updated by the last call to AES_cbc_encrypt.
+    // first is true, look up the cipher method and key and reset the initialization
+    // vector based on the available information in the manifest; otherwise, continue
+    // the cipher block chain where the previous call left off.
     //
     // For the input to decrypt correctly, decryptBuffer must be called on
     // consecutive byte ranges on block boundaries, e.g. 0..15, 16..47, 48..63,
@@ -186,9 +215,20 @@ private:
     status_t onStart(const sp<AMessage> &msg);
     void onPause();
     void onStop(const sp<AMessage> &msg);
+
+    // Access units are no longer queued to the packet sources from this
+    // fetcher's looper, see AnotherPacketSource::bindProducer().
+    void unbindPacketSources();
+
     void onMonitorQueue();
     void onDownloadNext();
 
+    void startPrefetching(
+            int32_t firstSeqNumberInPlaylist, int32_t lastSeqNumberInPlaylist);
+    ssize_t findPrefetchSlot(int32_t seqNumber, const AString &uri) const;
+    void releasePrefetchSlot(PrefetchSlot *slot);
+    void onSegmentPrefetched(const sp<AMessage> &msg);
+
     // Resume a fetcher to continue until the stopping point stored in msg.
     status_t onResumeUntil(const sp<AMessage> &msg);
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SegmentDownloader"
+#include <utils/Log.h>
+
+#include "SegmentDownloader.h"
+
+#include "AES128Decryptor.h"
+#include "LiveSession.h"
+#include "PlaylistFetcher.h"
+
+#include "include/HTTPBase.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include <inttypes.h>
+
+namespace android {
+
+SegmentDownloader::SegmentDownloader(
+        const sp<LiveSession> &session,
+        const sp<HTTPBase> &httpDataSource)
+    : mSession(session),
+      mHTTPDataSource(httpDataSource),
+      mGeneration(0) {
+}
+
+SegmentDownloader::~SegmentDownloader() {
+}
+
+void SegmentDownloader::downloadAsync(
+        const sp<AMessage> &notify,
+        const char *uri,
+        int64_t rangeOffset,
+        int64_t rangeLength,
+        const sp<ABuffer> &key,
+        const uint8_t *iv) {
+    sp<AMessage> msg = new AMessage(kWhatDownload, id());
+    msg->setMessage("notify", notify);
+    msg->setString("uri", uri);
+    msg->setInt64("rangeOffset", rangeOffset);
+    msg->setInt64("rangeLength", rangeLength);
+
+    if (key != NULL) {
+        CHECK_EQ(key->size(), 16u);
+        CHECK(iv != NULL);
+
+        sp<ABuffer> ivBuffer = new ABuffer(16);
+        memcpy(ivBuffer->data(), iv, 16);
+
+        msg->setBuffer("key", key);
+        msg->setBuffer("iv", ivBuffer);
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    msg->setInt32("generation", mGeneration);
+    msg->post();
+}
+
+void SegmentDownloader::cancel() {
+    Mutex::Autolock autoLock(mLock);
+    ++mGeneration;
+}
+
+void SegmentDownloader::disconnect() {
+    cancel();
+    mHTTPDataSource->disconnect();
+}
+
+bool SegmentDownloader::isCancelled(int32_t generation) {
+    Mutex::Autolock autoLock(mLock);
+    return generation != mGeneration;
+}
+
+void SegmentDownloader::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatDownload:
+        {
+            onDownload(msg);
+            break;
+        }
+
+        default:
+            TRESPASS();
+    }
+}
+
+void SegmentDownloader::onDownload(const sp<AMessage> &msg) {
+    sp<AMessage> notify;
+    CHECK(msg->findMessage("notify", &notify));
+
+    AString uri;
+    int64_t rangeOffset, rangeLength;
+    int32_t generation;
+    CHECK(msg->findString("uri", &uri));
+    CHECK(msg->findInt64("rangeOffset", &rangeOffset));
+    CHECK(msg->findInt64("rangeLength", &rangeLength));
+    CHECK(msg->findInt32("generation", &generation));
+
+    sp<ABuffer> key, iv;
+    AES128Decryptor decryptor;
+    status_t err = OK;
+    if (msg->findBuffer("key", &key)) {
+        CHECK(msg->findBuffer("iv", &iv));
+        err = decryptor.init(key->data(), iv->data());
+    }
+
+    int64_t startTimeUs = ALooper::GetNowUs();
+
+    // Download block-wise, so that cancel() takes effect in a timely
+    // fashion even for large segments, and decryption keeps pace with the
+    // download.
+    sp<DataSource> source;
+    sp<ABuffer> buffer;
+    ssize_t bytesRead = 0;
+    while (err == OK) {
+        if (isCancelled(generation)) {
+            err = -ECANCELED;
+            break;
+        }
+
+        bytesRead = mSession->fetchFile(
+                uri.c_str(), &buffer, rangeOffset, rangeLength,
+                PlaylistFetcher::kDownloadBlockSize, &source,
+                NULL /* actualUrl */, mHTTPDataSource);
+
+        if (bytesRead < 0) {
+            err = bytesRead;
+            break;
+        }
+
+        if (bytesRead == 0) {
+            break;
+        }
+
+        if (key != NULL) {
+            if (bytesRead % 16) {
+                ALOGE("encrypted segment '%s' is not a multiple of 16 bytes.",
+                      uri.c_str());
+                err = ERROR_MALFORMED;
+                break;
+            }
+
+            err = decryptor.decrypt(
+                    buffer->data() + buffer->size() - bytesRead, bytesRead);
+        }
+    }
+
+    if (err != OK && source != NULL && source == mHTTPDataSource) {
+        // Don't leave a half read response behind.
+        mHTTPDataSource->disconnect();
+    }
+
+    int64_t durationUs = ALooper::GetNowUs() - startTimeUs;
+
+    ALOGV("downloaded '%s' (err %d, %zu bytes) in %" PRId64 " us",
+          uri.c_str(), err, buffer != NULL ? buffer->size() : 0, durationUs);
+
+    notify->setInt32("err", err);
+    if (err == OK) {
+        buffer->meta()->setString(
+                "cipher-method", key != NULL ? "AES-128" : "NONE");
+        notify->setBuffer("buffer", buffer);
+    }
+    notify->setInt64("durationUs", durationUs);
+    notify->post();
+}
+
+}  // namespace android
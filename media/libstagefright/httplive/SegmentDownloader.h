@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEGMENT_DOWNLOADER_H_
+
+#define SEGMENT_DOWNLOADER_H_
+
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/threads.h>
+
+namespace android {
+
+struct ABuffer;
+struct HTTPBase;
+struct LiveSession;
+
+// Downloads entire media segments on behalf of a PlaylistFetcher, using an
+// HTTP connection of its own so that several segments can be in flight at
+// the same time. Meant to run on a looper of its own, as the downloads
+// block.
+struct SegmentDownloader : public AHandler {
+    SegmentDownloader(
+            const sp<LiveSession> &session,
+            const sp<HTTPBase> &httpDataSource);
+
+    // Given a key, the segment is AES-128 decrypted (padding left in place)
+    // block by block as it arrives, starting with initialization vector "iv".
+    //
+    // Upon completion "notify" is posted with
+    //   "err"        status of the download, OK or an error
+    //   "buffer"     the downloaded data if err == OK, its "cipher-method"
+    //                meta data is set as by PlaylistFetcher::decryptBuffer
+    //   "durationUs" wall clock time the download took
+    void downloadAsync(
+            const sp<AMessage> &notify,
+            const char *uri,
+            int64_t rangeOffset = 0,
+            int64_t rangeLength = -1,
+            const sp<ABuffer> &key = NULL,
+            const uint8_t *iv = NULL);
+
+    // Abandons all downloads requested so far, they complete with
+    // -ECANCELED as soon as possible.
+    void cancel();
+
+    // Like cancel(), but also drops the connection, so that a download
+    // blocked on the network fails right away rather than once the read
+    // returns. Called on the owner's thread, before stopping the looper.
+    void disconnect();
+
+protected:
+    virtual ~SegmentDownloader();
+    virtual void onMessageReceived(const sp<AMessage> &msg);
+
+private:
+    enum {
+        kWhatDownload = 'dnld',
+    };
+
+    sp<LiveSession> mSession;
+    sp<HTTPBase> mHTTPDataSource;
+
+    Mutex mLock;
+    int32_t mGeneration;
+
+    bool isCancelled(int32_t generation);
+
+    void onDownload(const sp<AMessage> &msg);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentDownloader);
+};
+
+}  // namespace android
+
+#endif  // SEGMENT_DOWNLOADER_H_
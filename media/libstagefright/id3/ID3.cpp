@@ -30,6 +30,14 @@ namespace android {
 
 static const size_t kMaxMetadataSize = 3 * 1024 * 1024;
 
+// Tags indexed in place are never loaded, but every frame header is a read,
+// give up on (and fall back to loading) tags made of suspiciously many.
+static const size_t kMaxNumIndexedFrames = 1024;
+
+// How much of a picture frame to read at first to find where its header
+// (mime type and description) ends and the picture begins.
+static const size_t kPictureHeaderReadSize = 256;
+
 struct MemorySource : public DataSource {
     MemorySource(const uint8_t *data, size_t size)
         : mData(data),
@@ -62,8 +70,11 @@ ID3::ID3(const sp<DataSource> &source, bool ignoreV1, off64_t offset)
       mSize(0),
       mFirstFrameOffset(0),
       mVersion(ID3_UNKNOWN),
-      mRawSize(0) {
-    mIsValid = parseV2(source, offset);
+      mRawSize(0),
+      mIndexed(false),
+      mAlbumArt(NULL),
+      mAlbumArtLength(0) {
+    mIsValid = parseV2(source, offset, true /* inPlace */);
 
     if (!mIsValid && !ignoreV1) {
         mIsValid = parseV1(source);
@@ -76,13 +87,17 @@ ID3::ID3(const uint8_t *data, size_t size, bool ignoreV1)
       mSize(0),
       mFirstFrameOffset(0),
       mVersion(ID3_UNKNOWN),
-      mRawSize(0) {
+      mRawSize(0),
+      mIndexed(false),
+      mAlbumArt(NULL),
+      mAlbumArtLength(0) {
     sp<MemorySource> source = new (std::nothrow) MemorySource(data, size);
 
     if (source == NULL)
         return;
 
-    mIsValid = parseV2(source, 0);
+    // The tag is in memory already, indexing it would only copy it around.
+    mIsValid = parseV2(source, 0, false /* inPlace */);
 
     if (!mIsValid && !ignoreV1) {
         mIsValid = parseV1(source);
@@ -94,6 +109,11 @@ ID3::~ID3() {
         free(mData);
         mData = NULL;
     }
+
+    if (mAlbumArt) {
+        free(mAlbumArt);
+        mAlbumArt = NULL;
+    }
 }
 
 bool ID3::isValid() const {
@@ -118,7 +138,7 @@ bool ID3::ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x) {
     return true;
 }
 
-bool ID3::parseV2(const sp<DataSource> &source, off64_t offset) {
+bool ID3::parseV2(const sp<DataSource> &source, off64_t offset, bool inPlace) {
 struct id3_header {
     char id[3];
     uint8_t version_major;
@@ -169,11 +189,33 @@ struct id3_header {
         return false;
     }
 
+    Version version;
+    if (header.version_major == 2) {
+        version = ID3_V2_2;
+    } else if (header.version_major == 3) {
+        version = ID3_V2_3;
+    } else {
+        version = ID3_V2_4;
+    }
+
     size_t size;
     if (!ParseSyncsafeInteger(header.enc_size, &size)) {
         return false;
     }
 
+    if (inPlace && !(header.flags & 0x80)
+            && indexV2(source, offset + sizeof(header), version,
+                       header.flags, size)) {
+        mIndexed = true;
+        mSource = source;
+        mRawSize = size + sizeof(header);
+        mVersion = version;
+
+        return true;
+    }
+
+    mFrames.clear();
+
     if (size > kMaxMetadataSize) {
         ALOGE("skipping huge ID3 metadata of size %zu", size);
         return false;
@@ -315,13 +357,129 @@ struct id3_header {
         mFirstFrameOffset = ext_size;
     }
 
-    if (header.version_major == 2) {
-        mVersion = ID3_V2_2;
-    } else if (header.version_major == 3) {
-        mVersion = ID3_V2_3;
-    } else {
-        CHECK_EQ(header.version_major, 4);
-        mVersion = ID3_V2_4;
+    mVersion = version;
+
+    return true;
+}
+
+// Indexes the frames of the |size| bytes of tag following the header at
+// |offset| without loading them, mirroring what findFrame makes of a
+// loaded tag. Fails if the tag has to be loaded after all, i.e. if any
+// frame is unsynchronized or carries a data length indicator, or if the
+// frame sizes don't add up (which loading may fix with the iTunes hack).
+bool ID3::indexV2(
+        const sp<DataSource> &source, off64_t offset, Version version,
+        uint8_t flags, size_t size) {
+    uint8_t buffer[10];
+    size_t frameOffset = 0;
+
+    if (version == ID3_V2_3 && (flags & 0x40)) {
+        if (size < 4 || source->readAt(offset, buffer, 4) != 4) {
+            return false;
+        }
+
+        size_t extendedHeaderSize = U32_AT(buffer);
+        if (extendedHeaderSize > size - 4) {
+            return false;
+        }
+        extendedHeaderSize += 4;
+
+        if (extendedHeaderSize >= 10) {
+            if (source->readAt(offset, buffer, 10) != 10) {
+                return false;
+            }
+
+            size_t paddingSize = U32_AT(&buffer[6]);
+            if (paddingSize > size - extendedHeaderSize) {
+                return false;
+            }
+
+            size -= paddingSize;
+        }
+
+        frameOffset = extendedHeaderSize;
+    } else if (version == ID3_V2_4 && (flags & 0x40)) {
+        if (size < 4 || source->readAt(offset, buffer, 4) != 4) {
+            return false;
+        }
+
+        size_t ext_size;
+        if (!ParseSyncsafeInteger(buffer, &ext_size)
+                || ext_size < 6 || ext_size > size) {
+            return false;
+        }
+
+        frameOffset = ext_size;
+    }
+
+    size_t idLength = (version == ID3_V2_2) ? 3 : 4;
+    size_t headerLength = (version == ID3_V2_2) ? 6 : 10;
+
+    while (size >= headerLength && frameOffset <= size - headerLength) {
+        if (source->readAt(offset + frameOffset, buffer, headerLength)
+                != (ssize_t)headerLength) {
+            return false;
+        }
+
+        if (!memcmp(buffer, "\0\0\0\0", idLength)) {
+            break;
+        }
+
+        size_t dataSize;
+        uint16_t frameFlags = 0;
+        if (version == ID3_V2_2) {
+            dataSize = (buffer[3] << 16) | (buffer[4] << 8) | buffer[5];
+        } else if (version == ID3_V2_3) {
+            dataSize = U32_AT(&buffer[4]);
+            frameFlags = U16_AT(&buffer[8]);
+        } else {
+            if (!ParseSyncsafeInteger(&buffer[4], &dataSize)) {
+                return false;
+            }
+            frameFlags = U16_AT(&buffer[8]);
+
+            if (frameFlags & 3) {
+                // Per-frame unsynchronization or data length indicator.
+                return false;
+            }
+        }
+
+        if (dataSize > size - headerLength - frameOffset) {
+            if (version == ID3_V2_4) {
+                return false;
+            }
+
+            ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
+                  frameOffset, dataSize, size - frameOffset - headerLength);
+            break;
+        }
+
+        if (version != ID3_V2_2 && dataSize == 0) {
+            // Skip frames without data, see findFrame.
+            frameOffset += headerLength;
+            continue;
+        }
+
+        if ((version == ID3_V2_4 && (frameFlags & 0x000c))
+                || (version == ID3_V2_3 && (frameFlags & 0x00c0))) {
+            ALOGV("Skipping unsupported frame (compression or encryption)");
+
+            frameOffset += headerLength + dataSize;
+            continue;
+        }
+
+        if (mFrames.size() >= kMaxNumIndexedFrames) {
+            return false;
+        }
+
+        FrameInfo info;
+        memcpy(info.mID, buffer, idLength);
+        info.mID[idLength] = '\0';
+        info.mOffset = offset + frameOffset + headerLength;
+        info.mSize = dataSize;
+        mFrames.push(info);
+
+        frameOffset += headerLength + dataSize;
     }
 
     return true;
@@ -418,7 +576,9 @@ ID3::Iterator::Iterator(const ID3 &parent, const char *id)
     : mParent(parent),
       mID(NULL),
       mOffset(mParent.mFirstFrameOffset),
+      mIndex(0),
       mFrameData(NULL),
+      mBuffer(NULL),
       mFrameSize(0) {
     if (id) {
         mID = strdup(id);
@@ -432,18 +592,31 @@ ID3::Iterator::~Iterator() {
         free(mID);
         mID = NULL;
     }
+
+    if (mBuffer) {
+        free(mBuffer);
+        mBuffer = NULL;
+    }
 }
 
 bool ID3::Iterator::done() const {
+    if (mParent.mIndexed) {
+        return mIndex >= mParent.mFrames.size();
+    }
+
     return mFrameData == NULL;
 }
 
 void ID3::Iterator::next() {
-    if (mFrameData == NULL) {
+    if (done()) {
         return;
     }
 
-    mOffset += mFrameSize;
+    if (mParent.mIndexed) {
+        ++mIndex;
+    } else {
+        mOffset += mFrameSize;
+    }
 
     findFrame();
 }
@@ -451,11 +624,13 @@ void ID3::Iterator::next() {
 void ID3::Iterator::getID(String8 *id) const {
     id->setTo("");
 
-    if (mFrameData == NULL) {
+    if (done()) {
         return;
     }
 
-    if (mParent.mVersion == ID3_V2_2) {
+    if (mParent.mIndexed) {
+        id->setTo(mParent.mFrames.itemAt(mIndex).mID);
+    } else if (mParent.mVersion == ID3_V2_2) {
         id->setTo((const char *)&mParent.mData[mOffset], 3);
     } else if (mParent.mVersion == ID3_V2_3 || mParent.mVersion == ID3_V2_4) {
         id->setTo((const char *)&mParent.mData[mOffset], 4);
@@ -642,7 +817,11 @@ void ID3::Iterator::getstring(String8 *id, bool otherdata) const {
 const uint8_t *ID3::Iterator::getData(size_t *length) const {
     *length = 0;
 
-    if (mFrameData == NULL) {
+    if (done()) {
+        return NULL;
+    }
+
+    if (mFrameData == NULL && !readFrameData()) {
         return NULL;
     }
 
@@ -651,6 +830,34 @@ const uint8_t *ID3::Iterator::getData(size_t *length) const {
     return mFrameData;
 }
 
+// Reads the current frame of an indexed tag, nul-terminated the way the
+// string parsing expects of a frame followed by the rest of the tag.
+bool ID3::Iterator::readFrameData() const {
+    CHECK(mParent.mIndexed);
+
+    const FrameInfo &info = mParent.mFrames.itemAt(mIndex);
+
+    mBuffer = (uint8_t *)malloc(info.mSize + 2);
+    if (mBuffer == NULL) {
+        return false;
+    }
+
+    if (mParent.mSource->readAt(info.mOffset, mBuffer, info.mSize)
+            != (ssize_t)info.mSize) {
+        free(mBuffer);
+        mBuffer = NULL;
+
+        return false;
+    }
+
+    mBuffer[info.mSize] = '\0';
+    mBuffer[info.mSize + 1] = '\0';
+
+    mFrameData = mBuffer;
+
+    return true;
+}
+
 size_t ID3::Iterator::getHeaderLength() const {
     if (mParent.mVersion == ID3_V2_2) {
         return 6;
@@ -663,6 +870,28 @@ size_t ID3::Iterator::getHeaderLength() const {
 }
 
 void ID3::Iterator::findFrame() {
+    if (mParent.mIndexed) {
+        if (mBuffer) {
+            free(mBuffer);
+            mBuffer = NULL;
+        }
+        mFrameData = NULL;
+        mFrameSize = 0;
+
+        while (mIndex < mParent.mFrames.size()) {
+            const FrameInfo &info = mParent.mFrames.itemAt(mIndex);
+
+            if (!mID || !strcmp(info.mID, mID)) {
+                mFrameSize = getHeaderLength() + info.mSize;
+                return;
+            }
+
+            ++mIndex;
+        }
+
+        return;
+    }
+
     for (;;) {
         mFrameData = NULL;
         mFrameSize = 0;
@@ -832,20 +1061,77 @@ void ID3::Iterator::findFrame() {
     }
 }
 
-static size_t StringSize(const uint8_t *start, uint8_t encoding) {
+// Returns the size of the string at |start| including its termination, or
+// 0 if it isn't terminated within |size| bytes.
+static size_t StringSize(const uint8_t *start, size_t size, uint8_t encoding) {
     if (encoding == 0x00 || encoding == 0x03) {
         // ISO 8859-1 or UTF-8
-        return strlen((const char *)start) + 1;
+        const uint8_t *end = (const uint8_t *)memchr(start, '\0', size);
+        return end == NULL ? 0 : end - start + 1;
     }
 
     // UCS-2
-    size_t n = 0;
-    while (start[n] != '\0' || start[n + 1] != '\0') {
-        n += 2;
+    for (size_t n = 0; n + 1 < size; n += 2) {
+        if (start[n] == '\0' && start[n + 1] == '\0') {
+            // Add size of null termination.
+            return n + 2;
+        }
     }
 
-    // Add size of null termination.
-    return n + 2;
+    return 0;
+}
+
+// Parses the header of an APIC (PIC in version 2.2) frame, returns the
+// offset of the picture in the frame, 0 if the |size| bytes at |data| don't
+// hold all of the header or a negative value if the frame is bogus.
+static ssize_t ParsePictureHeader(
+        ID3::Version version, const uint8_t *data, size_t size, String8 *mime) {
+    if (version == ID3::ID3_V2_3 || version == ID3::ID3_V2_4) {
+        if (size < 2) {
+            return 0;
+        }
+
+        uint8_t encoding = data[0];
+        size_t mimeLen = StringSize(&data[1], size - 1, 0x00);
+        if (mimeLen == 0 || size - 1 - mimeLen < 1) {
+            return 0;
+        }
+
+        // Skip the picture type, front cover or not.
+        size_t descLen =
+            StringSize(&data[2 + mimeLen], size - 2 - mimeLen, encoding);
+        if (descLen == 0) {
+            return 0;
+        }
+
+        mime->setTo((const char *)&data[1]);
+
+        return 2 + mimeLen + descLen;
+    }
+
+    if (size < 5) {
+        return 0;
+    }
+
+    uint8_t encoding = data[0];
+
+    if (!memcmp(&data[1], "PNG", 3)) {
+        mime->setTo("image/png");
+    } else if (!memcmp(&data[1], "JPG", 3)) {
+        mime->setTo("image/jpeg");
+    } else if (!memcmp(&data[1], "-->", 3)) {
+        mime->setTo("text/plain");
+    } else {
+        return -1;
+    }
+
+    size_t descLen = StringSize(&data[5], size - 5, encoding);
+    if (descLen == 0) {
+        mime->setTo("");
+        return 0;
+    }
+
+    return 5 + descLen;
 }
 
 const void *
@@ -853,70 +1139,123 @@ ID3::getAlbumArt(size_t *length, String8 *mime) const {
     *length = 0;
     mime->setTo("");
 
+    if (mIndexed) {
+        // Read the picture alone, once.
+        if (mAlbumArt == NULL) {
+            off64_t offset;
+            size_t size;
+            String8 type;
+            if (!getAlbumArtRange(&offset, &size, &type)) {
+                return NULL;
+            }
+
+            mAlbumArt = (uint8_t *)malloc(size > 0 ? size : 1);
+            if (mAlbumArt == NULL) {
+                return NULL;
+            }
+
+            if (mSource->readAt(offset, mAlbumArt, size) != (ssize_t)size) {
+                free(mAlbumArt);
+                mAlbumArt = NULL;
+
+                return NULL;
+            }
+
+            mAlbumArtLength = size;
+            mAlbumArtMIME = type;
+        }
+
+        *length = mAlbumArtLength;
+        mime->setTo(mAlbumArtMIME);
+
+        return mAlbumArt;
+    }
+
     Iterator it(
             *this,
             (mVersion == ID3_V2_3 || mVersion == ID3_V2_4) ? "APIC" : "PIC");
 
-    while (!it.done()) {
-        size_t size;
-        const uint8_t *data = it.getData(&size);
+    if (it.done()) {
+        return NULL;
+    }
 
-        if (mVersion == ID3_V2_3 || mVersion == ID3_V2_4) {
-            uint8_t encoding = data[0];
-            mime->setTo((const char *)&data[1]);
-            size_t mimeLen = strlen((const char *)&data[1]) + 1;
+    size_t size;
+    const uint8_t *data = it.getData(&size);
+    if (data == NULL) {
+        return NULL;
+    }
 
-#if 0
-            uint8_t picType = data[1 + mimeLen];
-            if (picType != 0x03) {
-                // Front Cover Art
-                it.next();
-                continue;
-            }
-#endif
+    ssize_t pictureOffset = ParsePictureHeader(mVersion, data, size, mime);
+    if (pictureOffset <= 0) {
+        ALOGW("bogus album art sizes");
+        mime->setTo("");
+        return NULL;
+    }
 
-            size_t descLen = StringSize(&data[2 + mimeLen], encoding);
+    *length = size - pictureOffset;
 
-            if (size < 2 ||
-                    size - 2 < mimeLen ||
-                    size - 2 - mimeLen < descLen) {
-                ALOGW("bogus album art sizes");
-                return NULL;
+    return &data[pictureOffset];
+}
+
+bool ID3::getAlbumArtRange(
+        off64_t *offset, size_t *length, String8 *mime) const {
+    *offset = 0;
+    *length = 0;
+    mime->setTo("");
+
+    if (!mIndexed) {
+        return false;
+    }
+
+    const char *id =
+        (mVersion == ID3_V2_3 || mVersion == ID3_V2_4) ? "APIC" : "PIC";
+
+    for (size_t i = 0; i < mFrames.size(); ++i) {
+        const FrameInfo &info = mFrames.itemAt(i);
+        if (strcmp(info.mID, id)) {
+            continue;
+        }
+
+        // Only the header is read, more of it in the unlikely case the
+        // description doesn't fit.
+        size_t size = info.mSize;
+        if (size > kPictureHeaderReadSize) {
+            size = kPictureHeaderReadSize;
+        }
+
+        for (;;) {
+            uint8_t *data = (uint8_t *)malloc(size > 0 ? size : 1);
+            if (data == NULL) {
+                return false;
             }
-            *length = size - 2 - mimeLen - descLen;
 
-            return &data[2 + mimeLen + descLen];
-        } else {
-            uint8_t encoding = data[0];
-
-            if (!memcmp(&data[1], "PNG", 3)) {
-                mime->setTo("image/png");
-            } else if (!memcmp(&data[1], "JPG", 3)) {
-                mime->setTo("image/jpeg");
-            } else if (!memcmp(&data[1], "-->", 3)) {
-                mime->setTo("text/plain");
-            } else {
-                return NULL;
+            ssize_t pictureOffset = -1;
+            if (mSource->readAt(info.mOffset, data, size) == (ssize_t)size) {
+                pictureOffset = ParsePictureHeader(mVersion, data, size, mime);
             }
 
-#if 0
-            uint8_t picType = data[4];
-            if (picType != 0x03) {
-                // Front Cover Art
-                it.next();
-                continue;
+            free(data);
+            data = NULL;
+
+            if (pictureOffset > 0) {
+                *offset = info.mOffset + pictureOffset;
+                *length = info.mSize - pictureOffset;
+
+                return true;
             }
-#endif
 
-            size_t descLen = StringSize(&data[5], encoding);
+            if (pictureOffset < 0 || size == info.mSize) {
+                ALOGW("bogus album art sizes");
+                mime->setTo("");
 
-            *length = size - 5 - descLen;
+                return false;
+            }
 
-            return &data[5 + descLen];
+            size = (size > info.mSize / 4) ? info.mSize : size * 4;
         }
     }
 
-    return NULL;
+    return false;
 }
 
 bool ID3::parseV1(const sp<DataSource> &source) {
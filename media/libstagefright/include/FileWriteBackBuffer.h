@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILE_WRITE_BACK_BUFFER_H_
+
+#define FILE_WRITE_BACK_BUFFER_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Condition.h>
+#include <utils/Errors.h>
+#include <utils/List.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+// Buffers data appended sequentially to a file and writes it out from a
+// thread of its own, a few large writes at a time, so that whoever is
+// appending neither waits for the storage nor makes a system call per
+// sample. The data is copied, the caller's buffers can be reused as soon
+// as append() returns.
+//
+// The buffers are aligned and map to aligned file offsets. With direct
+// I/O, the aligned parts are written through a second description of the
+// file opened with O_DIRECT, only the unaligned edges go through the page
+// cache.
+//
+// Once started, and until stopped, all writes to the file must go through
+// the buffer: its thread owns the file position of |fd|.
+//
+// append(), overwrite(), push() and flush() must not be called
+// concurrently.
+struct FileWriteBackBuffer {
+    enum {
+        kAlignment = 4096,
+    };
+
+    // |fd| remains owned by the caller. At most |numBuffers| buffers of
+    // |bufferSize| bytes are allocated, as they are needed.
+    FileWriteBackBuffer(
+            int fd, size_t bufferSize, size_t numBuffers, bool directIO);
+
+    ~FileWriteBackBuffer();
+
+    // Appending starts at |offset|.
+    status_t start(off64_t offset);
+
+    // Writes out everything appended and stops the thread. Returns the
+    // first error any write ran into.
+    status_t stop();
+
+    // Copies |size| bytes to the end of the data appended so far, waits
+    // for a buffer to be written out if they are all in use.
+    void append(const void *data, size_t size);
+
+    // Replaces bytes that have already been appended.
+    void overwrite(off64_t offset, const void *data, size_t size);
+
+    // Hands the data appended so far to the thread to be written out,
+    // without waiting for it.
+    void push();
+
+    // Waits for all the data appended so far to be written out, returns
+    // the first error any write ran into.
+    status_t flush();
+
+    // The offset the next append() writes to.
+    off64_t offset() const { return mOffset; }
+
+    bool isStarted() const { return mStarted; }
+
+    // Whether the data is, or was until stopped, written with direct I/O.
+    bool isDirectIO() const { return mDirectIO; }
+
+    // Write and stall statistics, appended to the dumpsys output.
+    void dump(int fd) const;
+
+private:
+    enum {
+        kNumLatencyBuckets = 10,  // See kLatencyBucketEdgesUs
+    };
+
+    struct Buffer {
+        uint8_t *mData;
+        off64_t mOffset;  // File offset of mData[0], aligned
+        size_t mStart;    // First byte holding data
+        size_t mEnd;      // One past the last byte holding data
+    };
+
+    struct LatencyStats {
+        void add(int64_t latencyUs);
+        void dump(const char *name, int fd) const;
+
+        uint64_t mCount;
+        int64_t mTotalUs;
+        int64_t mMaxUs;
+        uint64_t mBuckets[kNumLatencyBuckets];
+    };
+
+    int mFd;
+    int mDirectFd;
+    size_t mBufferSize;
+    size_t mMaxNumBuffers;
+    bool mDirectIORequested;
+    bool mDirectIO;
+
+    mutable Mutex mLock;
+    Condition mQueueChanged;    // Signaled when buffers are queued
+    Condition mBufferWritten;   // Signaled when buffers are written out
+
+    List<Buffer *> mFreeBuffers;
+    List<Buffer *> mQueuedBuffers;
+    List<Buffer *> mWritingBuffers;  // By the thread, lock not held
+    size_t mNumBuffers;              // Allocated
+    Buffer *mCurrentBuffer;          // Being appended to, not queued
+    off64_t mOffset;
+
+    bool mStarted;
+    bool mDone;
+    status_t mError;
+    pthread_t mThread;
+
+    uint64_t mNumBytesWritten;
+    LatencyStats mWriteLatency;  // Of every write system call
+    LatencyStats mStallLatency;  // Of append() waiting for a buffer
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc();
+
+    Buffer *getFreeBuffer_l();
+    void queueCurrentBuffer_l();
+
+    // Writes out buffers queued in order, lock not held.
+    status_t writeBuffers(const List<Buffer *> &buffers);
+    status_t writeRange(
+            int fd, off64_t offset, struct iovec *iov, int iovcnt,
+            size_t size);
+    status_t writeEdge(off64_t offset, const uint8_t *data, size_t size);
+
+    DISALLOW_EVIL_CONSTRUCTORS(FileWriteBackBuffer);
+};
+
+}  // namespace android
+
+#endif  // FILE_WRITE_BACK_BUFFER_H_
@@ -19,11 +19,12 @@
 #define ID3_H_
 
 #include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 
 struct DataSource;
-struct String8;
 
 struct ID3 {
     enum Version {
@@ -45,6 +46,11 @@ struct ID3 {
 
     const void *getAlbumArt(size_t *length, String8 *mime) const;
 
+    // Locates the album art without reading it: on success the picture is
+    // the *length bytes at *offset in the DataSource the tag was parsed
+    // from. Only possible for tags indexed in place, see below.
+    bool getAlbumArtRange(off64_t *offset, size_t *length, String8 *mime) const;
+
     struct Iterator {
         Iterator(const ID3 &parent, const char *id);
         ~Iterator();
@@ -59,11 +65,14 @@ struct ID3 {
         const ID3 &mParent;
         char *mID;
         size_t mOffset;
+        size_t mIndex;
 
-        const uint8_t *mFrameData;
+        mutable const uint8_t *mFrameData;
+        mutable uint8_t *mBuffer;
         size_t mFrameSize;
 
         void findFrame();
+        bool readFrameData() const;
 
         size_t getHeaderLength() const;
         void getstring(String8 *s, bool secondhalf) const;
@@ -85,8 +94,28 @@ private:
     // only valid for IDV2+
     size_t mRawSize;
 
+    // Tags read from a DataSource that need no unsynchronization aren't
+    // loaded, their frames are indexed in place and read as they are
+    // asked for.
+    struct FrameInfo {
+        char mID[5];
+        off64_t mOffset;  // of the frame's data in mSource
+        size_t mSize;     // of the frame's data
+    };
+
+    bool mIndexed;
+    sp<DataSource> mSource;
+    Vector<FrameInfo> mFrames;
+
+    mutable uint8_t *mAlbumArt;
+    mutable size_t mAlbumArtLength;
+    mutable String8 mAlbumArtMIME;
+
     bool parseV1(const sp<DataSource> &source);
-    bool parseV2(const sp<DataSource> &source, off64_t offset);
+    bool parseV2(const sp<DataSource> &source, off64_t offset, bool inPlace);
+    bool indexV2(
+            const sp<DataSource> &source, off64_t offset, Version version,
+            uint8_t flags, size_t size);
     void removeUnsynchronization();
     bool removeUnsynchronizationV2_4(bool iTunesHack);
 
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMX_BUFFER_ID_MAP_H_
+
+#define OMX_BUFFER_ID_MAP_H_
+
+#include <media/IOMX.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Vector.h>
+
+#include <OMX_Core.h>
+
+namespace android {
+
+// Maps buffer ids handed out to IOMX clients to buffer headers in constant
+// time. The low bits of an id select a slot, the high bits hold the
+// generation of that slot, which changes whenever the slot is released, so
+// that ids of freed buffers are detected as stale even if their slot has
+// been reused since. Not thread safe, callers provide their own locking.
+struct OMXBufferIDMap {
+    OMXBufferIDMap();
+
+    // Returns 0 if all slots are in use.
+    IOMX::buffer_id add(OMX_BUFFERHEADERTYPE *header);
+
+    // Returns NULL for ids that were never handed out or have been removed.
+    OMX_BUFFERHEADERTYPE *find(IOMX::buffer_id buffer) const;
+
+    // Returns false if "buffer" is not a live id.
+    bool remove(IOMX::buffer_id buffer);
+
+    size_t size() const { return mNumUsedSlots; }
+
+    enum {
+        kSlotBits = 16,
+        kMaxSlots = (1u << kSlotBits) - 1,
+    };
+
+private:
+    struct Slot {
+        OMX_BUFFERHEADERTYPE *mHeader;
+        uint32_t mGeneration;
+    };
+
+    Vector<Slot> mSlots;
+    Vector<uint32_t> mFreeSlots;
+    size_t mNumUsedSlots;
+
+    // Returns the slot "buffer" refers to or -1 if it is not live.
+    ssize_t slotIndexFor(IOMX::buffer_id buffer) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(OMXBufferIDMap);
+};
+
+}  // namespace android
+
+#endif  // OMX_BUFFER_ID_MAP_H_
@@ -19,6 +19,7 @@
 #define OMX_NODE_INSTANCE_H_
 
 #include "OMX.h"
+#include "OMXBufferIDMap.h"
 
 #include <utils/RefBase.h>
 #include <utils/threads.h>
@@ -135,6 +136,10 @@ private:
     bool mDying;
     bool mIsSecure;
 
+    // Whether allocateBufferWithBackup() hands the client memory straight
+    // to the component instead of copying to and from a private buffer.
+    bool mZeroCopyBackup;
+
     // Lock only covers mGraphicBufferSource.  We can't always use mLock
     // because of rare instances where we'd end up locking it recursively.
     Mutex mGraphicBufferSourceLock;
@@ -147,11 +152,10 @@ private:
         OMX::buffer_id mID;
     };
     Vector<ActiveBuffer> mActiveBuffers;
-    // for buffer ptr to buffer id translation
+    // for buffer ptr to buffer id translation, the reverse direction goes
+    // through the BufferMeta in pAppPrivate
     Mutex mBufferIDLock;
-    uint32_t mBufferIDCount;
-    KeyedVector<OMX::buffer_id, OMX_BUFFERHEADERTYPE *> mBufferIDToBufferHeader;
-    KeyedVector<OMX_BUFFERHEADERTYPE *, OMX::buffer_id> mBufferHeaderToBufferID;
+    OMXBufferIDMap mBufferIDs;
 
     // For debug support
     char *mName;
@@ -162,6 +166,10 @@ private:
     int DEBUG_BUMP;
     SortedVector<OMX_BUFFERHEADERTYPE *> mInputBuffersWithCodec, mOutputBuffersWithCodec;
     size_t mDebugLevelBumpPendingBuffers[2];
+    size_t mNumZeroCopyBuffers;
+    size_t mNumBackupBuffers;
+    uint64_t mBytesCopiedToOMX;
+    uint64_t mBytesCopiedFromOMX;
     void bumpDebugLevel_l(size_t numInputBuffers, size_t numOutputBuffers);
     void unbumpDebugLevel_l(size_t portIndex);
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SOFT_AUDIO_BATCH_DECODER_H_
+
+#define SOFT_AUDIO_BATCH_DECODER_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// Direct, non-OMX entry point into the software audio decoders, meant for
+// offline work (media scanning, waveform generation, transcoding) where the
+// OMX buffer round trips dominate the cost of decoding a whole file.
+// A single decode() call consumes as many access units as fit into the
+// caller provided PCM buffer. The input format of each access unit is the
+// same the corresponding OMX component expects on its input port.
+struct SoftAudioBatchDecoder {
+    struct AccessUnit {
+        const uint8_t *mData;
+        size_t mSize;
+    };
+
+    // Loads the library backing the soft OMX component "name" (e.g.
+    // "OMX.google.mp3.decoder") and instantiates its batch decoder.
+    // Returns NULL if the component does not provide one.
+    static SoftAudioBatchDecoder *Create(const char *name);
+
+    // Destroys a decoder returned by Create() and unloads its library.
+    static void Destroy(SoftAudioBatchDecoder *decoder);
+
+    virtual status_t initCheck() const = 0;
+
+    // Codec specific data ("csd-0", "csd-1", ...) in the order they
+    // appear in the track format, before the first call to decode().
+    virtual status_t addCodecSpecificData(const uint8_t *data, size_t size) = 0;
+
+    // Decodes up to "numUnits" access units into "pcm" as interleaved
+    // 16-bit samples. Decoding stops early once the remaining space in
+    // "pcm" cannot hold the worst case output of another access unit.
+    // Returns OK if at least one access unit was consumed.
+    virtual status_t decode(
+            const AccessUnit *units, size_t numUnits,
+            int16_t *pcm, size_t pcmSize,
+            size_t *numUnitsConsumed, size_t *pcmBytesWritten) = 0;
+
+    // Largest amount of PCM data a single access unit can produce, only
+    // valid once the codec specific data has been supplied.
+    virtual size_t maxOutputSizePerUnit() const = 0;
+
+    virtual void getOutputFormat(
+            int32_t *numChannels, int32_t *sampleRate) const = 0;
+
+    // Drops all decoder state that depends on previously decoded data,
+    // e.g. after the caller seeks.
+    virtual void flush() = 0;
+
+protected:
+    SoftAudioBatchDecoder() : mLibHandle(NULL) {}
+    virtual ~SoftAudioBatchDecoder() {}
+
+private:
+    void *mLibHandle;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SoftAudioBatchDecoder);
+};
+
+}  // namespace android
+
+#endif  // SOFT_AUDIO_BATCH_DECODER_H_
@@ -27,6 +27,8 @@ namespace android {
 
 struct DataSource;
 class MediaExtractor;
+struct MediaSource;
+class MetaData;
 
 struct StagefrightMetadataRetriever : public MediaMetadataRetrieverInterface {
     StagefrightMetadataRetriever();
@@ -40,6 +42,17 @@ struct StagefrightMetadataRetriever : public MediaMetadataRetrieverInterface {
     virtual status_t setDataSource(int fd, int64_t offset, int64_t length);
 
     virtual VideoFrame *getFrameAtTime(int64_t timeUs, int option);
+
+    // Extracts a frame for each of |timesUs| (negative for the thumbnail
+    // time) with a single decoder, scaled down to fit within maxWidth x
+    // maxHeight if either is positive. |frames| is in the order of
+    // |timesUs|, with NULL for frames that couldn't be extracted, and is
+    // the caller's to free.
+    status_t getFramesAtTimes(
+            const Vector<int64_t> &timesUs, int option,
+            int32_t maxWidth, int32_t maxHeight,
+            Vector<VideoFrame *> *frames);
+
     virtual MediaAlbumArt *extractAlbumArt();
     virtual const char *extractMetadata(int keyCode);
 
@@ -54,6 +67,8 @@ private:
 
     void parseMetaData();
 
+    status_t getVideoTrack(sp<MetaData> *trackMeta, sp<MediaSource> *source);
+
     StagefrightMetadataRetriever(const StagefrightMetadataRetriever &);
 
     StagefrightMetadataRetriever &operator=(
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef START_CODE_SCANNER_H_
+
+#define START_CODE_SCANNER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+// Returns the offset of the first 0x00 0x00 0x01 sequence that lies
+// entirely within "data", -1 if there is none.
+ssize_t FindStartCode(const uint8_t *data, size_t size);
+
+// Returns the offset of the first 0xff byte followed by a byte "b" with
+// (b & mask) == value, i.e. the first candidate for an audio frame sync word
+// such as ADTS (mask 0xf6, value 0xf0) or MPEG audio (mask 0xe0,
+// value 0xe0). Returns -1 if there is none.
+ssize_t FindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value);
+
+// Byte at a time versions of the above, whatever the build target.
+ssize_t FindStartCodeScalar(const uint8_t *data, size_t size);
+
+ssize_t FindSyncWordScalar(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value);
+
+}  // namespace android
+
+#endif  // START_CODE_SCANNER_H_
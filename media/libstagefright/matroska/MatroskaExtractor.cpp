@@ -53,9 +53,24 @@ typedef struct {
     uint32_t biClrImportant;
 } BITMAPINFOHEADER;
 
+// mkvparser reads element headers a few bytes at a time, so reads are
+// served from a couple of windows into the file instead. BlockIterator has
+// the cluster it moves to read into a window as a whole, the other window
+// keeps serving the cluster another track's iterator is in. Caching data
+// sources keep the data in memory already, and reading ahead of what they
+// have would only block, so they're read from directly.
 struct DataSourceReader : public mkvparser::IMkvReader {
     DataSourceReader(const sp<DataSource> &source)
-        : mSource(source) {
+        : mSource(source),
+          mUseWindows(!(source->flags() & DataSource::kIsCachingDataSource)),
+          mUseCount(0) {
+    }
+
+    virtual ~DataSourceReader() {
+        for (size_t i = 0; i < kNumWindows; ++i) {
+            delete[] mWindows[i].mData;
+            mWindows[i].mData = NULL;
+        }
     }
 
     virtual int Read(long long position, long length, unsigned char* buffer) {
@@ -66,15 +81,58 @@ struct DataSourceReader : public mkvparser::IMkvReader {
             return 0;
         }
 
-        ssize_t n = mSource->readAt(position, buffer, length);
+        if (!mUseWindows || length >= kReadAheadSize) {
+            ssize_t n = mSource->readAt(position, buffer, length);
 
-        if (n <= 0) {
+            if (n <= 0) {
+                return -1;
+            }
+
+            return 0;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+
+        Window *window = findWindow_l(position, length);
+        if (window == NULL) {
+            window = fillWindow_l(position, kReadAheadSize);
+        }
+
+        if (window == NULL || position >= window->mOffset + window->mSize) {
             return -1;
         }
 
+        // Like a short read from the source, only the data up to the end
+        // of the file is returned.
+        size_t offset = position - window->mOffset;
+        size_t n = window->mSize - offset;
+        if (n > (size_t)length) {
+            n = length;
+        }
+        memcpy(buffer, window->mData + offset, n);
+
         return 0;
     }
 
+    // Reads "length" bytes at "position" into a window in one go, unless
+    // they're available already. Lengths that are unknown (negative) or
+    // too large are capped.
+    void prefetch(long long position, long long length) {
+        if (!mUseWindows) {
+            return;
+        }
+
+        if (length <= 0 || length > kMaxWindowSize) {
+            length = kMaxWindowSize;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+
+        if (findWindow_l(position, length) == NULL) {
+            fillWindow_l(position, length);
+        }
+    }
+
     virtual int Length(long long* total, long long* available) {
         off64_t size;
         if (mSource->getSize(&size) != OK) {
@@ -96,7 +154,76 @@ struct DataSourceReader : public mkvparser::IMkvReader {
     }
 
 private:
+    enum {
+        kNumWindows = 2,
+        kReadAheadSize = 32 * 1024,
+        kMaxWindowSize = 1024 * 1024,
+    };
+
+    struct Window {
+        Window()
+            : mData(NULL),
+              mCapacity(0),
+              mOffset(0),
+              mSize(0),
+              mLastUsed(0) {
+        }
+
+        uint8_t *mData;
+        size_t mCapacity;
+        off64_t mOffset;
+        size_t mSize;
+        uint32_t mLastUsed;
+    };
+
     sp<DataSource> mSource;
+    bool mUseWindows;
+
+    Mutex mLock;
+    Window mWindows[kNumWindows];
+    uint32_t mUseCount;
+
+    Window *findWindow_l(long long position, long long length) {
+        for (size_t i = 0; i < kNumWindows; ++i) {
+            Window *window = &mWindows[i];
+            if (position >= window->mOffset
+                    && position + length <= window->mOffset + (off64_t)window->mSize) {
+                window->mLastUsed = ++mUseCount;
+                return window;
+            }
+        }
+
+        return NULL;
+    }
+
+    Window *fillWindow_l(long long position, size_t length) {
+        Window *window = &mWindows[0];
+        for (size_t i = 1; i < kNumWindows; ++i) {
+            if (mWindows[i].mLastUsed < window->mLastUsed) {
+                window = &mWindows[i];
+            }
+        }
+
+        if (window->mCapacity < length) {
+            delete[] window->mData;
+            window->mData = new uint8_t[length];
+            window->mCapacity = length;
+        }
+
+        window->mOffset = position;
+        window->mSize = 0;
+        window->mLastUsed = ++mUseCount;
+
+        ssize_t n = mSource->readAt(position, window->mData, length);
+
+        if (n <= 0) {
+            return NULL;
+        }
+
+        window->mSize = n;
+
+        return window;
+    }
 
     DataSourceReader(const DataSourceReader &);
     DataSourceReader &operator=(const DataSourceReader &);
@@ -129,6 +256,11 @@ private:
     long mBlockEntryIndex;
 
     void advance_l();
+    void prefetchCluster_l();
+    void seekToKeyFrame_l(
+            int64_t seekTimeUs, bool isAudio, int64_t *actualFrameTimeUs);
+    void seekToPrecedingKeyFrame_l(
+            int64_t seekTimeUs, int64_t *actualFrameTimeUs);
 
     BlockIterator(const BlockIterator &);
     BlockIterator &operator=(const BlockIterator &);
@@ -377,6 +509,7 @@ void BlockIterator::advance_l() {
             CHECK(!nextCluster->EOS());
 
             mCluster = nextCluster;
+            prefetchCluster_l();
 
             res = mCluster->Parse(pos, len);
             ALOGV("Parse (2) returned %ld", res);
@@ -396,12 +529,20 @@ void BlockIterator::advance_l() {
     }
 }
 
+void BlockIterator::prefetchCluster_l() {
+    if (mCluster != NULL && !mCluster->EOS()) {
+        mExtractor->mReader->prefetch(
+                mCluster->m_element_start, mCluster->GetElementSize());
+    }
+}
+
 void BlockIterator::reset() {
     Mutex::Autolock autoLock(mExtractor->mLock);
 
     mCluster = mExtractor->mSegment->GetFirst();
     mBlockEntry = NULL;
     mBlockEntryIndex = 0;
+    prefetchCluster_l();
 
     do {
         advance_l();
@@ -425,6 +566,7 @@ void BlockIterator::seek(
         ALOGV("Seek to beginning: %" PRId64, seekTimeUs);
         mCluster = pSegment->GetFirst();
         mBlockEntryIndex = 0;
+        prefetchCluster_l();
         do {
             advance_l();
         } while (!eos() && block()->GetTrackNumber() != mTrackNum);
@@ -452,14 +594,27 @@ void BlockIterator::seek(
                 break;
             }
         }
+    }
 
-        if (!pCues) {
-            ALOGE("No Cues in file");
+    if (!pCues) {
+        // Find the cluster to start from through the index of clusters
+        // built up as seeking needed them instead.
+        ALOGV("No Cues in file, seeking by cluster");
+
+        mCluster = mExtractor->findClusterForTime_l(seekTimeNs);
+        if (mCluster == NULL) {
+            ALOGE("Did not locate a cluster for seeking");
             return;
         }
-    }
-    else if (!pSH) {
-        ALOGE("No SeekHead");
+
+        prefetchCluster_l();
+        mBlockEntryIndex = 0;
+
+        if (isAudio) {
+            seekToKeyFrame_l(seekTimeUs, isAudio, actualFrameTimeUs);
+        } else {
+            seekToPrecedingKeyFrame_l(seekTimeUs, actualFrameTimeUs);
+        }
         return;
     }
 
@@ -514,10 +669,20 @@ void BlockIterator::seek(
     CHECK(mCluster);
     CHECK(!mCluster->EOS());
 
+    prefetchCluster_l();
+
     // mBlockEntryIndex starts at 0 but m_block starts at 1
     CHECK_GT(pTP->m_block, 0);
     mBlockEntryIndex = pTP->m_block - 1;
 
+    seekToKeyFrame_l(seekTimeUs, isAudio, actualFrameTimeUs);
+}
+
+void BlockIterator::seekToKeyFrame_l(
+        int64_t seekTimeUs, bool isAudio, int64_t *actualFrameTimeUs) {
+    const mkvparser::Track *thisTrack =
+        mExtractor->mSegment->GetTracks()->GetTrackByNumber(mTrackNum);
+
     for (;;) {
         advance_l();
 
@@ -536,6 +701,59 @@ void BlockIterator::seek(
     }
 }
 
+// A cluster may hold several GOPs: scan up to the first block past the
+// seek point and go back to the last key frame before it. If there is
+// none, e.g. the GOP started in the previous cluster, settle for the
+// first key frame after it.
+void BlockIterator::seekToPrecedingKeyFrame_l(
+        int64_t seekTimeUs, int64_t *actualFrameTimeUs) {
+    const mkvparser::Cluster *keyCluster = NULL;
+    const mkvparser::BlockEntry *keyBlockEntry = NULL;
+    long keyBlockEntryIndex = 0;
+    int64_t keyFrameTimeUs = -1ll;
+
+    for (;;) {
+        advance_l();
+
+        if (eos()) break;
+
+        int64_t frameTimeUs = blockTimeUs();
+        if (frameTimeUs > seekTimeUs && keyCluster != NULL) {
+            break;
+        }
+
+        if (block()->IsKey()) {
+            if (frameTimeUs > seekTimeUs) {
+                *actualFrameTimeUs = frameTimeUs;
+                ALOGV("Requested seek point: %" PRId64 " actual: %" PRId64,
+                      seekTimeUs, *actualFrameTimeUs);
+                return;
+            }
+
+            keyCluster = mCluster;
+            keyBlockEntry = mBlockEntry;
+            keyBlockEntryIndex = mBlockEntryIndex;
+            keyFrameTimeUs = frameTimeUs;
+        }
+    }
+
+    if (keyCluster == NULL) {
+        return;
+    }
+
+    // Back to where advance_l() left off after the key frame.
+    if (mCluster != keyCluster) {
+        mCluster = keyCluster;
+        prefetchCluster_l();
+    }
+    mBlockEntry = keyBlockEntry;
+    mBlockEntryIndex = keyBlockEntryIndex;
+
+    *actualFrameTimeUs = keyFrameTimeUs;
+    ALOGV("Requested seek point: %" PRId64 " actual: %" PRId64,
+          seekTimeUs, *actualFrameTimeUs);
+}
+
 const mkvparser::Block *BlockIterator::block() const {
     CHECK(!eos());
 
@@ -765,7 +983,8 @@ MatroskaExtractor::MatroskaExtractor(const sp<DataSource> &source)
       mSegment(NULL),
       mExtractedThumbnails(false),
       mIsWebm(false),
-      mSeekPreRollNs(0) {
+      mSeekPreRollNs(0),
+      mClusterIndexComplete(false) {
     off64_t size;
     mIsLiveStreaming =
         (mDataSource->flags()
@@ -866,6 +1085,53 @@ bool MatroskaExtractor::isLiveStreaming() const {
     return mIsLiveStreaming;
 }
 
+const mkvparser::Cluster *MatroskaExtractor::findClusterForTime_l(
+        long long timeNs) {
+    if (mClusterIndex.empty()) {
+        const mkvparser::Cluster *cluster = mSegment->GetFirst();
+        if (cluster == NULL || cluster->EOS()) {
+            return NULL;
+        }
+
+        mClusterIndex.push(cluster);
+    }
+
+    // Only look as far into the file as needed, and only once.
+    while (!mClusterIndexComplete && mClusterIndex.top()->GetTime() <= timeNs) {
+        const mkvparser::Cluster *nextCluster;
+        long long pos;
+        long len;
+        long res = mSegment->ParseNext(
+                mClusterIndex.top(), nextCluster, pos, len);
+
+        if (res != 0) {
+            // Retry on the next seek unless this was the last cluster.
+            mClusterIndexComplete = res > 0;
+            break;
+        }
+
+        CHECK(nextCluster != NULL);
+        CHECK(!nextCluster->EOS());
+
+        mClusterIndex.push(nextCluster);
+    }
+
+    // Find the last cluster starting at or before "timeNs", or the first
+    // one if there is none.
+    size_t lo = 0;
+    size_t hi = mClusterIndex.size();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mClusterIndex.itemAt(mid)->GetTime() <= timeNs) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return mClusterIndex.itemAt(lo);
+}
+
 static int bytesForSize(size_t size) {
     // use at most 28 bits (4 times 7)
     CHECK(size <= 0xfffffff);
@@ -74,11 +74,18 @@ private:
     bool mIsWebm;
     int64_t mSeekPreRollNs;
 
+    // Clusters from the first one on, in file order, as far as seeking in
+    // a file without Cues has had to look.
+    Vector<const mkvparser::Cluster *> mClusterIndex;
+    bool mClusterIndexComplete;
+
     int addTracks();
     void findThumbnails();
 
     bool isLiveStreaming() const;
 
+    const mkvparser::Cluster *findClusterForTime_l(long long timeNs);
+
     MatroskaExtractor(const MatroskaExtractor &);
     MatroskaExtractor &operator=(const MatroskaExtractor &);
 };
@@ -66,6 +66,9 @@ namespace android {
 
 static const size_t kTSPacketSize = 188;
 
+// Initial size of the buffer PES packets are reassembled in.
+static const size_t kPESBufferSize = 192 * 1024;
+
 struct ATSParser::Program : public RefBase {
     Program(ATSParser *parser, unsigned programNumber, unsigned programMapPID);
 
@@ -570,7 +573,7 @@ ATSParser::Stream::Stream(
     ALOGV("new stream PID 0x%02x, type 0x%02x", elementaryPID, streamType);
 
     if (mQueue != NULL) {
-        mBuffer = new ABuffer(192 * 1024);
+        mBuffer = new ABuffer(kPESBufferSize);
         mBuffer->setRange(0, 0);
     }
 }
@@ -902,6 +905,12 @@ status_t ATSParser::Stream::flush() {
 
     status_t err = parsePES(&br);
 
+    // The queue may have taken over the buffer in exchange for its own,
+    // which may be missing or too small to be worth reusing.
+    if (mBuffer == NULL || mBuffer->capacity() < kPESBufferSize) {
+        mBuffer = new ABuffer(kPESBufferSize);
+    }
+
     mBuffer->setRange(0, 0);
 
     return err;
@@ -925,7 +934,14 @@ void ATSParser::Stream::onPayloadData(
         timeUs = mProgram->convertPTSToTimestamp(PTS);
     }
 
-    status_t err = mQueue->appendData(data, size, timeUs);
+    // The payload is handed to the queue in place, saving a copy whenever
+    // the queue has no partial access unit left over from earlier packets.
+    CHECK(data >= mBuffer->data()
+            && data + size <= mBuffer->data() + mBuffer->size());
+
+    mBuffer->setRange(data - mBuffer->base(), size);
+
+    status_t err = mQueue->appendBuffer(&mBuffer, timeUs);
 
     if (mEOSReached) {
         mQueue->signalEOS();
@@ -1005,6 +1021,7 @@ ATSParser::ATSParser(uint32_t flags)
       mTimeOffsetUs(0ll),
       mNumTSPacketsParsed(0),
       mNumPCRs(0) {
+    memset(mIgnoredPIDs, 0, sizeof(mIgnoredPIDs));
     mPSISections.add(0 /* PID */, new PSISection);
 }
 
@@ -1014,8 +1031,26 @@ ATSParser::~ATSParser() {
 status_t ATSParser::feedTSPacket(const void *data, size_t size) {
     CHECK_EQ(size, kTSPacketSize);
 
-    ABitReader br((const uint8_t *)data, kTSPacketSize);
-    return parseTS(&br);
+    return parseTS((const uint8_t *)data);
+}
+
+status_t ATSParser::feedTSPackets(const void *data, size_t size) {
+    CHECK_EQ(size % kTSPacketSize, 0u);
+
+    const uint8_t *packet = (const uint8_t *)data;
+    const uint8_t *end = packet + size;
+
+    while (packet < end) {
+        status_t err = parseTS(packet);
+
+        if (err != OK) {
+            return err;
+        }
+
+        packet += kTSPacketSize;
+    }
+
+    return OK;
 }
 
 void ATSParser::signalDiscontinuity(
@@ -1181,6 +1216,9 @@ status_t ATSParser::parsePID(
             section->clear();
         }
 
+        // Programs or streams may have come and gone.
+        memset(mIgnoredPIDs, 0, sizeof(mIgnoredPIDs));
+
         return OK;
     }
 
@@ -1201,104 +1239,116 @@ status_t ATSParser::parsePID(
 
     if (!handled) {
         ALOGV("PID 0x%04x not handled.", PID);
+        setIgnoredPID(PID);
     }
 
     return OK;
 }
 
-void ATSParser::parseAdaptationField(ABitReader *br, unsigned PID) {
-    unsigned adaptation_field_length = br->getBits(8);
+status_t ATSParser::parseAdaptationField(
+        const uint8_t *packet, unsigned PID, size_t *payloadOffset) {
+    unsigned adaptation_field_length = packet[4];
 
-    if (adaptation_field_length > 0) {
-        unsigned discontinuity_indicator = br->getBits(1);
+    if (5 + adaptation_field_length > kTSPacketSize) {
+        ALOGE("PID 0x%04x: adaptation_field_length %u exceeds packet",
+              PID, adaptation_field_length);
+        return ERROR_MALFORMED;
+    }
 
-        if (discontinuity_indicator) {
-            ALOGV("PID 0x%04x: discontinuity_indicator = 1 (!!!)", PID);
-        }
+    *payloadOffset = 5 + adaptation_field_length;
 
-        br->skipBits(2);
-        unsigned PCR_flag = br->getBits(1);
+    if (adaptation_field_length == 0) {
+        return OK;
+    }
 
-        size_t numBitsRead = 4;
+    unsigned discontinuity_indicator = packet[5] >> 7;
 
-        if (PCR_flag) {
-            br->skipBits(4);
-            uint64_t PCR_base = br->getBits(32);
-            PCR_base = (PCR_base << 1) | br->getBits(1);
+    if (discontinuity_indicator) {
+        ALOGV("PID 0x%04x: discontinuity_indicator = 1 (!!!)", PID);
+    }
 
-            br->skipBits(6);
-            unsigned PCR_ext = br->getBits(9);
+    unsigned PCR_flag = (packet[5] >> 4) & 1;
 
-            // The number of bytes from the start of the current
-            // MPEG2 transport stream packet up and including
-            // the final byte of this PCR_ext field.
-            size_t byteOffsetFromStartOfTSPacket =
-                (188 - br->numBitsLeft() / 8);
+    if (PCR_flag) {
+        if (adaptation_field_length < 7) {
+            ALOGE("PID 0x%04x: adaptation field too short for PCR", PID);
+            return ERROR_MALFORMED;
+        }
 
-            uint64_t PCR = PCR_base * 300 + PCR_ext;
+        uint64_t PCR_base =
+            ((uint64_t)packet[6] << 25)
+                | (packet[7] << 17)
+                | (packet[8] << 9)
+                | (packet[9] << 1)
+                | (packet[10] >> 7);
 
-            ALOGV("PID 0x%04x: PCR = 0x%016" PRIx64 " (%.2f)",
-                  PID, PCR, PCR / 27E6);
+        unsigned PCR_ext = ((packet[10] & 1) << 8) | packet[11];
 
-            // The number of bytes received by this parser up to and
-            // including the final byte of this PCR_ext field.
-            size_t byteOffsetFromStart =
-                mNumTSPacketsParsed * 188 + byteOffsetFromStartOfTSPacket;
+        // The number of bytes from the start of the current
+        // MPEG2 transport stream packet up and including
+        // the final byte of this PCR_ext field.
+        size_t byteOffsetFromStartOfTSPacket = 12;
 
-            for (size_t i = 0; i < mPrograms.size(); ++i) {
-                updatePCR(PID, PCR, byteOffsetFromStart);
-            }
+        uint64_t PCR = PCR_base * 300 + PCR_ext;
 
-            numBitsRead += 52;
-        }
+        ALOGV("PID 0x%04x: PCR = 0x%016" PRIx64 " (%.2f)",
+              PID, PCR, PCR / 27E6);
 
-        CHECK_GE(adaptation_field_length * 8, numBitsRead);
+        // The number of bytes received by this parser up to and
+        // including the final byte of this PCR_ext field.
+        size_t byteOffsetFromStart =
+            mNumTSPacketsParsed * 188 + byteOffsetFromStartOfTSPacket;
 
-        br->skipBits(adaptation_field_length * 8 - numBitsRead);
+        for (size_t i = 0; i < mPrograms.size(); ++i) {
+            updatePCR(PID, PCR, byteOffsetFromStart);
+        }
     }
+
+    return OK;
 }
 
-status_t ATSParser::parseTS(ABitReader *br) {
+status_t ATSParser::parseTS(const uint8_t *packet) {
     ALOGV("---");
 
-    unsigned sync_byte = br->getBits(8);
+    // The header is picked apart byte-wise, this runs for every single
+    // packet and most of them are handed on right away.
+    unsigned sync_byte = packet[0];
     if (sync_byte != 0x47u) {
         ALOGE("[error] parseTS: return error as sync_byte=0x%x", sync_byte);
         return BAD_VALUE;
     }
 
-    if (br->getBits(1)) {  // transport_error_indicator
+    if (packet[1] & 0x80) {  // transport_error_indicator
         // silently ignore.
         return OK;
     }
 
-    unsigned payload_unit_start_indicator = br->getBits(1);
+    unsigned payload_unit_start_indicator = (packet[1] >> 6) & 1;
     ALOGV("payload_unit_start_indicator = %u", payload_unit_start_indicator);
 
-    MY_LOGV("transport_priority = %u", br->getBits(1));
-
-    unsigned PID = br->getBits(13);
+    unsigned PID = ((packet[1] & 0x1f) << 8) | packet[2];
     ALOGV("PID = 0x%04x", PID);
 
-    MY_LOGV("transport_scrambling_control = %u", br->getBits(2));
-
-    unsigned adaptation_field_control = br->getBits(2);
+    unsigned adaptation_field_control = (packet[3] >> 4) & 3;
     ALOGV("adaptation_field_control = %u", adaptation_field_control);
 
-    unsigned continuity_counter = br->getBits(4);
+    unsigned continuity_counter = packet[3] & 0x0f;
     ALOGV("PID = 0x%04x, continuity_counter = %u", PID, continuity_counter);
 
-    // ALOGI("PID = 0x%04x, continuity_counter = %u", PID, continuity_counter);
+    status_t err = OK;
 
+    size_t payloadOffset = 4;
     if (adaptation_field_control == 2 || adaptation_field_control == 3) {
-        parseAdaptationField(br, PID);
+        err = parseAdaptationField(packet, PID, &payloadOffset);
     }
 
-    status_t err = OK;
+    if (err == OK
+            && (adaptation_field_control == 1 || adaptation_field_control == 3)
+            && !isIgnoredPID(PID)) {
+        ABitReader br(packet + payloadOffset, kTSPacketSize - payloadOffset);
 
-    if (adaptation_field_control == 1 || adaptation_field_control == 3) {
         err = parsePID(
-                br, PID, continuity_counter, payload_unit_start_indicator);
+                &br, PID, continuity_counter, payload_unit_start_indicator);
     }
 
     ++mNumTSPacketsParsed;
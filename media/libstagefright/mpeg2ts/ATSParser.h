@@ -82,6 +82,11 @@ struct ATSParser : public RefBase {
 
     status_t feedTSPacket(const void *data, size_t size);
 
+    // Parses "size" bytes worth of consecutive transport stream packets,
+    // "size" must be a multiple of the packet size. Stops at and returns
+    // the first error encountered.
+    status_t feedTSPackets(const void *data, size_t size);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -141,6 +146,24 @@ private:
 
     size_t mNumTSPacketsParsed;
 
+    enum {
+        kNumPIDs = 8192,
+    };
+
+    // One bit per PID, set once a packet on that PID found neither a PSI
+    // section nor an elementary stream to go to. Payloads on these PIDs are
+    // skipped without being looked at. Reset whenever a PSI section was
+    // parsed, which is the only way for new PIDs to become interesting.
+    uint32_t mIgnoredPIDs[kNumPIDs / 32];
+
+    bool isIgnoredPID(unsigned PID) const {
+        return mIgnoredPIDs[PID >> 5] & (1u << (PID & 31));
+    }
+
+    void setIgnoredPID(unsigned PID) {
+        mIgnoredPIDs[PID >> 5] |= 1u << (PID & 31);
+    }
+
     void parseProgramAssociationTable(ABitReader *br);
     void parseProgramMap(ABitReader *br);
     void parsePES(ABitReader *br);
@@ -150,8 +173,9 @@ private:
         unsigned continuity_counter,
         unsigned payload_unit_start_indicator);
 
-    void parseAdaptationField(ABitReader *br, unsigned PID);
-    status_t parseTS(ABitReader *br);
+    status_t parseAdaptationField(
+            const uint8_t *packet, unsigned PID, size_t *payloadOffset);
+    status_t parseTS(const uint8_t *packet);
 
     void updatePCR(unsigned PID, uint64_t PCR, size_t byteOffsetFromStart);
 
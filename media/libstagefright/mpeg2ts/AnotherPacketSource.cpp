@@ -19,6 +19,7 @@
 
 #include "AnotherPacketSource.h"
 
+#include <cutils/atomic.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
@@ -43,8 +44,15 @@ AnotherPacketSource::AnotherPacketSource(const sp<MetaData> &meta)
       mEOSResult(OK),
       mLatestEnqueuedMeta(NULL),
       mLatestDequeuedMeta(NULL),
-      mQueuedDiscontinuityCount(0) {
+      mQueuedDiscontinuityCount(0),
+      mBufferedDurationUs(0ll),
+      mInbox(NULL),
+      mInboxFront(0),
+      mInboxRear(0),
+      mProducerTid(0),
+      mNumWaitingConsumers(0) {
     setFormat(meta);
+    resetTimeRuns_l();
 }
 
 void AnotherPacketSource::setFormat(const sp<MetaData> &meta) {
@@ -71,6 +79,114 @@ void AnotherPacketSource::setFormat(const sp<MetaData> &meta) {
 }
 
 AnotherPacketSource::~AnotherPacketSource() {
+    delete[] mInbox;
+    mInbox = NULL;
+}
+
+void AnotherPacketSource::enableSingleProducerMode() {
+    Mutex::Autolock autoLock(mLock);
+    if (mInbox == NULL) {
+        mInbox = new sp<ABuffer>[kInboxSize];
+    }
+}
+
+void AnotherPacketSource::bindProducer() {
+    Mutex::Autolock autoLock(mLock);
+    if (mInbox == NULL) {
+        return;
+    }
+
+    int32_t tid = androidGetTid();
+    ssize_t index = mProducerBinds.indexOfKey(tid);
+    if (index >= 0) {
+        ++mProducerBinds.editValueAt(index);
+    } else {
+        mProducerBinds.add(tid, 1);
+    }
+
+    if (mProducerTid == 0) {
+        android_atomic_release_store(tid, &mProducerTid);
+    }
+}
+
+void AnotherPacketSource::unbindProducer() {
+    Mutex::Autolock autoLock(mLock);
+    if (mInbox == NULL) {
+        return;
+    }
+
+    int32_t tid = androidGetTid();
+    ssize_t index = mProducerBinds.indexOfKey(tid);
+    if (index < 0) {
+        ALOGW("unbindProducer called on a thread that is not bound");
+        return;
+    }
+
+    if (--mProducerBinds.editValueAt(index) > 0) {
+        return;
+    }
+    mProducerBinds.removeItemsAt(index);
+
+    if (mProducerTid == tid) {
+        // Everything this thread put in the ring is visible to the next
+        // producer through the release.
+        int32_t nextTid =
+            mProducerBinds.isEmpty() ? 0 : mProducerBinds.keyAt(0);
+        android_atomic_release_store(nextTid, &mProducerTid);
+    }
+}
+
+bool AnotherPacketSource::isSingleProducer() {
+    if (mInbox == NULL) {
+        return false;
+    }
+
+    return android_atomic_acquire_load(&mProducerTid) == androidGetTid();
+}
+
+void AnotherPacketSource::drainInbox_l() {
+    if (mInbox == NULL) {
+        return;
+    }
+
+    uint32_t rear = android_atomic_acquire_load(&mInboxRear);
+    uint32_t front = mInboxFront;
+
+    while (front != rear) {
+        sp<ABuffer> &entry = mInbox[front & (kInboxSize - 1)];
+        queueAccessUnit_l(entry);
+        entry.clear();
+        ++front;
+    }
+
+    android_atomic_release_store(front, &mInboxFront);
+}
+
+void AnotherPacketSource::waitForBuffer_l() {
+    for (;;) {
+        drainInbox_l();
+
+        if (mEOSResult != OK || !mBuffers.empty()) {
+            return;
+        }
+
+        if (mInbox == NULL) {
+            mCondition.wait(mLock);
+            continue;
+        }
+
+        // Tell the producer to signal us, then look once more in case it
+        // handed over a buffer before it could have seen that. The full
+        // barriers on either side make sure at least one of us notices.
+        android_atomic_inc(&mNumWaitingConsumers);
+        __sync_synchronize();
+
+        if (android_atomic_acquire_load(&mInboxRear) == mInboxFront) {
+            mCondition.wait(mLock);
+        }
+
+        android_atomic_dec(&mNumWaitingConsumers);
+    }
 }
 
 status_t AnotherPacketSource::start(MetaData * /* params */) {
@@ -83,6 +199,8 @@ status_t AnotherPacketSource::stop() {
 
 sp<MetaData> AnotherPacketSource::getFormat() {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
+
     if (mFormat != NULL) {
         return mFormat;
     }
@@ -109,13 +227,12 @@ status_t AnotherPacketSource::dequeueAccessUnit(sp<ABuffer> *buffer) {
     buffer->clear();
 
     Mutex::Autolock autoLock(mLock);
-    while (mEOSResult == OK && mBuffers.empty()) {
-        mCondition.wait(mLock);
-    }
+    waitForBuffer_l();
 
     if (!mBuffers.empty()) {
         *buffer = *mBuffers.begin();
         mBuffers.erase(mBuffers.begin());
+        onBufferDequeued_l(*buffer);
 
         int32_t discontinuity;
         if ((*buffer)->meta()->findInt32("discontinuity", &discontinuity)) {
@@ -145,14 +262,13 @@ status_t AnotherPacketSource::read(
     *out = NULL;
 
     Mutex::Autolock autoLock(mLock);
-    while (mEOSResult == OK && mBuffers.empty()) {
-        mCondition.wait(mLock);
-    }
+    waitForBuffer_l();
 
     if (!mBuffers.empty()) {
 
         const sp<ABuffer> buffer = *mBuffers.begin();
         mBuffers.erase(mBuffers.begin());
+        onBufferDequeued_l(buffer);
         mLatestDequeuedMeta = buffer->meta()->dup();
 
         int32_t discontinuity;
@@ -208,10 +324,41 @@ void AnotherPacketSource::queueAccessUnit(const sp<ABuffer> &buffer) {
     mLastQueuedTimeUs = lastQueuedTimeUs;
     ALOGV("queueAccessUnit timeUs=%" PRIi64 " us (%.2f secs)", mLastQueuedTimeUs, mLastQueuedTimeUs / 1E6);
 
+    if (isSingleProducer()) {
+        uint32_t rear = mInboxRear;
+        uint32_t front = android_atomic_acquire_load(&mInboxFront);
+
+        if (rear - front < kInboxSize) {
+            mInbox[rear & (kInboxSize - 1)] = buffer;
+            android_atomic_release_store(rear + 1, &mInboxRear);
+
+            // Pairs with the barrier in waitForBuffer_l().
+            __sync_synchronize();
+
+            if (android_atomic_acquire_load(&mNumWaitingConsumers) > 0) {
+                Mutex::Autolock autoLock(mLock);
+                mCondition.signal();
+            }
+            return;
+        }
+
+        // The consumer is falling behind, hand everything over the slow way.
+    }
+
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
+    queueAccessUnit_l(buffer);
+}
+
+void AnotherPacketSource::queueAccessUnit_l(const sp<ABuffer> &buffer) {
+    int64_t lastQueuedTimeUs;
+    CHECK(buffer->meta()->findInt64("timeUs", &lastQueuedTimeUs));
+
     mBuffers.push_back(buffer);
     mCondition.signal();
 
+    onBufferQueued_l(buffer);
+
     int32_t discontinuity;
     if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
         ++mQueuedDiscontinuityCount;
@@ -237,10 +384,12 @@ void AnotherPacketSource::queueAccessUnit(const sp<ABuffer> &buffer) {
 
 void AnotherPacketSource::clear() {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
 
     mBuffers.clear();
     mEOSResult = OK;
     mQueuedDiscontinuityCount = 0;
+    resetTimeRuns_l();
 
     mFormat = NULL;
     mLatestEnqueuedMeta = NULL;
@@ -251,6 +400,7 @@ void AnotherPacketSource::queueDiscontinuity(
         const sp<AMessage> &extra,
         bool discard) {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
 
     if (discard) {
         // Leave only discontinuities in the queue.
@@ -267,6 +417,11 @@ void AnotherPacketSource::queueDiscontinuity(
 
             ++it;
         }
+
+        resetTimeRuns_l();
+        for (it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+            onBufferQueued_l(*it);
+        }
     }
 
     mEOSResult = OK;
@@ -283,6 +438,7 @@ void AnotherPacketSource::queueDiscontinuity(
     buffer->meta()->setMessage("extra", extra);
 
     mBuffers.push_back(buffer);
+    onBufferQueued_l(buffer);
     mCondition.signal();
 }
 
@@ -290,12 +446,14 @@ void AnotherPacketSource::signalEOS(status_t result) {
     CHECK(result != OK);
 
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
     mEOSResult = result;
     mCondition.signal();
 }
 
 bool AnotherPacketSource::hasBufferAvailable(status_t *finalResult) {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
     if (!mBuffers.empty()) {
         return true;
     }
@@ -306,49 +464,91 @@ bool AnotherPacketSource::hasBufferAvailable(status_t *finalResult) {
 
 int64_t AnotherPacketSource::getBufferedDurationUs(status_t *finalResult) {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
     return getBufferedDurationUs_l(finalResult);
 }
 
 int64_t AnotherPacketSource::getBufferedDurationUs_l(status_t *finalResult) {
     *finalResult = mEOSResult;
 
-    if (mBuffers.empty()) {
-        return 0;
+    return mBufferedDurationUs;
+}
+
+void AnotherPacketSource::onBufferQueued_l(const sp<ABuffer> &buffer) {
+    int64_t timeUs;
+    if (!buffer->meta()->findInt64("timeUs", &timeUs)) {
+        // A discontinuity, starts a new run.
+        mTimeRuns.push_back(TimeRun());
+        return;
+    } else if (timeUs < 0) {
+        // Format change markers carry no time.
+        return;
     }
 
-    int64_t time1 = -1;
-    int64_t time2 = -1;
-    int64_t durationUs = 0;
+    TimeRun *run = &*--mTimeRuns.end();
+    mBufferedDurationUs -= run->durationUs();
+    run->push(timeUs);
+    mBufferedDurationUs += run->durationUs();
+}
 
-    List<sp<ABuffer> >::iterator it = mBuffers.begin();
-    while (it != mBuffers.end()) {
-        const sp<ABuffer> &buffer = *it;
+void AnotherPacketSource::onBufferDequeued_l(const sp<ABuffer> &buffer) {
+    TimeRun *run = &*mTimeRuns.begin();
+
+    int64_t timeUs;
+    if (!buffer->meta()->findInt64("timeUs", &timeUs)) {
+        // A discontinuity, the run in front of it is gone by now.
+        mBufferedDurationUs -= run->durationUs();
+        mTimeRuns.erase(mTimeRuns.begin());
+    } else if (timeUs >= 0) {
+        mBufferedDurationUs -= run->durationUs();
+        run->pop(timeUs);
+        mBufferedDurationUs += run->durationUs();
+    }
+}
 
-        int64_t timeUs;
-        if (buffer->meta()->findInt64("timeUs", &timeUs)) {
-            if (time1 < 0 || timeUs < time1) {
-                time1 = timeUs;
-            }
+void AnotherPacketSource::resetTimeRuns_l() {
+    mTimeRuns.clear();
+    mTimeRuns.push_back(TimeRun());
+    mBufferedDurationUs = 0ll;
+}
 
-            if (time2 < 0 || timeUs > time2) {
-                time2 = timeUs;
-            }
-        } else {
-            // This is a discontinuity, reset everything.
-            durationUs += time2 - time1;
-            time1 = time2 = -1;
-        }
+int64_t AnotherPacketSource::TimeRun::durationUs() const {
+    if (mMinTimesUs.empty()) {
+        return 0ll;
+    }
 
-        ++it;
+    return *mMaxTimesUs.begin() - *mMinTimesUs.begin();
+}
+
+void AnotherPacketSource::TimeRun::push(int64_t timeUs) {
+    // Timestamps queued before, but larger (smaller) than this one, can no
+    // longer become the smallest (largest) one of the run.
+    while (!mMinTimesUs.empty() && *--mMinTimesUs.end() > timeUs) {
+        mMinTimesUs.erase(--mMinTimesUs.end());
     }
+    mMinTimesUs.push_back(timeUs);
 
-    return durationUs + (time2 - time1);
+    while (!mMaxTimesUs.empty() && *--mMaxTimesUs.end() < timeUs) {
+        mMaxTimesUs.erase(--mMaxTimesUs.end());
+    }
+    mMaxTimesUs.push_back(timeUs);
+}
+
+void AnotherPacketSource::TimeRun::pop(int64_t timeUs) {
+    if (!mMinTimesUs.empty() && *mMinTimesUs.begin() == timeUs) {
+        mMinTimesUs.erase(mMinTimesUs.begin());
+    }
+
+    if (!mMaxTimesUs.empty() && *mMaxTimesUs.begin() == timeUs) {
+        mMaxTimesUs.erase(mMaxTimesUs.begin());
+    }
 }
 
 // A cheaper but less precise version of getBufferedDurationUs that we would like to use in
 // LiveSession::dequeueAccessUnit to trigger downwards adaptation.
 int64_t AnotherPacketSource::getEstimatedDurationUs() {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
     if (mBuffers.empty()) {
         return 0;
     }
@@ -388,6 +588,7 @@ int64_t AnotherPacketSource::getEstimatedDurationUs() {
 
 size_t AnotherPacketSource::getBufferCount(status_t *finalResult) {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
 
     *finalResult = mEOSResult;
 
@@ -398,6 +599,7 @@ status_t AnotherPacketSource::nextBufferTime(int64_t *timeUs) {
     *timeUs = 0;
 
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
 
     if (mBuffers.empty()) {
         return mEOSResult != OK ? mEOSResult : -EWOULDBLOCK;
@@ -422,6 +624,7 @@ bool AnotherPacketSource::isFinished(int64_t duration) const {
 
 sp<AMessage> AnotherPacketSource::getLatestEnqueuedMeta() {
     Mutex::Autolock autoLock(mLock);
+    drainInbox_l();
     return mLatestEnqueuedMeta;
 }
 
@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/MediaSource.h>
 #include <utils/threads.h>
+#include <utils/KeyedVector.h>
 #include <utils/List.h>
 
 #include "ATSParser.h"
@@ -34,6 +35,28 @@ struct AnotherPacketSource : public MediaSource {
 
     void setFormat(const sp<MetaData> &meta);
 
+    // Lets access units be queued without taking the lock: the thread bound
+    // as the single producer hands them over through a ring buffer, which
+    // consumers drain as they look at the queue. Access units queued by any
+    // other thread take the locked path as before. Must be called before
+    // the source is in use.
+    void enableSingleProducerMode();
+
+    // Binds the calling thread as the single producer, or, if another one
+    // is still bound, as the one taking over once that one unbinds. Binds
+    // are counted per thread: producers sharing a looper, like the
+    // fetchers of a LiveSession, each bind and unbind once.
+    void bindProducer();
+
+    // Called by the producer once it is done queueing access units, e.g.
+    // a fetcher being stopped, on the thread that bound itself. The thread
+    // stays bound until its last bind is undone.
+    void unbindProducer();
+
+    // Whether access units queued on the calling thread take the lock-free
+    // path.
+    bool isSingleProducer();
+
     virtual status_t start(MetaData *params = NULL);
     virtual status_t stop();
     virtual sp<MetaData> getFormat();
@@ -75,6 +98,23 @@ protected:
     virtual ~AnotherPacketSource();
 
 private:
+    enum {
+        // Entries in the single producer ring buffer, a power of 2.
+        kInboxSize = 256,
+    };
+
+    // Access units between two discontinuities, with the queued timestamps
+    // that are, or may yet become, the smallest and the largest of the run
+    // as access units are dequeued, in queue order.
+    struct TimeRun {
+        List<int64_t> mMinTimesUs;
+        List<int64_t> mMaxTimesUs;
+
+        int64_t durationUs() const;
+        void push(int64_t timeUs);
+        void pop(int64_t timeUs);
+    };
+
     Mutex mLock;
     Condition mCondition;
 
@@ -89,9 +129,31 @@ private:
 
     size_t  mQueuedDiscontinuityCount;
 
+    // The runs making up the queue, never empty, and the sum of their
+    // durations, kept up to date as buffers come and go.
+    List<TimeRun> mTimeRuns;
+    int64_t mBufferedDurationUs;
+
+    // Ring buffer used in single producer mode, only the producer advances
+    // mInboxRear, mInboxFront is only advanced with mLock held.
+    sp<ABuffer> *mInbox;
+    volatile int32_t mInboxFront;
+    volatile int32_t mInboxRear;
+    volatile int32_t mProducerTid;      // Only changed with mLock held
+    KeyedVector<int32_t, size_t> mProducerBinds;  // Bind count by tid
+    volatile int32_t mNumWaitingConsumers;
+
     bool wasFormatChange(int32_t discontinuityType) const;
     int64_t getBufferedDurationUs_l(status_t *finalResult);
 
+    void drainInbox_l();
+    void waitForBuffer_l();
+
+    void queueAccessUnit_l(const sp<ABuffer> &buffer);
+    void onBufferQueued_l(const sp<ABuffer> &buffer);
+    void onBufferDequeued_l(const sp<ABuffer> &buffer);
+    void resetTimeRuns_l();
+
     DISALLOW_EVIL_CONSTRUCTORS(AnotherPacketSource);
 };
 
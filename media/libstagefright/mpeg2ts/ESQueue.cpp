@@ -50,6 +50,7 @@
 
 #include "include/avc_utils.h"
 #include "include/ExtendedUtils.h"
+#include "include/StartCodeScanner.h"
 
 #include <inttypes.h>
 #include <netinet/in.h>
@@ -271,215 +272,223 @@ static bool IsSeeminglyValidDDPAudioHeader(const uint8_t *ptr, size_t size) {
     return false;
 }
 #endif // DOLBY_END
-status_t ElementaryStreamQueue::appendData(
-        const void *data, size_t size, int64_t timeUs) {
-
-    if (mEOSReached) {
-        ALOGE("appending data after EOS");
-        return ERROR_MALFORMED;
-    }
-    if (mBuffer == NULL || mBuffer->size() == 0) {
-        switch (mMode) {
-            case H264:
-            case H265:
-            case MPEG_VIDEO:
-            {
+status_t ElementaryStreamQueue::skipToFirstSyncWord(
+        const void **data, size_t *size) {
+    switch (mMode) {
+        case H264:
+        case H265:
+        case MPEG_VIDEO:
+        {
 #if 0
-                if (size < 4 || memcmp("\x00\x00\x00\x01", data, 4)) {
-                    return ERROR_MALFORMED;
-                }
+            if (*size < 4 || memcmp("\x00\x00\x00\x01", *data, 4)) {
+                return ERROR_MALFORMED;
+            }
 #else
-                uint8_t *ptr = (uint8_t *)data;
-
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+            uint8_t *ptr = (uint8_t *)*data;
 
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
+            ssize_t startOffset = FindStartCode(ptr, *size);
 
-                if (startOffset > 0) {
-                    ALOGI("found something resembling an H.264/MPEG syncword "
-                          "at offset %zd",
-                          startOffset);
-                }
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-#endif
-                break;
+            if (startOffset > 0) {
+                ALOGI("found something resembling an H.264/MPEG syncword "
+                      "at offset %zd",
+                      startOffset);
             }
 
-            case MPEG4_VIDEO:
-            {
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+#endif
+            break;
+        }
+
+        case MPEG4_VIDEO:
+        {
 #if 0
-                if (size < 3 || memcmp("\x00\x00\x01", data, 3)) {
-                    return ERROR_MALFORMED;
-                }
+            if (*size < 3 || memcmp("\x00\x00\x01", *data, 3)) {
+                return ERROR_MALFORMED;
+            }
 #else
-                uint8_t *ptr = (uint8_t *)data;
-
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+            uint8_t *ptr = (uint8_t *)*data;
 
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
+            ssize_t startOffset = FindStartCode(ptr, *size);
 
-                if (startOffset > 0) {
-                    ALOGI("found something resembling an H.264/MPEG syncword "
-                          "at offset %zd",
-                          startOffset);
-                }
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-#endif
-                break;
+            if (startOffset > 0) {
+                ALOGI("found something resembling an H.264/MPEG syncword "
+                      "at offset %zd",
+                      startOffset);
             }
 
-            case AAC:
-            {
-                uint8_t *ptr = (uint8_t *)data;
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+#endif
+            break;
+        }
+
+        case AAC:
+        {
+            uint8_t *ptr = (uint8_t *)*data;
 
 #if 0
-                if (size < 2 || ptr[0] != 0xff || (ptr[1] >> 4) != 0x0f) {
-                    return ERROR_MALFORMED;
-                }
+            if (*size < 2 || ptr[0] != 0xff || (ptr[1] >> 4) != 0x0f) {
+                return ERROR_MALFORMED;
+            }
 #else
-                ssize_t startOffset = -1;
-                size_t frameLength;
-                for (size_t i = 0; i < size; ++i) {
-                    if (IsSeeminglyValidADTSHeader(
-                            &ptr[i], size - i, &frameLength)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
-
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
-
-                if (startOffset > 0) {
-                    ALOGI("found something resembling an AAC syncword at "
-                          "offset %zd",
-                          startOffset);
+            // Only positions that carry the ADTS syncword and layer 0 are
+            // worth a closer look.
+            ssize_t startOffset = -1;
+            size_t frameLength;
+            size_t i = 0;
+            ssize_t pos;
+            while ((pos = FindSyncWord(&ptr[i], *size - i, 0xf6, 0xf0)) >= 0) {
+                i += pos;
+                if (IsSeeminglyValidADTSHeader(
+                        &ptr[i], *size - i, &frameLength)) {
+                    startOffset = i;
+                    break;
                 }
+                ++i;
+            }
 
-                if (frameLength != size - startOffset) {
-                    ALOGV("First ADTS AAC frame length is %zd bytes, "
-                          "while the buffer size is %zd bytes.",
-                          frameLength, size - startOffset);
-                }
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-#endif
-                break;
+            if (startOffset > 0) {
+                ALOGI("found something resembling an AAC syncword at "
+                      "offset %zd",
+                      startOffset);
             }
 
-            case AC3:
-            {
-                uint8_t *ptr = (uint8_t *)data;
-
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i < size; ++i) {
-                    if (IsSeeminglyValidAC3Header(&ptr[i], size - i)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+            if (frameLength != *size - startOffset) {
+                ALOGV("First ADTS AAC frame length is %zd bytes, "
+                      "while the buffer size is %zd bytes.",
+                      frameLength, *size - startOffset);
+            }
 
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+#endif
+            break;
+        }
 
-                if (startOffset > 0) {
-                    ALOGI("found something resembling an AC3 syncword at "
-                          "offset %zd",
-                          startOffset);
+        case AC3:
+        {
+            uint8_t *ptr = (uint8_t *)*data;
+
+            ssize_t startOffset = -1;
+            for (size_t i = 0; i < *size; ++i) {
+                if (IsSeeminglyValidAC3Header(&ptr[i], *size - i)) {
+                    startOffset = i;
+                    break;
                 }
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-                break;
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
             }
 
-            case MPEG_AUDIO:
-            {
-                uint8_t *ptr = (uint8_t *)data;
-
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i < size; ++i) {
-                    if (IsSeeminglyValidMPEGAudioHeader(&ptr[i], size - i)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+            if (startOffset > 0) {
+                ALOGI("found something resembling an AC3 syncword at "
+                      "offset %zd",
+                      startOffset);
+            }
 
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+            break;
+        }
 
-                if (startOffset > 0) {
-                    ALOGI("found something resembling an MPEG audio "
-                          "syncword at offset %zd",
-                          startOffset);
+        case MPEG_AUDIO:
+        {
+            uint8_t *ptr = (uint8_t *)*data;
+
+            ssize_t startOffset = -1;
+            size_t i = 0;
+            ssize_t pos;
+            while ((pos = FindSyncWord(&ptr[i], *size - i, 0xe0, 0xe0)) >= 0) {
+                i += pos;
+                if (IsSeeminglyValidMPEGAudioHeader(&ptr[i], *size - i)) {
+                    startOffset = i;
+                    break;
                 }
+                ++i;
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-                break;
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
             }
 
-            case PCM_AUDIO:
-            {
-                break;
+            if (startOffset > 0) {
+                ALOGI("found something resembling an MPEG audio "
+                      "syncword at offset %zd",
+                      startOffset);
             }
 
-#if defined(DOLBY_UDC) && defined(DOLBY_UDC_STREAMING_HLS)
-            case DDP_EC3_AUDIO:
-            {
-                uint8_t *ptr = (uint8_t *)data;
-
-                ssize_t startOffset = -1;
-                for (size_t i = 0; i < size; ++i) {
-                    if (IsSeeminglyValidDDPAudioHeader(&ptr[i], size - i)) {
-                        startOffset = i;
-                        break;
-                    }
-                }
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+            break;
+        }
 
-                if (startOffset < 0) {
-                    return ERROR_MALFORMED;
-                }
+        case PCM_AUDIO:
+        {
+            break;
+        }
 
-                if (startOffset > 0) {
-                    ALOGI("found something resembling a DDP audio "
-                         "syncword at offset %ld",
-                         startOffset);
+#if defined(DOLBY_UDC) && defined(DOLBY_UDC_STREAMING_HLS)
+        case DDP_EC3_AUDIO:
+        {
+            uint8_t *ptr = (uint8_t *)*data;
+
+            ssize_t startOffset = -1;
+            for (size_t i = 0; i < *size; ++i) {
+                if (IsSeeminglyValidDDPAudioHeader(&ptr[i], *size - i)) {
+                    startOffset = i;
+                    break;
                 }
+            }
 
-                data = &ptr[startOffset];
-                size -= startOffset;
-                break;
+            if (startOffset < 0) {
+                return ERROR_MALFORMED;
             }
 
+            if (startOffset > 0) {
+                ALOGI("found something resembling a DDP audio "
+                     "syncword at offset %ld",
+                     startOffset);
+            }
+
+            *data = &ptr[startOffset];
+            *size -= startOffset;
+            break;
+        }
+
 #endif // DOLBY_END
-            default:
-                TRESPASS();
-                break;
+        default:
+            TRESPASS();
+            break;
+    }
+
+    return OK;
+}
+
+status_t ElementaryStreamQueue::appendData(
+        const void *data, size_t size, int64_t timeUs) {
+
+    if (mEOSReached) {
+        ALOGE("appending data after EOS");
+        return ERROR_MALFORMED;
+    }
+    if (mBuffer == NULL || mBuffer->size() == 0) {
+        status_t err = skipToFirstSyncWord(&data, &size);
+        if (err != OK) {
+            return err;
         }
     }
 
@@ -498,10 +507,15 @@ status_t ElementaryStreamQueue::appendData(
         }
 
         mBuffer = buffer;
+    } else if (mBuffer->offset() + neededSize > mBuffer->capacity()) {
+        // Access units are consumed off the front without moving the rest
+        // of the data, do that now that we have run out of room at the end.
+        memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
+        mBuffer->setRange(0, mBuffer->size());
     }
 
     memcpy(mBuffer->data() + mBuffer->size(), data, size);
-    mBuffer->setRange(0, mBuffer->size() + size);
+    mBuffer->setRange(mBuffer->offset(), mBuffer->size() + size);
 
     RangeInfo info;
     info.mLength = size;
@@ -518,6 +532,46 @@ status_t ElementaryStreamQueue::appendData(
     return OK;
 }
 
+status_t ElementaryStreamQueue::appendBuffer(
+        sp<ABuffer> *buffer, int64_t timeUs) {
+    if (mEOSReached || (mBuffer != NULL && mBuffer->size() > 0)) {
+        return appendData((*buffer)->data(), (*buffer)->size(), timeUs);
+    }
+
+    const void *data = (*buffer)->data();
+    size_t size = (*buffer)->size();
+
+    status_t err = skipToFirstSyncWord(&data, &size);
+    if (err != OK) {
+        return err;
+    }
+
+    // Nothing left over from previous data, take over the caller's buffer
+    // as is and hand back our own (empty) one in exchange.
+    (*buffer)->setRange((const uint8_t *)data - (*buffer)->base(), size);
+
+    sp<ABuffer> tmp = mBuffer;
+    mBuffer = *buffer;
+    *buffer = tmp;
+
+    RangeInfo info;
+    info.mLength = size;
+    info.mTimestampUs = timeUs;
+    mRangeInfos.push_back(info);
+
+    return OK;
+}
+
+void ElementaryStreamQueue::consume(size_t size) {
+    CHECK_LE(size, mBuffer->size());
+
+    if (size == mBuffer->size()) {
+        mBuffer->setRange(0, 0);
+    } else {
+        mBuffer->setRange(mBuffer->offset() + size, mBuffer->size() - size);
+    }
+}
+
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnit() {
     if (((mFlags & kFlag_AlignedData) && mMode == H264) || mMode == H265) {
         if (mRangeInfos.empty()) {
@@ -531,11 +585,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnit() {
         memcpy(accessUnit->data(), mBuffer->data(), info.mLength);
         accessUnit->meta()->setInt64("timeUs", info.mTimestampUs);
 
-        memmove(mBuffer->data(),
-                mBuffer->data() + info.mLength,
-                mBuffer->size() - info.mLength);
-
-        mBuffer->setRange(0, mBuffer->size() - info.mLength);
+        consume(info.mLength);
 
         if (mFormat == NULL) {
             if (mMode == H264) {
@@ -608,12 +658,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAC3() {
     CHECK_GE(timeUs, 0ll);
     accessUnit->meta()->setInt64("timeUs", timeUs);
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + syncStartPos + payloadSize,
-            mBuffer->size() - syncStartPos - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - syncStartPos - payloadSize);
+    consume(syncStartPos + payloadSize);
 
     return accessUnit;
 }
@@ -662,12 +707,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         ptr[i] = ntohs(ptr[i]);
     }
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + 4 + payloadSize,
-            mBuffer->size() - 4 - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - 4 - payloadSize);
+    consume(4 + payloadSize);
 
     return accessUnit;
 }
@@ -768,9 +808,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
     sp<ABuffer> accessUnit = new ABuffer(offset);
     memcpy(accessUnit->data(), mBuffer->data(), offset);
 
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    consume(offset);
 
     accessUnit->meta()->setInt64("timeUs", timeUs);
 
@@ -855,8 +893,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitDDP() {
     // Put data into buffer
     memcpy(accessUnit->data(), mBuffer->data(), frame_size);
 
-    memmove(mBuffer->data(), mBuffer->data() + frame_size, mBuffer->size() - frame_size);
-    mBuffer->setRange(0, mBuffer->size() - frame_size);
+    consume(frame_size);
 
     accessUnit->meta()->setInt64("timeUs", timeUs);
     if (timeUs >= 0) {
@@ -1039,11 +1076,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             const NALPosition &pos = nals.itemAt(nals.size() - 1);
             size_t nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            consume(nextScan);
 
             int64_t timeUs = fetchTimestamp(nextScan);
             CHECK_GE(timeUs, 0ll);
@@ -1098,11 +1131,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGAudio() {
     sp<ABuffer> accessUnit = new ABuffer(frameSize);
     memcpy(accessUnit->data(), data, frameSize);
 
-    memmove(mBuffer->data(),
-            mBuffer->data() + frameSize,
-            mBuffer->size() - frameSize);
-
-    mBuffer->setRange(0, mBuffer->size() - frameSize);
+    consume(frameSize);
 
     int64_t timeUs = fetchTimestamp(frameSize);
     CHECK_GE(timeUs, 0ll);
@@ -1187,21 +1216,23 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
 
     size_t offset = 0;
     while (offset + 3 < size) {
-        if (memcmp(&data[offset], "\x00\x00\x01", 3)) {
-            ++offset;
-            continue;
+        // The startcode needs to be followed by at least one byte.
+        ssize_t pos = FindStartCode(&data[offset], size - offset - 1);
+        if (pos < 0) {
+            break;
         }
+        offset += pos;
 
         pprevStartCode = prevStartCode;
         prevStartCode = currentStartCode;
         currentStartCode = data[offset + 3];
 
         if (currentStartCode == 0xb3 && mFormat == NULL) {
-            memmove(mBuffer->data(), mBuffer->data() + offset, size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             (void)fetchTimestamp(offset);
             offset = 0;
-            mBuffer->setRange(0, size);
         }
 
         if ((prevStartCode == 0xb3 && currentStartCode != 0xb5)
@@ -1227,11 +1258,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
                 sp<ABuffer> csd = new ABuffer(offset);
                 memcpy(csd->data(), data, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consume(offset);
+                data = mBuffer->data();
                 size -= offset;
                 (void)fetchTimestamp(offset);
                 offset = 0;
@@ -1255,11 +1283,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
                 sp<ABuffer> accessUnit = new ABuffer(offset);
                 memcpy(accessUnit->data(), data, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consume(offset);
 
                 int64_t timeUs = fetchTimestamp(offset);
                 CHECK_GE(timeUs, 0ll);
@@ -1295,16 +1319,12 @@ static ssize_t getNextChunkSize(
         TRESPASS();
     }
 
-    size_t offset = 3;
-    while (offset + 2 < size) {
-        if (!memcmp(&data[offset], kStartCode, 3)) {
-            return offset;
-        }
-
-        ++offset;
+    ssize_t pos = FindStartCode(&data[3], size - 3);
+    if (pos < 0) {
+        return -EAGAIN;
     }
 
-    return -EAGAIN;
+    return pos + 3;
 }
 
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
@@ -1416,9 +1436,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
                     sp<ABuffer> accessUnit = new ABuffer(offset);
                     memcpy(accessUnit->data(), data, offset);
 
-                    memmove(data, &data[offset], size - offset);
-                    size -= offset;
-                    mBuffer->setRange(0, size);
+                    consume(offset);
 
                     int64_t timeUs = fetchTimestamp(offset);
                     CHECK_GE(timeUs, 0ll);
@@ -1447,10 +1465,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
 
         if (discard) {
             (void)fetchTimestamp(offset);
-            memmove(data, &data[offset], size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             offset = 0;
-            mBuffer->setRange(0, size);
         } else {
             offset += chunkSize;
         }
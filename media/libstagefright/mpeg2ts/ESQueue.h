@@ -69,6 +69,11 @@ struct ElementaryStreamQueue {
     ElementaryStreamQueue(Mode mode, uint32_t flags = 0);
 
     status_t appendData(const void *data, size_t size, int64_t timeUs);
+
+    // Like appendData() for the range of "*buffer", but if the queue holds
+    // no other data it takes over "*buffer" instead of copying from it and
+    // returns its own, now empty buffer (or NULL) in its place.
+    status_t appendBuffer(sp<ABuffer> *buffer, int64_t timeUs);
     void signalEOS();
     void clear(bool clearFormat);
 
@@ -91,6 +96,11 @@ private:
 
     sp<MetaData> mFormat;
 
+    status_t skipToFirstSyncWord(const void **data, size_t *size);
+
+    // Drops "size" bytes off the front of mBuffer.
+    void consume(size_t size);
+
     sp<ABuffer> dequeueAccessUnitH264();
     sp<ABuffer> dequeueAccessUnitH265();
     sp<ABuffer> dequeueAccessUnitAAC();
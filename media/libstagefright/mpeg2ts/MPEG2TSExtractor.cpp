@@ -36,6 +36,9 @@ namespace android {
 
 static const size_t kTSPacketSize = 188;
 
+// Number of transport stream packets read and parsed per feedMore().
+static const size_t kNumPacketsPerFeed = 64;
+
 struct MPEG2TSSource : public MediaSource {
     MPEG2TSSource(
             const sp<MPEG2TSExtractor> &extractor,
@@ -189,7 +192,8 @@ void MPEG2TSExtractor::init() {
             }
         }
 
-        if (++numPacketsParsed > 10000) {
+        numPacketsParsed += kNumPacketsPerFeed;
+        if (numPacketsParsed > 10000) {
             break;
         }
     }
@@ -200,8 +204,8 @@ void MPEG2TSExtractor::init() {
 status_t MPEG2TSExtractor::feedMore() {
     Mutex::Autolock autoLock(mLock);
 
-    uint8_t packet[kTSPacketSize];
-    ssize_t n = mDataSource->readAt(mOffset, packet, kTSPacketSize);
+    uint8_t packets[kNumPacketsPerFeed * kTSPacketSize];
+    ssize_t n = mDataSource->readAt(mOffset, packets, sizeof(packets));
 
     if (n < (ssize_t)kTSPacketSize) {
         if (n >= 0) {
@@ -210,8 +214,11 @@ status_t MPEG2TSExtractor::feedMore() {
         return (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
     }
 
+    // A trailing partial packet is picked up again by the next read.
+    n -= n % kTSPacketSize;
+
     mOffset += n;
-    return mParser->feedTSPacket(packet, kTSPacketSize);
+    return mParser->feedTSPackets(packets, n);
 }
 
 uint32_t MPEG2TSExtractor::flags() const {
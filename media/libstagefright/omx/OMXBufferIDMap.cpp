@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "OMXBufferIDMap"
+#include <utils/Log.h>
+
+#include "../include/OMXBufferIDMap.h"
+
+namespace android {
+
+static const uint32_t kSlotMask = OMXBufferIDMap::kMaxSlots;
+static const uint32_t kGenerationMask = 0xffffffffu >> OMXBufferIDMap::kSlotBits;
+
+OMXBufferIDMap::OMXBufferIDMap()
+    : mNumUsedSlots(0) {
+}
+
+IOMX::buffer_id OMXBufferIDMap::add(OMX_BUFFERHEADERTYPE *header) {
+    if (header == NULL) {
+        return 0;
+    }
+
+    size_t index;
+    if (!mFreeSlots.isEmpty()) {
+        index = mFreeSlots.top();
+        mFreeSlots.pop();
+    } else if (mSlots.size() < kMaxSlots) {
+        Slot slot;
+        slot.mHeader = NULL;
+        slot.mGeneration = 0;
+        index = mSlots.add(slot);
+    } else {
+        ALOGE("out of buffer ids (%zu in use)", mNumUsedSlots);
+        return 0;
+    }
+
+    Slot &slot = mSlots.editItemAt(index);
+    slot.mHeader = header;
+    ++mNumUsedSlots;
+
+    // Slot numbers are offset by one so that no valid id is ever 0.
+    return (slot.mGeneration << kSlotBits) | (uint32_t)(index + 1);
+}
+
+ssize_t OMXBufferIDMap::slotIndexFor(IOMX::buffer_id buffer) const {
+    uint32_t slotNumber = buffer & kSlotMask;
+    if (slotNumber == 0 || slotNumber > mSlots.size()) {
+        return -1;
+    }
+
+    const Slot &slot = mSlots.itemAt(slotNumber - 1);
+    if (slot.mHeader == NULL || slot.mGeneration != (buffer >> kSlotBits)) {
+        return -1;
+    }
+
+    return slotNumber - 1;
+}
+
+OMX_BUFFERHEADERTYPE *OMXBufferIDMap::find(IOMX::buffer_id buffer) const {
+    ssize_t index = slotIndexFor(buffer);
+    return index < 0 ? NULL : mSlots.itemAt(index).mHeader;
+}
+
+bool OMXBufferIDMap::remove(IOMX::buffer_id buffer) {
+    ssize_t index = slotIndexFor(buffer);
+    if (index < 0) {
+        return false;
+    }
+
+    Slot &slot = mSlots.editItemAt(index);
+    slot.mHeader = NULL;
+    slot.mGeneration = (slot.mGeneration + 1) & kGenerationMask;
+    --mNumUsedSlots;
+
+    mFreeSlots.push((uint32_t)index);
+
+    return true;
+}
+
+}  // namespace android
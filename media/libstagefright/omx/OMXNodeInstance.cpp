@@ -29,6 +29,7 @@
 #include <OMX_AsString.h>
 
 #include <binder/IMemory.h>
+#include <cutils/properties.h>
 #include <gui/BufferQueue.h>
 #include <HardwareAPI.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -103,39 +104,48 @@ struct BufferMeta {
     BufferMeta(const sp<IMemory> &mem, OMX_U32 portIndex, bool is_backup = false)
         : mMem(mem),
           mIsBackup(is_backup),
-          mPortIndex(portIndex) {
+          mPortIndex(portIndex),
+          mBufferID(0) {
     }
 
     BufferMeta(size_t size, OMX_U32 portIndex)
         : mSize(size),
           mIsBackup(false),
-          mPortIndex(portIndex) {
+          mPortIndex(portIndex),
+          mBufferID(0) {
     }
 
     BufferMeta(const sp<GraphicBuffer> &graphicBuffer, OMX_U32 portIndex)
         : mGraphicBuffer(graphicBuffer),
           mIsBackup(false),
-          mPortIndex(portIndex) {
+          mPortIndex(portIndex),
+          mBufferID(0) {
     }
 
-    void CopyFromOMX(const OMX_BUFFERHEADERTYPE *header) {
+    // Both return the number of bytes copied, 0 for buffers the component
+    // operates on directly.
+    size_t CopyFromOMX(const OMX_BUFFERHEADERTYPE *header) {
         if (!mIsBackup) {
-            return;
+            return 0;
         }
-        size_t bytesToCopy = header->nFlags & OMX_BUFFERFLAG_EXTRADATA ?
-            header->nAllocLen - header->nOffset : header->nFilledLen;
+        size_t bytesToCopy = getBytesToCopy(header);
         memcpy((OMX_U8 *)mMem->pointer() + header->nOffset,
                header->pBuffer + header->nOffset, bytesToCopy);
+        return bytesToCopy;
     }
 
-    void CopyToOMX(const OMX_BUFFERHEADERTYPE *header) {
+    size_t CopyToOMX(const OMX_BUFFERHEADERTYPE *header) {
         if (!mIsBackup) {
-            return;
+            return 0;
         }
-        size_t bytesToCopy = header->nFlags & OMX_BUFFERFLAG_EXTRADATA ?
-            header->nAllocLen - header->nOffset : header->nFilledLen;
+        size_t bytesToCopy = getBytesToCopy(header);
         memcpy(header->pBuffer + header->nOffset,
                (const OMX_U8 *)mMem->pointer() + header->nOffset, bytesToCopy);
+        return bytesToCopy;
+    }
+
+    bool isBackup() const {
+        return mIsBackup;
     }
 
     void setGraphicBuffer(const sp<GraphicBuffer> &graphicBuffer) {
@@ -146,12 +156,41 @@ struct BufferMeta {
         return mPortIndex;
     }
 
+    // Lets OMXNodeInstance::findBufferID() go from header to id without
+    // a lookup.
+    OMX::buffer_id getBufferID() const {
+        return mBufferID;
+    }
+
+    void setBufferID(OMX::buffer_id buffer) {
+        mBufferID = buffer;
+    }
+
 private:
+    // Never copy past either end of the two buffers, whatever the component
+    // left in the header.
+    size_t getBytesToCopy(const OMX_BUFFERHEADERTYPE *header) const {
+        size_t capacity = header->nAllocLen;
+        if (mMem->size() < capacity) {
+            capacity = mMem->size();
+        }
+        if (header->nOffset > capacity) {
+            return 0;
+        }
+        size_t bytesToCopy = header->nFlags & OMX_BUFFERFLAG_EXTRADATA ?
+            header->nAllocLen - header->nOffset : header->nFilledLen;
+        if (bytesToCopy > capacity - header->nOffset) {
+            bytesToCopy = capacity - header->nOffset;
+        }
+        return bytesToCopy;
+    }
+
     sp<GraphicBuffer> mGraphicBuffer;
     sp<IMemory> mMem;
     size_t mSize;
     bool mIsBackup;
     OMX_U32 mPortIndex;
+    OMX::buffer_id mBufferID;
 
     BufferMeta(const BufferMeta &);
     BufferMeta &operator=(const BufferMeta &);
@@ -177,10 +216,11 @@ OMXNodeInstance::OMXNodeInstance(
       mNodeID(0),
       mHandle(NULL),
       mObserver(observer),
-      mDying(false)
-#ifdef __LP64__
-      , mBufferIDCount(0)
-#endif
+      mDying(false),
+      mNumZeroCopyBuffers(0),
+      mNumBackupBuffers(0),
+      mBytesCopiedToOMX(0),
+      mBytesCopiedFromOMX(0)
 {
     mName = ADebug::GetDebugName(name);
     DEBUG = ADebug::GetDebugLevelFromProperty(name, "debug.stagefright.omx-debug");
@@ -191,6 +231,20 @@ OMXNodeInstance::OMXNodeInstance(
     mDebugLevelBumpPendingBuffers[0] = 0;
     mDebugLevelBumpPendingBuffers[1] = 0;
     mIsSecure = AString(name).endsWith(".secure");
+
+    // Software components live in this process and accept any buffer
+    // pointer, so they can work on the client's shared memory directly
+    // instead of on a private backup that is copied on every transfer.
+    // Note that ACodec and OMXCodec only ask for a backup when the codec
+    // list gives the component a requires-allocate-on-*-ports quirk, which
+    // the stock OMX.google.* entries don't have: those get useBuffer() and
+    // no copies to begin with. This only matters for a device that lists
+    // a software component with one of those quirks.
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.stagefright.omx-zerocopy", value, "1");
+    mZeroCopyBackup = !mIsSecure
+            && AString(name).startsWith("OMX.google.")
+            && atoi(value) != 0;
 }
 
 OMXNodeInstance::~OMXNodeInstance() {
@@ -243,6 +297,13 @@ static status_t StatusFromOMXError(OMX_ERRORTYPE err) {
 
 status_t OMXNodeInstance::freeNode(OMXMaster *master) {
     CLOG_LIFE(freeNode, "handle=%p", mHandle);
+    {
+        Mutex::Autolock _l(mDebugLock);
+        CLOG_LIFE(freeNode, "backup buffers: %zu zero-copy, %zu copied, "
+                "%" PRIu64 " bytes to OMX, %" PRIu64 " bytes from OMX",
+                mNumZeroCopyBuffers, mNumBackupBuffers,
+                mBytesCopiedToOMX, mBytesCopiedFromOMX);
+    }
     static int32_t kMaxNumIterations = 10;
 
     // exit if we have already freed the node
@@ -908,12 +969,33 @@ status_t OMXNodeInstance::allocateBufferWithBackup(
         OMX::buffer_id *buffer) {
     Mutex::Autolock autoLock(mLock);
 
-    BufferMeta *buffer_meta = new BufferMeta(params, portIndex, true);
-
     OMX_BUFFERHEADERTYPE *header;
+    BufferMeta *buffer_meta = NULL;
+    OMX_ERRORTYPE err = OMX_ErrorUndefined;
 
-    OMX_ERRORTYPE err = OMX_AllocateBuffer(
-            mHandle, &header, portIndex, buffer_meta, params->size());
+    if (mZeroCopyBackup && params->pointer() != NULL) {
+        // Let the component use the client memory in place. Ownership is
+        // still tracked per buffer, see emptyBuffer() and fillBuffer().
+        buffer_meta = new BufferMeta(params, portIndex, false);
+
+        err = OMX_UseBuffer(
+                mHandle, &header, portIndex, buffer_meta,
+                params->size(), static_cast<OMX_U8 *>(params->pointer()));
+
+        if (err != OMX_ErrorNone) {
+            CLOGW("component refused to use client memory (%s), copying instead",
+                    asString(err));
+            delete buffer_meta;
+            buffer_meta = NULL;
+        }
+    }
+
+    if (buffer_meta == NULL) {
+        buffer_meta = new BufferMeta(params, portIndex, true);
+
+        err = OMX_AllocateBuffer(
+                mHandle, &header, portIndex, buffer_meta, params->size());
+    }
 
     if (err != OMX_ErrorNone) {
         CLOG_ERROR(allocateBufferWithBackup, err,
@@ -926,6 +1008,15 @@ status_t OMXNodeInstance::allocateBufferWithBackup(
         return StatusFromOMXError(err);
     }
 
+    {
+        Mutex::Autolock _l(mDebugLock);
+        if (buffer_meta->isBackup()) {
+            ++mNumBackupBuffers;
+        } else {
+            ++mNumZeroCopyBuffers;
+        }
+    }
+
     CHECK_EQ(header->pAppPrivate, buffer_meta);
 
     *buffer = makeBufferID(header);
@@ -973,6 +1064,20 @@ status_t OMXNodeInstance::fillBuffer(OMX::buffer_id buffer) {
     if (header == NULL) {
         return BAD_VALUE;
     }
+    BufferMeta *buffer_meta =
+        static_cast<BufferMeta *>(header->pAppPrivate);
+
+    {
+        // A buffer shared with the component must not be handed over
+        // twice, the component may still be writing into it.
+        Mutex::Autolock _l(mDebugLock);
+        if (!buffer_meta->isBackup()
+                && mOutputBuffersWithCodec.indexOf(header) >= 0) {
+            CLOGW("fillBuffer: buffer %#x is already owned by the component", buffer);
+            return INVALID_OPERATION;
+        }
+    }
+
     header->nFilledLen = 0;
     header->nOffset = 0;
     header->nFlags = 0;
@@ -1008,12 +1113,29 @@ status_t OMXNodeInstance::emptyBuffer(
             || rangeLength > header->nAllocLen - rangeOffset) {
         return BAD_VALUE;
     }
-    header->nFilledLen = rangeLength;
-    header->nOffset = rangeOffset;
 
     BufferMeta *buffer_meta =
         static_cast<BufferMeta *>(header->pAppPrivate);
-    buffer_meta->CopyToOMX(header);
+
+    {
+        // The component reads a shared buffer in place, so the client must
+        // not requeue it until it has been returned.
+        Mutex::Autolock _l(mDebugLock);
+        if (!buffer_meta->isBackup()
+                && mInputBuffersWithCodec.indexOf(header) >= 0) {
+            CLOGW("emptyBuffer: buffer %#x is already owned by the component", buffer);
+            return INVALID_OPERATION;
+        }
+    }
+
+    header->nFilledLen = rangeLength;
+    header->nOffset = rangeOffset;
+
+    size_t bytesCopied = buffer_meta->CopyToOMX(header);
+    if (bytesCopied > 0) {
+        Mutex::Autolock _l(mDebugLock);
+        mBytesCopiedToOMX += bytesCopied;
+    }
 
     return emptyBuffer_l(header, flags, timestamp, (intptr_t)buffer);
 }
@@ -1209,7 +1331,11 @@ void OMXNodeInstance::onMessage(const omx_message &msg) {
         BufferMeta *buffer_meta =
             static_cast<BufferMeta *>(buffer->pAppPrivate);
 
-        buffer_meta->CopyFromOMX(buffer);
+        size_t bytesCopied = buffer_meta->CopyFromOMX(buffer);
+        if (bytesCopied > 0) {
+            Mutex::Autolock _l(mDebugLock);
+            mBytesCopiedFromOMX += bytesCopied;
+        }
 
         if (bufferSource != NULL) {
             // fix up the buffer info (especially timestamp) if needed
@@ -1398,15 +1524,8 @@ OMX::buffer_id OMXNodeInstance::makeBufferID(OMX_BUFFERHEADERTYPE *bufferHeader)
         return 0;
     }
     Mutex::Autolock autoLock(mBufferIDLock);
-    OMX::buffer_id buffer;
-    do { // handle the very unlikely case of ID overflow
-        if (++mBufferIDCount == 0) {
-            ++mBufferIDCount;
-        }
-        buffer = (OMX::buffer_id)mBufferIDCount;
-    } while (mBufferIDToBufferHeader.indexOfKey(buffer) >= 0);
-    mBufferIDToBufferHeader.add(buffer, bufferHeader);
-    mBufferHeaderToBufferID.add(bufferHeader, buffer);
+    OMX::buffer_id buffer = mBufferIDs.add(bufferHeader);
+    static_cast<BufferMeta *>(bufferHeader->pAppPrivate)->setBufferID(buffer);
     return buffer;
 }
 
@@ -1416,12 +1535,11 @@ OMX_BUFFERHEADERTYPE *OMXNodeInstance::findBufferHeader(
         return NULL;
     }
     Mutex::Autolock autoLock(mBufferIDLock);
-    ssize_t index = mBufferIDToBufferHeader.indexOfKey(buffer);
-    if (index < 0) {
+    OMX_BUFFERHEADERTYPE *header = mBufferIDs.find(buffer);
+    if (header == NULL) {
         ALOGW("findBufferHeader: buffer %u not found", buffer);
         return NULL;
     }
-    OMX_BUFFERHEADERTYPE *header = mBufferIDToBufferHeader.valueAt(index);
     BufferMeta *buffer_meta =
         static_cast<BufferMeta *>(header->pAppPrivate);
     if (buffer_meta->getPortIndex() != portIndex) {
@@ -1437,7 +1555,13 @@ OMX::buffer_id OMXNodeInstance::findBufferID(OMX_BUFFERHEADERTYPE *bufferHeader)
         return 0;
     }
     Mutex::Autolock autoLock(mBufferIDLock);
-    return mBufferHeaderToBufferID.valueFor(bufferHeader);
+    OMX::buffer_id buffer =
+        static_cast<BufferMeta *>(bufferHeader->pAppPrivate)->getBufferID();
+    // the header must still be the one registered under its id
+    if (mBufferIDs.find(buffer) != bufferHeader) {
+        return 0;
+    }
+    return buffer;
 }
 
 void OMXNodeInstance::invalidateBufferID(OMX::buffer_id buffer) {
@@ -1445,8 +1569,9 @@ void OMXNodeInstance::invalidateBufferID(OMX::buffer_id buffer) {
         return;
     }
     Mutex::Autolock autoLock(mBufferIDLock);
-    mBufferHeaderToBufferID.removeItem(mBufferIDToBufferHeader.valueFor(buffer));
-    mBufferIDToBufferHeader.removeItem(buffer);
+    if (!mBufferIDs.remove(buffer)) {
+        ALOGW("invalidateBufferID: buffer %u not found", buffer);
+    }
 }
 
 }  // namespace android
@@ -56,6 +56,7 @@
 #include <utils/Log.h>
 
 #include "SoftOMXPlugin.h"
+#include "include/SoftAudioBatchDecoder.h"
 #include "include/SoftOMXComponent.h"
 
 #include <media/stagefright/foundation/ADebug.h>
@@ -233,4 +234,76 @@ OMX_ERRORTYPE SoftOMXPlugin::getRolesOfComponent(
     return OMX_ErrorInvalidComponentName;
 }
 
+// static
+SoftAudioBatchDecoder *SoftAudioBatchDecoder::Create(const char *name) {
+    ALOGV("SoftAudioBatchDecoder::Create '%s'", name);
+
+    dlerror(); // clear any existing error
+    for (size_t i = 0; i < kNumComponents; ++i) {
+        if (strcmp(name, kComponents[i].mName)) {
+            continue;
+        }
+
+        AString libName = "libstagefright_soft_";
+        libName.append(kComponents[i].mLibNameSuffix);
+        libName.append(".so");
+
+        void *libHandle = dlopen(libName.c_str(), RTLD_NOW);
+
+        if (libHandle == NULL) {
+            ALOGE("unable to dlopen %s: %s", libName.c_str(), dlerror());
+            return NULL;
+        }
+
+        typedef SoftAudioBatchDecoder *(*CreateSoftAudioBatchDecoderFunc)(
+                const char *);
+
+        CreateSoftAudioBatchDecoderFunc createSoftAudioBatchDecoder =
+            (CreateSoftAudioBatchDecoderFunc)dlsym(
+                    libHandle, "_Z27createSoftAudioBatchDecoderPKc");
+
+        if (const char *error = dlerror()) {
+            // Not every component provides a batch decoder.
+            ALOGV("unable to dlsym %s: %s", libName.c_str(), error);
+            dlclose(libHandle);
+            return NULL;
+        }
+
+        SoftAudioBatchDecoder *decoder = (*createSoftAudioBatchDecoder)(name);
+
+        if (decoder == NULL) {
+            dlclose(libHandle);
+            return NULL;
+        }
+
+        if (decoder->initCheck() != OK) {
+            delete decoder;
+            dlclose(libHandle);
+            return NULL;
+        }
+
+        decoder->mLibHandle = libHandle;
+
+        return decoder;
+    }
+
+    return NULL;
+}
+
+// static
+void SoftAudioBatchDecoder::Destroy(SoftAudioBatchDecoder *decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+
+    void *libHandle = decoder->mLibHandle;
+
+    // The destructor lives in the component library, unload it afterwards.
+    delete decoder;
+    decoder = NULL;
+
+    dlclose(libHandle);
+    libHandle = NULL;
+}
+
 }  // namespace android
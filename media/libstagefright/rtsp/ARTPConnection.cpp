@@ -42,6 +42,9 @@ namespace android {
 
 static const size_t kMaxUDPSize = 1500;
 
+// Largest datagram recvfrom()/recvmmsg() can hand us.
+static const size_t kMaxDatagramSize = 65536;
+
 static uint16_t u16at(const uint8_t *data) {
     return data[0] << 8 | data[1];
 }
@@ -76,10 +79,14 @@ ARTPConnection::ARTPConnection(uint32_t flags)
     : mFlags(flags),
       mPollEventPending(false),
       mLastReceiverReportTimeUs(-1),
-      mIPVersion(IPV4) {
+      mIPVersion(IPV4),
+      mNumRecvCalls(0),
+      mNumRecvPackets(0) {
 }
 
 ARTPConnection::~ARTPConnection() {
+    ALOGV("received %lld RTP packets in %lld calls",
+          (long long)mNumRecvPackets, (long long)mNumRecvCalls);
 }
 
 void ARTPConnection::addStream(
@@ -407,7 +414,11 @@ status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
 
     CHECK(!s->mIsInjected);
 
-    sp<ABuffer> buffer = new ABuffer(65536);
+    if (receiveRTP) {
+        return receiveRTPBatch(s);
+    }
+
+    sp<ABuffer> buffer = new ABuffer(kMaxDatagramSize);
 
     socklen_t remoteAddrLen =
         (!receiveRTP && s->mNumRTCPPacketsReceived == 0)
@@ -442,6 +453,74 @@ status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
     return err;
 }
 
+status_t ARTPConnection::receiveRTPBatch(StreamInfo *s) {
+    // The receive slots start out as a single buffer and only grow once a
+    // batch came back full, i.e. while the stream is busy enough for
+    // batching to pay off.
+    if (mRecvSlots.empty()) {
+        mRecvSlots.push(new ABuffer(kMaxDatagramSize));
+    }
+
+    size_t numSlots = mRecvSlots.size();
+
+    struct mmsghdr msgs[kMaxRecvBatchSize];
+    struct iovec iovs[kMaxRecvBatchSize];
+    memset(msgs, 0, numSlots * sizeof(msgs[0]));
+
+    for (size_t i = 0; i < numSlots; ++i) {
+        iovs[i].iov_base = mRecvSlots[i]->base();
+        iovs[i].iov_len = mRecvSlots[i]->capacity();
+
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n;
+    do {
+        n = recvmmsg(s->mRTPSocket, msgs, numSlots, MSG_DONTWAIT, NULL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? OK : -ECONNRESET;
+    }
+
+    ++mNumRecvCalls;
+
+    for (int i = 0; i < n; ++i) {
+        size_t nbytes = msgs[i].msg_len;
+
+        if (nbytes == 0) {
+            return -ECONNRESET;
+        }
+
+        // The parsed packet is queued by its ARTPSource until assembled,
+        // hand it a buffer of its own that is only as large as it needs
+        // to be and keep the slot for the next batch.
+        sp<ABuffer> buffer = new ABuffer(nbytes);
+        memcpy(buffer->data(), mRecvSlots[i]->base(), nbytes);
+
+        ++mNumRecvPackets;
+
+        parseRTP(s, buffer);
+    }
+
+    if ((size_t)n == numSlots && numSlots < kMaxRecvBatchSize) {
+        size_t newNumSlots = numSlots * 2;
+        if (newNumSlots > kMaxRecvBatchSize) {
+            newNumSlots = kMaxRecvBatchSize;
+        }
+
+        while (mRecvSlots.size() < newNumSlots) {
+            mRecvSlots.push(new ABuffer(kMaxDatagramSize));
+        }
+
+        ALOGV("now receiving up to %zu RTP packets per call",
+              mRecvSlots.size());
+    }
+
+    return OK;
+}
+
 status_t ARTPConnection::parseRTP(StreamInfo *s, const sp<ABuffer> &buffer) {
     if (s->mNumRTPPacketsReceived++ == 0) {
         sp<AMessage> notify = s->mNotifyMsg->dup();
@@ -20,6 +20,7 @@
 
 #include <media/stagefright/foundation/AHandler.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -64,6 +65,11 @@ private:
         kWhatInjectPacket,
     };
 
+    enum {
+        // Most RTP packets recvmmsg() picks up off a socket in one call.
+        kMaxRecvBatchSize = 16,
+    };
+
     static const int64_t kSelectTimeoutUs;
 
     uint32_t mFlags;
@@ -75,6 +81,12 @@ private:
     int64_t mLastReceiverReportTimeUs;
     int mIPVersion;
 
+    // Scratch buffers RTP packets are received into, shared by all streams
+    // as they are only used from within onPollStreams().
+    Vector<sp<ABuffer> > mRecvSlots;
+    int64_t mNumRecvCalls;
+    int64_t mNumRecvPackets;
+
     void onAddStream(const sp<AMessage> &msg);
     void onRemoveStream(const sp<AMessage> &msg);
     void onPollStreams();
@@ -82,6 +94,7 @@ private:
     void onSendReceiverReports();
 
     status_t receive(StreamInfo *info, bool receiveRTP);
+    status_t receiveRTPBatch(StreamInfo *info);
 
     status_t parseRTP(StreamInfo *info, const sp<ABuffer> &buffer);
     status_t parseRTCP(StreamInfo *info, const sp<ABuffer> &buffer);
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AnotherPacketSource_test"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+#include "mpeg2ts/AnotherPacketSource.h"
+
+namespace android {
+
+class AnotherPacketSourceTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mSource = new AnotherPacketSource(NULL /* meta */);
+        mSource->enableSingleProducerMode();
+    }
+
+    void queue(int64_t timeUs) {
+        sp<ABuffer> buffer = new ABuffer(1);
+        buffer->meta()->setInt64("timeUs", timeUs);
+        mSource->queueAccessUnit(buffer);
+    }
+
+    void expectDequeued(int64_t timeUs) {
+        sp<ABuffer> buffer;
+        ASSERT_EQ(OK, mSource->dequeueAccessUnit(&buffer));
+        int64_t dequeuedTimeUs;
+        ASSERT_TRUE(buffer->meta()->findInt64("timeUs", &dequeuedTimeUs));
+        EXPECT_EQ(timeUs, dequeuedTimeUs);
+    }
+
+    static void *BindAndUnbind(void *me) {
+        AnotherPacketSourceTest *test = static_cast<AnotherPacketSourceTest *>(me);
+        test->mSource->bindProducer();
+        test->mOtherThreadWasSingleProducer = test->mSource->isSingleProducer();
+        test->mSource->unbindProducer();
+        return NULL;
+    }
+
+    sp<AnotherPacketSource> mSource;
+    bool mOtherThreadWasSingleProducer;
+};
+
+TEST_F(AnotherPacketSourceTest, TestNotSingleProducerUnlessBound) {
+    EXPECT_FALSE(mSource->isSingleProducer());
+
+    mSource->bindProducer();
+    EXPECT_TRUE(mSource->isSingleProducer());
+
+    mSource->unbindProducer();
+    EXPECT_FALSE(mSource->isSingleProducer());
+}
+
+// Fetchers of a LiveSession share its looper: on a switch the new one binds
+// and the old one unbinds on the same thread.
+TEST_F(AnotherPacketSourceTest, TestBindsOnOneThreadAreCounted) {
+    mSource->bindProducer();
+    mSource->bindProducer();
+    queue(0ll);
+
+    mSource->unbindProducer();
+    EXPECT_TRUE(mSource->isSingleProducer());
+    queue(1ll);
+
+    mSource->unbindProducer();
+    EXPECT_FALSE(mSource->isSingleProducer());
+    queue(2ll);
+
+    expectDequeued(0ll);
+    expectDequeued(1ll);
+    expectDequeued(2ll);
+}
+
+TEST_F(AnotherPacketSourceTest, TestOtherThreadTakesOverOnUnbind) {
+    mSource->bindProducer();
+
+    // Another thread binding meanwhile queues through the lock.
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, BindAndUnbind, this));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+    EXPECT_FALSE(mOtherThreadWasSingleProducer);
+    EXPECT_TRUE(mSource->isSingleProducer());
+
+    mSource->unbindProducer();
+    EXPECT_FALSE(mSource->isSingleProducer());
+}
+
+}  // namespace android
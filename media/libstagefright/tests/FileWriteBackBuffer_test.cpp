@@ -0,0 +1,143 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FileWriteBackBuffer_test"
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/FileWriteBackBuffer.h"
+
+namespace android {
+
+class FileWriteBackBufferTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        const char *dir = getenv("TMPDIR");
+        snprintf(mPath, sizeof(mPath), "%s/FileWriteBackBuffer_test.XXXXXX",
+                dir != NULL ? dir : "/data/local/tmp");
+        mFd = mkstemp(mPath);
+        ASSERT_GE(mFd, 0);
+    }
+
+    virtual void TearDown() {
+        close(mFd);
+        unlink(mPath);
+    }
+
+    // Appends, and now and then overwrites or pushes, pseudo random data
+    // through a buffer started at an unaligned offset, and checks that
+    // the file ends up holding the same as a copy kept in memory.
+    void testRandomWrites(bool directIO) {
+        static const size_t kStartOffset = 100;
+        static const size_t kSize = 3 * 1024 * 1024;
+
+        uint8_t *expected = (uint8_t *)malloc(kSize);
+        ASSERT_TRUE(expected != NULL);
+        for (size_t i = 0; i < kStartOffset; ++i) {
+            expected[i] = i;
+        }
+        ASSERT_EQ((ssize_t)kStartOffset, write(mFd, expected, kStartOffset));
+
+        FileWriteBackBuffer buffer(
+                mFd, 2 * FileWriteBackBuffer::kAlignment, 3, directIO);
+        ASSERT_EQ(OK, buffer.start(kStartOffset));
+
+        unsigned seed = 1;
+        size_t offset = kStartOffset;
+        uint8_t data[20000];
+        while (offset < kSize) {
+            size_t size = rand_r(&seed) % sizeof(data);
+            if (size > kSize - offset) {
+                size = kSize - offset;
+            }
+            for (size_t i = 0; i < size; ++i) {
+                data[i] = rand_r(&seed);
+            }
+            buffer.append(data, size);
+            memcpy(&expected[offset], data, size);
+            offset += size;
+            ASSERT_EQ((off64_t)offset, buffer.offset());
+
+            // Anywhere from long written out to still being appended to.
+            if (offset >= kStartOffset + 4 && rand_r(&seed) % 2) {
+                size_t back = rand_r(&seed) % 50000;
+                if (back > offset - kStartOffset - 4) {
+                    back = offset - kStartOffset - 4;
+                }
+                uint32_t x = rand_r(&seed);
+                buffer.overwrite(offset - 4 - back, &x, 4);
+                memcpy(&expected[offset - 4 - back], &x, 4);
+            }
+
+            if (rand_r(&seed) % 10 == 0) {
+                buffer.push();
+            }
+        }
+
+        ASSERT_EQ(OK, buffer.stop());
+
+        uint8_t *actual = (uint8_t *)malloc(kSize);
+        ASSERT_TRUE(actual != NULL);
+        ASSERT_EQ((ssize_t)kSize, pread64(mFd, actual, kSize, 0));
+        for (size_t i = 0; i < kSize; ++i) {
+            ASSERT_EQ(expected[i], actual[i]) << "at offset " << i;
+        }
+
+        free(actual);
+        free(expected);
+    }
+
+    char mPath[256];
+    int mFd;
+};
+
+TEST_F(FileWriteBackBufferTest, TestRandomWrites) {
+    testRandomWrites(false /* directIO */);
+}
+
+// Falls back to the page cache where the file system has no direct I/O.
+TEST_F(FileWriteBackBufferTest, TestRandomWritesWithDirectIO) {
+    testRandomWrites(true /* directIO */);
+}
+
+TEST_F(FileWriteBackBufferTest, TestReportsWriteErrors) {
+    int fd = open(mPath, O_RDONLY);
+    ASSERT_GE(fd, 0);
+
+    {
+        FileWriteBackBuffer buffer(fd, FileWriteBackBuffer::kAlignment, 2, false);
+        ASSERT_EQ(OK, buffer.start(0));
+
+        uint8_t data[10000];
+        memset(data, 0xaa, sizeof(data));
+        buffer.append(data, sizeof(data));
+        ASSERT_NE(OK, buffer.flush());
+
+        // Further data is dropped, the error sticks.
+        buffer.append(data, sizeof(data));
+        ASSERT_NE(OK, buffer.stop());
+    }
+
+    close(fd);
+}
+
+}  // namespace android
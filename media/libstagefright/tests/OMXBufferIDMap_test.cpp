@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "OMXBufferIDMap_test"
+
+#include <gtest/gtest.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/foundation/ALooper.h>
+
+#include "include/OMXBufferIDMap.h"
+
+namespace android {
+
+class OMXBufferIDMapTest : public ::testing::Test {
+protected:
+    enum {
+        kNumBuffers = 32,
+    };
+
+    OMX_BUFFERHEADERTYPE mHeaders[kNumBuffers];
+};
+
+TEST_F(OMXBufferIDMapTest, AddFindRemove) {
+    OMXBufferIDMap map;
+    IOMX::buffer_id ids[kNumBuffers];
+
+    ASSERT_EQ(map.add(NULL), 0u);
+
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        ids[i] = map.add(&mHeaders[i]);
+        ASSERT_NE(ids[i], 0u);
+    }
+    ASSERT_EQ(map.size(), (size_t)kNumBuffers);
+
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        ASSERT_EQ(map.find(ids[i]), &mHeaders[i]);
+    }
+
+    ASSERT_EQ(map.find(0), (OMX_BUFFERHEADERTYPE *)NULL);
+    ASSERT_FALSE(map.remove(0));
+
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        ASSERT_TRUE(map.remove(ids[i]));
+        ASSERT_EQ(map.find(ids[i]), (OMX_BUFFERHEADERTYPE *)NULL);
+        ASSERT_FALSE(map.remove(ids[i]));
+    }
+    ASSERT_EQ(map.size(), 0u);
+}
+
+TEST_F(OMXBufferIDMapTest, StaleIDsAreRejected) {
+    OMXBufferIDMap map;
+
+    IOMX::buffer_id first = map.add(&mHeaders[0]);
+    ASSERT_TRUE(map.remove(first));
+
+    // the slot is reused, but the old id must not resolve to the new header
+    IOMX::buffer_id second = map.add(&mHeaders[1]);
+    ASSERT_NE(first, second);
+    ASSERT_EQ(map.find(first), (OMX_BUFFERHEADERTYPE *)NULL);
+    ASSERT_FALSE(map.remove(first));
+    ASSERT_EQ(map.find(second), &mHeaders[1]);
+
+    // ids pointing past the allocated slots
+    ASSERT_EQ(map.find(second + 1), (OMX_BUFFERHEADERTYPE *)NULL);
+    ASSERT_EQ(map.find(~0u), (OMX_BUFFERHEADERTYPE *)NULL);
+}
+
+// The component side of the benchmark: holds buffers for a while, then
+// hands them back in the order it received them, like a decoder with a
+// small pipeline would.
+struct MockComponent {
+    MockComponent() : mHead(0) {}
+
+    void queue(OMX_BUFFERHEADERTYPE *header) {
+        mQueue.push_back(header);
+    }
+
+    OMX_BUFFERHEADERTYPE *dequeue() {
+        if (mHead == mQueue.size()) {
+            return NULL;
+        }
+        OMX_BUFFERHEADERTYPE *header = mQueue[mHead++];
+        if (mHead == mQueue.size()) {
+            mQueue.clear();
+            mHead = 0;
+        }
+        return header;
+    }
+
+private:
+    Vector<OMX_BUFFERHEADERTYPE *> mQueue;
+    size_t mHead;
+};
+
+// Cycles the buffers through a mock component the way OMXNodeInstance does
+// on emptyBuffer()/fillBuffer() and the matching callbacks, once with the
+// slot map and once with the pair of KeyedVectors it replaced.
+TEST_F(OMXBufferIDMapTest, Benchmark) {
+    static const size_t kNumCycles = 200000;
+
+    OMXBufferIDMap map;
+    Vector<IOMX::buffer_id> ids;
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        ids.push_back(map.add(&mHeaders[i]));
+        mHeaders[i].pAppPrivate = (void *)(uintptr_t)ids[i];
+    }
+
+    MockComponent component;
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumCycles; ++i) {
+        OMX_BUFFERHEADERTYPE *header = map.find(ids[i % kNumBuffers]);
+        ASSERT_TRUE(header != NULL);
+        component.queue(header);
+        if ((i % 4) == 3) {
+            while ((header = component.dequeue()) != NULL) {
+                IOMX::buffer_id id = (IOMX::buffer_id)(uintptr_t)header->pAppPrivate;
+                ASSERT_EQ(map.find(id), header);
+            }
+        }
+    }
+    int64_t slotMapUs = ALooper::GetNowUs() - startUs;
+
+    KeyedVector<IOMX::buffer_id, OMX_BUFFERHEADERTYPE *> idToHeader;
+    KeyedVector<OMX_BUFFERHEADERTYPE *, IOMX::buffer_id> headerToID;
+    for (size_t i = 0; i < kNumBuffers; ++i) {
+        idToHeader.add(ids[i], &mHeaders[i]);
+        headerToID.add(&mHeaders[i], ids[i]);
+    }
+
+    startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumCycles; ++i) {
+        OMX_BUFFERHEADERTYPE *header = idToHeader.valueFor(ids[i % kNumBuffers]);
+        ASSERT_TRUE(header != NULL);
+        component.queue(header);
+        if ((i % 4) == 3) {
+            while ((header = component.dequeue()) != NULL) {
+                ASSERT_NE(headerToID.valueFor(header), 0u);
+            }
+        }
+    }
+    int64_t keyedVectorUs = ALooper::GetNowUs() - startUs;
+
+    ALOGI("%zu buffer cycles: slot map %lld us, keyed vectors %lld us",
+          kNumCycles, (long long)slotMapUs, (long long)keyedVectorUs);
+    printf("%zu buffer cycles: slot map %lld us (%.0f/sec), "
+           "keyed vectors %lld us (%.0f/sec)\n",
+           kNumCycles,
+           (long long)slotMapUs, slotMapUs > 0 ? kNumCycles * 1E6 / slotMapUs : 0.0,
+           (long long)keyedVectorUs,
+           keyedVectorUs > 0 ? kNumCycles * 1E6 / keyedVectorUs : 0.0);
+}
+
+} // namespace android
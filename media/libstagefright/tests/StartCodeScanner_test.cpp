@@ -0,0 +1,135 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "StartCodeScanner_test"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/StartCodeScanner.h"
+
+namespace android {
+
+static ssize_t FindStartCodeReference(const uint8_t *data, size_t size) {
+    for (size_t i = 0; i + 2 < size; ++i) {
+        if (!memcmp(&data[i], "\x00\x00\x01", 3)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static ssize_t FindSyncWordReference(
+        const uint8_t *data, size_t size, uint8_t mask, uint8_t value) {
+    for (size_t i = 0; i + 1 < size; ++i) {
+        if (data[i] == 0xff && (data[i + 1] & mask) == value) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+class StartCodeScannerTest : public ::testing::Test {
+};
+
+TEST_F(StartCodeScannerTest, TestStartCodeAtEveryPosition) {
+    uint8_t data[101];
+
+    for (size_t size = 0; size < sizeof(data); ++size) {
+        for (size_t pos = 0; pos + 3 <= size; ++pos) {
+            memset(data, 0xaa, sizeof(data));
+            memcpy(&data[pos], "\x00\x00\x01", 3);
+
+            ASSERT_EQ((ssize_t)pos, FindStartCode(data, size));
+            ASSERT_EQ((ssize_t)pos, FindStartCodeScalar(data, size));
+        }
+
+        // A startcode that is cut off by the end of the buffer.
+        if (size >= 2) {
+            memset(data, 0xaa, sizeof(data));
+            data[size - 2] = 0x00;
+            data[size - 1] = 0x00;
+            data[size] = 0x01;
+
+            ASSERT_EQ(-1, FindStartCode(data, size));
+            ASSERT_EQ(-1, FindStartCodeScalar(data, size));
+        }
+    }
+}
+
+TEST_F(StartCodeScannerTest, TestSyncWordAtEveryPosition) {
+    uint8_t data[101];
+
+    for (size_t size = 0; size < sizeof(data); ++size) {
+        for (size_t pos = 0; pos + 2 <= size; ++pos) {
+            memset(data, 0x00, sizeof(data));
+            data[pos] = 0xff;
+            data[pos + 1] = 0xf1;
+
+            ASSERT_EQ((ssize_t)pos, FindSyncWord(data, size, 0xf6, 0xf0));
+            ASSERT_EQ((ssize_t)pos, FindSyncWordScalar(data, size, 0xf6, 0xf0));
+        }
+
+        if (size >= 1) {
+            memset(data, 0x00, sizeof(data));
+            data[size - 1] = 0xff;
+            data[size] = 0xf1;
+
+            ASSERT_EQ(-1, FindSyncWord(data, size, 0xf6, 0xf0));
+        }
+    }
+}
+
+TEST_F(StartCodeScannerTest, TestRandomData) {
+    // Biased towards the bytes that make up startcodes and syncwords so that
+    // there are plenty of near misses.
+    static const uint8_t kBytes[] = { 0x00, 0x00, 0x00, 0x01, 0xff, 0xf1, 0xe3 };
+
+    uint8_t data[512];
+    srand(42);
+
+    for (int iter = 0; iter < 100000; ++iter) {
+        size_t size = rand() % sizeof(data);
+        for (size_t i = 0; i < size; ++i) {
+            int r = rand() % 16;
+            data[i] = r < (int)sizeof(kBytes) ? kBytes[r] : rand();
+        }
+
+        ASSERT_EQ(FindStartCodeReference(data, size), FindStartCode(data, size));
+        ASSERT_EQ(FindStartCodeReference(data, size),
+                  FindStartCodeScalar(data, size));
+
+        ASSERT_EQ(FindSyncWordReference(data, size, 0xf6, 0xf0),
+                  FindSyncWord(data, size, 0xf6, 0xf0));
+        ASSERT_EQ(FindSyncWordReference(data, size, 0xe0, 0xe0),
+                  FindSyncWord(data, size, 0xe0, 0xe0));
+    }
+}
+
+TEST_F(StartCodeScannerTest, TestUnalignedStart) {
+    uint8_t data[256];
+    memset(data, 0x11, sizeof(data));
+    memcpy(&data[200], "\x00\x00\x01", 3);
+
+    for (size_t start = 0; start < 64; ++start) {
+        ASSERT_EQ((ssize_t)(200 - start),
+                  FindStartCode(&data[start], sizeof(data) - start));
+    }
+}
+
+}  // namespace android